@@ -20,6 +20,10 @@
 
 #include "config.h"
 #include "module.h"
+#include "lib.h"
+#include "eol.h"
+
+#define CAT_BUF (128 * 1024)
 
 static bool markWithD = false;
 static bool tabAsI = false;
@@ -98,24 +102,92 @@ static void cat_special_device(int fd) {
 	}
 }
 
-// Handle reading regular files
-static void cat_regular_file(int fd) {
+static int write_full(int fd, const void *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Tabs as "^I", out needs 2 * len bytes
+static size_t expand_tabs(const unsigned char *in, size_t len, unsigned char *out) {
+	const unsigned char *end = in + len;
+	unsigned char *o = out;
+
+	while (in < end) {
+		const unsigned char *tab = memchr(in, '\t', end - in);
+		if (tab == NULL) {
+			tab = end;
+		}
+		memcpy(o, in, tab - in);
+		o += tab - in;
+		if (tab == end) {
+			break;
+		}
+		*o++ = '^';
+		*o++ = 'I';
+		in = tab + 1;
+	}
+	return o - out;
+}
+
+/**
+ * Handle reading regular files
+ *
+ * Blocks are read whole; -t expands them into a second buffer and -e
+ * marks the line ends with the line ending engine on the way out.
+ */
+static int cat_regular_file(int fd) {
+	unsigned char *buf = xmalloc(CAT_BUF);
+	unsigned char *tabs = tabAsI ? xmalloc(2 * CAT_BUF) : NULL;
+	unsigned char *marked = markWithD ? xmalloc(4 * CAT_BUF) : NULL;
+	EolState st;
+	int ret = 0;
+
+	eolInit(&st, EOL_MARK);
 	lseek(fd, 0, SEEK_SET);
-	char ch[2];
-	int readRet = 0;
-	while(1) {
-		if((readRet = read(fd, ch, 1)) <= 0) {
+	for (;;) {
+		ssize_t n = read(fd, buf, CAT_BUF);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			perror("read");
+			ret = 1;
 			break;
 		}
-		if(markWithD && ch[0] == '\n') {
-			write(1, "$", 1);
+		if (n == 0) {
+			break;
 		}
-		if(tabAsI && ch[0] == '\t') {
-			write(1, "^I", 2);
-			continue;
+
+		unsigned char *out = buf;
+		size_t len = n;
+		if (tabs != NULL) {
+			len = expand_tabs(out, len, tabs);
+			out = tabs;
+		}
+		if (marked != NULL) {
+			len = eolConvert(&st, out, len, marked, 0);
+			out = marked;
+		}
+		if (write_full(STDOUT_FILENO, out, len) != 0) {
+			perror("write");
+			ret = 1;
+			break;
 		}
-		write(1, ch, 1);
 	}
+	xfree(buf);
+	xfree(tabs);
+	xfree(marked);
+	return ret;
 }
 
 // Main function
@@ -151,8 +223,7 @@ M_ENTRY(cat) {
 
 	// If no files specified, read from stdin
 	if(argc - optind <= 0) {
-		cat_regular_file(0);
-		return 0;
+		return cat_regular_file(0);
 	}
 
 	int ret = 0;
@@ -170,7 +241,7 @@ M_ENTRY(cat) {
 				cat_special_device(fd);
 			} else {
 				posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-				cat_regular_file(fd);
+				ret |= cat_regular_file(fd);
 			}
 
 			close(fd);
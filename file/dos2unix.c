@@ -12,101 +12,279 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "module.h"
 #include "lib.h"
+#include "eol.h"
+#include "workPool.h"
+
+#define STREAM_BUF (256 * 1024)	// Read size for standard input
+
+// Conversion of the running applet
+static const char *prog = "dos2unix";
+static EolMode eol_mode = EOL_DOS2UNIX;
+static int thread_count = 0;
+static int exit_status = 0;
 
 static void dos2unix_show_help(void) {
+	static const char *formats[] = {
+		[EOL_DOS2UNIX] = "from DOS/MAC format to UNIX format",
+		[EOL_MAC2UNIX] = "from MAC format to UNIX format",
+		[EOL_UNIX2DOS] = "from UNIX format to DOS format",
+	};
+
 	SHOW_VERSION(stderr);
 	fprintf(stderr,
-	"Usage: dos2unix [OPTION]... [FILE]...\n\n"
-	"Convert text files from DOS/MAC format to UNIX format.\n\n"
-	"With no FILE, or when FILE is -, read standard input.\n");
+	"Usage: %s [OPTION]... [FILE]...\n\n"
+	"Convert text files %s.\n"
+	"Files are converted in place, files that need no change are left untouched.\n\n"
+	"  -j, --threads=N   convert several files on N threads (default: all CPUs)\n"
+	"  -h, --help        show this help\n\n"
+	"With no FILE, or when FILE is -, convert standard input to standard output.\n",
+	prog, formats[eol_mode]);
 }
 
-static int convert_stream(FILE *input, FILE *output) {
-	int c;
-
-	while ((c = fgetc(input)) != EOF) {
-		if (c == '\r') {
-			// Handle CR: if next is LF, skip CR (CRLF → LF)
-			// If next is not LF, output LF (MAC → LF)
-			int next = fgetc(input);
-			if (next != EOF) {
-				if (next == '\n') {
-					fputc('\n', output);
-				} else {
-					fputc('\n', output);
-					fputc(next, output);
-				}
-			} else {
-				fputc('\n', output);
+static int write_full(int fd, const void *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
 			}
-		} else {
-			fputc(c, output);
+			return -1;
 		}
+		buf = (const char *)buf + n;
+		len -= n;
 	}
-
 	return 0;
 }
 
-static int convert_file(const char *filename) {
-	FILE *input;
-	int use_stdin = 0;
-	int result = 0;
+/**
+ * Convert a stream to standard output
+ *
+ * The output buffer takes the worst case (every byte an LF gaining a CR),
+ * the engine carries line ends split between blocks.
+ */
+static int convert_stream(int in) {
+	unsigned char *buf = xmalloc(STREAM_BUF);
+	unsigned char *out = xmalloc(2 * STREAM_BUF + 1);
+	EolState st;
+	int ret = 0;
+	ssize_t n;
 
-	// Handle special case: read from stdin
+	eolInit(&st, eol_mode);
+	for (;;) {
+		n = read(in, buf, STREAM_BUF);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			perror(prog);
+			ret = 1;
+			break;
+		}
+
+		size_t len = eolConvert(&st, buf, n, out, n == 0);
+		if (write_full(STDOUT_FILENO, out, len) != 0) {
+			fprintf(stderr, "%s: write error: %s\n", prog, strerror(errno));
+			ret = 1;
+			break;
+		}
+		if (n == 0) {
+			break;
+		}
+	}
+	xfree(buf);
+	xfree(out);
+	return ret;
+}
+
+/**
+ * Convert a file in place
+ *
+ * A file that needs no change is neither written nor has its timestamps
+ * changed: dos2unix rewrites every CR, the other modes ask the engine to
+ * count the changes first. Shrinking conversions compact
+ * the shared mapping and truncate, growing ones extend the file to the
+ * exact new size and fill the mapping from the end.
+ */
+static int convert_file(const char *filename) {
 	if (strcmp(filename, "-") == 0) {
-		input = stdin;
-		use_stdin = 1;
+		return convert_stream(STDIN_FILENO);
+	}
+
+	int fd = open(filename, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s: %s\n", prog, filename, strerror(errno));
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", prog, filename, strerror(errno));
+		close(fd);
+		return 1;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		fprintf(stderr, "%s: %s: Not a regular file, skipping\n", prog, filename);
+		close(fd);
+		return 1;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	size_t len = st.st_size;
+	unsigned char *data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		goto fail;
+	}
+
+	size_t out_len = len;
+	if (eol_mode == EOL_DOS2UNIX) {
+		// Every CR is rewritten, finding one is enough
+		if (memchr(data, '\r', len) == NULL) {
+			munmap(data, len);
+			close(fd);
+			return 0;
+		}
 	} else {
-		input = fopen(filename, "rb");
-		if (!input) {
-			fprintf(stderr, "dos2unix: %s: %s\n", filename, strerror(errno));
-			return 1;
+		EolState es;
+		size_t changes;
+		eolInit(&es, eol_mode);
+		out_len = eolConvertedLen(&es, data, len, 1, &changes);
+		if (changes == 0) {
+			munmap(data, len);
+			close(fd);
+			return 0;
 		}
 	}
 
-	// For non-stdin files, we need to use a temporary file approach
-	// For simplicity, we'll just output to stdout in this implementation
-	result = convert_stream(input, stdout);
+	if (out_len > len) {
+		/*
+		 * Grow first, the mapping must cover the converted size. The blocks
+		 * are allocated up front: a full filesystem would otherwise show up
+		 * as SIGBUS on a store halfway through the conversion.
+		 */
+		munmap(data, len);
+		int err = posix_fallocate(fd, len, out_len - len);
+		if (err != 0) {
+			if (ftruncate(fd, len) != 0) {
+				// Nothing more to do, the original error is reported
+			}
+			errno = err;
+			goto fail;
+		}
+		data = mmap(NULL, out_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			int err = errno;
+			if (ftruncate(fd, len) != 0) {
+				// Nothing more to do, the original error is reported
+			}
+			errno = err;
+			goto fail;
+		}
+		eolConvertInPlace(eol_mode, data, len, out_len);
+		if (munmap(data, out_len) != 0) {
+			goto fail;
+		}
+	} else {
+		out_len = eolConvertInPlace(eol_mode, data, len, out_len);
+		if (munmap(data, len) != 0 || ftruncate(fd, out_len) != 0) {
+			goto fail;
+		}
+	}
 
-	if (!use_stdin) {
-		fclose(input);
+	if (close(fd) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", prog, filename, strerror(errno));
+		return 1;
 	}
+	return 0;
 
-	return result;
+fail:
+	fprintf(stderr, "%s: %s: %s\n", prog, filename, strerror(errno));
+	close(fd);
+	return 1;
 }
 
-M_ENTRY(dos2unix) {
-	int i;
-	int exit_status = 0;
-	
-	if(argc > 1 && findArg(argv, argc, "--help")) {
-		dos2unix_show_help();
-		return 0;
+static void convert_task(void *arg) {
+	if (convert_file(arg) != 0) {
+		__atomic_store_n(&exit_status, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static int eol_main(int argc, char **argv) {
+	static struct option long_options[] = {
+		{"threads", required_argument, NULL, 'j'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "j:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'j':
+			thread_count = atoi(optarg);
+			if (thread_count < 1) {
+				fprintf(stderr, "%s: invalid thread count: %s\n", prog, optarg);
+				return 1;
+			}
+			break;
+		case 'h':
+			dos2unix_show_help();
+			return 0;
+		default:
+			return 1;
+		}
 	}
 
 	// If no files specified, read from stdin
-	if (argc == 1) {
-		return convert_stream(stdin, stdout);
+	if (optind == argc) {
+		return convert_stream(STDIN_FILENO);
 	}
 
-	// Process all files
-	for (i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "--") == 0) {
-			// Skip argument
-			continue;
-		}
-		
-		if (convert_file(argv[i]) != 0) {
-			exit_status = 1;
+	// Files are independent, several of them go to a pool
+	int threads = argc - optind > 1 ? workPoolThreads(thread_count) : 1;
+	WorkPool *pool = threads > 1 ? workPoolCreate(threads) : NULL;
+
+	for (int i = optind; i < argc; i++) {
+		if (pool != NULL && strcmp(argv[i], "-") != 0) {
+			workPoolSubmit(pool, convert_task, argv[i]);
+		} else {
+			convert_task(argv[i]);
 		}
 	}
-	
+	if (pool != NULL) {
+		workPoolWait(pool);
+		workPoolDestroy(pool);
+	}
 	return exit_status;
 }
 
+M_ENTRY(dos2unix) {
+	return eol_main(argc, argv);
+}
+
+M_ENTRY(unix2dos) {
+	prog = "unix2dos";
+	eol_mode = EOL_UNIX2DOS;
+	return eol_main(argc, argv);
+}
+
+M_ENTRY(mac2unix) {
+	prog = "mac2unix";
+	eol_mode = EOL_MAC2UNIX;
+	return eol_main(argc, argv);
+}
+
 REGISTER_MODULE(dos2unix);
+REGISTER_MODULE(unix2dos);
+REGISTER_MODULE(mac2unix);
@@ -8,7 +8,7 @@
  *	Based on MIT protocol open source
  */
 
-#define _GNU_SOURCE // For asprintf
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <dirent.h>
@@ -18,16 +18,25 @@
 #include <grp.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <stdbool.h>
 #include <libgen.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "module.h"
 #include "config.h"
 #include "lib.h"
+#include "dirScan.h"
+#include "workPool.h"
+
+#define NAME_CHUNK (256 * 1024)	// String pool chunk
+#define STREAM_BUF (64 * 1024)	// Output buffer of streamed listings
 
 // Convert file type and permission to string
 const char *file_type(mode_t mode) {
@@ -41,23 +50,55 @@ const char *file_type(mode_t mode) {
 	return "?";
 }
 
-const char *permission_str(mode_t mode) {
-	static char str[10];
-	strcpy(str, "---------");
-	
-	if (mode & S_IRUSR) str[0] = 'r';
-	if (mode & S_IWUSR) str[1] = 'w';
-	if (mode & S_IXUSR) str[2] = (mode & S_ISUID) ? 's' : 'x';
-	
-	if (mode & S_IRGRP) str[3] = 'r';
-	if (mode & S_IWGRP) str[4] = 'w';
-	if (mode & S_IXGRP) str[5] = (mode & S_ISGID) ? 's' : 'x';
-	
-	if (mode & S_IROTH) str[6] = 'r';
-	if (mode & S_IWOTH) str[7] = 'w';
-	if (mode & S_IXOTH) str[8] = (mode & S_ISVTX) ? 't' : 'x';
-	
-	return str;
+// File type and permission, 10 characters
+static char *put_mode(char *p, mode_t mode) {
+	static const char rwx[8][3] = {
+		{'-', '-', '-'}, {'-', '-', 'x'}, {'-', 'w', '-'}, {'-', 'w', 'x'},
+		{'r', '-', '-'}, {'r', '-', 'x'}, {'r', 'w', '-'}, {'r', 'w', 'x'},
+	};
+
+	*p++ = file_type(mode)[0];
+	memcpy(p, rwx[mode >> 6 & 7], 3);
+	memcpy(p + 3, rwx[mode >> 3 & 7], 3);
+	memcpy(p + 6, rwx[mode & 7], 3);
+	if ((mode & (S_IXUSR | S_ISUID)) == (S_IXUSR | S_ISUID)) p[2] = 's';
+	if ((mode & (S_IXGRP | S_ISGID)) == (S_IXGRP | S_ISGID)) p[5] = 's';
+	if ((mode & (S_IXOTH | S_ISVTX)) == (S_IXOTH | S_ISVTX)) p[8] = 't';
+	return p + 9;
+}
+
+// Number of decimal digits of v
+static int uint_len(unsigned long long v) {
+	int n = 1;
+	while (v >= 10) {
+		v /= 10;
+		n++;
+	}
+	return n;
+}
+
+// v in decimal, right aligned to width
+static char *put_uint(char *p, unsigned long long v, int width) {
+	int n = uint_len(v);
+
+	for (; width > n; width--) {
+		*p++ = ' ';
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		p[i] = '0' + v % 10;
+		v /= 10;
+	}
+	return p + n;
+}
+
+// s left aligned to width
+static char *put_padded(char *p, const char *s, size_t len, size_t width) {
+	memcpy(p, s, len);
+	p += len;
+	for (; width > len; width--) {
+		*p++ = ' ';
+	}
+	return p;
 }
 
 // Get terminal width
@@ -80,13 +121,13 @@ int get_terminal_width() {
 #define COLOR_CHAR	"\033[1;33m"	// Light yello
 #define COLOR_ORPHAN	"\033[1;31m"	// Red (Broken links)
 
-// Get color from file types
-const char *get_file_color(mode_t mode, const char *path) {
+// Get color from file types, path is relative to dirfd
+const char *get_file_color(mode_t mode, int dirfd, const char *path) {
 	if (S_ISDIR(mode)) return COLOR_DIR;
 	if (S_ISLNK(mode)) {
 		// Check it's a valid link
 		struct stat st;
-		if (stat(path, &st) == -1) {
+		if (fstatat(dirfd, path, &st, 0) == -1) {
 			return COLOR_ORPHAN; // Broken
 		}
 		return COLOR_LINK;
@@ -103,12 +144,10 @@ const char *get_file_color(mode_t mode, const char *path) {
 	return "";
 }
 
-// Convert file size to human readable
-const char *human_readable(off_t size, bool use_human) {
-	static char buffer[32];
-
+// Convert file size to human readable, buffer holds 32 bytes
+const char *human_readable(off_t size, bool use_human, char *buffer) {
 	if (!use_human) {
-		snprintf(buffer, sizeof(buffer), "%lld", (long long)size);
+		snprintf(buffer, 32, "%lld", (long long)size);
 		return buffer;
 	}
 
@@ -123,146 +162,476 @@ const char *human_readable(off_t size, bool use_human) {
 
 	// Determine the accuracy according to the size
 	if (unit_index == 0) {
-		snprintf(buffer, sizeof(buffer), "%lld", (long long)display_size);
+		snprintf(buffer, 32, "%lld", (long long)display_size);
 	} else if (display_size < 10) {
-		snprintf(buffer, sizeof(buffer), "%.1f%s", display_size, units[unit_index]);
+		snprintf(buffer, 32, "%.1f%s", display_size, units[unit_index]);
 	} else {
-		snprintf(buffer, sizeof(buffer), "%.0f%s", display_size, units[unit_index]);
+		snprintf(buffer, 32, "%.0f%s", display_size, units[unit_index]);
 	}
 
 	return buffer;
 }
 
+// Sort orders
+enum {
+	SORT_NAME = 0,
+	SORT_TIME,	// -t: newest first
+	SORT_SIZE,	// -S: largest first
+	SORT_VERSION,	// -v: natural order of numbers in names
+};
+
 // Struct of options
 typedef struct {
 	bool list;	// -l
 	bool all;	// -a
 	bool color;	// --color
 	bool unsorted;	// -f
+	bool one_per_line;	// -1
+	bool reverse;	// -r
+	int sort;	// SORT_*
 	bool directory;	// Whether to display the directory itself
 	bool human;	// -h: human readable file size
+	bool recursive;	// -R
+	int threads;	// --threads, 0: all CPUs
 } Options;
 
 // Struct of file
 typedef struct {
-	char *name;
-	struct stat st;
-	char *path;	// Full path
+	const char *name;
+	struct stat st;	// Only the fields the output needs, see stat_fields()
+	const char *path;	// Relative to the directory fd of the listing
 } FileInfo;
 
-// Compare string
-int compare_files(const void *a, const void *b) {
-	const FileInfo *fa = (const FileInfo *)a;
-	const FileInfo *fb = (const FileInfo *)b;
-	return strcmp(fa->name, fb->name);
+// Allocation for listings, which -R also builds on pool threads (xalloc is not thread safe)
+static void *ls_realloc(void *ptr, size_t size) {
+	void *p = realloc(ptr, size);
+	if (!p) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+		exit(EXIT_FAILURE);
+	}
+	return p;
 }
 
-// Displays long-form information
-void display_long_format(FileInfo *files, int count, Options opts) {
-	// Calculate the maximum width for alignment
-	unsigned long max_nlink = 0, max_user = 0, max_group = 0;
-	long max_size = 0;
-	int max_size_chars = 0; // Human-readable size character length
-	long total_blocks = 0;
-	
-	// Collect the maximum value
-	for (int i = 0; i < count; i++) {
-		if (files[i].st.st_nlink > max_nlink) max_nlink = files[i].st.st_nlink;
+// Names of a listing, packed into large chunks instead of one allocation each
+typedef struct {
+	char **chunks;
+	size_t count;
+	size_t used;	// Bytes taken in the last chunk
+	size_t cap;	// Size of the last chunk
+} NamePool;
 
-		// Original size
-		if (files[i].st.st_size > max_size) max_size = files[i].st.st_size;
+static const char *pool_add(NamePool *pool, const char *name, size_t len) {
+	if (pool->count == 0 || pool->cap - pool->used < len + 1) {
+		size_t cap = len + 1 > NAME_CHUNK ? len + 1 : NAME_CHUNK;
+		pool->chunks = ls_realloc(pool->chunks, (pool->count + 1) * sizeof(char *));
+		pool->chunks[pool->count++] = ls_realloc(NULL, cap);
+		pool->used = 0;
+		pool->cap = cap;
+	}
 
-		const char *user = get_username(files[i].st.st_uid);
-		const char *group = get_groupname(files[i].st.st_gid);
+	char *p = pool->chunks[pool->count - 1] + pool->used;
+	memcpy(p, name, len + 1);
+	pool->used += len + 1;
+	return p;
+}
+
+static void pool_free(NamePool *pool) {
+	for (size_t i = 0; i < pool->count; i++) {
+		free(pool->chunks[i]);
+	}
+	free(pool->chunks);
+}
 
-		if (strlen(user) > max_user) max_user = strlen(user);
-		if (strlen(group) > max_group) max_group = strlen(group);
+/*
+ * Sorting works on (key, index) pairs, the FileInfo structs only move once
+ * into their final order. Names are radix sorted 8 bytes at a time (big
+ * endian, so integer order is strcmp order), going deeper only into the
+ * runs that share a whole prefix. Times and sizes are then radix
+ * sorted on their own; the sort is stable, so ties stay in name order.
+ */
+typedef struct {
+	uint64_t key;
+	uint32_t index;
+} SortKey;
 
-		total_blocks += files[i].st.st_blocks;
+// Stable LSD radix sort on key, bytes that are the same everywhere are skipped
+static void radix_sort(SortKey *keys, SortKey *tmp, size_t n) {
+	size_t count[8][256];
+	SortKey *src = keys, *dst = tmp;
+
+	memset(count, 0, sizeof(count));
+	for (size_t i = 0; i < n; i++) {
+		for (int b = 0; b < 8; b++) {
+			count[b][keys[i].key >> (8 * b) & 0xff]++;
+		}
 	}
 
-	// Calculate the maximum width of a human-readable size
-	if (opts.human) {
-		for (int i = 0; i < count; i++) {
-			const char *hr = human_readable(files[i].st.st_size, true);
-			int len = strlen(hr);
-			if (len > max_size_chars) max_size_chars = len;
+	for (int b = 0; b < 8; b++) {
+		size_t *c = count[b], sum = 0;
+		if (c[src[0].key >> (8 * b) & 0xff] == n) {
+			continue;
+		}
+		for (int v = 0; v < 256; v++) {
+			size_t t = c[v];
+			c[v] = sum;
+			sum += t;
+		}
+		for (size_t i = 0; i < n; i++) {
+			dst[c[src[i].key >> (8 * b) & 0xff]++] = src[i];
+		}
+		SortKey *t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != keys) {
+		memcpy(keys, src, n * sizeof(SortKey));
+	}
+}
+
+// First 8 bytes of a name as a big endian integer, zero padded
+static uint64_t name_prefix(const char *s) {
+	uint64_t k = 0;
+
+	for (int i = 0; i < 8; i++) {
+		unsigned char c = s[i];
+		if (c == '\0') {
+			return i ? k << (8 * (8 - i)) : 0;
+		}
+		k = k << 8 | c;
+	}
+	return k;
+}
+
+typedef struct {
+	const FileInfo *files;
+	size_t depth;		// Bytes the names being compared are known to share
+} TailCtx;
+
+static int compare_tail(const void *a, const void *b, void *arg) {
+	const TailCtx *ctx = arg;
+	return strcmp(ctx->files[((const SortKey *)a)->index].name + ctx->depth,
+			ctx->files[((const SortKey *)b)->index].name + ctx->depth);
+}
+
+/*
+ * Sort names that share their first depth bytes: radix on the next 8, then
+ * the same for every run that shares those too. Small runs go to strcmp.
+ */
+static void sort_names(const FileInfo *f, SortKey *keys, SortKey *tmp, size_t n, size_t depth) {
+	for (size_t i = 0; i < n; i++) {
+		keys[i].key = name_prefix(f[keys[i].index].name + depth);
+	}
+	radix_sort(keys, tmp, n);
+
+	for (size_t i = 0, j; i < n; i = j) {
+		for (j = i + 1; j < n && keys[j].key == keys[i].key; j++);
+		if (j - i < 2 || (keys[i].key & 0xff) == 0) {
+			continue;	// Alone, or names that ended within the prefix
 		}
+		if (j - i > 64) {
+			sort_names(f, keys + i, tmp, j - i, depth + 8);
+		} else {
+			TailCtx ctx = { f, depth + 8 };
+			qsort_r(keys + i, j - i, sizeof(SortKey), compare_tail, &ctx);
+		}
+	}
+}
+
+/*
+ * -v follows the version ordering of GNU ls: runs of digits compare as
+ * numbers, other characters as '~' < end of run < letters < the rest, and
+ * file suffixes ('.' + letter, then letters, digits and '~', repeated) are
+ * only compared when the names agree without them.
+ */
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') <= 9)
+#define IS_ALPHA(c) ((unsigned char)(((c) | 0x20) - 'a') <= 25)
+
+static int version_weight(const char *s, size_t pos, size_t len) {
+	if (pos == len) return 0;
+	unsigned char c = s[pos];
+	if (c == '~') return -1;
+	if (IS_ALPHA(c)) return c;
+	return c + 256;
+}
+
+static int version_cmp_len(const char *a, size_t alen, const char *b, size_t blen) {
+	size_t i = 0, j = 0;
+
+	while (i < alen || j < blen) {
+		// Non-digit parts
+		while ((i < alen && !IS_DIGIT(a[i])) || (j < blen && !IS_DIGIT(b[j]))) {
+			int wa = i < alen && IS_DIGIT(a[i]) ? 0 : version_weight(a, i, alen);
+			int wb = j < blen && IS_DIGIT(b[j]) ? 0 : version_weight(b, j, blen);
+			if (wa != wb) {
+				return wa - wb;
+			}
+			i++;
+			j++;
+		}
+
+		// Digit parts as numbers: the longer one (without leading zeros) is larger
+		while (i < alen && a[i] == '0') i++;
+		while (j < blen && b[j] == '0') j++;
+		int first = 0;
+		while (i < alen && j < blen && IS_DIGIT(a[i]) && IS_DIGIT(b[j])) {
+			if (first == 0) {
+				first = (unsigned char)a[i] - (unsigned char)b[j];
+			}
+			i++;
+			j++;
+		}
+		if (i < alen && IS_DIGIT(a[i])) return 1;
+		if (j < blen && IS_DIGIT(b[j])) return -1;
+		if (first != 0) return first;
+	}
+	return 0;
+}
+
+// Length of a name without its file suffixes
+static size_t version_stem(const char *s, size_t len) {
+	size_t stem = 0, i = 0;
+
+	while (i < len) {
+		// Suffixes, then an ordinary character
+		while (i + 1 < len && s[i] == '.' && (IS_ALPHA(s[i + 1]) || s[i + 1] == '~')) {
+			for (i += 2; i < len && (IS_ALPHA(s[i]) || IS_DIGIT(s[i]) || s[i] == '~'); i++);
+		}
+		if (i < len) {
+			stem = ++i;
+		}
+	}
+	return stem;
+}
+
+static int version_cmp(const char *a, const char *b) {
+	// ".", "..", other dot names, the rest
+	int ra = a[0] != '.' ? 3 : a[1] == '\0' ? 0 : a[1] == '.' && a[2] == '\0' ? 1 : 2;
+	int rb = b[0] != '.' ? 3 : b[1] == '\0' ? 0 : b[1] == '.' && b[2] == '\0' ? 1 : 2;
+	if (ra != rb || ra < 2) {
+		return ra - rb;
+	}
+
+	size_t alen = strlen(a), blen = strlen(b);
+	size_t astem = version_stem(a, alen), bstem = version_stem(b, blen);
+	int diff = version_cmp_len(a, astem, b, bstem);
+	if (diff == 0 && (astem != alen || bstem != blen)) {
+		diff = version_cmp_len(a, alen, b, blen);
+	}
+	return diff ? diff : strcmp(a, b);
+}
+
+static int compare_version(const void *a, const void *b, void *arg) {
+	const FileInfo *files = arg;
+	return version_cmp(files[((const SortKey *)a)->index].name, files[((const SortKey *)b)->index].name);
+}
+
+// Time or size as an unsigned key, largest first
+static uint64_t numeric_key(const struct stat *st, int sort) {
+	int64_t v = sort == SORT_TIME ? st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec : (int64_t)st->st_size;
+	return ~((uint64_t)v ^ 1ULL << 63);
+}
+
+static void sort_files(FileInfo **files, int count, Options opts) {
+	FileInfo *f = *files;
+	size_t n = count;
+
+	if (n < 2) {
+		return;
+	}
+
+	SortKey *keys = ls_realloc(NULL, n * sizeof(SortKey));
+	SortKey *tmp = ls_realloc(NULL, n * sizeof(SortKey));
+	for (size_t i = 0; i < n; i++) {
+		keys[i].index = i;
+	}
+
+	if (opts.sort == SORT_VERSION) {
+		qsort_r(keys, n, sizeof(SortKey), compare_version, f);
 	} else {
-		// Calculate the maximum width represented by the original size string
-		char tmp[32];
-		snprintf(tmp, sizeof(tmp), "%lld", (long long)max_size);
-		max_size_chars = strlen(tmp);
+		sort_names(f, keys, tmp, n, 0);
 	}
-	
-	// Convert to string length
-	char nlink_buf[20];
-	sprintf(nlink_buf, "%lu", max_nlink);
-	int nlink_width = strlen(nlink_buf);
 
-	// Total number of blocks printed (if there are multiple files)
-	if (count > 1) {
-		printf("total %ld\n", total_blocks / 2);
+	if (opts.sort == SORT_TIME || opts.sort == SORT_SIZE) {
+		for (size_t i = 0; i < n; i++) {
+			keys[i].key = numeric_key(&f[keys[i].index].st, opts.sort);
+		}
+		radix_sort(keys, tmp, n);
 	}
 
-	for (int i = 0; i < count; i++) {
-		struct stat *st = &files[i].st;
-		const char *name = files[i].name;
+	// Move the entries into place, reversed for -r
+	FileInfo *sorted = ls_realloc(NULL, n * sizeof(FileInfo));
+	for (size_t i = 0; i < n; i++) {
+		sorted[opts.reverse ? n - 1 - i : i] = f[keys[i].index];
+	}
+	free(f);
+	*files = sorted;
+	free(keys);
+	free(tmp);
+}
 
-		// File type and permission
-		printf("%s%s ", file_type(st->st_mode), permission_str(st->st_mode));
+#define LONG_BUF (256 * 1024)	// Output buffer of long listings
+#define TIME_SLOTS 64		// Minutes remembered by the time formatter
 
-		// Numbers of hard-link
-		printf("%*d ", nlink_width, (int)st->st_nlink);
+// Fields of a long listing line, formatted once for the widths and the output
+typedef struct {
+	const char *user;	// Cached by userInfo, stays valid
+	const char *group;
+	int ulen, glen, slen;
+	char size[32];
+} LongRow;
+
+// "Mon DD HH:MM" of one minute
+typedef struct {
+	time_t minute;
+	int len;		// 0: empty slot
+	char text[24];
+} TimeSlot;
+
+/*
+ * Format a modification time; entries of the same minute share one
+ * localtime() and strftime(). Zones whose offset is not whole minutes
+ * (local mean time of old dates) split a minute and are not cached.
+ */
+static int format_time(TimeSlot *cache, time_t t, char *out) {
+	time_t minute = t / 60 - (t % 60 < 0);
+	TimeSlot *slot = &cache[(unsigned long long)minute % TIME_SLOTS];
 
-		// Owner
-		const char *user = get_username(st->st_uid);
-		printf("%-*s ", (int)max_user, user);
+	if (slot->len == 0 || slot->minute != minute) {
+		struct tm tm;
+		char text[24];
+		int len = 1;
 
-		// Group
-		const char *group = get_groupname(st->st_gid);
-		printf("%-*s ", (int)max_group, group);
+		text[0] = '?';
+		if (localtime_r(&t, &tm) != NULL) {
+			len = strftime(text, sizeof(text), "%b %d %H:%M", &tm);
+		}
+		if (tm.tm_sec != t - minute * 60) {
+			memcpy(out, text, len);
+			return len;
+		}
+		memcpy(slot->text, text, len);
+		slot->len = len;
+		slot->minute = minute;
+	}
+	memcpy(out, slot->text, slot->len);
+	return slot->len;
+}
 
-		// Size
-		const char *size_str = human_readable(st->st_size, opts.human);
+// Displays long-form information
+void display_long_format(FILE *out, FileInfo *files, int count, Options opts, int dirfd) {
+	LongRow *rows = ls_realloc(NULL, (count ? count : 1) * sizeof(LongRow));
+	TimeSlot times[TIME_SLOTS];
+	int max_user = 0, max_group = 0, max_size = 0, nlink_width = 1;
+	size_t max_name = 0;
+	long total_blocks = 0;
+
+	// Format the fields once and collect the widths
+	for (int i = 0; i < count; i++) {
+		struct stat *st = &files[i].st;
+		LongRow *r = &rows[i];
+
+		r->user = get_username(st->st_uid);
+		r->group = get_groupname(st->st_gid);
+		r->ulen = strlen(r->user);
+		r->glen = strlen(r->group);
 		if (opts.human) {
-			// Human-readable
-			printf("%*s ", max_size_chars, size_str);
+			r->slen = strlen(human_readable(st->st_size, true, r->size));
 		} else {
-			// Original size
-			printf("%*s ", max_size_chars, size_str);
+			r->slen = put_uint(r->size, st->st_size, 0) - r->size;
+		}
+
+		if (r->ulen > max_user) max_user = r->ulen;
+		if (r->glen > max_group) max_group = r->glen;
+		if (r->slen > max_size) max_size = r->slen;
+		if (uint_len(st->st_nlink) > nlink_width) nlink_width = uint_len(st->st_nlink);
+		size_t nlen = strlen(files[i].name);
+		if (nlen > max_name) max_name = nlen;
+
+		total_blocks += st->st_blocks;
+	}
+
+	// Lines are assembled in one large buffer
+	char *buf = ls_realloc(NULL, LONG_BUF);
+	size_t used = 0;
+	size_t line_max = 64 + nlink_width + max_user + max_group + max_size + max_name + PATH_MAX;
+	memset(times, 0, sizeof(times));
+
+	// Total number of blocks printed (if there are multiple files)
+	if (count > 1) {
+		used = sprintf(buf, "total %ld\n", total_blocks / 2);
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct stat *st = &files[i].st;
+		LongRow *r = &rows[i];
+
+		if (LONG_BUF - used < line_max) {
+			fwrite(buf, 1, used, out);
+			used = 0;
 		}
+		char *p = buf + used;
 
-		// Change time
-		char time_buf[20];
-		struct tm *tm = localtime(&st->st_mtime);
-		strftime(time_buf, sizeof(time_buf), "%b %d %H:%M", tm);
-		printf("%s ", time_buf);
+		p = put_mode(p, st->st_mode);
+		*p++ = ' ';
+		p = put_uint(p, st->st_nlink, nlink_width);
+		*p++ = ' ';
+		p = put_padded(p, r->user, r->ulen, max_user);
+		*p++ = ' ';
+		p = put_padded(p, r->group, r->glen, max_group);
+		*p++ = ' ';
+		for (int k = r->slen; k < max_size; k++) {
+			*p++ = ' ';
+		}
+		memcpy(p, r->size, r->slen);
+		p += r->slen;
+		*p++ = ' ';
+		p += format_time(times, st->st_mtime, p);
+		*p++ = ' ';
 
 		// File name
+		size_t nlen = strlen(files[i].name);
 		if (opts.color) {
-			const char *color = get_file_color(st->st_mode, files[i].path);
-			printf("%s%s%s", color, name, COLOR_RESET);
+			const char *color = get_file_color(st->st_mode, dirfd, files[i].path);
+			p = put_padded(p, color, strlen(color), 0);
+			p = put_padded(p, files[i].name, nlen, 0);
+			p = put_padded(p, COLOR_RESET, strlen(COLOR_RESET), 0);
 		} else {
-			printf("%s", name);
+			p = put_padded(p, files[i].name, nlen, 0);
 		}
 
 		// If it's a symbolic link, show the target
 		if (S_ISLNK(st->st_mode)) {
-			char link_target[PATH_MAX];
-			ssize_t len = readlink(files[i].path, link_target, sizeof(link_target) - 1);
+			ssize_t len = readlinkat(dirfd, files[i].path, p + 4, PATH_MAX);
 			if (len != -1) {
-				link_target[len] = '\0';
-				printf(" -> %s", link_target);
+				memcpy(p, " -> ", 4);
+				p += 4 + len;
 			}
 		}
 
-		printf("\n");
+		*p++ = '\n';
+		used = p - buf;
 	}
+
+	fwrite(buf, 1, used, out);
+	free(buf);
+	free(rows);
 }
 
 // Show simple format
-void display_simple_format(FileInfo *files, int count, Options opts) {
+void display_simple_format(FILE *out, FileInfo *files, int count, Options opts, int dirfd) {
+	// Not a terminal or -1: one name per line, in listing order
+	if (opts.one_per_line || !isatty(STDOUT_FILENO)) {
+		for (int i = 0; i < count; i++) {
+			if (opts.color) {
+				fprintf(out, "%s%s%s\n", get_file_color(files[i].st.st_mode, dirfd, files[i].path),
+						files[i].name, COLOR_RESET);
+			} else {
+				fprintf(out, "%s\n", files[i].name);
+			}
+		}
+		return;
+	}
+
 	int max_len = 0;
 	for (int i = 0; i < count; i++) {
 		int len = strlen(files[i].name);
@@ -282,98 +651,375 @@ void display_simple_format(FileInfo *files, int count, Options opts) {
 			if (idx >= count) continue;
 
 			const char *name = files[idx].name;
-			if (isatty(STDOUT_FILENO)) {
-				if (opts.color) {
-					printf("%s%-*s%s", 
-						   get_file_color(files[idx].st.st_mode, files[idx].path),
-						   max_len, name, COLOR_RESET);
-				} else {
-					printf("%-*s", max_len, name);
-				}
-				// Spaces between columns (except for the last column)
-				if (col < num_cols - 1) {
-					printf("  ");
-				}
+			if (opts.color) {
+				fprintf(out, "%s%-*s%s", 
+					   get_file_color(files[idx].st.st_mode, dirfd, files[idx].path),
+					   max_len, name, COLOR_RESET);
 			} else {
-				printf("%s\n", name);
+				fprintf(out, "%-*s", max_len, name);
+			}
+			// Spaces between columns (except for the last column)
+			if (col < num_cols - 1) {
+				fprintf(out, "  ");
 			}
 		}
-		if (isatty(STDOUT_FILENO))
-			printf("\n");
+		fprintf(out, "\n");
 	}
 }
 
-// List the contents of the catalog
-void list_directory(const char *path, Options opts) {
-	DIR *dir = opendir(path);
-	if (!dir) {
-		perror("ls");
-		return;
+/*
+ * Fields of the stat an entry needs, 0: its d_type is enough
+ *
+ * Plain listings sort and print names only; -t and -S need their key,
+ * colors the permissions of regular files (executables), -R the type of
+ * entries the filesystem does not tell, -l everything it prints.
+ */
+static unsigned stat_fields(Options opts, unsigned char type) {
+	unsigned fields = 0;
+
+	if (opts.list) {
+		return DIRSCAN_MODE | DIRSCAN_NLINK | DIRSCAN_OWNER | DIRSCAN_SIZE | DIRSCAN_TIMES;
 	}
-	
-	// If it is the directory itself, print the directory name
-	if (opts.directory) {
-		printf("%s:\n", path);
+	if (!opts.unsorted && opts.sort == SORT_TIME) {
+		fields |= DIRSCAN_TIMES;
+	}
+	if (!opts.unsorted && opts.sort == SORT_SIZE) {
+		fields |= DIRSCAN_SIZE;
+	}
+	if ((opts.color && type == DT_REG) || ((opts.color || opts.recursive) && type == DT_UNKNOWN)) {
+		fields |= DIRSCAN_MODE;
+	}
+	return fields;
+}
+
+// Entries of one directory
+typedef struct {
+	DirScan ds;		// Kept open, names are resolved against its fd
+	FileInfo *files;
+	int count;
+	NamePool names;
+} Listing;
+
+/*
+ * Read and sort a directory, messages go to err
+ *
+ * @return false if it cannot be opened
+ */
+static bool read_listing(const char *path, Options opts, Listing *l, FILE *err) {
+	memset(l, 0, sizeof(*l));
+	if (dirScanOpenAt(&l->ds, AT_FDCWD, path) != 0) {
+		fprintf(err, "%s: cannot open directory '%s': %s\n", getProgramName(), path, strerror(errno));
+		return false;
 	}
 	
-	struct dirent *entry;
-	FileInfo *files = NULL;
-	int count = 0;
+	DirEntry entry;
 	int capacity = 0;
+	int ret;
 	
 	// Get contents of the catalog
-	while ((entry = readdir(dir)) != NULL) {
+	while ((ret = dirScanNext(&l->ds, &entry)) > 0) {
 		// Skip hidden file
-		if (!opts.all && entry->d_name[0] == '.') {
+		if (!opts.all && entry.name[0] == '.') {
 			continue;
 		}
 		
 		// Allocate memory
-		if (count >= capacity) {
+		if (l->count >= capacity) {
 			capacity = capacity ? capacity * 2 : 16;
-			files = xrealloc(files, capacity * sizeof(FileInfo));
-		}
-		
-		// Create full path
-		char *full_path = NULL;
-		if (asprintf(&full_path, "%s/%s", path, entry->d_name) == -1) {
-			perror("asprintf");
-			continue;
+			l->files = ls_realloc(l->files, capacity * sizeof(FileInfo));
 		}
 		
-		// Get file information
-		FileInfo *fi = &files[count];
-		if (lstat(full_path, &fi->st) == -1) {
-			perror("lstat");
-			xfree(full_path);
-			continue;
+		// Get file information, relative to the directory
+		FileInfo *fi = &l->files[l->count];
+		unsigned fields = stat_fields(opts, entry.type);
+		if (fields != 0) {
+			if (dirScanStat(l->ds.fd, entry.name, fields, &fi->st) == -1) {
+				fprintf(err, "%s: cannot access '%s/%s': %s\n",
+						getProgramName(), path, entry.name, strerror(errno));
+				continue;
+			}
+		} else {
+			memset(&fi->st, 0, sizeof(fi->st));
+			fi->st.st_mode = DTTOIF(entry.type);
 		}
 		
-		fi->name = xstrdup(entry->d_name);
-		fi->path = full_path; // Storage full path
+		fi->name = pool_add(&l->names, entry.name, entry.len);
+		fi->path = fi->name;
 		
-		count++;
+		l->count++;
+	}
+	if (ret < 0) {
+		fprintf(err, "%s: reading directory '%s': %s\n", getProgramName(), path, strerror(errno));
 	}
-	closedir(dir);
 	
 	// Sort
 	if (!opts.unsorted) {
-		qsort(files, count, sizeof(FileInfo), compare_files);
+		sort_files(&l->files, l->count, opts);
 	}
-	
-	// Show files
+	return true;
+}
+
+static void show_listing(FILE *out, Listing *l, Options opts) {
 	if (opts.list) {
-		display_long_format(files, count, opts);
+		display_long_format(out, l->files, l->count, opts, l->ds.fd);
 	} else {
-		display_simple_format(files, count, opts);
+		display_simple_format(out, l->files, l->count, opts, l->ds.fd);
+	}
+}
+
+static void free_listing(Listing *l) {
+	dirScanClose(&l->ds);
+	pool_free(&l->names);
+	free(l->files);
+}
+
+// List the contents of the catalog
+void list_directory(const char *path, Options opts) {
+	Listing l;
+	if (!read_listing(path, opts, &l, stderr)) {
+		return;
 	}
 	
-	// Clean up
-	for (int i = 0; i < count; i++) {
-		xfree(files[i].name);
-		xfree(files[i].path);
+	// If it is the directory itself, print the directory name
+	if (opts.directory) {
+		printf("%s:\n", path);
 	}
-	xfree(files);
+	show_listing(stdout, &l, opts);
+	free_listing(&l);
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Whether a directory can be printed as it is read (no sorting, no columns, no widths)
+static bool can_stream(Options opts) {
+	return opts.unsorted && !opts.list && !opts.recursive
+		&& (opts.one_per_line || !isatty(STDOUT_FILENO));
+}
+
+/*
+ * List a directory straight from the getdents buffers
+ *
+ * Names go to a fixed output buffer as they are read, nothing is kept per
+ * entry, so memory stays the same whatever the size of the directory.
+ */
+void stream_directory(const char *path, Options opts) {
+	DirScan ds;
+	if (dirScanOpenAt(&ds, AT_FDCWD, path) != 0) {
+		fprintf(stderr, "%s: cannot open directory '%s': %s\n", getProgramName(), path, strerror(errno));
+		return;
+	}
+
+	if (opts.directory) {
+		printf("%s:\n", path);
+	}
+	fflush(stdout);
+
+	char *buf = xmalloc(STREAM_BUF);
+	size_t used = 0;
+	DirEntry entry;
+	int ret;
+
+	while ((ret = dirScanNext(&ds, &entry)) > 0) {
+		if (!opts.all && entry.name[0] == '.') {
+			continue;
+		}
+
+		const char *color = "";
+		if (opts.color) {
+			struct stat st;
+			unsigned fields = stat_fields(opts, entry.type);
+			if (fields == 0) {
+				st.st_mode = DTTOIF(entry.type);
+			} else if (dirScanStat(ds.fd, entry.name, fields, &st) == -1) {
+				fprintf(stderr, "%s: cannot access '%s/%s': %s\n",
+						getProgramName(), path, entry.name, strerror(errno));
+				continue;
+			}
+			color = get_file_color(st.st_mode, ds.fd, entry.name);
+		}
+
+		size_t clen = strlen(color), rlen = opts.color ? strlen(COLOR_RESET) : 0;
+		size_t need = clen + entry.len + rlen + 1;
+		if (STREAM_BUF - used < need) {
+			if (write_full(STDOUT_FILENO, buf, used) != 0) {
+				break;
+			}
+			used = 0;
+		}
+		if (need > STREAM_BUF) {
+			// A name longer than the buffer (not on Linux, NAME_MAX is 255)
+			continue;
+		}
+		memcpy(buf + used, color, clen);
+		memcpy(buf + used + clen, entry.name, entry.len);
+		memcpy(buf + used + clen + entry.len, COLOR_RESET, rlen);
+		used += need;
+		buf[used - 1] = '\n';
+	}
+	if (ret < 0) {
+		fprintf(stderr, "%s: reading directory '%s': %s\n", getProgramName(), path, strerror(errno));
+	}
+	if (ret > 0 || (used > 0 && write_full(STDOUT_FILENO, buf, used) != 0)) {
+		perror("ls: write error");	// The loop only stops early on a failed write
+	}
+
+	xfree(buf);
+	dirScanClose(&ds);
+}
+
+/*
+ * -R: every directory of the tree is read, stat'ed and formatted into
+ * memory by a pool task, which then queues its subdirectories. The calling
+ * thread prints the blocks in the order GNU ls does (a directory, then its
+ * subdirectories in listing order, depth first), waiting for each block as
+ * it comes up while the pool keeps reading ahead.
+ */
+typedef struct ls_tree ls_tree_t;
+
+typedef struct ls_node {
+	ls_tree_t *tree;
+	char *path;
+	char *out;			// Formatted listing
+	size_t out_len;
+	char *err;			// Messages, printed when the block is
+	size_t err_len;
+	struct ls_node **children;	// Subdirectories in listing order
+	size_t nchildren;
+	int done;
+} ls_node_t;
+
+struct ls_tree {
+	Options opts;
+	WorkPool *pool;
+	pthread_mutex_t lock;		// Protects 'done' of the nodes
+	pthread_cond_t done_cv;
+};
+
+static ls_node_t *new_node(ls_tree_t *tree, const char *dir, const char *name) {
+	ls_node_t *node = ls_realloc(NULL, sizeof(ls_node_t));
+	size_t dlen = strlen(dir), nlen = name ? strlen(name) : 0;
+	int slash = name && dlen > 0 && dir[dlen - 1] != '/';
+
+	memset(node, 0, sizeof(*node));
+	node->tree = tree;
+	node->path = ls_realloc(NULL, dlen + slash + nlen + 1);
+	memcpy(node->path, dir, dlen);
+	if (slash) {
+		node->path[dlen] = '/';
+	}
+	memcpy(node->path + dlen + slash, name ? name : "", nlen + 1);
+	return node;
+}
+
+static void scan_node(void *arg) {
+	ls_node_t *node = arg;
+	ls_tree_t *tree = node->tree;
+	FILE *out = open_memstream(&node->out, &node->out_len);
+	FILE *err = open_memstream(&node->err, &node->err_len);
+	Listing l;
+
+	if (out == NULL || err == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+		exit(EXIT_FAILURE);
+	}
+
+	if (read_listing(node->path, tree->opts, &l, err)) {
+		show_listing(out, &l, tree->opts);
+		for (int i = 0; i < l.count; i++) {
+			const char *name = l.files[i].name;
+			if (!S_ISDIR(l.files[i].st.st_mode) || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+				continue;
+			}
+			node->children = ls_realloc(node->children, (node->nchildren + 1) * sizeof(ls_node_t *));
+			node->children[node->nchildren++] = new_node(tree, node->path, name);
+		}
+		free_listing(&l);
+	}
+	fclose(out);
+	fclose(err);
+
+	for (size_t i = 0; i < node->nchildren; i++) {
+		workPoolSubmit(tree->pool, scan_node, node->children[i]);
+	}
+
+	pthread_mutex_lock(&tree->lock);
+	node->done = 1;
+	pthread_cond_broadcast(&tree->done_cv);
+	pthread_mutex_unlock(&tree->lock);
+}
+
+// List a directory tree (-R)
+void list_recursive(const char *path, Options opts) {
+	ls_tree_t tree = { .opts = opts };
+	ls_node_t **stack = NULL;
+	size_t depth = 0, cap = 0;
+	bool first = true;
+
+	tree.pool = workPoolCreate(workPoolThreads(opts.threads));
+	if (tree.pool == NULL) {
+		perror("ls");
+		return;
+	}
+	pthread_mutex_init(&tree.lock, NULL);
+	pthread_cond_init(&tree.done_cv, NULL);
+
+	ls_node_t *root = new_node(&tree, path, NULL);
+	workPoolSubmit(tree.pool, scan_node, root);
+	stack = ls_realloc(NULL, sizeof(ls_node_t *));
+	stack[depth++] = root;
+	cap = 1;
+
+	while (depth > 0) {
+		ls_node_t *node = stack[--depth];
+
+		pthread_mutex_lock(&tree.lock);
+		while (!node->done) {
+			pthread_cond_wait(&tree.done_cv, &tree.lock);
+		}
+		pthread_mutex_unlock(&tree.lock);
+
+		printf(first ? "%s:\n" : "\n%s:\n", node->path);
+		first = false;
+		fwrite(node->out, 1, node->out_len, stdout);
+		if (node->err_len > 0) {
+			fflush(stdout);
+			fwrite(node->err, 1, node->err_len, stderr);
+		}
+
+		// Children go on the stack last first, so the first comes up next
+		if (depth + node->nchildren > cap) {
+			cap = (depth + node->nchildren) * 2;
+			stack = ls_realloc(stack, cap * sizeof(ls_node_t *));
+		}
+		for (size_t i = node->nchildren; i-- > 0;) {
+			stack[depth++] = node->children[i];
+		}
+
+		free(node->children);
+		free(node->path);
+		free(node->out);
+		free(node->err);
+		free(node);
+	}
+
+	workPoolWait(tree.pool);
+	workPoolDestroy(tree.pool);
+	pthread_cond_destroy(&tree.done_cv);
+	pthread_mutex_destroy(&tree.lock);
+	free(stack);
 }
 
 // Show help informations
@@ -386,7 +1032,14 @@ static void print_help() {
 	printf("  -a, --all		   do not ignore entries starting with .\n");
 	printf("  -l				  use a long listing format\n");
 	printf("  -f				  do not sort, enable -a\n");
+	printf("  -1				  list one file per line\n");
 	printf("  -h, --human-readable  with -l, print human readable sizes\n");
+	printf("  -r, --reverse	   reverse order while sorting\n");
+	printf("  -S				  sort by file size, largest first\n");
+	printf("  -t				  sort by modification time, newest first\n");
+	printf("  -v				  natural sort of (version) numbers within text\n");
+	printf("  -R, --recursive	   list subdirectories recursively\n");
+	printf("	  --threads=N	   with -R, read directories on N threads (default: all CPUs)\n");
 	printf("	  --color[=WHEN]   colorize the output; WHEN can be 'always', 'auto', or 'never';\n");
 	printf("						 default is 'auto'\n");
 	printf("	  --help		  display this help and exit\n");
@@ -402,12 +1055,15 @@ M_ENTRY(ls) {
 	static struct option long_options[] = {
 		{"all", no_argument, NULL, 'a'},
 		{"help", no_argument, NULL, 'H'},
-		{"human-readable", no_argument, NULL, 'r'},
+		{"human-readable", no_argument, NULL, 'h'},
+		{"reverse", no_argument, NULL, 'r'},
 		{"color", optional_argument, NULL, 'c'},
+		{"recursive", no_argument, NULL, 'R'},
+		{"threads", required_argument, NULL, 'j'},
 		{NULL, 0, NULL, 0}
 	};
 	
-	const char* short_options = "alHrfc:h?";
+	const char* short_options = "alHrRf1tSvc:h?";
 	
 	// Parse command line arguments
 	int opt;
@@ -423,12 +1079,36 @@ M_ENTRY(ls) {
 			case 'l':
 				opts.list = true;
 				break;
+			case '1':
+				opts.one_per_line = true;
+				break;
 			case 'f':
 				opts.unsorted = true;
 				opts.all = true; // -f
 				break;
-			case 'r': // --human-readable or -r
-			case 'h': // -h
+			case 'R':
+				opts.recursive = true;
+				break;
+			case 'j': // --threads
+				opts.threads = atoi(optarg);
+				if (opts.threads < 1) {
+					fprintf(stderr, "%s: invalid thread count: %s\n", getProgramName(), optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'r': // -r, --reverse
+				opts.reverse = true;
+				break;
+			case 't':
+				opts.sort = SORT_TIME;
+				break;
+			case 'S':
+				opts.sort = SORT_SIZE;
+				break;
+			case 'v':
+				opts.sort = SORT_VERSION;
+				break;
+			case 'h': // -h, --human-readable
 				opts.human = true;
 				break;
 			case 'c': // --color
@@ -497,7 +1177,13 @@ M_ENTRY(ls) {
 		if (S_ISDIR(st.st_mode)) {
 			// If it is a direcory
 			opts.directory = (path_count > 1);
-			list_directory(paths[i], opts);
+			if (opts.recursive) {
+				list_recursive(paths[i], opts);
+			} else if (can_stream(opts)) {
+				stream_directory(paths[i], opts);
+			} else {
+				list_directory(paths[i], opts);
+			}
 			if (i < path_count - 1) {
 				printf("\n");
 			}
@@ -505,29 +1191,28 @@ M_ENTRY(ls) {
 			// If it is a file
 			FileInfo file;
 			// Copy file name
-			file.name = xstrdup(basename(xstrdup(paths[i])));
-			file.path = xstrdup(paths[i]);
+			char *copy = xstrdup(paths[i]);
+			file.name = basename(copy);
+			file.path = paths[i];
 
 			if (lstat(paths[i], &file.st) == -1) {
 				fprintf(stderr, "%s: cannot access '%s': ", getProgramName(), paths[i]);
 				perror("");
-				xfree(file.name);
-				xfree(file.path);
+				xfree(copy);
 				continue;
 			}
 
 			if (opts.list) {
-				display_long_format(&file, 1, opts);
+				display_long_format(stdout, &file, 1, opts, AT_FDCWD);
 			} else {
 				if (opts.color) {
-					printf("%s%s%s\n", get_file_color(file.st.st_mode, paths[i]), file.name, COLOR_RESET);
+					printf("%s%s%s\n", get_file_color(file.st.st_mode, AT_FDCWD, paths[i]), file.name, COLOR_RESET);
 				} else {
 					printf("%s\n", file.name);
 				}
 			}
 
-			xfree(file.name);
-			xfree(file.path);
+			xfree(copy);
 		}
 	}
 	
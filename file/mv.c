@@ -9,12 +9,18 @@
  *	Based on MIT protocol open source
  */
 
+#define _GNU_SOURCE // For copy_file_range, SEEK_DATA and SEEK_HOLE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#include <linux/fs.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <dirent.h>
@@ -27,6 +33,7 @@
 #include "config.h"
 
 #define DEFAULT_BACKUP_SUFFIX "~"
+#define COPY_BUF (1024 * 1024)	// read/write fallback of cross-filesystem copies
 
 // Backup strategy type
 typedef enum {
@@ -179,33 +186,178 @@ static int need_update(const char *src, const char *dest) {
 	return 1;
 }
 
-// Copy content from source file to destination file
-static void copy_file(const char *src, const char *dest) {
-	int fd_src = open(src, O_RDONLY);
-	if (fd_src < 0) die("cannot open '%s' for reading", src);
-	int fd_dest = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd_dest < 0) { close(fd_src); die("cannot open '%s' for writing", dest); }
+// pwrite() all of buf at off
+static int write_all_at(int fd, const char *buf, size_t len, off_t off) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, len, off);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+		off += n;
+	}
+	return 0;
+}
+
+/*
+ * Copy the data of in to out: a reflink when the filesystem shares
+ * extents, otherwise only the data segments found by SEEK_DATA/SEEK_HOLE,
+ * with copy_file_range() until the kernel refuses it across these
+ * filesystems, then with large pread()/pwrite(). Holes stay holes.
+ */
+static int copy_data(int in, int out, off_t size) {
+#ifdef FICLONE
+	if (ioctl(out, FICLONE, in) == 0) return 0;
+#endif
+
+	int use_cfr = 1;
+	char *buf = NULL;
+	off_t pos = 0;
+
+	while (pos < size) {
+		off_t end = size;
+		off_t data = lseek(in, pos, SEEK_DATA);
+		if (data < 0) {
+			if (errno == ENXIO) break;	// Only a hole is left
+			data = pos;			// No SEEK_DATA here, all is data
+		} else {
+			end = lseek(in, data, SEEK_HOLE);
+			if (end < 0 || end > size) end = size;
+		}
 
-	char buf[4096];
-	ssize_t n;
-	while ((n = read(fd_src, buf, sizeof(buf))) > 0) {
-		if (write(fd_dest, buf, n) != n) {
-			close(fd_src); close(fd_dest);
-			die("failed to write to '%s'", dest);
+		for (pos = data; pos < end; ) {
+			ssize_t n;
+			if (use_cfr) {
+				loff_t in_off = pos, out_off = pos;
+				n = copy_file_range(in, &in_off, out, &out_off, end - pos, 0);
+				if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+					use_cfr = 0;
+					continue;
+				}
+			} else {
+				if (!buf && !(buf = malloc(COPY_BUF))) return -1;
+				size_t want = end - pos < COPY_BUF ? end - pos : COPY_BUF;
+				n = pread(in, buf, want, pos);
+				if (n > 0 && write_all_at(out, buf, n, pos) != 0) n = -1;
+			}
+			if (n < 0 && errno == EINTR) continue;
+			if (n < 0) {
+				free(buf);
+				return -1;
+			}
+			if (n == 0) {
+				// The source got shorter meanwhile
+				size = pos;
+				break;
+			}
+			pos += n;
 		}
 	}
-	if (n < 0) die("failed to read from '%s'", src);
+
+	free(buf);
+	// Sets the length, including a trailing hole
+	return ftruncate(out, size);
+}
+
+// Extended attributes of in onto out, those the target cannot take are skipped
+static void copy_xattrs(int in, int out, const char *dest) {
+	ssize_t len = flistxattr(in, NULL, 0);
+	if (len <= 0) return;
+
+	char *names = malloc(len);
+	if (!names) die("mv: out of memory");
+	len = flistxattr(in, names, len);
+
+	char *value = NULL;
+	size_t cap = 0;
+	for (char *name = names; len > 0 && name < names + len; name += strlen(name) + 1) {
+		ssize_t vlen = fgetxattr(in, name, NULL, 0);
+		if (vlen < 0) continue;
+		if ((size_t)vlen > cap) {
+			cap = vlen;
+			value = realloc(value, cap);
+			if (!value) die("mv: out of memory");
+		}
+		vlen = fgetxattr(in, name, value, vlen);
+		if (vlen < 0) continue;
+		if (fsetxattr(out, name, value, vlen, 0) != 0 && errno != ENOTSUP && errno != EPERM)
+			die("failed to preserve attribute '%s' of '%s'", name, dest);
+	}
+	free(value);
+	free(names);
+}
+
+// Owner, xattrs, mode and times of the source onto out
+static void copy_meta(int in, int out, const struct stat *st, const char *dest) {
+	// Without privilege the owner cannot be given away, the group maybe
+	if (fchown(out, st->st_uid, st->st_gid) != 0 && fchown(out, -1, st->st_gid) != 0 && errno != EPERM)
+		die("failed to preserve ownership of '%s'", dest);
+	// While out is still 0600/0700: a read-only mode would refuse user.* attributes
+	copy_xattrs(in, out, dest);
+	// After fchown(), which clears set-user-ID and set-group-ID
+	if (fchmod(out, st->st_mode & 07777) != 0)
+		die("failed to preserve permissions of '%s'", dest);
+	// Last, the others change them
+	struct timespec times[2] = { st->st_atim, st->st_mtim };
+	if (futimens(out, times) != 0)
+		die("failed to preserve times of '%s'", dest);
+}
+
+// Copy a regular file with its layout and metadata, on disk before returning
+static void copy_file(const char *src, const char *dest, const struct stat *st) {
+	int fd_src = open(src, O_RDONLY | O_CLOEXEC);
+	if (fd_src < 0) die("cannot open '%s' for reading", src);
+	// Nobody else can open it until the mode is copied
+	int fd_dest = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd_dest < 0) { close(fd_src); die("cannot open '%s' for writing", dest); }
+
+	if (copy_data(fd_src, fd_dest, st->st_size) != 0)
+		die("failed to copy '%s' to '%s': %s", src, dest, strerror(errno));
+	copy_meta(fd_src, fd_dest, st, dest);
+	if (fsync(fd_dest) != 0 || close(fd_dest) != 0)
+		die("failed to write to '%s'", dest);
 	close(fd_src);
-	close(fd_dest);
 }
 
-// Recursively copy directory contents
-static void copy_dir(const char *src, const char *dest) {
-	mkdir(dest, 0755);
+// Recreate a symbolic link, device or FIFO
+static void copy_special(const char *src, const char *dest, const struct stat *st) {
+	if (S_ISLNK(st->st_mode)) {
+		char target[PATH_MAX];
+		ssize_t len = readlink(src, target, sizeof(target));
+		if (len < 0 || len == sizeof(target)) die("cannot read link '%s'", src);
+		target[len] = '\0';
+		if (symlink(target, dest) != 0) die("cannot create link '%s'", dest);
+	} else {
+		if (mknod(dest, st->st_mode, st->st_rdev) != 0) die("cannot create '%s'", dest);
+		if (chmod(dest, st->st_mode & 07777) != 0) die("failed to preserve permissions of '%s'", dest);
+	}
+
+	if (lchown(dest, st->st_uid, st->st_gid) != 0 && errno != EPERM)
+		die("failed to preserve ownership of '%s'", dest);
+	struct timespec times[2] = { st->st_atim, st->st_mtim };
+	if (utimensat(AT_FDCWD, dest, times, AT_SYMLINK_NOFOLLOW) != 0)
+		die("failed to preserve times of '%s'", dest);
+}
+
+static void copy_dir(const char *src, const char *dest, const struct stat *st);
+
+// Copy any kind of file; symbolic links are copied, never followed
+static void copy_node(const char *src, const char *dest, const struct stat *st) {
+	if (S_ISDIR(st->st_mode)) copy_dir(src, dest, st);
+	else if (S_ISREG(st->st_mode)) copy_file(src, dest, st);
+	else copy_special(src, dest, st);
+}
+
+// Recursively copy directory contents, then its own metadata
+static void copy_dir(const char *src, const char *dest, const struct stat *st) {
+	if (mkdir(dest, 0700) != 0 && errno != EEXIST) die("cannot create directory '%s'", dest);
 	DIR *dir = opendir(src);
 	if (!dir) die("cannot open directory '%s'", src);
 
 	struct dirent *entry;
+	struct stat child;
 	char src_path[1024], dest_path[1024];
 	while ((entry = readdir(dir))) {
 		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
@@ -213,10 +365,30 @@ static void copy_dir(const char *src, const char *dest) {
 		snprintf(src_path, sizeof(src_path), "%s/%s", src, entry->d_name);
 		snprintf(dest_path, sizeof(dest_path), "%s/%s", dest, entry->d_name);
 
-		if (is_dir(src_path)) copy_dir(src_path, dest_path);
-		else copy_file(src_path, dest_path);
+		if (lstat(src_path, &child) != 0) die("cannot stat '%s'", src_path);
+		copy_node(src_path, dest_path, &child);
 	}
 	closedir(dir);
+
+	// The entries are synced one by one, the directory syncs the names
+	int fd_src = open(src, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	int fd_dest = open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd_src < 0 || fd_dest < 0) die("cannot open directory '%s'", fd_src < 0 ? src : dest);
+	copy_meta(fd_src, fd_dest, st, dest);
+	if (fsync(fd_dest) != 0) die("failed to write to '%s'", dest);
+	close(fd_src);
+	close(fd_dest);
+}
+
+// Sync the directory holding path, so its new entry is on disk too
+static void sync_parent(const char *path) {
+	char *copy = strdup(path);
+	if (!copy) die("mv: out of memory");
+	const char *dir = dirname(copy);
+	int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 || fsync(fd) != 0) die("failed to write to '%s'", dir);
+	close(fd);
+	free(copy);
 }
 
 // Recursively delete directory and its contents
@@ -225,12 +397,14 @@ static void remove_dir(const char *path) {
 	if (!dir) die("cannot open directory '%s'", path);
 
 	struct dirent *entry;
+	struct stat st;
 	char child[1024];
 	while ((entry = readdir(dir))) {
 		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
 			continue;
 		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
-		if (is_dir(child)) remove_dir(child);
+		// A link to a directory is removed, not what it points to
+		if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) remove_dir(child);
 		else if (unlink(child) != 0) die("cannot remove '%s'", child);
 	}
 	closedir(dir);
@@ -279,12 +453,16 @@ static void move_single(const char *src, const char *dest) {
 	if (opts.no_copy) die("mv: cannot move across filesystems (--no-copy)");
 	debug("copying across filesystems: %s -> %s", src, final_dest);
 
-	if (is_dir(src)) {
-		copy_dir(src, final_dest);
+	// The source only goes once the copy is synced
+	struct stat st;
+	if (lstat(src, &st) != 0) die("cannot stat '%s'", src);
+	copy_node(src, final_dest, &st);
+	sync_parent(final_dest);
+
+	if (S_ISDIR(st.st_mode)) {
 		remove_dir(src);
-	} else {
-		copy_file(src, final_dest);
-		if (unlink(src) != 0) die("cannot remove source '%s'", src);
+	} else if (unlink(src) != 0) {
+		die("cannot remove source '%s'", src);
 	}
 	verbose("moved '%s' -> '%s'", src, final_dest);
 }
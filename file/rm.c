@@ -11,13 +11,24 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <getopt.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "config.h"
 #include "module.h"
+#include "lib.h"
+#include "dirScan.h"
+#include "workPool.h"
 
 static void rm_show_help() {
 	SHOW_VERSION(stderr);
@@ -27,118 +38,675 @@ static void rm_show_help() {
 			"  -f   Delete files without error(Except that the file exists but the deletion fails)\n"
 			"  -i   Confirm before deleting\n"
 			"  -rR  Chain deletion\n"
-			"  -v   Verbose\n");
+			"  -j N With -r, remove subdirectories on N threads\n"
+			"  -v   Verbose\n"
+			"  --background  With -rf, move directories into a trash directory and\n"
+			"                delete them in a detached low-priority process; with -r, a\n"
+			"                trash left next to an operand is deleted the same way\n");
 }
 
+#define RM_OPEN_DIRS 64	// Directory scans kept open at once, deeper ones are parked
+#define RM_PAR_DEPTH 16	// Below this depth -j hands the subtree to one thread
+#define RM_TRASH ".rm-trash"	// --background: per parent directory, on the same filesystem
+
+static int force = 0, interactive = 0, recursive = 0, verbose = 0;
+static int exit_status = 0;
+
+// Allocation usable on pool threads (xalloc is not thread safe)
+static void *rm_realloc(void *ptr, size_t size) {
+	void *p = realloc(ptr, size);
+	if (!p) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+// A directory being emptied
+typedef struct {
+	DirScan ds;		// ds.fd < 0 while parked
+	off_t pos;		// Where a parked scan resumes
+	dev_t dev;		// Identity of a parked directory, checked when it is
+	ino_t ino;		// reopened through ".." of its child
+	size_t path_len;	// Length of its path in RmTree.path
+} RmFrame;
+
+/*
+ * Iterative removal of one tree. Every call goes relative to the fd of
+ * the parent directory, so no path is resolved twice and the depth is not
+ * limited by PATH_MAX; the path is only assembled for the messages.
+ * Beyond RM_OPEN_DIRS levels, or when the process runs out of descriptors,
+ * the outer scans are closed, and reopened through ".." of the child once
+ * it is gone.
+ */
+typedef struct {
+	int topfd;		// Parent of the tree
+	const char *top_name;
+	RmFrame *frames;
+	int depth, frames_cap;
+	int parked;		// frames[0 .. parked - 1] are closed
+	char *path;
+	size_t len, cap;
+	int ret;
+} RmTree;
+
 // Function to check if a file is read-only (no write permission for user)
-static int is_readonly(const char *path) {
+static int is_readonly(int dirfd, const char *name) {
 	struct stat st;
-	if (stat(path, &st) == -1) {
+	if (fstatat(dirfd, name, &st, 0) == -1) {
 		return 0; // If we can't stat, assume not read-only
 	}
 	return (st.st_mode & S_IWUSR) == 0; // Check if user write permission is missing
 }
 
 // Function to prompt user for confirmation
-static int prompt_user(const char *message) {
-	printf("%s", message);
+static int prompt_user(const char *format, const char *path) {
 	char response[4];
-	if (fgets(response, sizeof(response), stdin) == NULL) {
-		return 0; // Assume no on error
+	int answer = 0;
+
+	// With -j, no other message may come between the question and the answer
+	flockfile(stdout);
+	printf(format, path);
+	if (fgets(response, sizeof(response), stdin) != NULL) {
+		answer = (response[0] == 'y' || response[0] == 'Y');
+	}
+	funlockfile(stdout);
+	return answer;
+}
+
+// Questions of write-protected files and of -i, return: 1->remove, 0->keep
+static int confirm(const char *path, int readonly, const char *ro_format, const char *format) {
+	int should_remove = 1;
+
+	if (!force && readonly) {
+		should_remove = prompt_user(ro_format, path);
+	}
+	if (should_remove && interactive) {
+		should_remove = prompt_user(format, path);
+	}
+	return should_remove || force;
+}
+
+// Append "/name" to the message path
+static void tree_path_push(RmTree *t, const char *name, size_t len) {
+	if (t->len + len + 2 > t->cap) {
+		t->cap = (t->len + len + 2) * 2;
+		t->path = rm_realloc(t->path, t->cap);
+	}
+	t->path[t->len] = '/';
+	memcpy(t->path + t->len + 1, name, len + 1);
+	t->len += len + 1;
+}
+
+// Close the outermost open scan; never the innermost, entries are opened relative to it
+static int tree_park(RmTree *t) {
+	struct stat st;
+
+	if (t->parked >= t->depth - 1) {
+		return -1;
+	}
+	RmFrame *p = &t->frames[t->parked];
+	if (fstat(p->ds.fd, &st) != 0) {
+		return -1;
+	}
+	p->dev = st.st_dev;
+	p->ino = st.st_ino;
+	p->pos = dirScanTell(&p->ds);
+	dirScanClose(&p->ds);
+	t->parked++;
+	return 0;
+}
+
+// Start emptying the directory name of dirfd, its path is already in t->path
+static int tree_enter(RmTree *t, int dirfd, const char *name) {
+	if (t->depth == t->frames_cap) {
+		t->frames_cap = t->frames_cap ? t->frames_cap * 2 : 16;
+		t->frames = rm_realloc(t->frames, t->frames_cap * sizeof(RmFrame));
+	}
+
+	// Out of descriptors: give back outer ones until the open succeeds
+	RmFrame *f = &t->frames[t->depth];
+	while (dirScanOpenAt(&f->ds, dirfd, name) != 0) {
+		int err = errno;
+		if ((err != EMFILE && err != ENFILE) || tree_park(t) != 0) {
+			errno = err;
+			return -1;
+		}
+	}
+	f->path_len = t->len;
+	t->depth++;
+
+	if (t->depth - t->parked > RM_OPEN_DIRS) {
+		tree_park(t);
+	}
+	return 0;
+}
+
+// Reopen the parked parent of the top frame
+static int tree_unpark(RmTree *t) {
+	RmFrame *f = &t->frames[t->depth - 1];
+	RmFrame *p = &t->frames[t->depth - 2];
+	struct stat st;
+
+	if (dirScanOpenAt(&p->ds, f->ds.fd, "..") != 0) {
+		return -1;
+	}
+	if (fstat(p->ds.fd, &st) != 0 || st.st_dev != p->dev || st.st_ino != p->ino) {
+		dirScanClose(&p->ds);
+		errno = ESTALE;
+		return -1;
+	}
+	t->parked = t->depth - 2;
+	return dirScanSeek(&p->ds, p->pos);
+}
+
+// Remove a non-directory entry of dirfd, path is only for the messages
+static void remove_file(const char *path, int dirfd, const char *name) {
+	if (!confirm(path, !force && is_readonly(dirfd, name),
+			"rm: remove write-protected regular file '%s'? ", "rm: remove '%s'? ")) {
+		return;
+	}
+	if (unlinkat(dirfd, name, 0) != 0) {
+		if (!force) perror(path);
+	} else if (verbose) {
+		printf("removed '%s'\n", path);
+	}
+}
+
+// Remove the emptied directory of the top frame, then pop it
+static void tree_leave(RmTree *t) {
+	RmFrame *f = &t->frames[t->depth - 1];
+	RmFrame *p = t->depth > 1 ? &t->frames[t->depth - 2] : NULL;
+	const char *name = p ? t->path + p->path_len + 1 : t->top_name;
+	int dirfd = t->topfd;
+	struct stat st;
+
+	if (p != NULL && p->ds.fd < 0 && tree_unpark(t) != 0) {
+		fprintf(stderr, "rm: cannot return to '%.*s': %s\n", (int)p->path_len, t->path, strerror(errno));
+		t->ret = -1;
+		// Without the parent, the remaining levels cannot be reached
+		while (t->depth > 0) {
+			dirScanClose(&t->frames[--t->depth].ds);
+		}
+		return;
+	}
+	if (p != NULL) {
+		dirfd = p->ds.fd;
+	}
+
+	int readonly = fstat(f->ds.fd, &st) == 0 && (st.st_mode & S_IWUSR) == 0;
+	dirScanClose(&f->ds);
+	if (confirm(t->path, readonly, "rm: remove write-protected directory '%s'? ", "rm: remove directory '%s'? ")) {
+		if (unlinkat(dirfd, name, AT_REMOVEDIR) != 0) {
+			if (!force) perror(t->path);
+			t->ret = -1;
+		} else if (verbose) {
+			printf("removed directory '%s'\n", t->path);
+		}
+	}
+
+	t->depth--;
+	if (p != NULL) {
+		t->len = p->path_len;
+		t->path[t->len] = '\0';
 	}
-	return (response[0] == 'y' || response[0] == 'Y');
 }
 
-// Recursively remove directory contents
-static int remove_directory(const char *path, int force, int interactive, int verbose) {
-	DIR *dir = opendir(path);
-	if (!dir) {
+// Recursively remove the directory name of dirfd, path is only for the messages
+static int remove_tree(int dirfd, const char *name, const char *path) {
+	RmTree t = { .topfd = dirfd, .top_name = name };
+
+	t.len = strlen(path);
+	t.cap = t.len + 256;
+	t.path = rm_realloc(NULL, t.cap);
+	memcpy(t.path, path, t.len + 1);
+
+	if (tree_enter(&t, dirfd, name) != 0) {
 		if (!force) perror(path);
+		free(t.path);
 		return -1;
 	}
 
-	struct dirent *entry;
-	while ((entry = readdir(dir)) != NULL) {
-		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+	while (t.depth > 0) {
+		RmFrame *f = &t.frames[t.depth - 1];
+		DirEntry ent;
+		int r = dirScanNext(&f->ds, &ent);
+
+		if (r <= 0) {
+			if (r < 0) {
+				if (!force) perror(t.path);
+				t.ret = -1;
+			}
+			tree_leave(&t);
+			continue;
+		}
+		if (ent.name[0] == '.' && (ent.len == 1 || (ent.len == 2 && ent.name[1] == '.'))) {
 			continue;
+		}
 
-		char full_path[1024];
-		snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+		tree_path_push(&t, ent.name, ent.len);
 
-		struct stat st;
-		if (lstat(full_path, &st) == -1) {
-			if (!force) perror(full_path);
-			continue;
+		// The entry type usually comes with the name, stat only when it does not
+		unsigned char type = ent.type;
+		if (type == DT_UNKNOWN) {
+			struct stat st;
+			if (fstatat(f->ds.fd, ent.name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+				if (!force) perror(t.path);
+				t.len = f->path_len;
+				t.path[t.len] = '\0';
+				continue;
+			}
+			type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
 		}
 
-		if (S_ISDIR(st.st_mode)) {
-			remove_directory(full_path, force, interactive, verbose);
+		if (type == DT_DIR) {
+			if (tree_enter(&t, f->ds.fd, ent.name) == 0) {
+				continue;
+			}
+			if (!force) perror(t.path);
+			t.ret = -1;
+			f = &t.frames[t.depth - 1];	// The frames may have moved
 		} else {
-			int should_remove = 1;
-			
-			// Check if we need to prompt for read-only files
-			if (!force && is_readonly(full_path)) {
-				char prompt_msg[2048];
-				snprintf(prompt_msg, sizeof(prompt_msg), "rm: remove write-protected regular file '%s'? ", full_path);
-				should_remove = prompt_user(prompt_msg);
-			}
-			
-			// Check if we need to prompt for interactive mode
-			if (should_remove && interactive) {
-				char prompt_msg[2048];
-				snprintf(prompt_msg, sizeof(prompt_msg), "rm: remove '%s'? ", full_path);
-				should_remove = prompt_user(prompt_msg);
-			}
-			
-			if (should_remove || force) {
-				if (remove(full_path) != 0) {
-					if (!force) perror(full_path);
+			remove_file(t.path, f->ds.fd, ent.name);
+		}
+		t.len = f->path_len;
+		t.path[t.len] = '\0';
+	}
+
+	free(t.frames);
+	free(t.path);
+	return t.ret;
+}
+
+/*
+ * Parallel removal (-j). Every directory is a node of the pool: its task
+ * unlinks the files and queues the subdirectories, which workers steal
+ * from each other. A node counts its own scan and its unfinished
+ * subdirectories; whoever drops the count to zero removes the directory
+ * and releases the parent, so a directory goes right after its last
+ * child. The fd of a node stays open until then, its children are opened
+ * and removed relative to it. Since a wide tree would otherwise hold one
+ * descriptor per started directory, the nodes in flight are limited by
+ * RLIMIT_NOFILE; past that, and below RM_PAR_DEPTH, a subdirectory is
+ * removed inline by remove_tree(), which copes with running out of
+ * descriptors by parking its scans.
+ */
+typedef struct RmNode {
+	struct RmNode *parent;
+	int fd;			// Open from the scan until the directory is removed
+	int depth;
+	long pending;		// Own scan + subdirectories not yet done (atomic)
+	const char *name;	// Points into path
+	char path[];		// For the messages
+} RmNode;
+
+static WorkPool *rm_pool = NULL;
+static long rm_inflight = 0;		// Nodes holding or about to hold an fd (atomic)
+static long rm_inflight_max = 0;
+
+// Take a slot for one more node, return: 1->true, 0->false (remove it inline)
+static int node_reserve(void) {
+	if (__atomic_add_fetch(&rm_inflight, 1, __ATOMIC_ACQ_REL) <= rm_inflight_max) {
+		return 1;
+	}
+	__atomic_sub_fetch(&rm_inflight, 1, __ATOMIC_ACQ_REL);
+	return 0;
+}
+
+static RmNode *node_new(RmNode *parent, const char *name, size_t len) {
+	size_t plen = parent ? strlen(parent->path) + 1 : 0;
+	RmNode *n = rm_realloc(NULL, sizeof(RmNode) + plen + len + 1);
+
+	if (parent) {
+		memcpy(n->path, parent->path, plen - 1);
+		n->path[plen - 1] = '/';
+	}
+	memcpy(n->path + plen, name, len);
+	n->path[plen + len] = '\0';
+	n->name = n->path + plen;
+	n->parent = parent;
+	n->depth = parent ? parent->depth + 1 : 0;
+	n->fd = -1;
+	n->pending = 1;
+	return n;
+}
+
+static int node_parent_fd(const RmNode *n) {
+	return n->parent ? n->parent->fd : AT_FDCWD;
+}
+
+// Drop one reference; the last one removes the directory, then goes on with the parent
+static void node_release(RmNode *n) {
+	while (n != NULL && __atomic_sub_fetch(&n->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		RmNode *parent = n->parent;
+
+		// fd < 0: it could not be opened, the error is already out
+		if (n->fd >= 0) {
+			struct stat st;
+			int readonly = fstat(n->fd, &st) == 0 && (st.st_mode & S_IWUSR) == 0;
+			close(n->fd);
+			if (confirm(n->path, readonly, "rm: remove write-protected directory '%s'? ", "rm: remove directory '%s'? ")) {
+				if (unlinkat(node_parent_fd(n), n->name, AT_REMOVEDIR) != 0) {
+					if (!force) perror(n->path);
+					__atomic_store_n(&exit_status, 1, __ATOMIC_RELAXED);
 				} else if (verbose) {
-					printf("removed '%s'\n", full_path);
+					printf("removed directory '%s'\n", n->path);
 				}
 			}
 		}
+		free(n);
+		__atomic_sub_fetch(&rm_inflight, 1, __ATOMIC_ACQ_REL);
+		n = parent;
 	}
-	closedir(dir);
+}
 
-	int should_remove = 1;
-	
-	// Check if we need to prompt for read-only directory
-	if (!force && is_readonly(path)) {
-		char prompt_msg[1024];
-		snprintf(prompt_msg, sizeof(prompt_msg), "rm: remove write-protected directory '%s'? ", path);
-		should_remove = prompt_user(prompt_msg);
-	}
-	
-	// Check if we need to prompt for interactive mode
-	if (should_remove && interactive) {
-		char prompt_msg[1024];
-		snprintf(prompt_msg, sizeof(prompt_msg), "rm: remove directory '%s'? ", path);
-		should_remove = prompt_user(prompt_msg);
-	}
-	
-	if (should_remove || force) {
-		if (rmdir(path) != 0) {
-			if (!force) perror(path);
-			return -1;
-		} else if (verbose) {
-			printf("removed directory '%s'\n", path);
+static void node_task(void *arg) {
+	RmNode *n = arg;
+	DirScan ds;
+	DirEntry ent;
+	char *path = NULL;
+	size_t cap = 0, base = strlen(n->path);
+	int r;
+
+	if (dirScanOpenAt(&ds, node_parent_fd(n), n->name) != 0) {
+		// Descriptors used elsewhere in the process: the walk of one thread needs fewer
+		if (errno == EMFILE || errno == ENFILE) {
+			if (remove_tree(node_parent_fd(n), n->name, n->path) != 0) {
+				__atomic_store_n(&exit_status, 1, __ATOMIC_RELAXED);
+			}
+		} else {
+			if (!force) perror(n->path);
+			__atomic_store_n(&exit_status, 1, __ATOMIC_RELAXED);
 		}
+		node_release(n);
+		return;
 	}
-	return 0;
+	n->fd = ds.fd;
+
+	while ((r = dirScanNext(&ds, &ent)) > 0) {
+		if (ent.name[0] == '.' && (ent.len == 1 || (ent.len == 2 && ent.name[1] == '.'))) {
+			continue;
+		}
+
+		// Message path of the entry
+		if (base + ent.len + 2 > cap) {
+			cap = (base + ent.len + 2) * 2;
+			path = rm_realloc(path, cap);
+			memcpy(path, n->path, base);
+			path[base] = '/';
+		}
+		memcpy(path + base + 1, ent.name, ent.len + 1);
+
+		unsigned char type = ent.type;
+		if (type == DT_UNKNOWN) {
+			struct stat st;
+			if (fstatat(ds.fd, ent.name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+				if (!force) perror(path);
+				continue;
+			}
+			type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+		}
+
+		if (type != DT_DIR) {
+			remove_file(path, ds.fd, ent.name);
+		} else if (n->depth + 1 >= RM_PAR_DEPTH || !node_reserve()) {
+			if (remove_tree(ds.fd, ent.name, path) != 0) {
+				__atomic_store_n(&exit_status, 1, __ATOMIC_RELAXED);
+			}
+		} else {
+			__atomic_add_fetch(&n->pending, 1, __ATOMIC_ACQ_REL);
+			workPoolSubmit(rm_pool, node_task, node_new(n, ent.name, ent.len));
+		}
+	}
+	if (r < 0) {
+		if (!force) perror(n->path);
+		__atomic_store_n(&exit_status, 1, __ATOMIC_RELAXED);
+	}
+
+	// The descriptor lives on in n->fd, only the scan buffer goes
+	ds.fd = -1;
+	dirScanClose(&ds);
+	free(path);
+	node_release(n);
+}
+
+// Recursively remove a directory given on the command line
+static int remove_directory(const char *path) {
+	if (rm_pool == NULL) {
+		return remove_tree(AT_FDCWD, path, path);
+	}
+
+	exit_status = 0;
+	__atomic_add_fetch(&rm_inflight, 1, __ATOMIC_ACQ_REL);
+	workPoolSubmit(rm_pool, node_task, node_new(NULL, path, strlen(path)));
+	workPoolWait(rm_pool);
+	return exit_status ? -1 : 0;
+}
+
+/*
+ * --background: a directory is renamed into RM_TRASH of its parent, which
+ * is atomic and on the same filesystem, and a detached reaper at idle I/O
+ * priority deletes the trash afterwards. The reaper sweeps the whole trash
+ * until it is empty under an flock(). A trash an earlier reaper left behind
+ * when it was killed is picked up by the next rm -r of anything in the
+ * same directory, with or without --background.
+ */
+static int *trash_parents = NULL;	// Parent fds whose trash the reaper empties
+static int trash_count = 0;
+
+/*
+ * Open the parent of path, *name is the last component (in *buf, free it).
+ * return: fd, -1 -> false (also for "." and "..", which cannot be moved)
+ */
+static int open_parent(const char *path, char **buf, const char **name) {
+	size_t len = strlen(path);
+	const char *parent = ".";
+
+	// Split into parent and name, trailing slashes do not count
+	*buf = rm_realloc(NULL, len + 1);
+	memcpy(*buf, path, len + 1);
+	while (len > 1 && (*buf)[len - 1] == '/') {
+		(*buf)[--len] = '\0';
+	}
+	*name = *buf;
+	char *slash = strrchr(*buf, '/');
+	if (slash == *buf) {
+		parent = "/";
+		*name = *buf + 1;
+	} else if (slash != NULL) {
+		*slash = '\0';
+		parent = *buf;
+		*name = slash + 1;
+	}
+	if ((*name)[0] == '\0' || strcmp(*name, ".") == 0 || strcmp(*name, "..") == 0) {
+		return -1;
+	}
+	return open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Hand a parent to the reaper, once per directory (takes pfd)
+static void add_trash_parent(int pfd) {
+	struct stat st, seen;
+
+	if (fstat(pfd, &st) == 0) {
+		for (int i = 0; i < trash_count; i++) {
+			if (fstat(trash_parents[i], &seen) == 0 && seen.st_dev == st.st_dev && seen.st_ino == st.st_ino) {
+				close(pfd);
+				return;
+			}
+		}
+	}
+	trash_parents = rm_realloc(trash_parents, (trash_count + 1) * sizeof(int));
+	trash_parents[trash_count++] = pfd;
+}
+
+// A trash of ours left by a reaper that did not finish goes to this run's reaper
+static void adopt_leftover_trash(const char *path) {
+	char *buf;
+	const char *name;
+	struct stat st;
+	int pfd = open_parent(path, &buf, &name);
+
+	if (pfd >= 0 && fstatat(pfd, RM_TRASH, &st, AT_SYMLINK_NOFOLLOW) == 0
+			&& S_ISDIR(st.st_mode) && st.st_uid == geteuid()) {
+		add_trash_parent(pfd);
+	} else if (pfd >= 0) {
+		close(pfd);
+	}
+	free(buf);
+}
+
+// Move path into the trash of its parent, return: 0->true, -1->false (remove it in place)
+static int move_to_trash(const char *path) {
+	static unsigned seq = 0;
+	char *buf;
+	const char *name;
+	char tname[64];
+	int ret = -1;
+
+	int pfd = open_parent(path, &buf, &name);
+	if (pfd < 0) {
+		free(buf);
+		return -1;
+	}
+
+	snprintf(tname, sizeof(tname), "%ld.%u.%lx", (long)getpid(), seq++, (unsigned long)time(NULL));
+	// ENOENT: a reaper removed the emptied trash in between, make it again
+	for (int tries = 0; tries < 3 && ret != 0; tries++) {
+		if (mkdirat(pfd, RM_TRASH, 0700) != 0 && errno != EEXIST) {
+			break;
+		}
+		int tfd = openat(pfd, RM_TRASH, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		struct stat st;
+		// Somebody else's trash is not a place for our files
+		if (tfd < 0 || fstat(tfd, &st) != 0 || st.st_uid != geteuid()) {
+			if (tfd >= 0) close(tfd);
+			break;
+		}
+		if (renameat(pfd, name, tfd, tname) == 0) {
+			ret = 0;
+		} else if (errno != ENOENT) {
+			tries = 3;
+		}
+		close(tfd);
+	}
+
+	if (ret == 0) {
+		add_trash_parent(pfd);
+	} else {
+		close(pfd);
+	}
+	free(buf);
+	return ret;
+}
+
+// Empty and remove the trash of a parent directory
+static void sweep_trash(int pfd) {
+	int tfd = openat(pfd, RM_TRASH, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (tfd < 0) {
+		return;
+	}
+
+	// One reaper at a time; the one holding the lock also takes entries added meanwhile
+	flock(tfd, LOCK_EX);
+	for (int progress = 1; progress; ) {
+		DirScan ds;
+		DirEntry ent;
+
+		progress = 0;
+		if (dirScanOpenAt(&ds, tfd, ".") != 0) {
+			break;
+		}
+		while (dirScanNext(&ds, &ent) > 0) {
+			if (ent.name[0] == '.' && (ent.len == 1 || (ent.len == 2 && ent.name[1] == '.'))) {
+				continue;
+			}
+			if ((ent.type != DT_DIR && unlinkat(ds.fd, ent.name, 0) == 0)
+					|| remove_tree(ds.fd, ent.name, ent.name) == 0) {
+				progress = 1;
+			}
+		}
+		dirScanClose(&ds);
+	}
+	unlinkat(pfd, RM_TRASH, AT_REMOVEDIR);
+	close(tfd);
+}
+
+// Delete the trash in a detached low-priority process
+static void spawn_reaper(void) {
+	if (trash_count == 0) {
+		return;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid > 0) {
+		waitpid(pid, NULL, 0);
+	} else {
+		if (pid == 0) {
+			// Leave the session; the grandchild is the reaper, nobody waits for it
+			setsid();
+			if (fork() > 0) {
+				_exit(0);
+			}
+			int null = open("/dev/null", O_RDWR);
+			if (null >= 0) {
+				dup2(null, STDIN_FILENO);
+				dup2(null, STDOUT_FILENO);
+				dup2(null, STDERR_FILENO);
+				if (null > STDERR_FILENO) close(null);
+			}
+			setpriority(PRIO_PROCESS, 0, 19);
+#ifdef SYS_ioprio_set
+			// IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+			syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+		}
+		// Without fork() the caller reaps in place. The trash holds only what
+		// was already confirmed and nobody is there to answer a prompt
+		force = 1;
+		interactive = 0;
+		verbose = 0;
+		for (int i = 0; i < trash_count; i++) {
+			sweep_trash(trash_parents[i]);
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+	}
+
+	for (int i = 0; i < trash_count; i++) {
+		close(trash_parents[i]);
+	}
+	free(trash_parents);
+	trash_parents = NULL;
+	trash_count = 0;
 }
 
 M_ENTRY(rm) {
 	int opt;
-	int force = 0, interactive = 0, recursive = 0, verbose = 0;
+	int threads = 1, background = 0;
+	struct option long_opts[] = {
+		{"background", no_argument, 0, 'B'},
+		{0, 0, 0, 0}
+	};
 
 	// Parse command line options
-	while ((opt = getopt(argc, argv, "firRv")) != -1) {
+	while ((opt = getopt_long(argc, argv, "firRvj:", long_opts, NULL)) != -1) {
 		switch (opt) {
 			case 'f': force = 1; break;
 			case 'i': interactive = 1; break;
 			case 'r': case 'R': recursive = 1; break;
 			case 'v': verbose = 1; break;
+			case 'B': background = 1; break;
+			case 'j':
+				threads = atoi(optarg);
+				if (threads < 1) {
+					fprintf(stderr, "rm: invalid thread count: %s\n", optarg);
+					return 1;
+				}
+				break;
 			default:
 				rm_show_help();
 				return 1;
@@ -151,9 +719,36 @@ M_ENTRY(rm) {
 		return 1;
 	}
 
+	// The reaper asks nothing, so only -f lets directories go to the background
+	background = background && recursive && force && !interactive;
+
+	// -i asks about every file, that stays in order on one thread
+	if (recursive && threads > 1 && !interactive) {
+		// Every node in flight holds a descriptor, more of them allow more parallel work
+		struct rlimit rl;
+		long limit = 1024;
+		if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+			if (rl.rlim_cur < rl.rlim_max) {
+				rl.rlim_cur = rl.rlim_max;
+				setrlimit(RLIMIT_NOFILE, &rl);
+				getrlimit(RLIMIT_NOFILE, &rl);
+			}
+			limit = rl.rlim_cur > LONG_MAX ? LONG_MAX : (long)rl.rlim_cur;
+		}
+		// Left for stdio and the inline walks of the workers and this thread
+		rm_inflight_max = limit - 16 - (long)(threads + 1) * (RM_OPEN_DIRS + 2);
+		rm_pool = workPoolCreate(threads);
+	}
+
 	int ret = 0;
 	for (int i = optind; i < argc; i++) {
 		struct stat st;
+
+		// Also when the operand is already gone, its trash neighbour may not be
+		if (recursive) {
+			adopt_leftover_trash(argv[i]);
+		}
+
 		if (lstat(argv[i], &st) == -1) {
 			if (!force) {
 				perror(argv[i]);
@@ -168,27 +763,16 @@ M_ENTRY(rm) {
 			continue;
 		}
 
-		int should_remove = 1;
-		
-		// Check if we need to prompt for read-only files
-		if (!force && is_readonly(argv[i])) {
-			char prompt_msg[1024];
-			snprintf(prompt_msg, sizeof(prompt_msg), "rm: remove write-protected regular file '%s'? ", argv[i]);
-			should_remove = prompt_user(prompt_msg);
-		}
-		
-		// Check if we need to prompt for interactive mode
-		if (should_remove && interactive) {
-			char prompt_msg[1024];
-			snprintf(prompt_msg, sizeof(prompt_msg), "rm: remove '%s'? ", argv[i]);
-			should_remove = prompt_user(prompt_msg);
-		}
+		int should_remove = confirm(argv[i], !force && is_readonly(AT_FDCWD, argv[i]),
+				"rm: remove write-protected regular file '%s'? ", "rm: remove '%s'? ");
 
 		if (S_ISDIR(st.st_mode)) {
-			if (remove_directory(argv[i], force, interactive, verbose) != 0) {
+			if (background && move_to_trash(argv[i]) == 0) {
+				if (verbose) printf("removed directory '%s'\n", argv[i]);
+			} else if (remove_directory(argv[i]) != 0) {
 				ret = 1;
 			}
-		} else if (should_remove || force) {
+		} else if (should_remove) {
 			if (remove(argv[i]) != 0) {
 				if (!force) {
 					perror(argv[i]);
@@ -200,6 +784,8 @@ M_ENTRY(rm) {
 		}
 	}
 
+	workPoolDestroy(rm_pool);
+	spawn_reaper();
 	return ret;
 }
 
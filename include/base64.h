@@ -0,0 +1,42 @@
+/*
+ * base64.h - Base64 (RFC 4648) block encoder and decoder (header file)
+ */
+
+#ifndef _BASE64_H
+#define _BASE64_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Characters produced for n input bytes, '=' padding included
+#define BASE64_ENCODED_LEN(n)	(((n) + 2) / 3 * 4)
+
+// Most bytes decoded from n characters (plus an incomplete group carried in)
+#define BASE64_DECODED_MAX(n)	((n) / 4 * 3 + 3)
+
+// Decoder state carried from one block to the next
+typedef struct {
+	unsigned char quad[4];	// Characters of the group being completed
+	int n;			// Characters in quad
+	int ignore_garbage;	// Skip non-alphabet characters instead of failing
+} Base64Decoder;
+
+/* Encode len bytes, the output is '=' padded and not wrapped */
+size_t base64Encode(const unsigned char *in, size_t len, char *out);	// return: BASE64_ENCODED_LEN(len)
+
+/* Start decoding */
+void base64DecodeInit(Base64Decoder *dec, int ignore_garbage);
+
+/*
+ * Decode a block of text, whitespace is skipped and a group may straddle
+ * blocks; out needs BASE64_DECODED_MAX(len) bytes
+ */
+ssize_t base64DecodeBlock(Base64Decoder *dec, const char *in, size_t len, unsigned char *out, size_t *bad);	// return: bytes written, -1->invalid character at in[*bad]
+
+/* Characters of text that the decoder does not skip as whitespace */
+size_t base64TextLen(const char *text, size_t len);	// return: count
+
+/* End of input */
+int base64DecodeFinish(const Base64Decoder *dec);	// return: 0->success, -1->incomplete group
+
+#endif // _BASE64_H
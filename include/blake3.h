@@ -0,0 +1,54 @@
+/*
+ * blake3.h - BLAKE3 hash (header file)
+ */
+
+#ifndef _BLAKE3_H
+#define _BLAKE3_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLAKE3_OUT_LEN		32
+#define BLAKE3_BLOCK_LEN	64
+#define BLAKE3_CHUNK_LEN	1024
+#define BLAKE3_MAX_DEPTH	54
+
+// Chunk being absorbed
+typedef struct {
+	uint32_t cv[8];
+	uint64_t chunk_counter;
+	uint8_t buf[BLAKE3_BLOCK_LEN];
+	uint8_t buf_len;
+	uint8_t blocks_compressed;
+} blake3_chunk_state;
+
+// Incremental hasher
+typedef struct {
+	blake3_chunk_state chunk;
+	uint8_t cv_stack_len;
+	uint8_t cv_stack[BLAKE3_MAX_DEPTH * BLAKE3_OUT_LEN];	// Roots of the completed subtrees
+} blake3_hasher;
+
+/* Start a hash (unkeyed mode) */
+void blake3_hasher_init(blake3_hasher *self);
+
+/* Absorb more input */
+void blake3_hasher_update(blake3_hasher *self, const void *input, size_t input_len);
+
+/*
+ * Append a subtree hashed elsewhere by blake3_subtree_cv(), the input so far
+ * must end on a multiple of its size (nchunks is a power of two, >= 2)
+ */
+void blake3_hasher_add_subtree(blake3_hasher *self, const uint8_t cv[BLAKE3_OUT_LEN], uint64_t nchunks);
+
+/* Write the digest, the hasher can still be updated afterwards */
+void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out, size_t out_len);
+
+/*
+ * Chaining value of a complete subtree: len is a power of two number of
+ * chunks (>= 2) starting at chunk chunk_counter, never the root of a hash.
+ * Thread safe, return: 0->success, -1->out of memory
+ */
+int blake3_subtree_cv(const void *input, size_t len, uint64_t chunk_counter, uint8_t cv[BLAKE3_OUT_LEN]);
+
+#endif // _BLAKE3_H
@@ -0,0 +1,100 @@
+/*
+ * checksum.h - Shared front end of the checksum commands (header file)
+ */
+
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include <stddef.h>
+
+/*
+ * Compute the digest of a file ("-" is stdin)
+ * return: 0->success, -1->cannot open, -2->read error (errno is set)
+ */
+typedef int (*sumFileFunc)(const char *path, unsigned char *digest, int binary);
+
+// Hash update callback, receives the file contents block by block
+typedef void (*sumFeedFunc)(void *ctx, const unsigned char *data, size_t len);
+
+/* Feed a whole file ("-" is stdin) to a hash, large files use a read-ahead thread */
+int sumReadFile(const char *path, sumFeedFunc feed, void *ctx);	// return: 0->success, -1->cannot open, -2->read error
+
+/* Same as sumReadFile() for an open descriptor */
+int sumReadFd(int fd, sumFeedFunc feed, void *ctx);	// return: 0->success, -2->read error
+
+// Persistent digest cache ('--cache'), keyed by (dev, inode, size, mtime, ctime)
+typedef struct SumCache SumCache;
+
+// Counters of a digest cache
+typedef struct {
+	unsigned long hits;	// Digests taken from the cache
+	unsigned long misses;	// Files read and hashed
+	unsigned long stale;	// Revalidated files whose digest changed behind unchanged metadata
+} SumCacheStats;
+
+/* Open the cache of an algorithm, path NULL means ~/.cache/toolen/<alg>.idx */
+SumCache *sumCacheOpen(const char *prog, const char *alg, size_t digest_len, const char *path, int revalidate);	// return: NULL->unusable (a message was printed)
+
+/* Digest of a file through the cache (NULL cache: straight to sum), thread safe */
+int sumCacheFile(SumCache *cache, const char *path, sumFileFunc sum, unsigned char *digest, int binary);	// return: same as sum
+
+/* Read the counters */
+void sumCacheGetStats(SumCache *cache, SumCacheStats *stats);
+
+/* Print the counters on stderr ('--cache-stats') */
+void sumCacheReport(SumCache *cache);
+
+/* Save the new digests and free the cache */
+int sumCacheClose(SumCache *cache);	// return: 0->success, -1->could not save
+
+// Options of check mode ('-c')
+typedef struct {
+	const char *prog;	// Program name used in messages
+	const char *tag;	// Algorithm tag like "SHA256" (BSD-style lines, messages)
+	size_t digest_len;	// Digest size in bytes
+	sumFileFunc sum;	// Digest function, must be thread safe
+	SumCache *cache;	// Digest cache, NULL if not used
+	int threads;		// Verifier threads, 0 means one per CPU
+	int binary;		// Force binary mode
+	int ignore_missing;	// --ignore-missing
+	int quiet;		// --quiet
+	int status;		// --status
+	int strict;		// --strict
+	int warn;		// --warn
+} SumCheckOpts;
+
+// Counters of a checked manifest
+typedef struct {
+	int lines;		// Lines in the manifest
+	int total;		// Properly formatted lines
+	int malformed;		// Improperly formatted lines
+	int mismatched;		// Computed checksums that did NOT match
+	int unreadable;		// Listed files that could not be read
+	int stopped;		// Gave up early (--status and a failure)
+} SumCheckResult;
+
+/* Verify every entry listed in a manifest ("-" is stdin) */
+int sumCheckFile(const SumCheckOpts *opts, const char *manifest, SumCheckResult *res);	// return: 0->all OK, 1->failures, -1->cannot read manifest
+
+/* Print the GNU-style warnings for a checked manifest */
+void sumCheckReport(const SumCheckOpts *opts, const SumCheckResult *res);
+
+// Options of recursive mode ('-r')
+typedef struct {
+	const char *prog;	// Program name used in messages
+	const char *tag;	// Algorithm tag for BSD-style lines
+	size_t digest_len;	// Digest size in bytes
+	sumFileFunc sum;	// Digest function, must be thread safe
+	SumCache *cache;	// Digest cache, NULL if not used
+	int threads;		// Walker and hashing threads, 0 means one per CPU
+	int binary;		// Binary mode ('*' marker)
+	int bsd_tag;		// --tag
+	int zero;		// --zero
+	int follow;		// Follow symbolic links (-L)
+	int one_fs;		// Stay on the file system of the operand (-x)
+} SumTreeOpts;
+
+/* Print a manifest of every regular file under a directory, sorted by path */
+int sumTreeFile(const SumTreeOpts *opts, const char *root);	// return: 0->success, 1->some files could not be read
+
+#endif // _CHECKSUM_H
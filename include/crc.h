@@ -0,0 +1,32 @@
+/*
+ * crc.h - CRC-32 kernels (header file)
+ */
+
+#ifndef _CRC_H
+#define _CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Continue a CRC-32 (IEEE 802.3, reflected 0xEDB88320) with more data,
+ * pass 0 to start. crc32_update(crc32_update(0, a), b) is the CRC of a+b.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+/* CRC-32 of a single buffer */
+uint32_t calculate_crc32(const void *data, size_t length);
+
+/* CRC-32 of A followed by B, from crc(A), crc(B) and the length of B */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+/* Same as crc32_update() for CRC-32C (Castagnoli, reflected 0x82F63B78) */
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length);
+
+/* CRC-32C of a single buffer */
+uint32_t calculate_crc32c(const void *data, size_t length);
+
+/* CRC-32C of A followed by B, from crc(A), crc(B) and the length of B */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+#endif // _CRC_H
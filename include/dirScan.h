@@ -0,0 +1,54 @@
+/*
+ * dirScan.h - Directory enumeration on raw getdents64 buffers (header file)
+ */
+
+#ifndef _DIRSCAN_H
+#define _DIRSCAN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct {
+	int fd;			// The directory, for the *at() calls on its entries
+	char *buf;		// getdents64 records
+	size_t pos;
+	size_t len;
+	off_t off;		// Position after the last returned entry
+} DirScan;
+
+typedef struct {
+	const char *name;	// Points into the scan buffer, valid until the next dirScanNext()
+	size_t len;
+	ino_t ino;
+	unsigned char type;	// DT_*, DT_UNKNOWN when the filesystem does not tell
+} DirEntry;
+
+// Fields asked from dirScanStat(), the others are left zero
+#define DIRSCAN_MODE	0x01	// st_mode (type and permissions)
+#define DIRSCAN_NLINK	0x02
+#define DIRSCAN_OWNER	0x04	// st_uid, st_gid
+#define DIRSCAN_SIZE	0x08	// st_size, st_blocks
+#define DIRSCAN_TIMES	0x10	// st_atim, st_mtim, st_ctim
+#define DIRSCAN_INO	0x20	// st_dev, st_ino
+#define DIRSCAN_ALL	0x3f
+
+/* Open a directory relative to dirfd (AT_FDCWD for the working directory) */
+int dirScanOpenAt(DirScan *ds, int dirfd, const char *path);	// return: 0->true, -1->false (errno)
+
+/* Next entry, "." and ".." included */
+int dirScanNext(DirScan *ds, DirEntry *ent);	// return: 1->entry, 0->end, -1->error (errno)
+
+/* Position after the last returned entry, for dirScanSeek() */
+off_t dirScanTell(const DirScan *ds);
+
+/* Continue a scan from a dirScanTell() position, also on a reopened descriptor of the directory */
+int dirScanSeek(DirScan *ds, off_t pos);	// return: 0->true, -1->false (errno)
+
+/* Close the directory and free the buffer */
+void dirScanClose(DirScan *ds);
+
+/* lstat() of name relative to dirfd that only fetches the DIRSCAN_* fields (statx) */
+int dirScanStat(int dirfd, const char *name, unsigned fields, struct stat *st);	// return: 0->true, -1->false (errno)
+
+#endif // _DIRSCAN_H
@@ -0,0 +1,44 @@
+/*
+ * eol.h - Line ending conversion (header file)
+ */
+
+#ifndef _EOL_H
+#define _EOL_H
+
+#include <stddef.h>
+
+typedef enum {
+	EOL_DOS2UNIX,	// CRLF -> LF, a lone CR -> LF
+	EOL_MAC2UNIX,	// A lone CR -> LF, CRLF is kept
+	EOL_UNIX2DOS,	// LF -> CRLF, CRLF is kept
+	EOL_MARK,	// '$' before every LF (cat -e)
+} EolMode;
+
+// Conversion state carried from one block to the next
+typedef struct {
+	EolMode mode;
+	int prev_cr;	// The input byte before the block was a CR
+	int held_cr;	// MAC2UNIX: a CR ended the last block, its output depends on the next byte
+} EolState;
+
+/* Start a conversion */
+void eolInit(EolState *st, EolMode mode);
+
+/*
+ * Size of the converted block without converting it; final: the block
+ * ends the input. *changes gets the number of bytes rewritten, dropped or
+ * inserted before, 0 when the block comes out unchanged.
+ */
+size_t eolConvertedLen(const EolState *st, const unsigned char *in, size_t len, int final, size_t *changes);	// return: bytes eolConvert() writes
+
+/* Convert a block, out needs eolConvertedLen() bytes and must not overlap in */
+size_t eolConvert(EolState *st, const unsigned char *in, size_t len, unsigned char *out, int final);	// return: bytes written
+
+/*
+ * Convert a whole input in place. buf holds len bytes of input; growing
+ * modes need out_len = eolConvertedLen() bytes of room and fill it
+ * backwards, the others ignore out_len.
+ */
+size_t eolConvertInPlace(EolMode mode, unsigned char *buf, size_t len, size_t out_len);	// return: converted length
+
+#endif // _EOL_H
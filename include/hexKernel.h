@@ -0,0 +1,19 @@
+/*
+ * hexKernel.h - Bulk hex encoding and decoding (header file)
+ */
+
+#ifndef _HEXKERNEL_H
+#define _HEXKERNEL_H
+
+#include <stddef.h>
+
+/* Two hex digits per byte, the output is not terminated */
+void hexEncode(const unsigned char *in, size_t len, char *out, int upper);	// Non-return, 2 * len characters->@arg3
+
+/* Decode digit pairs up to the first character that is not a hex digit */
+size_t hexDecode(const char *in, size_t len, unsigned char *out, size_t *used);	// return: bytes written, characters consumed->@arg4
+
+/* Value of one hex digit */
+int hexValue(unsigned char c);	// return: 0..15, -1->not a hex digit
+
+#endif // _HEXKERNEL_H
@@ -35,4 +35,7 @@ void free_group_info(group_info_t *info);
 uid_t getuid_name(const char *name);
 gid_t getgid_name(const char *name);
 
+// Group IDs of a user, the primary group first (free with xfree)
+gid_t *get_user_groups(const char *username, int *count);
+
 #endif /* USERINFO_H */
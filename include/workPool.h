@@ -0,0 +1,36 @@
+/*
+ * workPool.h - Work-stealing thread pool (header file)
+ */
+
+#ifndef _WORKPOOL_H
+#define _WORKPOOL_H
+
+#include <stddef.h>
+
+typedef struct WorkPool WorkPool;
+
+// Task function, runs on one of the pool threads
+typedef void (*workFunc)(void *arg);
+
+/* Resolve a thread count, <= 0 means the number of usable CPUs */
+int workPoolThreads(int requested);	// return: always >= 1
+
+/* Create a pool with N worker threads */
+WorkPool *workPoolCreate(int nthreads);	// return: NULL->false, other->true
+
+/* Number of worker threads actually started, 0 if none could be */
+int workPoolSize(const WorkPool *pool);
+
+/* Queue a task (tasks may queue more tasks, they go to the worker's own deque) */
+void workPoolSubmit(WorkPool *pool, workFunc fn, void *arg);
+
+/* Wait until every queued task (including nested ones) finished, the caller helps */
+void workPoolWait(WorkPool *pool);
+
+/* Stop and free a pool, pending tasks are still executed */
+void workPoolDestroy(WorkPool *pool);
+
+/* Index of the calling worker in its pool, -1 if not a pool thread */
+int workPoolSelf(void);
+
+#endif // _WORKPOOL_H
@@ -0,0 +1,39 @@
+/*
+ * xxhash.h - XXH3 64-bit and 128-bit hashes (header file)
+ */
+
+#ifndef _XXHASH_H
+#define _XXHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define XXH3_SECRET_SIZE	192
+#define XXH3_BUFFER_SIZE	256
+#define XXH3_ACC_NB		8
+
+typedef struct {
+	uint64_t low64;
+	uint64_t high64;
+} XXH128_hash_t;
+
+// Streaming state, shared by the 64-bit and 128-bit digests
+typedef struct {
+	uint64_t acc[XXH3_ACC_NB] __attribute__((aligned(64)));
+	uint8_t buffer[XXH3_BUFFER_SIZE] __attribute__((aligned(64)));
+	size_t buffered;		// Bytes in buffer
+	size_t stripes_so_far;		// Stripes of the current block already accumulated
+	uint64_t total_len;
+} XXH3_state_t;
+
+/* One-shot hashes with the default secret and seed 0 */
+uint64_t XXH3_64bits(const void *input, size_t len);
+XXH128_hash_t XXH3_128bits(const void *input, size_t len);
+
+/* Streaming: reset, feed any number of times, then take one or both digests */
+void XXH3_reset(XXH3_state_t *state);
+void XXH3_update(XXH3_state_t *state, const void *input, size_t len);
+uint64_t XXH3_64bits_digest(const XXH3_state_t *state);
+XXH128_hash_t XXH3_128bits_digest(const XXH3_state_t *state);
+
+#endif // _XXHASH_H
@@ -0,0 +1,477 @@
+/*
+ * base64Kernel.c - Base64 (RFC 4648) block encoder and decoder
+ *
+ * The bulk of the data goes through vector kernels picked once at runtime:
+ *   x86: AVX2 (24 bytes <-> 32 characters) or SSSE3 (12 <-> 16), the
+ *        shuffle / multiply-add formulation of Mula and Lemire. Decoding
+ *        validates a whole register with two nibble lookups.
+ *   AArch64: NEON with de-interleaving loads (48 bytes <-> 64 characters)
+ *        and 64-byte table lookups.
+ * The decoder runs the kernel over the clean stretches between line breaks
+ * and takes a scalar path for the few characters around them (whitespace,
+ * '=' padding, garbage), a group may straddle calls. A vectorized
+ * whitespace count lets callers cut encoded text on group boundaries.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define B64_X86 1
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+# define B64_ARM 1
+#endif
+
+#include "base64.h"
+#include "debug.h"
+
+static const char b64_alphabet[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Value of each character, -1: not in the alphabet
+static int8_t b64_value[256];
+
+/*
+ * Kernels: encode whole vectors of input and return the bytes consumed,
+ * decode while every character of a vector is in the alphabet and return
+ * the characters consumed (*produced: bytes written).
+ */
+typedef size_t (*b64_encode_fn)(const unsigned char *in, size_t len, char *out);
+typedef size_t (*b64_decode_fn)(const unsigned char *in, size_t len, unsigned char *out, size_t *produced);
+// Count whitespace over whole vectors, return: characters examined
+typedef size_t (*b64_space_fn)(const unsigned char *in, size_t len, size_t *spaces);
+
+static b64_encode_fn b64_encode_kernel;
+static b64_decode_fn b64_decode_kernel;
+static b64_space_fn b64_space_kernel;
+static pthread_once_t b64_once = PTHREAD_ONCE_INIT;
+
+static size_t encode_none(const unsigned char *in, size_t len, char *out) {
+	(void)in;
+	(void)len;
+	(void)out;
+	return 0;
+}
+
+static size_t decode_none(const unsigned char *in, size_t len, unsigned char *out, size_t *produced) {
+	(void)in;
+	(void)len;
+	(void)out;
+	*produced = 0;
+	return 0;
+}
+
+static size_t space_none(const unsigned char *in, size_t len, size_t *spaces) {
+	(void)in;
+	(void)len;
+	*spaces = 0;
+	return 0;
+}
+
+#ifdef B64_X86
+/* 12 bytes in the low lanes -> 16 index bytes (0..63) */
+__attribute__((target("ssse3")))
+static inline __m128i enc_indices_ssse3(__m128i in) {
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
+
+/* Indices -> ASCII: one shuffle picks the offset of the index range */
+__attribute__((target("ssse3")))
+static inline __m128i enc_ascii_ssse3(__m128i idx) {
+	const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+	return _mm_add_epi8(_mm_shuffle_epi8(shift, r), idx);
+}
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const unsigned char *in, size_t len, char *out) {
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 12, out += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)out, enc_ascii_ssse3(enc_indices_ssse3(v)));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const unsigned char *in, size_t len, char *out) {
+	const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+			1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	size_t i = 0;
+
+	// 12 bytes per 128-bit lane, the second lane is loaded from in + 12
+	for (; i + 28 <= len; i += 24, out += 32) {
+		__m256i v = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+				_mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+		v = _mm256_shuffle_epi8(v, shuf);
+		__m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+		__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		__m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+		__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		__m256i idx = _mm256_or_si256(t1, t3);
+
+		__m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+		__m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+		r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+		_mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(_mm256_shuffle_epi8(shift, r), idx));
+	}
+	return i;
+}
+
+/*
+ * Decoding: the high and low nibble of each character index two tables
+ * whose AND is non-zero exactly for characters outside the alphabet, a
+ * third table gives the offset from ASCII to the 6-bit value.
+ */
+#define B64_LUT_LO	0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+			0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define B64_LUT_HI	0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+			0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define B64_LUT_ROLL	0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const unsigned char *in, size_t len, unsigned char *out, size_t *produced) {
+	const __m128i lut_lo = _mm_setr_epi8(B64_LUT_LO);
+	const __m128i lut_hi = _mm_setr_epi8(B64_LUT_HI);
+	const __m128i lut_roll = _mm_setr_epi8(B64_LUT_ROLL);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t i = 0, o = 0;
+
+	// The 16-byte store writes 4 bytes past the 12 decoded ones
+	for (; i + 24 <= len; i += 16, o += 12) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i hi_nib = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0f));
+		__m128i lo_nib = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+		__m128i lo = _mm_shuffle_epi8(lut_lo, lo_nib);
+		__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nib);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff) {
+			break;
+		}
+
+		__m128i eq_slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+		__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_slash, hi_nib));
+		v = _mm_add_epi8(v, roll);
+
+		// Four 6-bit values -> 24 bits per 32-bit lane, then drop the top bytes
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i *)(out + o), _mm_shuffle_epi8(v, pack));
+	}
+	*produced = o;
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const unsigned char *in, size_t len, unsigned char *out, size_t *produced) {
+	const __m256i lut_lo = _mm256_setr_epi8(B64_LUT_LO, B64_LUT_LO);
+	const __m256i lut_hi = _mm256_setr_epi8(B64_LUT_HI, B64_LUT_HI);
+	const __m256i lut_roll = _mm256_setr_epi8(B64_LUT_ROLL, B64_LUT_ROLL);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+	size_t i = 0, o = 0;
+
+	// The 32-byte store writes 8 bytes past the 24 decoded ones
+	for (; i + 44 <= len; i += 32, o += 24) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i hi_nib = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+		__m256i lo_nib = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nib);
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nib);
+		if (!_mm256_testz_si256(lo, hi)) {
+			break;
+		}
+
+		__m256i eq_slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+		__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_slash, hi_nib));
+		v = _mm256_add_epi8(v, roll);
+
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		_mm256_storeu_si256((__m256i *)(out + o), _mm256_permutevar8x32_epi32(v, join));
+	}
+	*produced = o;
+	return i;
+}
+
+/* Whitespace is ' ' and '\t'..'\r': c - 9 <= 4 unsigned */
+__attribute__((target("sse2")))
+static size_t space_sse2(const unsigned char *in, size_t len, size_t *spaces) {
+	size_t i = 0, n = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i t = _mm_sub_epi8(v, _mm_set1_epi8(9));
+		__m128i ws = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+		n += __builtin_popcount(_mm_movemask_epi8(ws));
+	}
+	*spaces = n;
+	return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t space_avx2(const unsigned char *in, size_t len, size_t *spaces) {
+	size_t i = 0, n = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+		__m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+		n += __builtin_popcount((uint32_t)_mm256_movemask_epi8(ws));
+	}
+	*spaces = n;
+	return i;
+}
+#endif
+
+#ifdef B64_ARM
+static size_t encode_neon(const unsigned char *in, size_t len, char *out) {
+	uint8x16x4_t tbl;
+	size_t i = 0;
+
+	for (int k = 0; k < 4; k++) {
+		tbl.val[k] = vld1q_u8((const uint8_t *)b64_alphabet + 16 * k);
+	}
+	for (; i + 48 <= len; i += 48, out += 64) {
+		uint8x16x3_t v = vld3q_u8(in + i);
+		uint8x16x4_t r;
+		const uint8x16_t m = vdupq_n_u8(0x3f);
+
+		r.val[0] = vshrq_n_u8(v.val[0], 2);
+		r.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 4), vshrq_n_u8(v.val[1], 4)), m);
+		r.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1], 2), vshrq_n_u8(v.val[2], 6)), m);
+		r.val[3] = vandq_u8(v.val[2], m);
+		for (int k = 0; k < 4; k++) {
+			r.val[k] = vqtbl4q_u8(tbl, r.val[k]);
+		}
+		vst4q_u8((uint8_t *)out, r);
+	}
+	return i;
+}
+
+static size_t decode_neon(const unsigned char *in, size_t len, unsigned char *out, size_t *produced) {
+	uint8x16x4_t lo, hi;
+	size_t i = 0, o = 0;
+
+	// b64_value as unsigned bytes: 0xff for characters outside the alphabet
+	for (int k = 0; k < 4; k++) {
+		lo.val[k] = vld1q_u8((const uint8_t *)b64_value + 16 * k);
+		hi.val[k] = vld1q_u8((const uint8_t *)b64_value + 64 + 16 * k);
+	}
+	for (; i + 64 <= len; i += 64, o += 48) {
+		uint8x16x4_t v = vld4q_u8(in + i);
+		uint8x16_t bad = vdupq_n_u8(0);
+
+		for (int k = 0; k < 4; k++) {
+			uint8x16_t c = v.val[k];
+			uint8x16_t r = vqtbl4q_u8(lo, c);			// 0..63, 0 above
+			r = vqtbx4q_u8(r, hi, veorq_u8(c, vdupq_n_u8(0x40)));	// 64..127
+			v.val[k] = r;
+			bad = vorrq_u8(bad, vorrq_u8(r, c));
+		}
+		if (vmaxvq_u8(bad) & 0x80) {
+			break;
+		}
+
+		uint8x16x3_t r;
+		r.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+		r.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+		r.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+		vst3q_u8(out + o, r);
+	}
+	*produced = o;
+	return i;
+}
+
+static size_t space_neon(const unsigned char *in, size_t len, size_t *spaces) {
+	size_t i = 0, n = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(in + i);
+		uint8x16_t ws = vorrq_u8(vcleq_u8(vsubq_u8(v, vdupq_n_u8(9)), vdupq_n_u8(4)),
+				vceqq_u8(v, vdupq_n_u8(' ')));
+		n += vaddvq_u8(vandq_u8(ws, vdupq_n_u8(1)));
+	}
+	*spaces = n;
+	return i;
+}
+#endif
+
+static void b64_init(void) {
+	memset(b64_value, -1, sizeof(b64_value));
+	for (int i = 0; i < 64; i++) {
+		b64_value[(unsigned char)b64_alphabet[i]] = i;
+	}
+
+	b64_encode_kernel = encode_none;
+	b64_decode_kernel = decode_none;
+	b64_space_kernel = space_none;
+#if defined(B64_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		b64_encode_kernel = encode_avx2;
+		b64_decode_kernel = decode_avx2;
+		b64_space_kernel = space_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		b64_encode_kernel = encode_ssse3;
+		b64_decode_kernel = decode_ssse3;
+	}
+	if (b64_space_kernel == space_none && __builtin_cpu_supports("sse2")) {
+		b64_space_kernel = space_sse2;
+	}
+#elif defined(B64_ARM)
+	b64_encode_kernel = encode_neon;
+	b64_decode_kernel = decode_neon;
+	b64_space_kernel = space_neon;
+#endif
+	LOG("base64 kernel: %s\n", b64_encode_kernel == encode_none ? "scalar" : "vector");
+}
+
+size_t base64Encode(const unsigned char *in, size_t len, char *out) {
+	pthread_once(&b64_once, b64_init);
+
+	size_t i = b64_encode_kernel(in, len, out);
+	char *o = out + i / 3 * 4;
+
+	for (; i + 3 <= len; i += 3, o += 4) {
+		uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+		o[0] = b64_alphabet[v >> 18];
+		o[1] = b64_alphabet[(v >> 12) & 0x3f];
+		o[2] = b64_alphabet[(v >> 6) & 0x3f];
+		o[3] = b64_alphabet[v & 0x3f];
+	}
+	if (i < len) {
+		uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0);
+		o[0] = b64_alphabet[v >> 18];
+		o[1] = b64_alphabet[(v >> 12) & 0x3f];
+		o[2] = i + 1 < len ? b64_alphabet[(v >> 6) & 0x3f] : '=';
+		o[3] = '=';
+		o += 4;
+	}
+	return o - out;
+}
+
+void base64DecodeInit(Base64Decoder *dec, int ignore_garbage) {
+	pthread_once(&b64_once, b64_init);
+	dec->n = 0;
+	dec->ignore_garbage = ignore_garbage;
+}
+
+// Whole groups of alphabet characters, return: characters consumed
+static size_t decode_bulk(const unsigned char *in, size_t len, unsigned char *out, size_t *produced) {
+	size_t o;
+	size_t i = b64_decode_kernel(in, len, out, &o);
+
+	for (; i + 4 <= len; i += 4, o += 3) {
+		int a = b64_value[in[i]], b = b64_value[in[i + 1]];
+		int c = b64_value[in[i + 2]], d = b64_value[in[i + 3]];
+		if ((a | b | c | d) < 0) {
+			break;
+		}
+		uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+		out[o] = v >> 16;
+		out[o + 1] = v >> 8;
+		out[o + 2] = v;
+	}
+	*produced = o;
+	return i;
+}
+
+// A complete group, possibly padded, return: bytes written
+static int decode_quad(const unsigned char q[4], unsigned char *out) {
+	uint32_t v = (uint32_t)b64_value[q[0]] << 18 | (uint32_t)b64_value[q[1]] << 12;
+
+	if (q[2] == '=') {
+		out[0] = v >> 16;
+		return 1;
+	}
+	v |= (uint32_t)b64_value[q[2]] << 6;
+	if (q[3] == '=') {
+		out[0] = v >> 16;
+		out[1] = v >> 8;
+		return 2;
+	}
+	v |= (uint32_t)b64_value[q[3]];
+	out[0] = v >> 16;
+	out[1] = v >> 8;
+	out[2] = v;
+	return 3;
+}
+
+static int is_space(unsigned char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+ssize_t base64DecodeBlock(Base64Decoder *dec, const char *text, size_t len, unsigned char *out, size_t *bad) {
+	const unsigned char *in = (const unsigned char *)text;
+	size_t i = 0, o = 0;
+
+	while (i < len) {
+		if (dec->n == 0) {
+			size_t produced;
+			i += decode_bulk(in + i, len - i, out + o, &produced);
+			o += produced;
+			if (i == len) {
+				break;
+			}
+		}
+
+		// Around line breaks, padding and garbage
+		unsigned char c = in[i++];
+		int padded = dec->n > 0 && dec->quad[dec->n - 1] == '=';
+		if (b64_value[c] >= 0 && !padded) {
+			dec->quad[dec->n++] = c;
+		} else if (c == '=' && dec->n >= 2) {
+			dec->quad[dec->n++] = c;
+		} else if (is_space(c)) {
+			continue;
+		} else if (dec->ignore_garbage) {
+			continue;
+		} else {
+			*bad = i - 1;
+			return -1;
+		}
+
+		if (dec->n == 4) {
+			o += decode_quad(dec->quad, out + o);
+			dec->n = 0;
+		}
+	}
+	return o;
+}
+
+size_t base64TextLen(const char *text, size_t len) {
+	const unsigned char *in = (const unsigned char *)text;
+	size_t spaces;
+
+	pthread_once(&b64_once, b64_init);
+	size_t i = b64_space_kernel(in, len, &spaces);
+	for (; i < len; i++) {
+		spaces += is_space(in[i]);
+	}
+	return len - spaces;
+}
+
+int base64DecodeFinish(const Base64Decoder *dec) {
+	return dec->n == 0 || dec->ignore_garbage ? 0 : -1;
+}
@@ -0,0 +1,586 @@
+/*
+ * blake3.c - BLAKE3 hash
+ *
+ * Streaming hasher after the reference implementation: a chunk state plus a
+ * stack of subtree chaining values. Runs of whole chunks are hashed as
+ * complete subtrees, several chunks (and later several parents) at a time:
+ * each SIMD lane holds the state of a different chunk, so the compression
+ * function itself stays plain 32-bit arithmetic.
+ *
+ * The multi-lane kernel is written once with GCC vector types and compiled
+ * for SSE4.1 (4 lanes), AVX2 (8 lanes) and AVX-512 (16 lanes) on x86, NEON
+ * (4 lanes) on AArch64, picked at runtime from the CPU features.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "blake3.h"
+#include "debug.h"
+
+// Domain flags
+#define B3_CHUNK_START	(1 << 0)
+#define B3_CHUNK_END	(1 << 1)
+#define B3_PARENT	(1 << 2)
+#define B3_ROOT		(1 << 3)
+
+// Widest kernel
+#define B3_MAX_LANES	16
+
+// Largest subtree hashed in one go by blake3_hasher_update(), its CVs live on the stack
+#define B3_UPDATE_CHUNKS	256
+
+static const uint32_t b3_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// Message word order of each of the 7 rounds
+static const uint8_t b3_schedule[7][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+// Rotate right, the vector kernels pass byte shuffles for 16 and 8
+#define B3_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define B3_G(v, a, b, c, d, x, y, rot16, rot8) do { \
+	v[a] = v[a] + v[b] + (x); \
+	v[d] = rot16(v[d] ^ v[a]); \
+	v[c] = v[c] + v[d]; \
+	v[b] = B3_ROTR(v[b] ^ v[c], 12); \
+	v[a] = v[a] + v[b] + (y); \
+	v[d] = rot8(v[d] ^ v[a]); \
+	v[c] = v[c] + v[d]; \
+	v[b] = B3_ROTR(v[b] ^ v[c], 7); \
+} while (0)
+
+#define B3_ROUND(v, m, s, rot16, rot8) do { \
+	B3_G(v, 0, 4, 8, 12, m[(s)[0]], m[(s)[1]], rot16, rot8); \
+	B3_G(v, 1, 5, 9, 13, m[(s)[2]], m[(s)[3]], rot16, rot8); \
+	B3_G(v, 2, 6, 10, 14, m[(s)[4]], m[(s)[5]], rot16, rot8); \
+	B3_G(v, 3, 7, 11, 15, m[(s)[6]], m[(s)[7]], rot16, rot8); \
+	B3_G(v, 0, 5, 10, 15, m[(s)[8]], m[(s)[9]], rot16, rot8); \
+	B3_G(v, 1, 6, 11, 12, m[(s)[10]], m[(s)[11]], rot16, rot8); \
+	B3_G(v, 2, 7, 8, 13, m[(s)[12]], m[(s)[13]], rot16, rot8); \
+	B3_G(v, 3, 4, 9, 14, m[(s)[14]], m[(s)[15]], rot16, rot8); \
+} while (0)
+
+// All 7 rounds unrolled, so the schedule lookups fold to constants
+#define B3_ROUNDS(v, m, rot16, rot8) do { \
+	B3_ROUND(v, m, b3_schedule[0], rot16, rot8); \
+	B3_ROUND(v, m, b3_schedule[1], rot16, rot8); \
+	B3_ROUND(v, m, b3_schedule[2], rot16, rot8); \
+	B3_ROUND(v, m, b3_schedule[3], rot16, rot8); \
+	B3_ROUND(v, m, b3_schedule[4], rot16, rot8); \
+	B3_ROUND(v, m, b3_schedule[5], rot16, rot8); \
+	B3_ROUND(v, m, b3_schedule[6], rot16, rot8); \
+} while (0)
+
+#define B3_ROTR16(x) B3_ROTR(x, 16)
+#define B3_ROTR8(x) B3_ROTR(x, 8)
+
+// Hash n inputs of `blocks` blocks each, write one 32-byte CV per input
+typedef void (*b3_many_fn)(const uint8_t *const *inputs, size_t n, size_t blocks,
+		const uint32_t key[8], uint64_t counter, int increment,
+		uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out);
+
+static b3_many_fn b3_hash_many;
+static size_t b3_lanes;
+static pthread_once_t b3_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t load_le32(const uint8_t *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void store_le32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+// Run the 7 rounds, v[] is the full 16-word state afterwards
+static void b3_compress_pre(uint32_t v[16], const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+		uint8_t block_len, uint64_t counter, uint8_t flags) {
+	uint32_t m[16];
+
+	for (int i = 0; i < 16; i++) {
+		m[i] = load_le32(block + 4 * i);
+	}
+	memcpy(v, cv, 8 * sizeof(uint32_t));
+	v[8] = b3_iv[0];
+	v[9] = b3_iv[1];
+	v[10] = b3_iv[2];
+	v[11] = b3_iv[3];
+	v[12] = (uint32_t)counter;
+	v[13] = (uint32_t)(counter >> 32);
+	v[14] = block_len;
+	v[15] = flags;
+
+	B3_ROUNDS(v, m, B3_ROTR16, B3_ROTR8);
+}
+
+static void b3_compress_in_place(uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+		uint8_t block_len, uint64_t counter, uint8_t flags) {
+	uint32_t v[16];
+
+	b3_compress_pre(v, cv, block, block_len, counter, flags);
+	for (int i = 0; i < 8; i++) {
+		cv[i] = v[i] ^ v[i + 8];
+	}
+}
+
+// Portable kernel: one input after the other
+static void b3_hash_many_portable(const uint8_t *const *inputs, size_t n, size_t blocks,
+		const uint32_t key[8], uint64_t counter, int increment,
+		uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out) {
+	for (size_t i = 0; i < n; i++) {
+		uint32_t cv[8];
+		uint8_t block_flags = flags | flags_start;
+
+		memcpy(cv, key, sizeof(cv));
+		for (size_t b = 0; b < blocks; b++) {
+			if (b + 1 == blocks) {
+				block_flags |= flags_end;
+			}
+			b3_compress_in_place(cv, inputs[i] + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, counter, block_flags);
+			block_flags = flags;
+		}
+		for (int w = 0; w < 8; w++) {
+			store_le32(out + i * BLAKE3_OUT_LEN + 4 * w, cv[w]);
+		}
+		if (increment) {
+			counter++;
+		}
+	}
+}
+
+/*
+ * Multi-lane kernel, lane l hashes inputs[l]. Lanes past n repeat input 0
+ * and are not stored. load(m, in, offset) fills the 16 message vectors
+ * (word w of every lane in m[w]), rot16/rot8 are byte shuffles.
+ */
+#define B3_HASH_MANY(name, vec, lanes, load, rot16, rot8) \
+static void name(const uint8_t *const *inputs, size_t n, size_t blocks, \
+		const uint32_t key[8], uint64_t counter, int increment, \
+		uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out) { \
+	const uint8_t *in[lanes]; \
+	vec h[8], v[16], m[16], ctr_lo, ctr_hi; \
+	uint32_t words[8][lanes]; \
+	\
+	for (int l = 0; l < (lanes); l++) { \
+		uint64_t c = counter + (increment ? (uint64_t)l : 0); \
+		in[l] = inputs[(size_t)l < n ? l : 0]; \
+		ctr_lo[l] = (uint32_t)c; \
+		ctr_hi[l] = (uint32_t)(c >> 32); \
+	} \
+	for (int i = 0; i < 8; i++) { \
+		h[i] = (vec){ 0 } + key[i]; \
+	} \
+	\
+	for (size_t b = 0; b < blocks; b++) { \
+		uint32_t block_flags = flags | (b == 0 ? flags_start : 0) | (b + 1 == blocks ? flags_end : 0); \
+		\
+		load(m, in, b * BLAKE3_BLOCK_LEN); \
+		for (int i = 0; i < 8; i++) { \
+			v[i] = h[i]; \
+		} \
+		v[8] = (vec){ 0 } + b3_iv[0]; \
+		v[9] = (vec){ 0 } + b3_iv[1]; \
+		v[10] = (vec){ 0 } + b3_iv[2]; \
+		v[11] = (vec){ 0 } + b3_iv[3]; \
+		v[12] = ctr_lo; \
+		v[13] = ctr_hi; \
+		v[14] = (vec){ 0 } + (uint32_t)BLAKE3_BLOCK_LEN; \
+		v[15] = (vec){ 0 } + block_flags; \
+		\
+		B3_ROUNDS(v, m, rot16, rot8); \
+		for (int i = 0; i < 8; i++) { \
+			h[i] = v[i] ^ v[i + 8]; \
+		} \
+	} \
+	\
+	memcpy(words, h, sizeof(words)); \
+	for (size_t l = 0; l < n && l < (lanes); l++) { \
+		for (int w = 0; w < 8; w++) { \
+			store_le32(out + l * BLAKE3_OUT_LEN + 4 * w, words[w][l]); \
+		} \
+	} \
+}
+
+/*
+ * The vector kernels load whole rows and transpose them, which relies on a
+ * little-endian layout (true for every target they are built for).
+ */
+typedef uint32_t b3_vec4 __attribute__((vector_size(16)));
+typedef uint8_t b3_bytes16 __attribute__((vector_size(16)));
+
+#define B3_ROT16_4(x) ((b3_vec4)__builtin_shuffle((b3_bytes16)(x), \
+	(b3_bytes16){ 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13 }))
+#define B3_ROT8_4(x) ((b3_vec4)__builtin_shuffle((b3_bytes16)(x), \
+	(b3_bytes16){ 1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12 }))
+
+// 4x4 transposes of 16-byte rows: m[4j + w] holds word 4j + w of every lane
+#define B3_LOAD4_BODY \
+	for (int j = 0; j < 4; j++) { \
+		b3_vec4 r0, r1, r2, r3; \
+		memcpy(&r0, in[0] + offset + 16 * j, 16); \
+		memcpy(&r1, in[1] + offset + 16 * j, 16); \
+		memcpy(&r2, in[2] + offset + 16 * j, 16); \
+		memcpy(&r3, in[3] + offset + 16 * j, 16); \
+		b3_vec4 lo01 = __builtin_shuffle(r0, r1, (b3_vec4){ 0, 4, 1, 5 }); \
+		b3_vec4 hi01 = __builtin_shuffle(r0, r1, (b3_vec4){ 2, 6, 3, 7 }); \
+		b3_vec4 lo23 = __builtin_shuffle(r2, r3, (b3_vec4){ 0, 4, 1, 5 }); \
+		b3_vec4 hi23 = __builtin_shuffle(r2, r3, (b3_vec4){ 2, 6, 3, 7 }); \
+		m[4 * j + 0] = __builtin_shuffle(lo01, lo23, (b3_vec4){ 0, 1, 4, 5 }); \
+		m[4 * j + 1] = __builtin_shuffle(lo01, lo23, (b3_vec4){ 2, 3, 6, 7 }); \
+		m[4 * j + 2] = __builtin_shuffle(hi01, hi23, (b3_vec4){ 0, 1, 4, 5 }); \
+		m[4 * j + 3] = __builtin_shuffle(hi01, hi23, (b3_vec4){ 2, 3, 6, 7 }); \
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef uint32_t b3_vec8 __attribute__((vector_size(32)));
+typedef uint8_t b3_bytes32 __attribute__((vector_size(32)));
+
+#define B3_ROT16_8(x) ((b3_vec8)__builtin_shuffle((b3_bytes32)(x), (b3_bytes32){ \
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, \
+	18, 19, 16, 17, 22, 23, 20, 21, 26, 27, 24, 25, 30, 31, 28, 29 }))
+#define B3_ROT8_8(x) ((b3_vec8)__builtin_shuffle((b3_bytes32)(x), (b3_bytes32){ \
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12, \
+	17, 18, 19, 16, 21, 22, 23, 20, 25, 26, 27, 24, 29, 30, 31, 28 }))
+
+__attribute__((target("sse4.1")))
+static inline void b3_load4(b3_vec4 *m, const uint8_t *const *in, size_t offset) {
+	B3_LOAD4_BODY
+}
+
+// 8x8 transposes of 32-byte rows: unpack 32-bit, unpack 64-bit, swap 128-bit halves
+__attribute__((target("avx2")))
+static inline void b3_load8(b3_vec8 *m, const uint8_t *const *in, size_t offset) {
+	for (int j = 0; j < 2; j++) {
+		b3_vec8 r[8], a[8], b[8];
+		for (int l = 0; l < 8; l++) {
+			memcpy(&r[l], in[l] + offset + 32 * j, 32);
+		}
+		for (int l = 0; l < 8; l += 2) {
+			a[l] = __builtin_shuffle(r[l], r[l + 1], (b3_vec8){ 0, 8, 1, 9, 4, 12, 5, 13 });
+			a[l + 1] = __builtin_shuffle(r[l], r[l + 1], (b3_vec8){ 2, 10, 3, 11, 6, 14, 7, 15 });
+		}
+		for (int l = 0; l < 8; l += 4) {
+			b[l] = __builtin_shuffle(a[l], a[l + 2], (b3_vec8){ 0, 1, 8, 9, 4, 5, 12, 13 });
+			b[l + 1] = __builtin_shuffle(a[l], a[l + 2], (b3_vec8){ 2, 3, 10, 11, 6, 7, 14, 15 });
+			b[l + 2] = __builtin_shuffle(a[l + 1], a[l + 3], (b3_vec8){ 0, 1, 8, 9, 4, 5, 12, 13 });
+			b[l + 3] = __builtin_shuffle(a[l + 1], a[l + 3], (b3_vec8){ 2, 3, 10, 11, 6, 7, 14, 15 });
+		}
+		for (int w = 0; w < 4; w++) {
+			m[8 * j + w] = __builtin_shuffle(b[w], b[w + 4], (b3_vec8){ 0, 1, 2, 3, 8, 9, 10, 11 });
+			m[8 * j + w + 4] = __builtin_shuffle(b[w], b[w + 4], (b3_vec8){ 4, 5, 6, 7, 12, 13, 14, 15 });
+		}
+	}
+}
+
+typedef uint32_t b3_vec16 __attribute__((vector_size(64)));
+
+// Two 8x8 transposes, lanes 0-7 and 8-15 of every message vector
+__attribute__((target("avx512f")))
+static inline void b3_load16(b3_vec16 *m, const uint8_t *const *in, size_t offset) {
+	b3_vec8 lo[16], hi[16];
+
+	b3_load8(lo, in, offset);
+	b3_load8(hi, in + 8, offset);
+	for (int w = 0; w < 16; w++) {
+		memcpy((uint8_t *)&m[w], &lo[w], 32);
+		memcpy((uint8_t *)&m[w] + 32, &hi[w], 32);
+	}
+}
+
+__attribute__((target("sse4.1")))
+B3_HASH_MANY(b3_hash_many_sse41, b3_vec4, 4, b3_load4, B3_ROT16_4, B3_ROT8_4)
+
+__attribute__((target("avx2")))
+B3_HASH_MANY(b3_hash_many_avx2, b3_vec8, 8, b3_load8, B3_ROT16_8, B3_ROT8_8)
+
+// AVX-512F has a rotate instruction, no byte shuffles needed
+__attribute__((target("avx512f")))
+B3_HASH_MANY(b3_hash_many_avx512, b3_vec16, 16, b3_load16, B3_ROTR16, B3_ROTR8)
+#elif defined(__aarch64__)
+static inline void b3_load4(b3_vec4 *m, const uint8_t *const *in, size_t offset) {
+	B3_LOAD4_BODY
+}
+
+B3_HASH_MANY(b3_hash_many_neon, b3_vec4, 4, b3_load4, B3_ROT16_4, B3_ROT8_4)
+#endif
+
+static void b3_init(void) {
+	b3_hash_many = b3_hash_many_portable;
+	b3_lanes = 1;
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx512f")) {
+		b3_hash_many = b3_hash_many_avx512;
+		b3_lanes = 16;
+	} else if (__builtin_cpu_supports("avx2")) {
+		b3_hash_many = b3_hash_many_avx2;
+		b3_lanes = 8;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		b3_hash_many = b3_hash_many_sse41;
+		b3_lanes = 4;
+	}
+#elif defined(__aarch64__)
+	b3_hash_many = b3_hash_many_neon;
+	b3_lanes = 4;
+#endif
+	LOG("blake3 kernel: %zu lanes\n", b3_lanes);
+}
+
+/*
+ * Hash nchunks (a power of two) whole chunks to their subtree CV. cvs is
+ * scratch for nchunks CVs, parents are reduced in place level by level.
+ */
+static void b3_subtree(const uint8_t *input, uint64_t nchunks, uint64_t counter,
+		uint8_t *cvs, uint8_t cv[BLAKE3_OUT_LEN]) {
+	const uint8_t *ptrs[B3_MAX_LANES];
+
+	for (uint64_t i = 0; i < nchunks; i += b3_lanes) {
+		size_t n = nchunks - i < b3_lanes ? nchunks - i : b3_lanes;
+		for (size_t l = 0; l < n; l++) {
+			ptrs[l] = input + (i + l) * BLAKE3_CHUNK_LEN;
+		}
+		b3_hash_many(ptrs, n, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, b3_iv, counter + i, 1,
+				0, B3_CHUNK_START, B3_CHUNK_END, cvs + i * BLAKE3_OUT_LEN);
+	}
+
+	// Two neighbouring CVs are exactly one parent block
+	for (uint64_t count = nchunks; count > 1; count /= 2) {
+		for (uint64_t i = 0; i < count / 2; i += b3_lanes) {
+			size_t n = count / 2 - i < b3_lanes ? count / 2 - i : b3_lanes;
+			for (size_t l = 0; l < n; l++) {
+				ptrs[l] = cvs + (i + l) * BLAKE3_BLOCK_LEN;
+			}
+			b3_hash_many(ptrs, n, 1, b3_iv, 0, 0, B3_PARENT, 0, 0, cvs + i * BLAKE3_OUT_LEN);
+		}
+	}
+
+	memcpy(cv, cvs, BLAKE3_OUT_LEN);
+}
+
+static void chunk_state_init(blake3_chunk_state *cs, uint64_t chunk_counter) {
+	memcpy(cs->cv, b3_iv, sizeof(cs->cv));
+	cs->chunk_counter = chunk_counter;
+	cs->buf_len = 0;
+	cs->blocks_compressed = 0;
+}
+
+static size_t chunk_state_len(const blake3_chunk_state *cs) {
+	return (size_t)cs->blocks_compressed * BLAKE3_BLOCK_LEN + cs->buf_len;
+}
+
+static uint8_t chunk_state_start_flag(const blake3_chunk_state *cs) {
+	return cs->blocks_compressed == 0 ? B3_CHUNK_START : 0;
+}
+
+static void chunk_state_update(blake3_chunk_state *cs, const uint8_t *input, size_t len) {
+	while (len > 0) {
+		// A full block is only compressed once more input shows it is not the last one
+		if (cs->buf_len == BLAKE3_BLOCK_LEN) {
+			b3_compress_in_place(cs->cv, cs->buf, BLAKE3_BLOCK_LEN, cs->chunk_counter,
+					chunk_state_start_flag(cs));
+			cs->blocks_compressed++;
+			cs->buf_len = 0;
+		}
+
+		size_t take = BLAKE3_BLOCK_LEN - cs->buf_len;
+		if (take > len) {
+			take = len;
+		}
+		memcpy(cs->buf + cs->buf_len, input, take);
+		cs->buf_len += take;
+		input += take;
+		len -= take;
+	}
+}
+
+// Inputs of the last compression of a node, kept so it can be run as root
+typedef struct {
+	uint32_t cv[8];
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	uint8_t block_len;
+	uint64_t counter;
+	uint8_t flags;
+} b3_output;
+
+static void chunk_state_output(const blake3_chunk_state *cs, b3_output *o) {
+	memcpy(o->cv, cs->cv, sizeof(o->cv));
+	memcpy(o->block, cs->buf, cs->buf_len);
+	memset(o->block + cs->buf_len, 0, BLAKE3_BLOCK_LEN - cs->buf_len);
+	o->block_len = cs->buf_len;
+	o->counter = cs->chunk_counter;
+	o->flags = chunk_state_start_flag(cs) | B3_CHUNK_END;
+}
+
+static void parent_output(const uint8_t left[BLAKE3_OUT_LEN], const uint8_t right[BLAKE3_OUT_LEN], b3_output *o) {
+	memcpy(o->cv, b3_iv, sizeof(o->cv));
+	memcpy(o->block, left, BLAKE3_OUT_LEN);
+	memcpy(o->block + BLAKE3_OUT_LEN, right, BLAKE3_OUT_LEN);
+	o->block_len = BLAKE3_BLOCK_LEN;
+	o->counter = 0;
+	o->flags = B3_PARENT;
+}
+
+static void output_cv(const b3_output *o, uint8_t cv[BLAKE3_OUT_LEN]) {
+	uint32_t words[8];
+
+	memcpy(words, o->cv, sizeof(words));
+	b3_compress_in_place(words, o->block, o->block_len, o->counter, o->flags);
+	for (int i = 0; i < 8; i++) {
+		store_le32(cv + 4 * i, words[i]);
+	}
+}
+
+// Extendable output of the root node
+static void output_root_bytes(const b3_output *o, uint8_t *out, size_t out_len) {
+	uint64_t block_counter = 0;
+
+	while (out_len > 0) {
+		uint32_t v[16];
+		uint8_t block[BLAKE3_BLOCK_LEN];
+
+		b3_compress_pre(v, o->cv, o->block, o->block_len, block_counter++, o->flags | B3_ROOT);
+		for (int i = 0; i < 8; i++) {
+			store_le32(block + 4 * i, v[i] ^ v[i + 8]);
+			store_le32(block + 32 + 4 * i, v[i + 8] ^ o->cv[i]);
+		}
+
+		size_t take = out_len < BLAKE3_BLOCK_LEN ? out_len : BLAKE3_BLOCK_LEN;
+		memcpy(out, block, take);
+		out += take;
+		out_len -= take;
+	}
+}
+
+/*
+ * Push the CV of a finished subtree; total counts finished subtrees of its
+ * size. Every completed pair of siblings is merged into their parent.
+ */
+static void hasher_push_cv(blake3_hasher *self, const uint8_t cv[BLAKE3_OUT_LEN], uint64_t total) {
+	uint8_t node[BLAKE3_OUT_LEN];
+	b3_output o;
+
+	memcpy(node, cv, BLAKE3_OUT_LEN);
+	while ((total & 1) == 0) {
+		self->cv_stack_len--;
+		parent_output(self->cv_stack + self->cv_stack_len * BLAKE3_OUT_LEN, node, &o);
+		output_cv(&o, node);
+		total >>= 1;
+	}
+	memcpy(self->cv_stack + self->cv_stack_len * BLAKE3_OUT_LEN, node, BLAKE3_OUT_LEN);
+	self->cv_stack_len++;
+}
+
+// Finish a full chunk, called once more input shows it is not the root
+static void hasher_flush_chunk(blake3_hasher *self) {
+	uint8_t cv[BLAKE3_OUT_LEN];
+	b3_output o;
+	uint64_t total = self->chunk.chunk_counter + 1;
+
+	chunk_state_output(&self->chunk, &o);
+	output_cv(&o, cv);
+	hasher_push_cv(self, cv, total);
+	chunk_state_init(&self->chunk, total);
+}
+
+void blake3_hasher_init(blake3_hasher *self) {
+	pthread_once(&b3_once, b3_init);
+	chunk_state_init(&self->chunk, 0);
+	self->cv_stack_len = 0;
+}
+
+void blake3_hasher_update(blake3_hasher *self, const void *input, size_t input_len) {
+	const uint8_t *in = input;
+	uint8_t cvs[B3_UPDATE_CHUNKS * BLAKE3_OUT_LEN];
+
+	while (input_len > 0) {
+		if (chunk_state_len(&self->chunk) == BLAKE3_CHUNK_LEN) {
+			hasher_flush_chunk(self);
+		}
+
+		// Whole aligned subtrees go to the multi-lane kernel, keep at least one byte back
+		if (chunk_state_len(&self->chunk) == 0 && input_len > BLAKE3_CHUNK_LEN) {
+			uint64_t counter = self->chunk.chunk_counter;
+			uint64_t n = (input_len - 1) / BLAKE3_CHUNK_LEN;
+
+			if (n > B3_UPDATE_CHUNKS) {
+				n = B3_UPDATE_CHUNKS;
+			}
+			while (n & (n - 1)) {
+				n &= n - 1;
+			}
+			while (counter & (n - 1)) {
+				n >>= 1;
+			}
+
+			if (n >= 2) {
+				uint8_t cv[BLAKE3_OUT_LEN];
+				b3_subtree(in, n, counter, cvs, cv);
+				hasher_push_cv(self, cv, counter / n + 1);
+				chunk_state_init(&self->chunk, counter + n);
+				in += n * BLAKE3_CHUNK_LEN;
+				input_len -= n * BLAKE3_CHUNK_LEN;
+				continue;
+			}
+		}
+
+		size_t take = BLAKE3_CHUNK_LEN - chunk_state_len(&self->chunk);
+		if (take > input_len) {
+			take = input_len;
+		}
+		chunk_state_update(&self->chunk, in, take);
+		in += take;
+		input_len -= take;
+	}
+}
+
+void blake3_hasher_add_subtree(blake3_hasher *self, const uint8_t cv[BLAKE3_OUT_LEN], uint64_t nchunks) {
+	if (chunk_state_len(&self->chunk) == BLAKE3_CHUNK_LEN) {
+		hasher_flush_chunk(self);
+	}
+
+	uint64_t counter = self->chunk.chunk_counter;
+	hasher_push_cv(self, cv, counter / nchunks + 1);
+	chunk_state_init(&self->chunk, counter + nchunks);
+}
+
+void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out, size_t out_len) {
+	b3_output o;
+
+	chunk_state_output(&self->chunk, &o);
+
+	// Walk up the right edge of the tree, the last parent is the root
+	for (int i = self->cv_stack_len - 1; i >= 0; i--) {
+		uint8_t right[BLAKE3_OUT_LEN];
+		output_cv(&o, right);
+		parent_output(self->cv_stack + i * BLAKE3_OUT_LEN, right, &o);
+	}
+
+	output_root_bytes(&o, out, out_len);
+}
+
+int blake3_subtree_cv(const void *input, size_t len, uint64_t chunk_counter, uint8_t cv[BLAKE3_OUT_LEN]) {
+	uint64_t nchunks = len / BLAKE3_CHUNK_LEN;
+	uint8_t *cvs = malloc(nchunks * BLAKE3_OUT_LEN);
+
+	if (!cvs) {
+		return -1;
+	}
+	pthread_once(&b3_once, b3_init);
+	b3_subtree(input, nchunks, chunk_counter, cvs, cv);
+	free(cvs);
+	return 0;
+}
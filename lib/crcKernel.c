@@ -0,0 +1,579 @@
+/*
+ * crcKernel.c - CRC-32 kernels
+ *
+ * CRC-32 (IEEE):
+ *   Portable path: slicing-by-16 tables, 16 bytes per iteration.
+ *   x86: PCLMULQDQ folding of 64-byte blocks (SSE4.1 + PCLMUL).
+ *   AArch64: PMULL folding of 64-byte blocks (crypto extension).
+ * CRC-32C (Castagnoli):
+ *   Portable path: slicing-by-16 tables.
+ *   x86 SSE4.2 / AArch64 CRC32 extension: the CRC32C instruction on three
+ *   interleaved streams (it has a latency of three cycles but can start
+ *   one every cycle), merged by multiplying with x^(8n) mod P.
+ * The kernels are picked once at runtime from the CPU features.
+ *
+ * crc32_combine() joins the CRCs of two adjacent blocks with arithmetic in
+ * GF(2)[x] mod P, so blocks of one file can be computed independently.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define CRC_X86 1
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+# include <sys/auxv.h>
+# define CRC_ARM 1
+# include <arm_acle.h>
+# ifndef HWCAP_PMULL
+#  define HWCAP_PMULL (1 << 4)
+# endif
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32 (1 << 7)
+# endif
+#endif
+
+#include "crc.h"
+#include "defs.h"
+#include "debug.h"
+
+// CRC32 polynomial (IEEE 802.3, reflected)
+#define CRC32_POLY 0xEDB88320
+
+// CRC32C polynomial (Castagnoli, reflected)
+#define CRC32C_POLY 0x82F63B78
+
+// Folding kernels want at least this much data
+#define CRC_FOLD_MIN 64
+
+// Interleaved stream lengths of the CRC32C instruction kernels
+#define CRC32C_LANE_LONG	8192
+#define CRC32C_LANE_SHORT	256
+
+// Tables of one polynomial
+typedef struct {
+	uint32_t poly;
+	uint32_t table[16][256];	// Slicing tables, table[0] is the classic byte-at-a-time table
+	uint32_t x2n[32];		// x^(2^n) mod P, for crc_combine()
+} crc_model_t;
+
+static crc_model_t crc32_model = { .poly = CRC32_POLY };
+static crc_model_t crc32c_model = { .poly = CRC32C_POLY };
+
+// x^(8 * lane) and x^(16 * lane) mod P, shift the first two CRC32C streams over the others
+static uint32_t crc32c_long1, crc32c_long2, crc32c_short1, crc32c_short2;
+
+// Kernels of the running CPU, work on the inverted CRC register
+static uint32_t (*crc32_kernel)(uint32_t crc, const uint8_t *p, size_t len);
+static uint32_t (*crc32c_kernel)(uint32_t crc, const uint8_t *p, size_t len);
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t load_le32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint32_t crc_bytes(const uint32_t (*t)[256], uint32_t crc, const uint8_t *p, size_t len) {
+	while (len--) {
+		crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+// Portable kernel: slicing-by-16
+static inline uint32_t crc_slice16(const uint32_t (*t)[256], uint32_t crc, const uint8_t *p, size_t len) {
+	while (len >= 16) {
+		uint32_t a = load_le32(p) ^ crc;
+		uint32_t b = load_le32(p + 4);
+		uint32_t c = load_le32(p + 8);
+		uint32_t d = load_le32(p + 12);
+
+		crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24]
+			^ t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24]
+			^ t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24]
+			^ t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+
+		p += 16;
+		len -= 16;
+	}
+
+	return crc_bytes(t, crc, p, len);
+}
+
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *p, size_t len) {
+	return crc_slice16((const uint32_t (*)[256])crc32_model.table, crc, p, len);
+}
+
+static uint32_t crc32c_slice16(uint32_t crc, const uint8_t *p, size_t len) {
+	return crc_slice16((const uint32_t (*)[256])crc32c_model.table, crc, p, len);
+}
+
+// a * b mod P, reflected bit order (x^0 is the top bit)
+static uint32_t crc_multmodp(uint32_t poly, uint32_t a, uint32_t b) {
+	uint32_t m = (uint32_t)1 << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) {
+				break;
+			}
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+	}
+	return p;
+}
+
+// x^(n * 2^k) mod P
+static uint32_t crc_x2nmodp(const crc_model_t *m, uint64_t n, unsigned k) {
+	uint32_t p = (uint32_t)1 << 31;	// x^0
+
+	while (n) {
+		if (n & 1) {
+			p = crc_multmodp(m->poly, m->x2n[k & 31], p);
+		}
+		n >>= 1;
+		k++;
+	}
+	return p;
+}
+
+/*
+ * Folding constants for the reflected polynomial, shared by PCLMUL and PMULL:
+ * x^(4*128+32) and x^(4*128-32) mod P (fold by 4), x^(128+32) and x^(128-32)
+ * mod P (fold by 1), x^64 mod P, then P' and mu for the Barrett reduction.
+ */
+static const uint64_t crc_k1k2[2] align(16) = { 0x0154442bd4, 0x01c6e41596 };
+static const uint64_t crc_k3k4[2] align(16) = { 0x01751997d0, 0x00ccaa009e };
+static const uint64_t crc_k5k0[2] align(16) = { 0x0163cd6124, 0x0000000000 };
+static const uint64_t crc_poly[2] align(16) = { 0x01db710641, 0x01f7011641 };
+
+#ifdef CRC_X86
+// Fold 4x128 bits per step, len >= 64, returns after consuming len & ~15
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold(uint32_t crc, const uint8_t *buf, size_t len) {
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	x0 = _mm_load_si128((const __m128i *)crc_k1k2);
+	buf += 64;
+	len -= 64;
+
+	// Fold by 4
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		buf += 64;
+		len -= 64;
+	}
+
+	// Fold the four lanes into one
+	x0 = _mm_load_si128((const __m128i *)crc_k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// Fold remaining 16-byte blocks
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)buf);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		buf += 16;
+		len -= 16;
+	}
+
+	// 128 -> 64 bits
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)crc_k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_load_si128((const __m128i *)crc_poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p, size_t len) {
+	if (len >= CRC_FOLD_MIN) {
+		size_t blocks = len & ~(size_t)15;
+		crc = crc32_pclmul_fold(crc, p, blocks);
+		p += blocks;
+		len -= blocks;
+	}
+	return crc32_slice16(crc, p, len);
+}
+#endif // CRC_X86
+
+#ifdef CRC_ARM
+__attribute__((target("+crypto")))
+static inline uint64x2_t pmull_lo(uint64x2_t a, uint64x2_t b) {
+	return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 0), vgetq_lane_u64(b, 0)));
+}
+
+__attribute__((target("+crypto")))
+static inline uint64x2_t pmull_hi(uint64x2_t a, uint64x2_t b) {
+	return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 1), vgetq_lane_u64(b, 1)));
+}
+
+// Low half of a times high half of b (PCLMUL immediate 0x10)
+__attribute__((target("+crypto")))
+static inline uint64x2_t pmull_lo_hi(uint64x2_t a, uint64x2_t b) {
+	return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 0), vgetq_lane_u64(b, 1)));
+}
+
+// Shift a 128-bit value right by N bytes
+#define SHR_BYTES(x, n) vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x), vdupq_n_u8(0), n))
+
+// Same folding as the PCLMUL kernel, len >= 64
+__attribute__((target("+crypto")))
+static uint32_t crc32_pmull_fold(uint32_t crc, const uint8_t *buf, size_t len) {
+	static const uint32_t mask[4] align(16) = { ~0u, 0, ~0u, 0 };
+	uint64x2_t x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = vld1q_u64((const uint64_t *)(buf + 0x00));
+	x2 = vld1q_u64((const uint64_t *)(buf + 0x10));
+	x3 = vld1q_u64((const uint64_t *)(buf + 0x20));
+	x4 = vld1q_u64((const uint64_t *)(buf + 0x30));
+	x1 = veorq_u64(x1, vreinterpretq_u64_u32(vsetq_lane_u32(crc, vdupq_n_u32(0), 0)));
+	x0 = vld1q_u64(crc_k1k2);
+	buf += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x5 = pmull_lo(x1, x0);
+		x6 = pmull_lo(x2, x0);
+		x7 = pmull_lo(x3, x0);
+		x8 = pmull_lo(x4, x0);
+
+		x1 = pmull_hi(x1, x0);
+		x2 = pmull_hi(x2, x0);
+		x3 = pmull_hi(x3, x0);
+		x4 = pmull_hi(x4, x0);
+
+		y5 = vld1q_u64((const uint64_t *)(buf + 0x00));
+		y6 = vld1q_u64((const uint64_t *)(buf + 0x10));
+		y7 = vld1q_u64((const uint64_t *)(buf + 0x20));
+		y8 = vld1q_u64((const uint64_t *)(buf + 0x30));
+
+		x1 = veorq_u64(veorq_u64(x1, x5), y5);
+		x2 = veorq_u64(veorq_u64(x2, x6), y6);
+		x3 = veorq_u64(veorq_u64(x3, x7), y7);
+		x4 = veorq_u64(veorq_u64(x4, x8), y8);
+
+		buf += 64;
+		len -= 64;
+	}
+
+	x0 = vld1q_u64(crc_k3k4);
+
+	x5 = pmull_lo(x1, x0);
+	x1 = pmull_hi(x1, x0);
+	x1 = veorq_u64(veorq_u64(x1, x2), x5);
+
+	x5 = pmull_lo(x1, x0);
+	x1 = pmull_hi(x1, x0);
+	x1 = veorq_u64(veorq_u64(x1, x3), x5);
+
+	x5 = pmull_lo(x1, x0);
+	x1 = pmull_hi(x1, x0);
+	x1 = veorq_u64(veorq_u64(x1, x4), x5);
+
+	while (len >= 16) {
+		x2 = vld1q_u64((const uint64_t *)buf);
+
+		x5 = pmull_lo(x1, x0);
+		x1 = pmull_hi(x1, x0);
+		x1 = veorq_u64(veorq_u64(x1, x2), x5);
+
+		buf += 16;
+		len -= 16;
+	}
+
+	x2 = pmull_lo_hi(x1, x0);
+	x3 = vreinterpretq_u64_u32(vld1q_u32(mask));
+	x1 = SHR_BYTES(x1, 8);
+	x1 = veorq_u64(x1, x2);
+
+	x0 = vld1q_u64(crc_k5k0);
+
+	x2 = SHR_BYTES(x1, 4);
+	x1 = vandq_u64(x1, x3);
+	x1 = pmull_lo(x1, x0);
+	x1 = veorq_u64(x1, x2);
+
+	x0 = vld1q_u64(crc_poly);
+
+	x2 = vandq_u64(x1, x3);
+	x2 = pmull_lo_hi(x2, x0);
+	x2 = vandq_u64(x2, x3);
+	x2 = pmull_lo(x2, x0);
+	x1 = veorq_u64(x1, x2);
+
+	return vgetq_lane_u32(vreinterpretq_u32_u64(x1), 1);
+}
+
+static uint32_t crc32_pmull(uint32_t crc, const uint8_t *p, size_t len) {
+	if (len >= CRC_FOLD_MIN) {
+		size_t blocks = len & ~(size_t)15;
+		crc = crc32_pmull_fold(crc, p, blocks);
+		p += blocks;
+		len -= blocks;
+	}
+	return crc32_slice16(crc, p, len);
+}
+#endif // CRC_ARM
+
+#ifdef CRC_X86
+// One CRC32C stream over len bytes (multiple of 8)
+__attribute__((target("sse4.2")))
+static inline uint64_t crc32c_hw_stream(uint64_t crc, const uint8_t *p, size_t len) {
+	for (size_t i = 0; i < len; i += 8) {
+		uint64_t v;
+		memcpy(&v, p + i, sizeof(v));
+		crc = _mm_crc32_u64(crc, v);
+	}
+	return crc;
+}
+
+// Three streams of lane bytes each, return: CRC of the 3 * lane bytes
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_hw_lanes(uint32_t crc, const uint8_t *p, size_t lane, uint32_t k1, uint32_t k2) {
+	uint64_t a = crc, b = 0, c = 0;
+
+	for (size_t i = 0; i < lane; i += 8) {
+		uint64_t va, vb, vc;
+		memcpy(&va, p + i, sizeof(va));
+		memcpy(&vb, p + lane + i, sizeof(vb));
+		memcpy(&vc, p + 2 * lane + i, sizeof(vc));
+		a = _mm_crc32_u64(a, va);
+		b = _mm_crc32_u64(b, vb);
+		c = _mm_crc32_u64(c, vc);
+	}
+	return crc_multmodp(CRC32C_POLY, k2, (uint32_t)a)
+		^ crc_multmodp(CRC32C_POLY, k1, (uint32_t)b) ^ (uint32_t)c;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+	// Align to 8 bytes first
+	while (len && ((uintptr_t)p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	while (len >= 3 * CRC32C_LANE_LONG) {
+		crc = crc32c_hw_lanes(crc, p, CRC32C_LANE_LONG, crc32c_long1, crc32c_long2);
+		p += 3 * CRC32C_LANE_LONG;
+		len -= 3 * CRC32C_LANE_LONG;
+	}
+	while (len >= 3 * CRC32C_LANE_SHORT) {
+		crc = crc32c_hw_lanes(crc, p, CRC32C_LANE_SHORT, crc32c_short1, crc32c_short2);
+		p += 3 * CRC32C_LANE_SHORT;
+		len -= 3 * CRC32C_LANE_SHORT;
+	}
+	size_t words = len & ~(size_t)7;
+	crc = (uint32_t)crc32c_hw_stream(crc, p, words);
+	p += words;
+	len -= words;
+	while (len--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return crc;
+}
+#endif // CRC_X86
+
+#ifdef CRC_ARM
+// One CRC32C stream over len bytes (multiple of 8)
+__attribute__((target("+crc")))
+static inline uint32_t crc32c_hw_stream(uint32_t crc, const uint8_t *p, size_t len) {
+	for (size_t i = 0; i < len; i += 8) {
+		uint64_t v;
+		memcpy(&v, p + i, sizeof(v));
+		crc = __crc32cd(crc, v);
+	}
+	return crc;
+}
+
+// Three streams of lane bytes each, return: CRC of the 3 * lane bytes
+__attribute__((target("+crc")))
+static inline uint32_t crc32c_hw_lanes(uint32_t crc, const uint8_t *p, size_t lane, uint32_t k1, uint32_t k2) {
+	uint32_t a = crc, b = 0, c = 0;
+
+	for (size_t i = 0; i < lane; i += 8) {
+		uint64_t va, vb, vc;
+		memcpy(&va, p + i, sizeof(va));
+		memcpy(&vb, p + lane + i, sizeof(vb));
+		memcpy(&vc, p + 2 * lane + i, sizeof(vc));
+		a = __crc32cd(a, va);
+		b = __crc32cd(b, vb);
+		c = __crc32cd(c, vc);
+	}
+	return crc_multmodp(CRC32C_POLY, k2, a) ^ crc_multmodp(CRC32C_POLY, k1, b) ^ c;
+}
+
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *p, size_t len) {
+	while (len && ((uintptr_t)p & 7)) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	while (len >= 3 * CRC32C_LANE_LONG) {
+		crc = crc32c_hw_lanes(crc, p, CRC32C_LANE_LONG, crc32c_long1, crc32c_long2);
+		p += 3 * CRC32C_LANE_LONG;
+		len -= 3 * CRC32C_LANE_LONG;
+	}
+	while (len >= 3 * CRC32C_LANE_SHORT) {
+		crc = crc32c_hw_lanes(crc, p, CRC32C_LANE_SHORT, crc32c_short1, crc32c_short2);
+		p += 3 * CRC32C_LANE_SHORT;
+		len -= 3 * CRC32C_LANE_SHORT;
+	}
+	size_t words = len & ~(size_t)7;
+	crc = crc32c_hw_stream(crc, p, words);
+	p += words;
+	len -= words;
+	while (len--) {
+		crc = __crc32cb(crc, *p++);
+	}
+	return crc;
+}
+#endif // CRC_ARM
+
+static void crc_model_init(crc_model_t *m) {
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int j = 0; j < 8; j++) {
+			c = (c & 1) ? (c >> 1) ^ m->poly : (c >> 1);
+		}
+		m->table[0][i] = c;
+	}
+	for (int k = 1; k < 16; k++) {
+		for (int i = 0; i < 256; i++) {
+			uint32_t c = m->table[k - 1][i];
+			m->table[k][i] = (c >> 8) ^ m->table[0][c & 0xFF];
+		}
+	}
+
+	uint32_t p = (uint32_t)1 << 30;	// x^1
+	m->x2n[0] = p;
+	for (int n = 1; n < 32; n++) {
+		m->x2n[n] = p = crc_multmodp(m->poly, p, p);
+	}
+}
+
+static void crc_init(void) {
+	crc_model_init(&crc32_model);
+	crc_model_init(&crc32c_model);
+
+	crc32c_long1 = crc_x2nmodp(&crc32c_model, CRC32C_LANE_LONG, 3);
+	crc32c_long2 = crc_x2nmodp(&crc32c_model, 2 * CRC32C_LANE_LONG, 3);
+	crc32c_short1 = crc_x2nmodp(&crc32c_model, CRC32C_LANE_SHORT, 3);
+	crc32c_short2 = crc_x2nmodp(&crc32c_model, 2 * CRC32C_LANE_SHORT, 3);
+
+	crc32_kernel = crc32_slice16;
+	crc32c_kernel = crc32c_slice16;
+#ifdef CRC_X86
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		crc32_kernel = crc32_pclmul;
+	}
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_kernel = crc32c_sse42;
+	}
+#endif
+#ifdef CRC_ARM
+	unsigned long hwcap = getauxval(AT_HWCAP);
+	if (hwcap & HWCAP_PMULL) {
+		crc32_kernel = crc32_pmull;
+	}
+	if (hwcap & HWCAP_CRC32) {
+		crc32c_kernel = crc32c_armv8;
+	}
+#endif
+	LOG("crc32 kernel: %s\n", crc32_kernel == crc32_slice16 ? "slice16" : "folding");
+	LOG("crc32c kernel: %s\n", crc32c_kernel == crc32c_slice16 ? "slice16" : "instruction");
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length) {
+	pthread_once(&crc_once, crc_init);
+	return ~crc32_kernel(~crc, data, length);
+}
+
+uint32_t calculate_crc32(const void *data, size_t length) {
+	return crc32_update(0, data, length);
+}
+
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+	pthread_once(&crc_once, crc_init);
+	// Shift crc1 over len2 zero bytes (x^(8 * len2)), the conditioning cancels out
+	return crc_multmodp(CRC32_POLY, crc_x2nmodp(&crc32_model, len2, 3), crc1) ^ crc2;
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length) {
+	pthread_once(&crc_once, crc_init);
+	return ~crc32c_kernel(~crc, data, length);
+}
+
+uint32_t calculate_crc32c(const void *data, size_t length) {
+	return crc32c_update(0, data, length);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+	pthread_once(&crc_once, crc_init);
+	return crc_multmodp(CRC32C_POLY, crc_x2nmodp(&crc32c_model, len2, 3), crc1) ^ crc2;
+}
@@ -0,0 +1,157 @@
+/*
+ * dirScan.c - Directory enumeration on raw getdents64 buffers
+ *
+ * readdir() hands out one struct dirent at a time from a small buffer; here
+ * the records of a large getdents64 buffer are walked directly, so a big
+ * directory takes few system calls and no copies. Entries keep their d_type,
+ * which lets callers skip the stat when the type is all they need. The stat
+ * helper goes through statx with only the fields asked for, relative to the
+ * directory fd, so the kernel neither walks the path again nor gathers the
+ * fields nobody prints.
+ *
+ * Buffers use plain malloc(), scans may run on pool threads.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include "dirScan.h"
+
+#define DIRSCAN_BUF (128 * 1024)
+
+// Record layout of getdents64
+struct dirscan_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+int dirScanOpenAt(DirScan *ds, int dirfd, const char *path) {
+	ds->fd = openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (ds->fd < 0) {
+		return -1;
+	}
+	ds->buf = malloc(DIRSCAN_BUF);
+	if (ds->buf == NULL) {
+		close(ds->fd);
+		ds->fd = -1;
+		errno = ENOMEM;
+		return -1;
+	}
+	ds->pos = 0;
+	ds->len = 0;
+	ds->off = 0;
+	return 0;
+}
+
+int dirScanNext(DirScan *ds, DirEntry *ent) {
+	if (ds->pos >= ds->len) {
+		long n;
+		do {
+			n = syscall(SYS_getdents64, ds->fd, ds->buf, DIRSCAN_BUF);
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0) {
+			return n < 0 ? -1 : 0;
+		}
+		ds->pos = 0;
+		ds->len = n;
+	}
+
+	struct dirscan_dirent64 *d = (struct dirscan_dirent64 *)(ds->buf + ds->pos);
+	ds->pos += d->d_reclen;
+	ent->name = d->d_name;
+	ent->len = strlen(d->d_name);
+	ent->ino = d->d_ino;
+	ent->type = d->d_type;
+	ds->off = d->d_off;
+	return 1;
+}
+
+off_t dirScanTell(const DirScan *ds) {
+	return ds->off;
+}
+
+int dirScanSeek(DirScan *ds, off_t pos) {
+	if (lseek(ds->fd, pos, SEEK_SET) < 0) {
+		return -1;
+	}
+	ds->pos = 0;
+	ds->len = 0;
+	ds->off = pos;
+	return 0;
+}
+
+void dirScanClose(DirScan *ds) {
+	if (ds->fd >= 0) {
+		close(ds->fd);
+		ds->fd = -1;
+	}
+	free(ds->buf);
+	ds->buf = NULL;
+}
+
+#ifdef STATX_TYPE
+static int statx_missing = 0;	// The kernel or a seccomp filter refused statx
+
+static unsigned statx_mask(unsigned fields) {
+	unsigned mask = STATX_TYPE;
+
+	if (fields & DIRSCAN_MODE) mask |= STATX_MODE;
+	if (fields & DIRSCAN_NLINK) mask |= STATX_NLINK;
+	if (fields & DIRSCAN_OWNER) mask |= STATX_UID | STATX_GID;
+	if (fields & DIRSCAN_SIZE) mask |= STATX_SIZE | STATX_BLOCKS;
+	if (fields & DIRSCAN_TIMES) mask |= STATX_ATIME | STATX_MTIME | STATX_CTIME;
+	if (fields & DIRSCAN_INO) mask |= STATX_INO;
+	return mask;
+}
+#endif
+
+int dirScanStat(int dirfd, const char *name, unsigned fields, struct stat *st) {
+#ifdef STATX_TYPE
+	if (!__atomic_load_n(&statx_missing, __ATOMIC_RELAXED)) {
+		struct statx sx;
+
+		if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, statx_mask(fields), &sx) == 0) {
+			memset(st, 0, sizeof(*st));
+			st->st_mode = sx.stx_mode;
+			st->st_nlink = sx.stx_nlink;
+			st->st_uid = sx.stx_uid;
+			st->st_gid = sx.stx_gid;
+			st->st_size = sx.stx_size;
+			st->st_blocks = sx.stx_blocks;
+			st->st_ino = sx.stx_ino;
+			st->st_dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+			st->st_rdev = makedev(sx.stx_rdev_major, sx.stx_rdev_minor);
+			st->st_atim.tv_sec = sx.stx_atime.tv_sec;
+			st->st_atim.tv_nsec = sx.stx_atime.tv_nsec;
+			st->st_mtim.tv_sec = sx.stx_mtime.tv_sec;
+			st->st_mtim.tv_nsec = sx.stx_mtime.tv_nsec;
+			st->st_ctim.tv_sec = sx.stx_ctime.tv_sec;
+			st->st_ctim.tv_nsec = sx.stx_ctime.tv_nsec;
+			return 0;
+		}
+		if (errno != ENOSYS && errno != EPERM) {
+			return -1;
+		}
+		__atomic_store_n(&statx_missing, 1, __ATOMIC_RELAXED);
+	}
+#else
+	(void)fields;
+#endif
+	return fstatat(dirfd, name, st, AT_SYMLINK_NOFOLLOW);
+}
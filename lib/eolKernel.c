@@ -0,0 +1,321 @@
+/*
+ * eolKernel.c - Line ending conversion (dos2unix, unix2dos, mac2unix, cat -e)
+ *
+ * The input is scanned in blocks of 64 bytes into two bitmasks, one bit per
+ * byte for CR and for LF (AVX2, SSE2 or NEON compares, picked at runtime).
+ * Shifting the masks by one gives the neighbour of every byte, so the bytes
+ * a mode has to rewrite, drop or insert before come out of a few bitwise
+ * operations. Blocks without any are copied whole, the others are copied in
+ * runs between the set bits. Counting the bits first gives the exact output
+ * size, which lets a file grow in place: the converter then runs from the
+ * end towards the start.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define EOL_X86 1
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+# define EOL_ARM 1
+#endif
+
+#include "eol.h"
+#include "debug.h"
+
+#define EOL_BLOCK 64
+
+// CR and LF masks of 64 bytes
+typedef void (*eol_scan_fn)(const unsigned char *p, uint64_t *cr, uint64_t *lf);
+
+static eol_scan_fn eol_scan;
+static pthread_once_t eol_once = PTHREAD_ONCE_INIT;
+
+static void scan_scalar(const unsigned char *p, uint64_t *cr, uint64_t *lf) {
+	uint64_t c = 0, l = 0;
+
+	for (int i = 0; i < EOL_BLOCK; i++) {
+		c |= (uint64_t)(p[i] == '\r') << i;
+		l |= (uint64_t)(p[i] == '\n') << i;
+	}
+	*cr = c;
+	*lf = l;
+}
+
+#ifdef EOL_X86
+__attribute__((target("sse2")))
+static void scan_sse2(const unsigned char *p, uint64_t *cr, uint64_t *lf) {
+	const __m128i vcr = _mm_set1_epi8('\r');
+	const __m128i vlf = _mm_set1_epi8('\n');
+	uint64_t c = 0, l = 0;
+
+	for (int i = 0; i < EOL_BLOCK; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		c |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vcr)) << i;
+		l |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vlf)) << i;
+	}
+	*cr = c;
+	*lf = l;
+}
+
+__attribute__((target("avx2")))
+static void scan_avx2(const unsigned char *p, uint64_t *cr, uint64_t *lf) {
+	const __m256i vcr = _mm256_set1_epi8('\r');
+	const __m256i vlf = _mm256_set1_epi8('\n');
+	__m256i lo = _mm256_loadu_si256((const __m256i *)p);
+	__m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+	*cr = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vcr))
+		| (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vcr)) << 32;
+	*lf = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vlf))
+		| (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vlf)) << 32;
+}
+#endif
+
+#ifdef EOL_ARM
+/* Four compare results (0x00 / 0xff per byte) -> one bit per byte */
+static inline uint64_t neon_mask64(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d) {
+	const uint8x16_t bits = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t s = vpaddq_u8(vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits)),
+			vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits)));
+
+	s = vpaddq_u8(s, s);
+	return vgetq_lane_u64(vreinterpretq_u64_u8(s), 0);
+}
+
+static void scan_neon(const unsigned char *p, uint64_t *cr, uint64_t *lf) {
+	uint8x16x4_t v = { { vld1q_u8(p), vld1q_u8(p + 16), vld1q_u8(p + 32), vld1q_u8(p + 48) } };
+	const uint8x16_t vcr = vdupq_n_u8('\r');
+	const uint8x16_t vlf = vdupq_n_u8('\n');
+
+	*cr = neon_mask64(vceqq_u8(v.val[0], vcr), vceqq_u8(v.val[1], vcr),
+			vceqq_u8(v.val[2], vcr), vceqq_u8(v.val[3], vcr));
+	*lf = neon_mask64(vceqq_u8(v.val[0], vlf), vceqq_u8(v.val[1], vlf),
+			vceqq_u8(v.val[2], vlf), vceqq_u8(v.val[3], vlf));
+}
+#endif
+
+static void eol_init(void) {
+	eol_scan = scan_scalar;
+#if defined(EOL_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		eol_scan = scan_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		eol_scan = scan_sse2;
+	}
+#elif defined(EOL_ARM)
+	eol_scan = scan_neon;
+#endif
+	LOG("eol scanner: %s\n", eol_scan == scan_scalar ? "scalar" : "vector");
+}
+
+/*
+ * Bytes of the block at in + b that the mode acts on
+ *
+ * prev_cr: the byte before the block is a CR. *cr gets the CR mask, *held
+ * the bit of a CR that ends a non-final input in MAC2UNIX mode.
+ */
+static uint64_t block_events(EolMode mode, const unsigned char *in, size_t len, size_t b,
+		int prev_cr, int final, uint64_t *cr, uint64_t *held) {
+	size_t n = len - b < EOL_BLOCK ? len - b : EOL_BLOCK;
+	uint64_t lf;
+
+	if (n == EOL_BLOCK) {
+		eol_scan(in + b, cr, &lf);
+	} else {
+		// The tail is scanned from a zero padded copy
+		unsigned char tmp[EOL_BLOCK] = { 0 };
+		memcpy(tmp, in + b, n);
+		eol_scan(tmp, cr, &lf);
+	}
+
+	uint64_t after_cr = *cr << 1 | (uint64_t)prev_cr;	// Bytes that follow a CR
+	*held = 0;
+	switch (mode) {
+	case EOL_DOS2UNIX:
+		return *cr | (lf & after_cr);
+	case EOL_MAC2UNIX: {
+		uint64_t next_lf = b + EOL_BLOCK < len && in[b + EOL_BLOCK] == '\n';
+		uint64_t ev = *cr & ~(lf >> 1 | next_lf << 63);
+		if (b + n == len && !final && (*cr >> (n - 1) & 1)) {
+			*held = 1ULL << (n - 1);
+			ev &= ~*held;
+		}
+		return ev;
+	}
+	case EOL_UNIX2DOS:
+		return lf & ~after_cr;
+	default:
+		return lf;
+	}
+}
+
+void eolInit(EolState *st, EolMode mode) {
+	pthread_once(&eol_once, eol_init);
+	st->mode = mode;
+	st->prev_cr = 0;
+	st->held_cr = 0;
+}
+
+size_t eolConvertedLen(const EolState *st, const unsigned char *in, size_t len, int final, size_t *changes) {
+	size_t out = len, count = 0;
+	int prev = st->prev_cr;
+
+	pthread_once(&eol_once, eol_init);
+	if (st->held_cr && (len > 0 || final)) {
+		out++;
+		count += len == 0 || in[0] != '\n';
+	}
+
+	for (size_t b = 0; b < len; b += EOL_BLOCK) {
+		size_t n = len - b < EOL_BLOCK ? len - b : EOL_BLOCK;
+		uint64_t cr, held;
+		uint64_t ev = block_events(st->mode, in, len, b, prev, final, &cr, &held);
+
+		count += __builtin_popcountll(ev);
+		switch (st->mode) {
+		case EOL_DOS2UNIX:
+			out -= __builtin_popcountll(ev & ~cr);	// LFs after a CR are dropped
+			break;
+		case EOL_MAC2UNIX:
+			out -= held != 0;
+			break;
+		default:
+			out += __builtin_popcountll(ev);
+			break;
+		}
+		prev = cr >> (n - 1) & 1;
+	}
+
+	if (changes) {
+		*changes = count;
+	}
+	return out;
+}
+
+/* Forward conversion, out may equal in for the modes that do not grow */
+static size_t convert_forward(EolState *st, const unsigned char *in, size_t len, unsigned char *out, int final) {
+	EolMode mode = st->mode;
+	unsigned char *o = out;
+	int prev = st->prev_cr;
+	uint64_t held = 0;
+	size_t s = 0;			// Start of the bytes not copied yet, runs cross blocks
+
+	if (st->held_cr && (len > 0 || final)) {
+		*o++ = len > 0 && in[0] == '\n' ? '\r' : '\n';
+		st->held_cr = 0;
+	}
+	if (mode == EOL_DOS2UNIX && prev && len > 0 && in[0] == '\n') {
+		s = 1;			// The CR before it ended the last block
+	}
+
+	for (size_t b = 0; b < len; b += EOL_BLOCK) {
+		size_t n = len - b < EOL_BLOCK ? len - b : EOL_BLOCK;
+		uint64_t cr;
+		uint64_t ev = block_events(mode, in, len, b, prev, final, &cr, &held);
+
+		if (mode == EOL_DOS2UNIX) {
+			ev &= cr;	// The LF after a CR goes along with it below
+		}
+
+		while (ev) {
+			int bit = __builtin_ctzll(ev);
+			size_t p = b + bit;
+			ev &= ev - 1;
+
+			if (o != in + s) {
+				memmove(o, in + s, p - s);
+			}
+			o += p - s;
+			switch (mode) {
+			case EOL_DOS2UNIX:
+				*o++ = '\n';
+				s = p + 1 + (p + 1 < len && in[p + 1] == '\n');
+				break;
+			case EOL_MAC2UNIX:
+				*o++ = '\n';
+				s = p + 1;
+				break;
+			case EOL_UNIX2DOS:
+				*o++ = '\r';
+				s = p;
+				break;
+			default:
+				*o++ = '$';
+				s = p;
+				break;
+			}
+		}
+		prev = cr >> (n - 1) & 1;
+	}
+
+	size_t e = len - (held != 0);
+	if (s < e) {
+		if (o != in + s) {
+			memmove(o, in + s, e - s);
+		}
+		o += e - s;
+	}
+
+	st->prev_cr = prev;
+	if (held) {
+		st->held_cr = 1;
+	}
+	return o - out;
+}
+
+size_t eolConvert(EolState *st, const unsigned char *in, size_t len, unsigned char *out, int final) {
+	pthread_once(&eol_once, eol_init);
+	return convert_forward(st, in, len, out, final);
+}
+
+/*
+ * Growing modes in place: blocks are taken from the end, so every byte
+ * moves up to its final place before anything below it is overwritten.
+ */
+static void expand_backward(EolMode mode, unsigned char *buf, size_t len, size_t out_len) {
+	unsigned char ins = mode == EOL_UNIX2DOS ? '\r' : '$';
+	size_t w = out_len;		// Start of the output written so far
+
+	for (size_t k = (len + EOL_BLOCK - 1) / EOL_BLOCK; k-- > 0;) {
+		size_t b = k * EOL_BLOCK;
+		size_t n = len - b < EOL_BLOCK ? len - b : EOL_BLOCK;
+		int prev = b > 0 && buf[b - 1] == '\r';
+		uint64_t cr, held;
+		uint64_t ev = block_events(mode, buf, len, b, prev, 1, &cr, &held);
+		size_t e = b + n;	// End of the bytes not moved yet
+
+		while (ev) {
+			int bit = 63 - __builtin_clzll(ev);
+			size_t p = b + bit;
+			ev &= ~(1ULL << bit);
+
+			w -= e - p;
+			memmove(buf + w, buf + p, e - p);
+			buf[--w] = ins;
+			e = p;
+		}
+		w -= e - b;
+		if (w != b) {
+			memmove(buf + w, buf + b, e - b);
+		} else {
+			break;		// Nothing inserted below this block
+		}
+	}
+}
+
+size_t eolConvertInPlace(EolMode mode, unsigned char *buf, size_t len, size_t out_len) {
+	pthread_once(&eol_once, eol_init);
+	if (mode == EOL_UNIX2DOS || mode == EOL_MARK) {
+		expand_backward(mode, buf, len, out_len);
+		return out_len;
+	}
+
+	EolState st;
+	eolInit(&st, mode);
+	return convert_forward(&st, buf, len, buf, 1);
+}
@@ -0,0 +1,261 @@
+/*
+ * hexKernel.c - Bulk hex encoding and decoding
+ *
+ * Encoding splits every byte into its nibbles and maps them to digits with
+ * one table shuffle (pshufb, tbl), then interleaves the two halves: SSSE3
+ * does 16 bytes per step, AVX2 32, NEON 16 through its interleaving store.
+ * Decoding classifies a register of characters as digits or letters in a
+ * few compares, stops at the first vector holding anything else and packs
+ * the nibble pairs with a multiply-add. Kernels are picked at runtime, the
+ * ragged ends go through tables.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define HEX_X86 1
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+# define HEX_ARM 1
+#endif
+
+#include "hexKernel.h"
+#include "debug.h"
+
+static const char hex_lower[16] = "0123456789abcdef";
+static const char hex_upper[16] = "0123456789ABCDEF";
+
+// Value of each character, -1: not a hex digit
+static int8_t hex_value[256];
+
+// Kernels work on whole vectors and return the bytes (encode) / characters (decode) done
+typedef size_t (*hex_encode_fn)(const unsigned char *in, size_t len, char *out, const char *digits);
+typedef size_t (*hex_decode_fn)(const unsigned char *in, size_t len, unsigned char *out);
+
+static hex_encode_fn hex_encode_kernel;
+static hex_decode_fn hex_decode_kernel;
+static pthread_once_t hex_once = PTHREAD_ONCE_INIT;
+
+static size_t encode_none(const unsigned char *in, size_t len, char *out, const char *digits) {
+	(void)in;
+	(void)len;
+	(void)out;
+	(void)digits;
+	return 0;
+}
+
+static size_t decode_none(const unsigned char *in, size_t len, unsigned char *out) {
+	(void)in;
+	(void)len;
+	(void)out;
+	return 0;
+}
+
+#ifdef HEX_X86
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const unsigned char *in, size_t len, char *out, const char *digits) {
+	const __m128i lut = _mm_loadu_si128((const __m128i *)digits);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16, out += 32) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+		_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return i;
+}
+
+__attribute__((target("avx2,ssse3")))
+static size_t encode_avx2(const unsigned char *in, size_t len, char *out, const char *digits) {
+	const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)digits));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32, out += 64) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+		// Unpacking stays inside 128-bit lanes, put the quarters back in order
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	// Short inputs such as one dump line still get a 128-bit step
+	return i + encode_ssse3(in + i, len - i, out, digits);
+}
+
+/* 16 characters -> nibble values, *ok: all of them were hex digits */
+__attribute__((target("ssse3")))
+static inline __m128i nibbles_ssse3(__m128i c, int *ok) {
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_l = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+	*ok = _mm_movemask_epi8(_mm_or_si128(is_d, is_l)) == 0xffff;
+	return _mm_or_si128(_mm_and_si128(is_d, d),
+			_mm_and_si128(is_l, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const unsigned char *in, size_t len, unsigned char *out) {
+	const __m128i pair = _mm_set1_epi16(0x0110);	// high nibble * 16 + low nibble
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32, out += 16) {
+		int ok0, ok1;
+		__m128i a = nibbles_ssse3(_mm_loadu_si128((const __m128i *)(in + i)), &ok0);
+		__m128i b = nibbles_ssse3(_mm_loadu_si128((const __m128i *)(in + i + 16)), &ok1);
+		if (!(ok0 & ok1)) {
+			break;
+		}
+		a = _mm_maddubs_epi16(a, pair);
+		b = _mm_maddubs_epi16(b, pair);
+		_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(a, b));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const unsigned char *in, size_t len, unsigned char *out) {
+	const __m256i pair = _mm256_set1_epi16(0x0110);
+	size_t i = 0;
+
+	for (; i + 64 <= len; i += 64, out += 32) {
+		__m256i v[2];
+		int bad = 0;
+
+		for (int k = 0; k < 2; k++) {
+			__m256i c = _mm256_loadu_si256((const __m256i *)(in + i + 32 * k));
+			__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+			__m256i is_d = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+			__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+			__m256i is_l = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+
+			bad |= _mm256_movemask_epi8(_mm256_or_si256(is_d, is_l)) != -1;
+			v[k] = _mm256_or_si256(_mm256_and_si256(is_d, d),
+					_mm256_and_si256(is_l, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+			v[k] = _mm256_maddubs_epi16(v[k], pair);
+		}
+		if (bad) {
+			break;
+		}
+		// packus interleaves the lanes of its operands
+		__m256i r = _mm256_packus_epi16(v[0], v[1]);
+		_mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(r, 0xd8));
+	}
+	return i;
+}
+#endif
+
+#ifdef HEX_ARM
+static size_t encode_neon(const unsigned char *in, size_t len, char *out, const char *digits) {
+	const uint8x16_t lut = vld1q_u8((const uint8_t *)digits);
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16, out += 32) {
+		uint8x16_t v = vld1q_u8(in + i);
+		uint8x16x2_t r;
+		r.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(v, 4));
+		r.val[1] = vqtbl1q_u8(lut, vandq_u8(v, vdupq_n_u8(0x0f)));
+		vst2q_u8((uint8_t *)out, r);
+	}
+	return i;
+}
+
+static inline uint8x16_t nibbles_neon(uint8x16_t c, uint8x16_t *bad) {
+	uint8x16_t d = vsubq_u8(c, vdupq_n_u8('0'));
+	uint8x16_t is_d = vcleq_u8(d, vdupq_n_u8(9));
+	uint8x16_t l = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+	uint8x16_t is_l = vcleq_u8(l, vdupq_n_u8(5));
+
+	*bad = vorrq_u8(*bad, vmvnq_u8(vorrq_u8(is_d, is_l)));
+	return vorrq_u8(vandq_u8(is_d, d), vandq_u8(is_l, vaddq_u8(l, vdupq_n_u8(10))));
+}
+
+static size_t decode_neon(const unsigned char *in, size_t len, unsigned char *out) {
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32, out += 16) {
+		uint8x16x2_t c = vld2q_u8(in + i);	// Even (high) and odd (low) digits
+		uint8x16_t bad = vdupq_n_u8(0);
+		uint8x16_t hi = nibbles_neon(c.val[0], &bad);
+		uint8x16_t lo = nibbles_neon(c.val[1], &bad);
+		if (vmaxvq_u8(bad)) {
+			break;
+		}
+		vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
+	return i;
+}
+#endif
+
+static void hex_init(void) {
+	memset(hex_value, -1, sizeof(hex_value));
+	for (int i = 0; i < 16; i++) {
+		hex_value[(unsigned char)hex_lower[i]] = i;
+		hex_value[(unsigned char)hex_upper[i]] = i;
+	}
+
+	hex_encode_kernel = encode_none;
+	hex_decode_kernel = decode_none;
+#if defined(HEX_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		hex_encode_kernel = encode_avx2;
+		hex_decode_kernel = decode_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		hex_encode_kernel = encode_ssse3;
+		hex_decode_kernel = decode_ssse3;
+	}
+#elif defined(HEX_ARM)
+	hex_encode_kernel = encode_neon;
+	hex_decode_kernel = decode_neon;
+#endif
+	LOG("hex kernel: %s\n", hex_encode_kernel == encode_none ? "scalar" : "vector");
+}
+
+void hexEncode(const unsigned char *in, size_t len, char *out, int upper) {
+	const char *digits = upper ? hex_upper : hex_lower;
+
+	pthread_once(&hex_once, hex_init);
+	size_t i = hex_encode_kernel(in, len, out, digits);
+	for (; i < len; i++) {
+		out[2 * i] = digits[in[i] >> 4];
+		out[2 * i + 1] = digits[in[i] & 0x0f];
+	}
+}
+
+size_t hexDecode(const char *text, size_t len, unsigned char *out, size_t *used) {
+	const unsigned char *in = (const unsigned char *)text;
+
+	pthread_once(&hex_once, hex_init);
+	size_t i = hex_decode_kernel(in, len, out);
+	for (; i + 2 <= len; i += 2) {
+		int hi = hex_value[in[i]], lo = hex_value[in[i + 1]];
+		if ((hi | lo) < 0) {
+			break;
+		}
+		out[i / 2] = hi << 4 | lo;
+	}
+	*used = i;
+	return i / 2;
+}
+
+int hexValue(unsigned char c) {
+	if ((unsigned)(c - '0') <= 9) {
+		return c - '0';
+	}
+	c |= 0x20;
+	if ((unsigned)(c - 'a') <= 5) {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
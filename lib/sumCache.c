@@ -0,0 +1,434 @@
+/*
+ * sumCache.c - Persistent digest cache ('--cache') for the checksum commands
+ *
+ * The digests are kept in an index file, one per algorithm, holding records
+ * sorted by (dev, inode) with the size, mtime and ctime seen when the file
+ * was hashed. A file whose stat metadata still matches its record is not
+ * read at all. Extended attributes were not used: setting one bumps the
+ * ctime of the file, so the record could never match the file it describes.
+ *
+ * The index is mapped read-only when the cache is opened and never changes
+ * while the command runs, so lookups from the check mode threads take no
+ * lock. New records are collected in memory and merged into the current
+ * index (which another process may have rewritten meanwhile) under a lock
+ * file when the cache is closed, the result replaces the index by rename().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "lib.h"
+#include "checksum.h"
+
+#define CACHE_MAGIC	"TLSUMC1\n"
+#define CACHE_MAX_DIGEST 64
+
+typedef struct {
+	char magic[8];
+	uint32_t digest_len;
+	uint32_t rec_size;	// Bytes per record
+	uint64_t count;		// Records following the header
+} cache_header_t;
+
+// Start of a record, the digest follows (padded to 8 bytes)
+typedef struct {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;
+	int64_t ctime;
+	uint32_t mtime_ns;
+	uint32_t ctime_ns;
+} cache_key_t;
+
+struct SumCache {
+	const char *prog;
+	char *path;		// Index file
+	size_t digest_len;
+	size_t rec_size;
+	int revalidate;		// Re-hash every file, the records are only refreshed
+
+	void *map;		// Index as it was when opened
+	size_t map_size;
+	const unsigned char *recs;
+	size_t count;
+
+	pthread_mutex_t lock;	// Protects everything below
+	unsigned char *pending;	// New records
+	size_t npending;
+	size_t cap;
+	SumCacheStats stats;
+};
+
+static void key_from_stat(cache_key_t *k, const struct stat *st) {
+	memset(k, 0, sizeof(*k));
+	k->dev = st->st_dev;
+	k->ino = st->st_ino;
+	k->size = st->st_size;
+	k->mtime = st->st_mtim.tv_sec;
+	k->mtime_ns = st->st_mtim.tv_nsec;
+	k->ctime = st->st_ctim.tv_sec;
+	k->ctime_ns = st->st_ctim.tv_nsec;
+}
+
+// Order of the records: (dev, inode)
+static int key_cmp(const void *a, const void *b) {
+	const cache_key_t *x = a, *y = b;
+
+	if (x->dev != y->dev) {
+		return x->dev < y->dev ? -1 : 1;
+	}
+	if (x->ino != y->ino) {
+		return x->ino < y->ino ? -1 : 1;
+	}
+	return 0;
+}
+
+// Same file, unchanged since the record was made
+static int key_same(const cache_key_t *x, const cache_key_t *y) {
+	return x->dev == y->dev && x->ino == y->ino && x->size == y->size
+		&& x->mtime == y->mtime && x->mtime_ns == y->mtime_ns
+		&& x->ctime == y->ctime && x->ctime_ns == y->ctime_ns;
+}
+
+// Map an index file, return: records (NULL if none), *count, *map, *size
+static const unsigned char *index_map(const char *path, size_t digest_len, size_t rec_size,
+		size_t *count, void **map, size_t *size, int *invalid) {
+	struct stat st;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	*count = 0;
+	*map = NULL;
+	*size = 0;
+	*invalid = 0;
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(cache_header_t)) {
+		*invalid = st.st_size != 0;
+		close(fd);
+		return NULL;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+
+	const cache_header_t *h = p;
+	if (memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) != 0 || h->digest_len != digest_len
+			|| h->rec_size != rec_size
+			|| h->count != (st.st_size - sizeof(cache_header_t)) / rec_size
+			|| (st.st_size - sizeof(cache_header_t)) % rec_size != 0) {
+		// Damaged or another algorithm: start over, it is only a cache
+		munmap(p, st.st_size);
+		*invalid = 1;
+		return NULL;
+	}
+
+	madvise(p, st.st_size, MADV_RANDOM);
+	*map = p;
+	*size = st.st_size;
+	*count = h->count;
+	return (const unsigned char *)p + sizeof(cache_header_t);
+}
+
+static const unsigned char *index_find(const unsigned char *recs, size_t count, size_t rec_size,
+		const cache_key_t *k) {
+	size_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const unsigned char *r = recs + mid * rec_size;
+		int c = key_cmp(r, k);
+		if (c == 0) {
+			return r;
+		}
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+// ~/.cache/toolen/<alg>.idx ($XDG_CACHE_HOME is honoured), parents are created
+static char *default_path(const char *alg) {
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char dir[PATH_MAX];
+
+	if (xdg && *xdg) {
+		snprintf(dir, sizeof(dir), "%s", xdg);
+	} else if (home && *home) {
+		snprintf(dir, sizeof(dir), "%s/.cache", home);
+	} else {
+		errno = ENOENT;
+		return NULL;
+	}
+	mkdir(dir, 0700);
+	strncat(dir, "/toolen", sizeof(dir) - strlen(dir) - 1);
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		return NULL;
+	}
+
+	size_t len = strlen(dir) + strlen(alg) + 6;
+	char *path = xmalloc(len);
+	snprintf(path, len, "%s/%s.idx", dir, alg);
+	return path;
+}
+
+SumCache *sumCacheOpen(const char *prog, const char *alg, size_t digest_len, const char *path, int revalidate) {
+	if (digest_len > CACHE_MAX_DIGEST) {
+		return NULL;
+	}
+
+	char *p = path ? xstrdup(path) : default_path(alg);
+	if (p == NULL) {
+		fprintf(stderr, "%s: cannot create the digest cache: %s\n", prog, strerror(errno));
+		return NULL;
+	}
+
+	SumCache *c = xcalloc(1, sizeof(*c));
+	int invalid;
+	c->prog = prog;
+	c->path = p;
+	c->digest_len = digest_len;
+	c->rec_size = sizeof(cache_key_t) + ((digest_len + 7) & ~(size_t)7);
+	c->revalidate = revalidate;
+	c->recs = index_map(p, digest_len, c->rec_size, &c->count, &c->map, &c->map_size, &invalid);
+	if (invalid) {
+		fprintf(stderr, "%s: %s: not a %s digest cache, it will be rebuilt\n", prog, p, alg);
+	}
+	pthread_mutex_init(&c->lock, NULL);
+	return c;
+}
+
+static void cache_add(SumCache *c, const cache_key_t *k, const unsigned char *digest) {
+	if (c->npending == c->cap) {
+		c->cap = c->cap ? c->cap * 2 : 256;
+		// Runs on the hash threads, xalloc is not thread safe
+		c->pending = realloc(c->pending, c->cap * c->rec_size);
+		if (c->pending == NULL) {
+			fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+			exit(EXIT_FAILURE);
+		}
+	}
+	unsigned char *r = c->pending + c->npending++ * c->rec_size;
+	memset(r, 0, c->rec_size);
+	memcpy(r, k, sizeof(*k));
+	memcpy(r + sizeof(*k), digest, c->digest_len);
+}
+
+int sumCacheFile(SumCache *c, const char *path, sumFileFunc sum, unsigned char *digest, int binary) {
+	struct stat st;
+	cache_key_t key;
+
+	// Only regular files have metadata that tracks their contents
+	if (c == NULL || strcmp(path, "-") == 0 || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return sum(path, digest, binary);
+	}
+	key_from_stat(&key, &st);
+
+	const unsigned char *rec = index_find(c->recs, c->count, c->rec_size, &key);
+	if (rec && !key_same((const cache_key_t *)rec, &key)) {
+		rec = NULL;
+	}
+	if (rec && !c->revalidate) {
+		memcpy(digest, rec + sizeof(cache_key_t), c->digest_len);
+		pthread_mutex_lock(&c->lock);
+		c->stats.hits++;
+		pthread_mutex_unlock(&c->lock);
+		return 0;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_REALTIME, &start);
+
+	int ret = sum(path, digest, binary);
+	if (ret != 0) {
+		return ret;
+	}
+
+	/*
+	 * Only remember the digest if the file did not change while it was read,
+	 * and was last changed before this second: timestamps are coarse, a write
+	 * in the same tick would leave them as they are (the racy-git problem).
+	 */
+	struct stat after;
+	cache_key_t key_after;
+	int store = stat(path, &after) == 0;
+	if (store) {
+		key_from_stat(&key_after, &after);
+		store = key_same(&key, &key_after) && key.mtime < start.tv_sec && key.ctime < start.tv_sec;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	c->stats.misses++;
+	if (rec && memcmp(rec + sizeof(cache_key_t), digest, c->digest_len) != 0) {
+		// Contents changed behind unchanged metadata
+		c->stats.stale++;
+	}
+	if (store && !(rec && memcmp(rec + sizeof(cache_key_t), digest, c->digest_len) == 0)) {
+		cache_add(c, &key, digest);
+	}
+	pthread_mutex_unlock(&c->lock);
+	return 0;
+}
+
+void sumCacheGetStats(SumCache *c, SumCacheStats *stats) {
+	pthread_mutex_lock(&c->lock);
+	*stats = c->stats;
+	pthread_mutex_unlock(&c->lock);
+}
+
+void sumCacheReport(SumCache *c) {
+	SumCacheStats st;
+
+	sumCacheGetStats(c, &st);
+	fflush(stdout);
+	fprintf(stderr, "%s: cache: %lu hit%s, %lu miss%s", c->prog,
+			st.hits, st.hits == 1 ? "" : "s", st.misses, st.misses == 1 ? "" : "es");
+	if (c->revalidate) {
+		fprintf(stderr, ", %lu stale", st.stale);
+	}
+	fputc('\n', stderr);
+}
+
+// Write the current index merged with the new records into 'out'
+static int index_write(SumCache *c, FILE *out, const unsigned char *recs, size_t count) {
+	size_t i = 0, j = 0, total = 0;
+	cache_header_t h;
+
+	// Count first, a record of the new set replaces the one on disk
+	while (i < count || j < c->npending) {
+		const unsigned char *a = i < count ? recs + i * c->rec_size : NULL;
+		const unsigned char *b = j < c->npending ? c->pending + j * c->rec_size : NULL;
+		int cmp = !a ? 1 : !b ? -1 : key_cmp(a, b);
+		i += cmp <= 0;
+		j += cmp >= 0;
+		total++;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.digest_len = c->digest_len;
+	h.rec_size = c->rec_size;
+	h.count = total;
+	if (fwrite(&h, sizeof(h), 1, out) != 1) {
+		return -1;
+	}
+
+	for (i = j = 0; i < count || j < c->npending;) {
+		const unsigned char *a = i < count ? recs + i * c->rec_size : NULL;
+		const unsigned char *b = j < c->npending ? c->pending + j * c->rec_size : NULL;
+		int cmp = !a ? 1 : !b ? -1 : key_cmp(a, b);
+		if (fwrite(cmp < 0 ? a : b, c->rec_size, 1, out) != 1) {
+			return -1;
+		}
+		i += cmp <= 0;
+		j += cmp >= 0;
+	}
+	return 0;
+}
+
+// Merge the new records into the index on disk
+static int cache_save(SumCache *c) {
+	size_t len = strlen(c->path) + 8;
+	char *lock_path = xmalloc(len);
+	char *tmp_path = xmalloc(len);
+	int ret = -1;
+
+	snprintf(lock_path, len, "%s.lock", c->path);
+	snprintf(tmp_path, len, "%s.XXXXXX", c->path);
+
+	int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+		goto out;
+	}
+
+	// Sort the new records and drop duplicates (a file listed twice)
+	qsort(c->pending, c->npending, c->rec_size, key_cmp);
+	size_t n = 0;
+	for (size_t i = 0; i < c->npending; i++) {
+		if (n > 0 && key_cmp(c->pending + (n - 1) * c->rec_size, c->pending + i * c->rec_size) == 0) {
+			n--;
+		}
+		memmove(c->pending + n++ * c->rec_size, c->pending + i * c->rec_size, c->rec_size);
+	}
+	c->npending = n;
+
+	// Another process may have saved since we opened, merge with its result
+	void *map;
+	size_t map_size, count;
+	int invalid;
+	const unsigned char *recs = index_map(c->path, c->digest_len, c->rec_size, &count, &map, &map_size, &invalid);
+
+	int fd = mkstemp(tmp_path);
+	if (fd >= 0) {
+		FILE *out = fdopen(fd, "w");
+		if (out == NULL) {
+			close(fd);
+		} else {
+			ret = index_write(c, out, recs, count);
+			if (fclose(out) != 0) {
+				ret = -1;
+			}
+			if (ret == 0 && rename(tmp_path, c->path) != 0) {
+				ret = -1;
+			}
+			if (ret != 0) {
+				unlink(tmp_path);
+			}
+		}
+	}
+	if (map) {
+		munmap(map, map_size);
+	}
+
+out:
+	if (ret != 0) {
+		fprintf(stderr, "%s: %s: cannot save the digest cache: %s\n", c->prog, c->path, strerror(errno));
+	}
+	if (lock_fd >= 0) {
+		close(lock_fd);
+	}
+	xfree(lock_path);
+	xfree(tmp_path);
+	return ret;
+}
+
+int sumCacheClose(SumCache *c) {
+	int ret = 0;
+
+	if (c == NULL) {
+		return 0;
+	}
+	if (c->npending > 0) {
+		ret = cache_save(c);
+	}
+	if (c->map) {
+		munmap(c->map, c->map_size);
+	}
+	pthread_mutex_destroy(&c->lock);
+	free(c->pending);
+	xfree(c->path);
+	xfree(c);
+	return ret;
+}
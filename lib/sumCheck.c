@@ -0,0 +1,458 @@
+/*
+ * sumCheck.c - Parallel checksum verification ('-c') for the checksum commands
+ *
+ * The manifest is mapped (or slurped when it is a pipe) and parsed in a single
+ * pass into a compact entry table: names stay in the manifest and are referred
+ * to by offset, the expected digests are packed into one array. Workers claim
+ * entries with an atomic counter and publish a state per entry, the calling
+ * thread reports them in manifest order as soon as they are ready.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+#include "checksum.h"
+#include "workPool.h"
+
+// Largest digest supported by the checker
+#define SUM_MAX_DIGEST 64
+
+// Entry states
+enum {
+	ENT_PENDING = 0,	// Waiting for a worker
+	ENT_MALFORMED,		// Improperly formatted line, not verified
+	ENT_OK,			// Checksum matched
+	ENT_FAILED,		// Checksum did NOT match
+	ENT_UNREADABLE,		// Could not open or read the file
+	ENT_MISSING,		// Missing and --ignore-missing
+};
+
+typedef struct {
+	size_t name;		// Offset of the file name in the manifest
+	uint32_t name_len;	// Length of the file name
+	uint32_t line;		// Line number in the manifest
+	uint8_t binary;		// Listed in binary mode ('*')
+	uint8_t state;		// ENT_* (atomic)
+	int err;		// errno of an unreadable file
+} entry_t;
+
+typedef struct {
+	const char *data;	// Manifest contents
+	size_t size;
+	int mapped;		// data is a mapping, otherwise malloc'ed
+} manifest_t;
+
+typedef struct {
+	const SumCheckOpts *opts;
+	const char *data;
+	entry_t *ents;
+	const unsigned char *expected;
+	size_t count;
+
+	size_t next;		// Next entry to claim (atomic)
+	int stop;		// Stop claiming entries (atomic)
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	int waiting;		// Reporter is sleeping on 'ready'
+} check_ctx_t;
+
+static const signed char hex_value[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};	// Value + 1, 0 means not a hex digit
+
+// Decode 2*len hex digits, return: 0->success, -1->bad digit
+static int hex_decode(const char *s, size_t len, unsigned char *out) {
+	for (size_t i = 0; i < len; i++) {
+		int hi = hex_value[(unsigned char)s[2 * i]];
+		int lo = hex_value[(unsigned char)s[2 * i + 1]];
+		if (!hi || !lo) {
+			return -1;
+		}
+		out[i] = (unsigned char)(((hi - 1) << 4) | (lo - 1));
+	}
+	return 0;
+}
+
+static int manifest_load(const char *path, manifest_t *m) {
+	int fd = STDIN_FILENO;
+	struct stat st;
+
+	memset(m, 0, sizeof(*m));
+	if (strcmp(path, "-") != 0) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return -1;
+		}
+	}
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			m->data = p;
+			m->size = st.st_size;
+			m->mapped = 1;
+			if (fd != STDIN_FILENO) close(fd);
+			return 0;
+		}
+	}
+
+	// Pipes and special files: read everything
+	size_t cap = 65536;
+	char *buf = xmalloc(cap);
+	ssize_t n;
+	while ((n = read(fd, buf + m->size, cap - m->size)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			int saved = errno;
+			xfree(buf);
+			if (fd != STDIN_FILENO) close(fd);
+			errno = saved;
+			return -1;
+		}
+		m->size += n;
+		if (m->size == cap) {
+			cap *= 2;
+			buf = xrealloc(buf, cap);
+		}
+	}
+
+	m->data = buf;
+	if (fd != STDIN_FILENO) close(fd);
+	return 0;
+}
+
+static void manifest_free(manifest_t *m) {
+	if (m->mapped) {
+		munmap((void *)m->data, m->size);
+	} else {
+		xfree((void *)m->data);
+	}
+}
+
+/*
+ * Parse one line (without terminator) into an entry
+ * Accepts "DIGEST  NAME", "DIGEST *NAME", "DIGEST NAME", "DIGEST\tNAME"
+ * and the BSD-style "TAG (NAME) = DIGEST"
+ */
+static int parse_line(const SumCheckOpts *opts, const char *base, const char *p, size_t len,
+		entry_t *e, unsigned char *digest) {
+	size_t hexlen = opts->digest_len * 2;
+	size_t taglen = opts->tag ? strlen(opts->tag) : 0;
+
+	if (taglen && len > taglen + 2 && memcmp(p, opts->tag, taglen) == 0
+			&& p[taglen] == ' ' && p[taglen + 1] == '(') {
+		// BSD-style, the name may contain ") = " so search from the end
+		if (len < taglen + 2 + 1 + 4 + hexlen) {
+			return -1;
+		}
+		const char *sep = p + len - hexlen - 4;
+		if (memcmp(sep, ") = ", 4) != 0 || sep <= p + taglen + 2) {
+			return -1;
+		}
+		if (hex_decode(sep + 4, opts->digest_len, digest) != 0) {
+			return -1;
+		}
+		e->name = (p + taglen + 2) - base;
+		e->name_len = sep - (p + taglen + 2);
+		e->binary = 1;
+		return 0;
+	}
+
+	if (len < hexlen + 2 || (p[hexlen] != ' ' && p[hexlen] != '\t')) {
+		return -1;
+	}
+	if (hex_decode(p, opts->digest_len, digest) != 0) {
+		return -1;
+	}
+
+	const char *name = p + hexlen + 1;
+	e->binary = 0;
+	if (*name == ' ' || *name == '*') {
+		e->binary = (*name == '*');
+		name++;
+	}
+	if (name >= p + len) {
+		return -1;
+	}
+
+	e->name = name - base;
+	e->name_len = (p + len) - name;
+	return 0;
+}
+
+// Parse the whole manifest, return: number of entries
+static size_t parse_manifest(const SumCheckOpts *opts, const manifest_t *m,
+		entry_t **ents_out, unsigned char **expected_out) {
+	size_t cap = 1024, count = 0;
+	entry_t *ents = xmalloc(cap * sizeof(*ents));
+	unsigned char *expected = xmalloc(cap * opts->digest_len);
+	const char *p = m->data, *end = m->data + m->size;
+	uint32_t line = 0;
+
+	while (p < end) {
+		const char *nl = memchr(p, '\n', end - p);
+		const char *eol = nl ? nl : end;
+		size_t len = eol - p;
+
+		line++;
+		if (len > 0 && p[len - 1] == '\r') {
+			len--;
+		}
+		// A trailing or hand-edited blank line is not a malformed entry
+		if (len == 0) {
+			p = nl ? nl + 1 : end;
+			continue;
+		}
+
+		if (count == cap) {
+			cap *= 2;
+			ents = xrealloc(ents, cap * sizeof(*ents));
+			expected = xrealloc(expected, cap * opts->digest_len);
+		}
+
+		entry_t *e = &ents[count];
+		memset(e, 0, sizeof(*e));
+		e->line = line;
+		if (parse_line(opts, m->data, p, len, e, expected + count * opts->digest_len) != 0) {
+			e->state = ENT_MALFORMED;
+		}
+		count++;
+
+		p = nl ? nl + 1 : end;
+	}
+
+	*ents_out = ents;
+	*expected_out = expected;
+	return count;
+}
+
+static void publish(check_ctx_t *ctx, entry_t *e, int state) {
+	__atomic_store_n(&e->state, (uint8_t)state, __ATOMIC_RELEASE);
+	if (state != ENT_OK && state != ENT_MISSING && ctx->opts->status) {
+		// Exit status is all that is left to report
+		__atomic_store_n(&ctx->stop, 1, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->waiting) {
+		pthread_cond_broadcast(&ctx->ready);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void verify_worker(void *arg) {
+	check_ctx_t *ctx = arg;
+	const SumCheckOpts *opts = ctx->opts;
+	unsigned char digest[SUM_MAX_DIGEST];
+	char path[PATH_MAX];
+
+	while (!__atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE)) {
+		size_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+		if (i >= ctx->count) {
+			break;
+		}
+
+		entry_t *e = &ctx->ents[i];
+		if (__atomic_load_n(&e->state, __ATOMIC_RELAXED) == ENT_MALFORMED) {
+			continue;
+		}
+
+		if (e->name_len >= sizeof(path)) {
+			e->err = ENAMETOOLONG;
+			publish(ctx, e, ENT_UNREADABLE);
+			continue;
+		}
+		memcpy(path, ctx->data + e->name, e->name_len);
+		path[e->name_len] = '\0';
+
+		int ret = sumCacheFile(opts->cache, path, opts->sum, digest, e->binary || opts->binary);
+		if (ret != 0) {
+			e->err = errno;
+			publish(ctx, e, (ret == -1 && e->err == ENOENT && opts->ignore_missing)
+					? ENT_MISSING : ENT_UNREADABLE);
+		} else if (memcmp(digest, ctx->expected + i * opts->digest_len, opts->digest_len) != 0) {
+			publish(ctx, e, ENT_FAILED);
+		} else {
+			publish(ctx, e, ENT_OK);
+		}
+	}
+}
+
+// Wait for an entry to be verified, return: its state, ENT_PENDING if stopped
+static int wait_entry(check_ctx_t *ctx, entry_t *e) {
+	int state = __atomic_load_n(&e->state, __ATOMIC_ACQUIRE);
+	if (state != ENT_PENDING) {
+		return state;
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+	while ((state = __atomic_load_n(&e->state, __ATOMIC_ACQUIRE)) == ENT_PENDING
+			&& !__atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE)) {
+		ctx->waiting = 1;
+		pthread_cond_wait(&ctx->ready, &ctx->lock);
+		ctx->waiting = 0;
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	return state;
+}
+
+int sumCheckFile(const SumCheckOpts *opts, const char *manifest, SumCheckResult *res) {
+	const char *display = strcmp(manifest, "-") == 0 ? "standard input" : manifest;
+	manifest_t m;
+	entry_t *ents;
+	unsigned char *expected;
+
+	memset(res, 0, sizeof(*res));
+	if (opts->digest_len > SUM_MAX_DIGEST) {
+		return -1;
+	}
+
+	if (manifest_load(manifest, &m) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", opts->prog, display, strerror(errno));
+		return -1;
+	}
+
+	size_t count = parse_manifest(opts, &m, &ents, &expected);
+	res->lines = count;
+	for (size_t i = 0; i < count; i++) {
+		if (ents[i].state == ENT_MALFORMED) {
+			res->malformed++;
+		}
+	}
+	res->total = count - res->malformed;
+
+	int verify = res->total > 0;
+	if (opts->status && opts->strict && res->malformed > 0) {
+		// The exit status is already known
+		verify = 0;
+		res->stopped = 1;
+	}
+
+	check_ctx_t ctx = {
+		.opts = opts, .data = m.data, .ents = ents,
+		.expected = expected, .count = count,
+	};
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.ready, NULL);
+
+	WorkPool *pool = NULL;
+	if (verify) {
+		int nthreads = workPoolThreads(opts->threads);
+		if ((size_t)nthreads > (size_t)res->total) {
+			nthreads = res->total;
+		}
+		pool = workPoolCreate(nthreads);
+		if (workPoolSize(pool) > 0) {
+			for (int i = 0; i < nthreads; i++) {
+				workPoolSubmit(pool, verify_worker, &ctx);
+			}
+		} else {
+			// Nobody would pick the workers up before the report below waits
+			verify_worker(&ctx);
+		}
+	}
+
+	// Report in manifest order
+	for (size_t i = 0; i < count; i++) {
+		entry_t *e = &ents[i];
+		int len = e->name_len;
+		const char *name = m.data + e->name;
+
+		if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == ENT_MALFORMED) {
+			if (opts->warn) {
+				fflush(stdout);
+				fprintf(stderr, "%s: %s: %u: improperly formatted %s checksum line\n",
+						opts->prog, display, e->line, opts->tag ? opts->tag : "");
+			}
+			continue;
+		}
+		if (!verify) {
+			continue;
+		}
+
+		int state = wait_entry(&ctx, e);
+		if (state == ENT_PENDING) {
+			res->stopped = 1;
+			break;
+		}
+
+		switch (state) {
+			case ENT_OK:
+				if (!opts->quiet && !opts->status) {
+					printf("%.*s: OK\n", len, name);
+				}
+				break;
+			case ENT_FAILED:
+				res->mismatched++;
+				if (!opts->status) {
+					printf("%.*s: FAILED\n", len, name);
+				}
+				break;
+			case ENT_UNREADABLE:
+				res->unreadable++;
+				if (!opts->status) {
+					fflush(stdout);
+					fprintf(stderr, "%s: %.*s: %s\n", opts->prog, len, name, strerror(e->err));
+					printf("%.*s: FAILED open or read\n", len, name);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	workPoolDestroy(pool);
+	pthread_mutex_destroy(&ctx.lock);
+	pthread_cond_destroy(&ctx.ready);
+	xfree(ents);
+	xfree(expected);
+	manifest_free(&m);
+
+	if (res->total == 0) {
+		if (!opts->status) {
+			fprintf(stderr, "%s: %s: no properly formatted checksum lines found\n",
+					opts->prog, display);
+		}
+		return 1;
+	}
+
+	if (res->stopped || res->mismatched || res->unreadable
+			|| (opts->strict && res->malformed)) {
+		return 1;
+	}
+	return 0;
+}
+
+void sumCheckReport(const SumCheckOpts *opts, const SumCheckResult *res) {
+	if (opts->status) {
+		return;
+	}
+
+	fflush(stdout);
+	if (res->malformed && res->total) {
+		fprintf(stderr, "%s: WARNING: %d line%s improperly formatted\n",
+				opts->prog, res->malformed, res->malformed == 1 ? " is" : "s are");
+	}
+	if (res->unreadable) {
+		fprintf(stderr, "%s: WARNING: %d listed file%s could not be read\n",
+				opts->prog, res->unreadable, res->unreadable == 1 ? "" : "s");
+	}
+	if (res->mismatched) {
+		fprintf(stderr, "%s: WARNING: %d computed checksum%s did NOT match\n",
+				opts->prog, res->mismatched, res->mismatched == 1 ? "" : "s");
+	}
+}
@@ -0,0 +1,212 @@
+/*
+ * sumRead.c - Read-ahead file reader for the checksum commands
+ *
+ * Large regular files are hashed through a two stage pipeline: an I/O thread
+ * fills a ring of page aligned chunks (and keeps an explicit read-ahead window
+ * in flight) while the calling thread feeds the filled chunks to the hash, so
+ * waiting for the disk and hashing overlap. Small files, pipes and terminals
+ * are read in the calling thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+#include "checksum.h"
+
+#define SUM_CHUNK	(1 << 20)		// Bytes per pipeline chunk
+#define SUM_SLOTS	4			// Chunks in the ring
+#define SUM_WINDOW	(16 << 20)		// Read-ahead window in front of the reader
+#define SUM_PIPE_MIN	(SUM_CHUNK * SUM_SLOTS)	// Smaller files are read directly
+#define SUM_SMALL_BUF	(64 << 10)		// Buffer of the direct reader
+
+typedef struct {
+	int fd;
+	unsigned char *buf[SUM_SLOTS];
+	size_t len[SUM_SLOTS];
+	int full[SUM_SLOTS];	// Slot holds data for the hash
+	int eof;		// Reader published its last chunk
+	int err;		// errno of a failed read
+	int quit;		// Hash side gave up
+
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+} sum_pipe_t;
+
+// Read until the buffer is full or EOF, return: bytes read, -1 on error
+static ssize_t read_full(int fd, unsigned char *buf, size_t size) {
+	size_t done = 0;
+
+	while (done < size) {
+		ssize_t n = read(fd, buf + done, size - done);
+		if (n == 0) {
+			break;
+		}
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		done += n;
+	}
+	return done;
+}
+
+static void *reader_main(void *arg) {
+	sum_pipe_t *p = arg;
+	off_t offset = 0;
+
+	for (int slot = 0; ; slot = (slot + 1) % SUM_SLOTS) {
+		pthread_mutex_lock(&p->lock);
+		while (p->full[slot] && !p->quit) {
+			pthread_cond_wait(&p->cv, &p->lock);
+		}
+		int quit = p->quit;
+		pthread_mutex_unlock(&p->lock);
+		if (quit) {
+			break;
+		}
+
+		// Keep the kernel busy with the data we will need next
+		posix_fadvise(p->fd, offset + SUM_WINDOW, SUM_CHUNK, POSIX_FADV_WILLNEED);
+
+		ssize_t n = read_full(p->fd, p->buf[slot], SUM_CHUNK);
+		int err = n < 0 ? errno : 0;
+
+		pthread_mutex_lock(&p->lock);
+		if (n > 0) {
+			p->len[slot] = n;
+			p->full[slot] = 1;
+		}
+		if (err) {
+			p->err = err;
+		} else if (n < SUM_CHUNK) {
+			p->eof = 1;
+		}
+		pthread_cond_broadcast(&p->cv);
+		pthread_mutex_unlock(&p->lock);
+
+		if (err || n < SUM_CHUNK) {
+			break;
+		}
+		offset += n;
+	}
+
+	return NULL;
+}
+
+// Hash a large regular file through the pipeline, return: 0->success, -2->read error
+static int read_pipelined(int fd, sumFeedFunc feed, void *ctx) {
+	sum_pipe_t p;
+	pthread_t tid;
+	int ret = 0;
+
+	memset(&p, 0, sizeof(p));
+	p.fd = fd;
+	for (int i = 0; i < SUM_SLOTS; i++) {
+		if (posix_memalign((void **)&p.buf[i], 4096, SUM_CHUNK) != 0) {
+			for (int j = 0; j < i; j++) free(p.buf[j]);
+			return 1;
+		}
+	}
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.cv, NULL);
+
+	if (pthread_create(&tid, NULL, reader_main, &p) != 0) {
+		ret = 1;
+		goto out;
+	}
+
+	for (int slot = 0; ; slot = (slot + 1) % SUM_SLOTS) {
+		pthread_mutex_lock(&p.lock);
+		while (!p.full[slot] && !p.eof && !p.err) {
+			pthread_cond_wait(&p.cv, &p.lock);
+		}
+		int full = p.full[slot], err = p.err;
+		pthread_mutex_unlock(&p.lock);
+
+		if (!full) {
+			// Chunks are published in order, an empty slot means we are done
+			if (err) {
+				errno = err;
+				ret = -2;
+			}
+			break;
+		}
+
+		feed(ctx, p.buf[slot], p.len[slot]);
+
+		pthread_mutex_lock(&p.lock);
+		p.full[slot] = 0;
+		pthread_cond_broadcast(&p.cv);
+		pthread_mutex_unlock(&p.lock);
+	}
+
+	pthread_mutex_lock(&p.lock);
+	p.quit = 1;
+	pthread_cond_broadcast(&p.cv);
+	pthread_mutex_unlock(&p.lock);
+	pthread_join(tid, NULL);
+
+out:
+	pthread_mutex_destroy(&p.lock);
+	pthread_cond_destroy(&p.cv);
+	for (int i = 0; i < SUM_SLOTS; i++) {
+		free(p.buf[i]);
+	}
+	if (ret == -2) {
+		errno = p.err;
+	}
+	return ret;
+}
+
+int sumReadFd(int fd, sumFeedFunc feed, void *ctx) {
+	struct stat st;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		if (st.st_size >= SUM_PIPE_MIN) {
+			int ret = read_pipelined(fd, feed, ctx);
+			if (ret <= 0) {
+				return ret;
+			}
+			// Could not set the pipeline up, fall back to reading here
+		}
+	}
+
+	unsigned char buf[SUM_SMALL_BUF];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -2;
+		}
+		feed(ctx, buf, n);
+	}
+	return 0;
+}
+
+int sumReadFile(const char *path, sumFeedFunc feed, void *ctx) {
+	int fd = STDIN_FILENO;
+
+	if (strcmp(path, "-") != 0) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return -1;
+		}
+	}
+
+	int ret = sumReadFd(fd, feed, ctx);
+
+	if (fd != STDIN_FILENO) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+	}
+	return ret;
+}
@@ -0,0 +1,357 @@
+/*
+ * sumTree.c - Recursive manifests ('-r') for the checksum commands
+ *
+ * Two phases on one work pool. The walk submits a task per directory, so
+ * sibling directories are read concurrently, and collects the paths of the
+ * regular files. The paths are then sorted and hashed by the pool threads
+ * in that order while the calling thread prints the lines as soon as the
+ * ones before them are done, so the manifest streams out sorted and can be
+ * fed back to '-c'.
+ *
+ * The walk allocates on pool threads, so it uses plain malloc(): xalloc's
+ * block list is not thread safe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+#include "checksum.h"
+#include "workPool.h"
+
+#define TREE_MAX_DIGEST 64
+
+// Directory on the path from an operand to the one being read (-L loops)
+typedef struct tree_node {
+	dev_t dev;
+	ino_t ino;
+	struct tree_node *parent;
+	struct tree_node *next;		// All nodes, freed at the end
+} tree_node_t;
+
+typedef struct {
+	const SumTreeOpts *opts;
+	WorkPool *pool;
+	dev_t root_dev;			// Filesystem of the operand (-x)
+
+	pthread_mutex_t lock;		// Protects everything below
+	char **paths;			// Regular files found
+	size_t count;
+	size_t cap;
+	tree_node_t *nodes;
+	int errors;
+} walk_ctx_t;
+
+typedef struct {
+	walk_ctx_t *ctx;
+	char *path;
+	tree_node_t *node;
+} dir_task_t;
+
+// Entry states of the hashing phase
+enum {
+	TREE_PENDING = 0,
+	TREE_DONE,
+	TREE_FAILED,
+};
+
+typedef struct {
+	const SumTreeOpts *opts;
+	char **paths;
+	unsigned char *digests;
+	uint8_t *state;			// TREE_* per path (atomic)
+	int *err;			// errno of a failed path
+	size_t count;
+	size_t next;			// Next path to claim (atomic)
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	int waiting;			// Printer is sleeping on 'ready'
+} hash_ctx_t;
+
+static void walk_error(walk_ctx_t *ctx, const char *path, int err) {
+	pthread_mutex_lock(&ctx->lock);
+	fprintf(stderr, "%s: %s: %s\n", ctx->opts->prog, path, strerror(err));
+	ctx->errors++;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void *tree_alloc(void *ptr, size_t size) {
+	void *p = realloc(ptr, size);
+	if (!p) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+static char *tree_strdup(const char *s) {
+	size_t len = strlen(s) + 1;
+	return memcpy(tree_alloc(NULL, len), s, len);
+}
+
+static void add_path(walk_ctx_t *ctx, char *path) {
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->count == ctx->cap) {
+		ctx->cap = ctx->cap ? ctx->cap * 2 : 1024;
+		ctx->paths = tree_alloc(ctx->paths, ctx->cap * sizeof(*ctx->paths));
+	}
+	ctx->paths[ctx->count++] = path;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static char *join_path(const char *dir, const char *name) {
+	size_t dlen = strlen(dir), nlen = strlen(name);
+	int slash = dlen > 0 && dir[dlen - 1] != '/';
+	char *p = tree_alloc(NULL, dlen + slash + nlen + 1);
+
+	memcpy(p, dir, dlen);
+	if (slash) {
+		p[dlen] = '/';
+	}
+	memcpy(p + dlen + slash, name, nlen + 1);
+	return p;
+}
+
+static void walk_dir(void *arg);
+
+// Queue a directory unless it is one of its own ancestors (a symlink loop)
+static void queue_dir(walk_ctx_t *ctx, char *path, const struct stat *st, tree_node_t *parent) {
+	for (tree_node_t *n = parent; n; n = n->parent) {
+		if (n->dev == st->st_dev && n->ino == st->st_ino) {
+			pthread_mutex_lock(&ctx->lock);
+			fprintf(stderr, "%s: %s: file system loop detected\n", ctx->opts->prog, path);
+			ctx->errors++;
+			pthread_mutex_unlock(&ctx->lock);
+			free(path);
+			return;
+		}
+	}
+
+	tree_node_t *node = tree_alloc(NULL, sizeof(*node));
+	node->dev = st->st_dev;
+	node->ino = st->st_ino;
+	node->parent = parent;
+	pthread_mutex_lock(&ctx->lock);
+	node->next = ctx->nodes;
+	ctx->nodes = node;
+	pthread_mutex_unlock(&ctx->lock);
+
+	dir_task_t *t = tree_alloc(NULL, sizeof(*t));
+	t->ctx = ctx;
+	t->path = path;
+	t->node = node;
+	workPoolSubmit(ctx->pool, walk_dir, t);
+}
+
+static void walk_dir(void *arg) {
+	dir_task_t *t = arg;
+	walk_ctx_t *ctx = t->ctx;
+	const SumTreeOpts *opts = ctx->opts;
+
+	int fd = open(t->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+	if (d == NULL) {
+		walk_error(ctx, t->path, errno);
+		if (fd >= 0) {
+			close(fd);
+		}
+		goto out;
+	}
+
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		const char *name = de->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+			continue;
+		}
+
+		// d_type saves the stat of plain files, directories need one for -x / -L
+		int type = de->d_type;
+		struct stat st;
+		int have_st = 0;
+		if (type == DT_UNKNOWN || type == DT_DIR || (type == DT_LNK && opts->follow)) {
+			if (fstatat(dirfd(d), name, &st, opts->follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+				char *p = join_path(t->path, name);
+				walk_error(ctx, p, errno);
+				free(p);
+				continue;
+			}
+			have_st = 1;
+			type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+		}
+
+		if (type == DT_REG) {
+			add_path(ctx, join_path(t->path, name));
+		} else if (type == DT_DIR && have_st) {
+			if (opts->one_fs && st.st_dev != ctx->root_dev) {
+				continue;
+			}
+			queue_dir(ctx, join_path(t->path, name), &st, t->node);
+		}
+	}
+	closedir(d);
+
+out:
+	free(t->path);
+	free(t);
+}
+
+static int path_cmp(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void hash_worker(void *arg) {
+	hash_ctx_t *h = arg;
+	const SumTreeOpts *opts = h->opts;
+
+	for (;;) {
+		size_t i = __atomic_fetch_add(&h->next, 1, __ATOMIC_RELAXED);
+		if (i >= h->count) {
+			break;
+		}
+
+		int state = TREE_DONE;
+		if (sumCacheFile(opts->cache, h->paths[i], opts->sum, h->digests + i * opts->digest_len, opts->binary) != 0) {
+			h->err[i] = errno;
+			state = TREE_FAILED;
+		}
+		__atomic_store_n(&h->state[i], (uint8_t)state, __ATOMIC_RELEASE);
+
+		pthread_mutex_lock(&h->lock);
+		if (h->waiting) {
+			pthread_cond_broadcast(&h->ready);
+		}
+		pthread_mutex_unlock(&h->lock);
+	}
+}
+
+static void print_line(const SumTreeOpts *opts, const char *path, const unsigned char *digest) {
+	static const char hex_chars[] = "0123456789abcdef";
+	char hex[2 * TREE_MAX_DIGEST + 1];
+
+	for (size_t i = 0; i < opts->digest_len; i++) {
+		hex[2 * i] = hex_chars[digest[i] >> 4];
+		hex[2 * i + 1] = hex_chars[digest[i] & 0x0F];
+	}
+	hex[2 * opts->digest_len] = '\0';
+
+	if (opts->bsd_tag) {
+		printf("%s (%s) = %s", opts->tag, path, hex);
+	} else {
+		printf("%s %c%s", hex, opts->binary ? '*' : ' ', path);
+	}
+	putchar(opts->zero ? '\0' : '\n');
+}
+
+// Hash the sorted paths on the pool, print them in order
+static int hash_paths(const SumTreeOpts *opts, WorkPool *pool, int nthreads, char **paths, size_t count) {
+	hash_ctx_t h = {
+		.opts = opts, .paths = paths, .count = count,
+		.digests = xmalloc(count * opts->digest_len + 1),
+		.state = xcalloc(count + 1, sizeof(uint8_t)),
+		.err = xcalloc(count + 1, sizeof(int)),
+	};
+	int ret = 0;
+
+	pthread_mutex_init(&h.lock, NULL);
+	pthread_cond_init(&h.ready, NULL);
+	if (workPoolSize(pool) > 0) {
+		for (int i = 0; i < nthreads && (size_t)i < count; i++) {
+			workPoolSubmit(pool, hash_worker, &h);
+		}
+	} else {
+		// No thread would take the workers, the loop below would wait forever
+		hash_worker(&h);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		int state = __atomic_load_n(&h.state[i], __ATOMIC_ACQUIRE);
+		if (state == TREE_PENDING) {
+			pthread_mutex_lock(&h.lock);
+			while ((state = __atomic_load_n(&h.state[i], __ATOMIC_ACQUIRE)) == TREE_PENDING) {
+				h.waiting = 1;
+				pthread_cond_wait(&h.ready, &h.lock);
+				h.waiting = 0;
+			}
+			pthread_mutex_unlock(&h.lock);
+		}
+
+		if (state == TREE_FAILED) {
+			fflush(stdout);
+			fprintf(stderr, "%s: %s: %s\n", opts->prog, paths[i], strerror(h.err[i]));
+			ret = 1;
+		} else {
+			print_line(opts, paths[i], h.digests + i * opts->digest_len);
+		}
+	}
+
+	workPoolWait(pool);
+	pthread_mutex_destroy(&h.lock);
+	pthread_cond_destroy(&h.ready);
+	xfree(h.digests);
+	xfree(h.state);
+	xfree(h.err);
+	return ret;
+}
+
+int sumTreeFile(const SumTreeOpts *opts, const char *root) {
+	struct stat st;
+	int ret = 0;
+
+	if (opts->digest_len > TREE_MAX_DIGEST) {
+		return 1;
+	}
+	if (stat(root, &st) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", opts->prog, root, strerror(errno));
+		return 1;
+	}
+
+	walk_ctx_t ctx = {
+		.opts = opts,
+		.root_dev = st.st_dev,
+	};
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	int nthreads = workPoolThreads(opts->threads);
+	ctx.pool = workPoolCreate(nthreads);
+	if (ctx.pool == NULL) {
+		fprintf(stderr, "%s: %s\n", opts->prog, strerror(errno));
+		pthread_mutex_destroy(&ctx.lock);
+		return 1;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		queue_dir(&ctx, tree_strdup(root), &st, NULL);
+		workPoolWait(ctx.pool);
+	} else {
+		// A plain operand is listed as it is
+		add_path(&ctx, tree_strdup(root));
+	}
+
+	qsort(ctx.paths, ctx.count, sizeof(*ctx.paths), path_cmp);
+	if (hash_paths(opts, ctx.pool, nthreads, ctx.paths, ctx.count) != 0 || ctx.errors) {
+		ret = 1;
+	}
+
+	workPoolDestroy(ctx.pool);
+	for (size_t i = 0; i < ctx.count; i++) {
+		free(ctx.paths[i]);
+	}
+	free(ctx.paths);
+	while (ctx.nodes) {
+		tree_node_t *n = ctx.nodes;
+		ctx.nodes = n->next;
+		free(n);
+	}
+	pthread_mutex_destroy(&ctx.lock);
+	return ret;
+}
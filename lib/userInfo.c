@@ -1,371 +1,757 @@
-/*
- * userInfo.c - Lightweight user and group information library implementation
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-#include <stdbool.h>
-#if LIBNSS || ANDROID_NSS
-# include <grp.h>
-# include <pwd.h>
-#endif
-
-#include "lib.h"
-#include "debug.h"
-
-// Internal structures
-typedef struct passwd_entry {
-	uid_t uid;
-	gid_t gid;
-	char *name;
-	char *home_dir;
-	char *shell;
-	struct passwd_entry *next;
-} passwd_entry_t;
-
-typedef struct group_entry {
-	gid_t gid;
-	char *name;
-	struct group_entry *next;
-} group_entry_t;
-
-// Linked list heads
-static passwd_entry_t *passwd_list = NULL;
-static group_entry_t *group_list = NULL;
-
-// Internal helper functions
-static char *trim_whitespace(char *str) {
-	if (!str) return NULL;
-	
-	// Trim leading space
-	while (*str && (*str == ' ' || *str == '\t')) str++;
-	
-	if (!*str) return str;
-	
-	// Trim trailing space
-	char *end = str + strlen(str) - 1;
-	while (end > str && (*end == ' ' || *end == '\t' || *end == '\n')) {
-		*end-- = '\0';
-	}
-	
-	return str;
-}
-
-static void free_passwd_list(void) {
-	passwd_entry_t *current = passwd_list;
-	while (current) {
-		passwd_entry_t *next = current->next;
-		xfree(current->name);
-		xfree(current->home_dir);
-		xfree(current->shell);
-		xfree(current);
-		current = next;
-	}
-	passwd_list = NULL;
-}
-
-static void free_group_list(void) {
-	group_entry_t *current = group_list;
-	while (current) {
-		group_entry_t *next = current->next;
-		xfree(current->name);
-		xfree(current);
-		current = next;
-	}
-	group_list = NULL;
-}
-
-static bool parse_passwd_file(void) {
-#if HAVE_PASSWD
-	FILE *fp = fopen("/etc/passwd", "r");
-#else
-	FILE *fp = NULL;
-#endif
-	if (!fp) {
-		return false;
-	}
-
-	// Free existing list if any
-	free_passwd_list();
-
-	char line[1024];
-	passwd_entry_t *tail = NULL;
-
-	while (fgets(line, sizeof(line), fp)) {
-		// Skip comments and empty lines
-		if (line[0] == '#' || line[0] == '\n') continue;
-
-		char *token = strtok(line, ":");
-		if (!token) continue;
-
-		passwd_entry_t *entry = xmalloc(sizeof(passwd_entry_t));
-		if (!entry) {
-			fclose(fp);
-			free_passwd_list();
-			return false;
-		}
-
-		// Initialize the entry
-		entry->name = strdup(trim_whitespace(token));
-		token = strtok(NULL, ":");
-
-		// Skip password field
-		token = strtok(NULL, ":");
-		if (token) entry->uid = atoi(trim_whitespace(token));
-
-		token = strtok(NULL, ":");
-		if (token) entry->gid = atoi(trim_whitespace(token));
-
-		// Skip GECOS
-		token = strtok(NULL, ":");
-
-		token = strtok(NULL, ":");
-		if (token) entry->home_dir = strdup(trim_whitespace(token));
-
-		token = strtok(NULL, ":");
-		if (token) entry->shell = strdup(trim_whitespace(token));
-
-		token = strtok(NULL, ":");
-		// Ignore any remaining fields
-
-		entry->next = NULL;
-
-		// Add to list
-		if (!passwd_list) {
-			passwd_list = entry;
-			tail = entry;
-		} else {
-			tail->next = entry;
-			tail = entry;
-		}
-	}
-	
-	fclose(fp);
-	return true;
-}
-
-static bool parse_group_file(void) {
-#if HAVE_GROUP
-	FILE *fp = fopen("/etc/group", "r");
-#else
-	FILE *fp = NULL;
-#endif
-	if (!fp) {
-		return false;
-	}
-	
-	// Free existing list if any
-	free_group_list();
-	
-	char line[1024];
-	group_entry_t *tail = NULL;
-	
-	while (fgets(line, sizeof(line), fp)) {
-		// Skip comments and empty lines
-		if (line[0] == '#' || line[0] == '\n') continue;
-		
-		char *token = strtok(line, ":");
-		if (!token) continue;
-		
-		group_entry_t *entry = xmalloc(sizeof(group_entry_t));
-		if (!entry) {
-			fclose(fp);
-			free_group_list();
-			return false;
-		}
-		
-		// Initialize the entry
-		entry->name = strdup(trim_whitespace(token));
-		token = strtok(NULL, ":");
-		
-		// Skip password field
-		token = strtok(NULL, ":");
-		if (token) entry->gid = atoi(trim_whitespace(token));
-		
-	// Skip member list
-		entry->next = NULL;
-		
-		// Add to list
-		if (!group_list) {
-			group_list = entry;
-			tail = entry;
-		} else {
-			tail->next = entry;
-			tail = entry;
-		}
-	}
-	
-	fclose(fp);
-	return true;
-}
-
-const char *get_username(uid_t uid) {
-	static char uid_buf[16];
-
-#if ANDROID_NSS || LIBNSS
-	snprintf(uid_buf, sizeof(uid_buf), "%s", getpwuid(uid)->pw_name);
-#else
-
-	// Parse passwd file if not already done
-	if (!passwd_list && !parse_passwd_file()) {
-		snprintf(uid_buf, sizeof(uid_buf), "%d", uid);
-		return uid_buf;
-	}
-
-	// Search for the UID
-	passwd_entry_t *current = passwd_list;
-	while (current) {
-		if (current->uid == uid) {
-			return current->name;
-		}
-		current = current->next;
-	}
-
-	// Not found, return UID as string
-	snprintf(uid_buf, sizeof(uid_buf), "%d", uid);
-#endif
-	return uid_buf;
-}
-
-const char *get_groupname(gid_t gid) {
-	static char gid_buf[16];
-
-#if ANDROID_NSS || LIBNSS
-	snprintf(gid_buf, sizeof(gid_buf), "%s", getgrgid(gid)->gr_name);
-#else
-	// Parse group file if not already done
-	if (!group_list && !parse_group_file()) {
-		snprintf(gid_buf, sizeof(gid_buf), "%d", gid);
-		return gid_buf;
-	}
-	
-	// Search for the GID
-	group_entry_t *current = group_list;
-	while (current) {
-		if (current->gid == gid) {
-			return current->name;
-		}
-		current = current->next;
-	}
-
-	// Not found, return GID as string
-	snprintf(gid_buf, sizeof(gid_buf), "%d", gid);
-#endif
-	return gid_buf;
-}
-
-bool get_user_info(uid_t uid, user_info_t *info) {
-	if (!info) return false;
-	
-	// Initialize with default values
-	info->uid = uid;
-	info->gid = (gid_t)-1;
-	info->name = NULL;
-	info->home_dir = NULL;
-	info->shell = NULL;
-	
-	// Parse passwd file if not already done
-	if (!passwd_list && !parse_passwd_file()) {
-		return false;
-	}
-	
-	// Search for the UID
-	passwd_entry_t *current = passwd_list;
-	while (current) {
-		if (current->uid == uid) {
-			info->gid = current->gid;
-			info->name = current->name;
-			info->home_dir = current->home_dir;
-			info->shell = current->shell;
-			return true;
-		}
-		current = current->next;
-	}
-	
-	return false;
-}
-
-bool get_group_info(gid_t gid, group_info_t *info) {
-	if (!info) return false;
-	
-	// Initialize with default values
-	info->gid = gid;
-	info->name = NULL;
-	
-	// Parse group file if not already done
-	if (!group_list && !parse_group_file()) {
-		return false;
-	}
-	
-	// Search for the GID
-	group_entry_t *current = group_list;
-	while (current) {
-		if (current->gid == gid) {
-			info->name = current->name;
-			return true;
-		}
-		current = current->next;
-	}
-	
-	return false;
-}
-
-static int getuid_gid_name(const char *name, bool isGid) {
-#if ANDROID_NSS || LIBNSS
-	return isGid ? getgrnam(name)->gr_gid : getpwnam(name)->pw_uid;
-#else
-	if (!passwd_list && !parse_passwd_file()) {
-		return -1;
-	}
-
-	passwd_entry_t *current = passwd_list;
-	while(current) {
-		if (strcmp(current->name, name) == 0) {
-			return isGid ? current->gid : current->uid;
-		}
-		current = current->next;
-	}
-#endif
-	return -1;
-}
-
-uid_t getuid_name(const char *name) {
-	return getuid_gid_name(name, false);
-}
-
-gid_t getgid_name(const char *name) {
-	return getuid_gid_name(name, true);
-}
-
-void free_user_info(user_info_t *info) {
-	// This function exists for API symmetry but doesn't need to do anything
-	// since we're not allocating memory for the returned strings
-	(void)info;
-}
-
-void free_group_info(group_info_t *info) {
-	// This function exists for API symmetry but doesn't need to do anything
-	// since we're not allocating memory for the returned strings
-	(void)info;
-}
-
-// Cleanup function (call this at program exit)
-void userinfo_cleanup(void) {
-	free_passwd_list();
-	free_group_list();
-}
-
-#ifdef DEBUG
-
-initary
-void __userInfo__ () {
-#if LIBNSS || ANDROID_NSS
-	LOG("Name Service Switch(NSS) enabled\n");
-#else
-	LOG("Name Service Switch(NSS) disabled\n");
-#endif
-}
-
-#endif
+/*
+ * userInfo.c - Lightweight user and group information library implementation
+ *
+ * /etc/passwd and /etc/group are mapped once and split in place (the private
+ * mapping takes the field terminators), the entries land in arrays indexed
+ * by open-addressing hash tables on the id and on the name. With NSS the
+ * libc lookups are memoized instead. Either way the names handed out by
+ * get_username()/get_groupname() are cached per id, numeric fallbacks
+ * included, so they stay valid and repeated lookups cost one probe.
+ *
+ * Everything is behind one lock and uses plain malloc(), lookups may come
+ * from pool threads. NSS calls run with the lock dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if LIBNSS || ANDROID_NSS
+# include <grp.h>
+# include <pwd.h>
+#endif
+
+#include "lib.h"
+#include "debug.h"
+
+// Internal structures
+typedef struct {
+	uid_t uid;
+	gid_t gid;
+	const char *name;
+	const char *home_dir;
+	const char *shell;
+} passwd_entry_t;
+
+typedef struct {
+	gid_t gid;
+	const char *name;
+	const char *members;	// Comma separated user names
+} group_entry_t;
+
+// Open addressing table, slots hold an entry index + 1 (0: empty)
+typedef struct {
+	uint32_t *slots;
+	size_t mask;
+} db_index_t;
+
+typedef struct {
+	char *map;		// Private mapping, fields are split in place
+	size_t map_len;
+	int state;		// 0: not loaded yet, 1: loaded, -1: unavailable
+} db_file_t;
+
+// Names handed out per id, real or numeric
+typedef struct {
+	uint32_t id;
+	char *name;		// NULL: empty slot
+} name_slot_t;
+
+typedef struct {
+	name_slot_t *slots;
+	size_t mask;
+	size_t count;
+} name_cache_t;
+
+static pthread_mutex_t db_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static db_file_t passwd_file, group_file;
+static passwd_entry_t *users;
+static size_t user_count;
+static db_index_t users_by_id, users_by_name;
+static group_entry_t *groups;
+static size_t group_count;
+static db_index_t groups_by_id, groups_by_name;
+
+static name_cache_t user_names, group_names;
+
+static inline size_t hash_id(uint32_t id) {
+	return (size_t)(id * 0x9e3779b97f4a7c15ULL >> 32);
+}
+
+static inline size_t hash_name(const char *s) {
+	uint64_t h = 0xcbf29ce484222325ULL;	// FNV-1a
+
+	while (*s) {
+		h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+	}
+	return (size_t)(h ^ h >> 32);
+}
+
+static void *db_alloc(size_t size) {
+	void *p = calloc(1, size);
+	if (!p) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+static void index_init(db_index_t *idx, size_t count) {
+	size_t size = 16;
+	while (size < count * 2) {
+		size *= 2;
+	}
+	idx->slots = db_alloc(size * sizeof(uint32_t));
+	idx->mask = size - 1;
+}
+
+/*
+ * Map a database file writable and private, with a terminator after the
+ * last line. When the file fills its last page there is no room behind
+ * it, the text is copied to an anonymous mapping then.
+ */
+static bool map_db(db_file_t *db, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	size_t len = st.st_size;
+	long page = sysconf(_SC_PAGESIZE);
+	char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED && len % page == 0) {
+		char *copy = mmap(NULL, len + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (copy != MAP_FAILED) {
+			memcpy(copy, map, len);
+		}
+		munmap(map, len);
+		map = copy;
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+
+	map[len] = '\n';
+	db->map = map;
+	db->map_len = len + 1;
+	return true;
+}
+
+/*
+ * Split a line into its ':' fields in place
+ *
+ * @return number of fields found, at most max
+ */
+static int split_fields(char *line, char *end, char **fields, int max) {
+	int n = 0;
+
+	*end = '\0';
+	while (n < max) {
+		fields[n++] = line;
+		char *colon = memchr(line, ':', end - line);
+		if (colon == NULL) {
+			break;
+		}
+		*colon = '\0';
+		line = colon + 1;
+	}
+	return n;
+}
+
+// Parse a decimal id, false for an empty or malformed field
+static bool parse_id(const char *s, uint32_t *id) {
+	uint64_t v = 0;
+
+	if (*s == '\0') {
+		return false;
+	}
+	for (; *s; s++) {
+		if (*s < '0' || *s > '9' || (v = v * 10 + (*s - '0')) > UINT32_MAX) {
+			return false;
+		}
+	}
+	*id = v;
+	return true;
+}
+
+// Count the lines of a mapped file, an upper bound for its entries
+static size_t count_lines(const db_file_t *db) {
+	size_t n = 0;
+	const char *p = db->map, *end = db->map + db->map_len;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL) {
+		n++;
+		p++;
+	}
+	return n;
+}
+
+/*
+ * Probe for key; the first entry of a key wins, like the libc lookups
+ *
+ * @return slot of the key or of the empty slot where it belongs
+ */
+static uint32_t *probe_id(db_index_t *idx, size_t h, uint32_t id, bool group) {
+	for (size_t i = h & idx->mask;; i = (i + 1) & idx->mask) {
+		uint32_t s = idx->slots[i];
+		if (s == 0 || (group ? groups[s - 1].gid : users[s - 1].uid) == id) {
+			return &idx->slots[i];
+		}
+	}
+}
+
+static uint32_t *probe_name(db_index_t *idx, const char *name, bool group) {
+	for (size_t i = hash_name(name) & idx->mask;; i = (i + 1) & idx->mask) {
+		uint32_t s = idx->slots[i];
+		if (s == 0 || strcmp(group ? groups[s - 1].name : users[s - 1].name, name) == 0) {
+			return &idx->slots[i];
+		}
+	}
+}
+
+static bool load_passwd(void) {
+	if (passwd_file.state != 0) {
+		return passwd_file.state > 0;
+	}
+	passwd_file.state = -1;
+#if HAVE_PASSWD
+	const char *path = "/etc/passwd";
+#else
+	const char *path = NULL;
+#endif
+	if (!path || !map_db(&passwd_file, path)) {
+		return false;
+	}
+
+	size_t max = count_lines(&passwd_file);
+	users = db_alloc(max * sizeof(passwd_entry_t));
+	index_init(&users_by_id, max);
+	index_init(&users_by_name, max);
+
+	char *p = passwd_file.map, *end = passwd_file.map + passwd_file.map_len;
+	while (p < end) {
+		char *line = p, *nl = memchr(p, '\n', end - p);
+		char *f[7];
+		uint32_t uid, gid;
+
+		p = nl + 1;
+		// Skip comments, empty lines and malformed ones
+		if (*line == '#' || line == nl) {
+			continue;
+		}
+		int n = split_fields(line, nl, f, 7);
+		if (n < 4 || !parse_id(f[2], &uid) || !parse_id(f[3], &gid)) {
+			continue;
+		}
+
+		passwd_entry_t *e = &users[user_count];
+		e->uid = uid;
+		e->gid = gid;
+		e->name = f[0];
+		e->home_dir = n > 5 ? f[5] : "";
+		e->shell = n > 6 ? f[6] : "";
+
+		uint32_t *slot = probe_id(&users_by_id, hash_id(uid), uid, false);
+		if (*slot == 0) {
+			*slot = user_count + 1;
+		}
+		slot = probe_name(&users_by_name, e->name, false);
+		if (*slot == 0) {
+			*slot = user_count + 1;
+		}
+		user_count++;
+	}
+
+	passwd_file.state = 1;
+	LOG("passwd: %zu users indexed\n", user_count);
+	return true;
+}
+
+static bool load_group(void) {
+	if (group_file.state != 0) {
+		return group_file.state > 0;
+	}
+	group_file.state = -1;
+#if HAVE_GROUP
+	const char *path = "/etc/group";
+#else
+	const char *path = NULL;
+#endif
+	if (!path || !map_db(&group_file, path)) {
+		return false;
+	}
+
+	size_t max = count_lines(&group_file);
+	groups = db_alloc(max * sizeof(group_entry_t));
+	index_init(&groups_by_id, max);
+	index_init(&groups_by_name, max);
+
+	char *p = group_file.map, *end = group_file.map + group_file.map_len;
+	while (p < end) {
+		char *line = p, *nl = memchr(p, '\n', end - p);
+		char *f[4];
+		uint32_t gid;
+
+		p = nl + 1;
+		if (*line == '#' || line == nl) {
+			continue;
+		}
+		int n = split_fields(line, nl, f, 4);
+		if (n < 3 || !parse_id(f[2], &gid)) {
+			continue;
+		}
+
+		group_entry_t *e = &groups[group_count];
+		e->gid = gid;
+		e->name = f[0];
+		e->members = n > 3 ? f[3] : "";
+
+		uint32_t *slot = probe_id(&groups_by_id, hash_id(gid), gid, true);
+		if (*slot == 0) {
+			*slot = group_count + 1;
+		}
+		slot = probe_name(&groups_by_name, e->name, true);
+		if (*slot == 0) {
+			*slot = group_count + 1;
+		}
+		group_count++;
+	}
+
+	group_file.state = 1;
+	LOG("group: %zu groups indexed\n", group_count);
+	return true;
+}
+
+// Index lookups, the caller holds db_lock
+static passwd_entry_t *find_user(uid_t uid) {
+	if (!load_passwd()) {
+		return NULL;
+	}
+	uint32_t s = *probe_id(&users_by_id, hash_id(uid), uid, false);
+	return s ? &users[s - 1] : NULL;
+}
+
+static group_entry_t *find_group(gid_t gid) {
+	if (!load_group()) {
+		return NULL;
+	}
+	uint32_t s = *probe_id(&groups_by_id, hash_id(gid), gid, true);
+	return s ? &groups[s - 1] : NULL;
+}
+
+// Slot of id in a name cache, grown at half load
+static name_slot_t *cache_slot(name_cache_t *c, uint32_t id) {
+	if (c->count * 2 >= c->mask) {
+		name_cache_t old = *c;
+		size_t size = old.slots ? (old.mask + 1) * 2 : 64;
+
+		c->slots = db_alloc(size * sizeof(name_slot_t));
+		c->mask = size - 1;
+		for (size_t i = 0; old.slots && i <= old.mask; i++) {
+			if (old.slots[i].name) {
+				size_t j = hash_id(old.slots[i].id) & c->mask;
+				while (c->slots[j].name) {
+					j = (j + 1) & c->mask;
+				}
+				c->slots[j] = old.slots[i];
+			}
+		}
+		free(old.slots);
+	}
+
+	size_t i = hash_id(id) & c->mask;
+	while (c->slots[i].name && c->slots[i].id != id) {
+		i = (i + 1) & c->mask;
+	}
+	return &c->slots[i];
+}
+
+static char *copy_name(const char *name, uint32_t id) {
+	char buf[16];
+
+	if (name == NULL) {
+		snprintf(buf, sizeof(buf), "%u", id);
+		name = buf;
+	}
+	char *p = strdup(name);
+	if (!p) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", getProgramName());
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+#if ANDROID_NSS || LIBNSS
+// Ids of a user name, memoized for getuid_name()/getgid_name()
+typedef struct {
+	char *name;		// NULL: empty slot
+	int uid;		// -1: unknown user
+	int gid;
+} id_slot_t;
+
+typedef struct {
+	id_slot_t *slots;
+	size_t mask;
+	size_t count;
+} id_cache_t;
+
+static id_cache_t user_ids;
+
+// Slot of name in the id cache, grown at half load
+static id_slot_t *id_slot(id_cache_t *c, const char *name) {
+	if (c->count * 2 >= c->mask) {
+		id_cache_t old = *c;
+		size_t size = old.slots ? (old.mask + 1) * 2 : 64;
+
+		c->slots = db_alloc(size * sizeof(id_slot_t));
+		c->mask = size - 1;
+		for (size_t i = 0; old.slots && i <= old.mask; i++) {
+			if (old.slots[i].name) {
+				size_t j = hash_name(old.slots[i].name) & c->mask;
+				while (c->slots[j].name) {
+					j = (j + 1) & c->mask;
+				}
+				c->slots[j] = old.slots[i];
+			}
+		}
+		free(old.slots);
+	}
+
+	size_t i = hash_name(name) & c->mask;
+	while (c->slots[i].name && strcmp(c->slots[i].name, name) != 0) {
+		i = (i + 1) & c->mask;
+	}
+	return &c->slots[i];
+}
+
+/*
+ * Buffer for the *_r lookups: sized from sysconf() and doubled while
+ * the libc reports ERANGE, large group member lists do not fit any
+ * fixed size.
+ */
+static char *nss_buf(char *buf, size_t *size, int sc) {
+	if (buf == NULL) {
+		long n = sysconf(sc);
+		*size = n > 0 ? (size_t)n : 1024;
+	} else {
+		*size *= 2;
+	}
+	free(buf);
+	return db_alloc(*size);
+}
+#endif
+
+// Name of an id from the system database, its number if it has none
+static char *resolve_name(uint32_t id, bool group) {
+	char *name;
+#if ANDROID_NSS || LIBNSS
+	char *buf = NULL;
+	size_t size = 0;
+	int err;
+
+	if (group) {
+		struct group gr, *res = NULL;
+		do {
+			buf = nss_buf(buf, &size, _SC_GETGR_R_SIZE_MAX);
+			err = getgrgid_r(id, &gr, buf, size, &res);
+		} while (err == ERANGE);
+		name = copy_name(res ? res->gr_name : NULL, id);
+	} else {
+		struct passwd pw, *res = NULL;
+		do {
+			buf = nss_buf(buf, &size, _SC_GETPW_R_SIZE_MAX);
+			err = getpwuid_r(id, &pw, buf, size, &res);
+		} while (err == ERANGE);
+		name = copy_name(res ? res->pw_name : NULL, id);
+	}
+	free(buf);
+#else
+	pthread_mutex_lock(&db_lock);
+	if (group) {
+		group_entry_t *e = find_group(id);
+		name = copy_name(e ? e->name : NULL, id);
+	} else {
+		passwd_entry_t *e = find_user(id);
+		name = copy_name(e ? e->name : NULL, id);
+	}
+	pthread_mutex_unlock(&db_lock);
+#endif
+	return name;
+}
+
+/*
+ * A miss is resolved without db_lock held, an NSS backend may be slow
+ * (LDAP, sssd) and must not stall the hits of other threads. Two threads
+ * resolving the same id keep the first name.
+ */
+static const char *cached_name(name_cache_t *c, uint32_t id, bool group) {
+	pthread_mutex_lock(&db_lock);
+	const char *name = cache_slot(c, id)->name;
+	pthread_mutex_unlock(&db_lock);
+	if (name) {
+		return name;
+	}
+
+	char *resolved = resolve_name(id, group);
+	pthread_mutex_lock(&db_lock);
+	name_slot_t *slot = cache_slot(c, id);
+	if (slot->name == NULL) {
+		slot->name = resolved;
+		slot->id = id;
+		c->count++;
+		resolved = NULL;
+	}
+	name = slot->name;
+	pthread_mutex_unlock(&db_lock);
+	free(resolved);
+	return name;
+}
+
+const char *get_username(uid_t uid) {
+	return cached_name(&user_names, uid, false);
+}
+
+const char *get_groupname(gid_t gid) {
+	return cached_name(&group_names, gid, true);
+}
+
+bool get_user_info(uid_t uid, user_info_t *info) {
+	if (!info) return false;
+	
+	// Initialize with default values
+	info->uid = uid;
+	info->gid = (gid_t)-1;
+	info->name = NULL;
+	info->home_dir = NULL;
+	info->shell = NULL;
+	
+	pthread_mutex_lock(&db_lock);
+	passwd_entry_t *e = find_user(uid);
+	if (e) {
+		info->gid = e->gid;
+		info->name = e->name;
+		info->home_dir = e->home_dir;
+		info->shell = e->shell;
+	}
+	pthread_mutex_unlock(&db_lock);
+	return e != NULL;
+}
+
+bool get_group_info(gid_t gid, group_info_t *info) {
+	if (!info) return false;
+	
+	// Initialize with default values
+	info->gid = gid;
+	info->name = NULL;
+	
+	pthread_mutex_lock(&db_lock);
+	group_entry_t *e = find_group(gid);
+	if (e) {
+		info->name = e->name;
+	}
+	pthread_mutex_unlock(&db_lock);
+	return e != NULL;
+}
+
+// UID or primary GID of a user name, -1 if unknown
+static int getuid_gid_name(const char *name, bool isGid) {
+#if ANDROID_NSS || LIBNSS
+	pthread_mutex_lock(&db_lock);
+	id_slot_t *slot = id_slot(&user_ids, name);
+	if (slot->name) {
+		int id = isGid ? slot->gid : slot->uid;
+		pthread_mutex_unlock(&db_lock);
+		return id;
+	}
+	pthread_mutex_unlock(&db_lock);
+
+	// Resolved unlocked, see cached_name()
+	struct passwd pw, *res = NULL;
+	char *buf = NULL;
+	size_t size = 0;
+	int err;
+	do {
+		buf = nss_buf(buf, &size, _SC_GETPW_R_SIZE_MAX);
+		err = getpwnam_r(name, &pw, buf, size, &res);
+	} while (err == ERANGE);
+	int uid = res ? (int)pw.pw_uid : -1;
+	int gid = res ? (int)pw.pw_gid : -1;
+	free(buf);
+
+	pthread_mutex_lock(&db_lock);
+	slot = id_slot(&user_ids, name);
+	if (slot->name == NULL) {
+		slot->name = copy_name(name, 0);
+		slot->uid = uid;
+		slot->gid = gid;
+		user_ids.count++;
+	}
+	pthread_mutex_unlock(&db_lock);
+	return isGid ? gid : uid;
+#else
+	int id = -1;
+
+	pthread_mutex_lock(&db_lock);
+	if (load_passwd()) {
+		uint32_t s = *probe_name(&users_by_name, name, false);
+		if (s) {
+			id = isGid ? (int)users[s - 1].gid : (int)users[s - 1].uid;
+		}
+	}
+	pthread_mutex_unlock(&db_lock);
+	return id;
+#endif
+}
+
+uid_t getuid_name(const char *name) {
+	return getuid_gid_name(name, false);
+}
+
+gid_t getgid_name(const char *name) {
+	return getuid_gid_name(name, true);
+}
+
+#if !(ANDROID_NSS || LIBNSS)
+// Whether name is in a comma separated member list
+static bool is_member(const char *members, const char *name) {
+	size_t len = strlen(name);
+
+	while (*members) {
+		const char *comma = strchr(members, ',');
+		size_t n = comma ? (size_t)(comma - members) : strlen(members);
+		if (n == len && memcmp(members, name, len) == 0) {
+			return true;
+		}
+		if (!comma) {
+			break;
+		}
+		members = comma + 1;
+	}
+	return false;
+}
+#endif
+
+gid_t *get_user_groups(const char *username, int *count) {
+	gid_t primary = getgid_name(username);
+	gid_t *list;
+	int n = 0;
+
+	*count = 0;
+	if (primary == (gid_t)-1) {
+		return NULL;
+	}
+
+#if ANDROID_NSS || LIBNSS
+	int size = 32;
+	list = xmalloc(size * sizeof(gid_t));
+	n = size;
+	while (getgrouplist(username, primary, list, &n) < 0) {
+		size = n > size ? n : size * 2;
+		list = xrealloc(list, size * sizeof(gid_t));
+		n = size;
+	}
+#else
+	// The primary group first, then every group listing the user
+	pthread_mutex_lock(&db_lock);
+	load_group();
+	list = xmalloc((group_count + 1) * sizeof(gid_t));
+	list[n++] = primary;
+	for (size_t i = 0; i < group_count; i++) {
+		if (groups[i].gid != primary && is_member(groups[i].members, username)) {
+			list[n++] = groups[i].gid;
+		}
+	}
+	pthread_mutex_unlock(&db_lock);
+#endif
+
+	*count = n;
+	return list;
+}
+
+void free_user_info(user_info_t *info) {
+	// This function exists for API symmetry but doesn't need to do anything
+	// since we're not allocating memory for the returned strings
+	(void)info;
+}
+
+void free_group_info(group_info_t *info) {
+	// This function exists for API symmetry but doesn't need to do anything
+	// since we're not allocating memory for the returned strings
+	(void)info;
+}
+
+static void free_names(name_cache_t *c) {
+	for (size_t i = 0; c->slots && i <= c->mask; i++) {
+		free(c->slots[i].name);
+	}
+	free(c->slots);
+	memset(c, 0, sizeof(*c));
+}
+
+#if ANDROID_NSS || LIBNSS
+static void free_ids(id_cache_t *c) {
+	for (size_t i = 0; c->slots && i <= c->mask; i++) {
+		free(c->slots[i].name);
+	}
+	free(c->slots);
+	memset(c, 0, sizeof(*c));
+}
+#endif
+
+static void free_db(db_file_t *db, db_index_t *by_id, db_index_t *by_name) {
+	if (db->state > 0) {
+		munmap(db->map, db->map_len);
+	}
+	free(by_id->slots);
+	free(by_name->slots);
+	memset(db, 0, sizeof(*db));
+	memset(by_id, 0, sizeof(*by_id));
+	memset(by_name, 0, sizeof(*by_name));
+}
+
+// Cleanup function (call this at program exit)
+void userinfo_cleanup(void) {
+	pthread_mutex_lock(&db_lock);
+	free_names(&user_names);
+	free_names(&group_names);
+#if ANDROID_NSS || LIBNSS
+	free_ids(&user_ids);
+#endif
+	free_db(&passwd_file, &users_by_id, &users_by_name);
+	free_db(&group_file, &groups_by_id, &groups_by_name);
+	free(users);
+	free(groups);
+	users = NULL;
+	groups = NULL;
+	user_count = 0;
+	group_count = 0;
+	pthread_mutex_unlock(&db_lock);
+}
+
+#ifdef DEBUG
+
+initary
+void __userInfo__ () {
+#if LIBNSS || ANDROID_NSS
+	LOG("Name Service Switch(NSS) enabled\n");
+#else
+	LOG("Name Service Switch(NSS) disabled\n");
+#endif
+}
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * workPool.c - Work-stealing thread pool
+ *
+ * Every worker owns a deque: tasks queued from inside a worker are pushed to
+ * and popped from its tail (LIFO, cache friendly for tree walks), idle workers
+ * steal from the head of the others. Tasks queued from outside the pool go to
+ * a shared injection queue.
+ *
+ * Pool internals use plain malloc(), xalloc's block list is not thread safe.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "lib.h"
+#include "workPool.h"
+#include "debug.h"
+
+typedef struct {
+	workFunc fn;
+	void *arg;
+} wp_task_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	wp_task_t *buf;		// Ring buffer
+	size_t cap;
+	size_t head;
+	size_t count;
+} wp_deque_t;
+
+struct WorkPool {
+	int nqueues;		// Worker deques + the shared queue (last one)
+	int nthreads;		// Threads actually started
+	pthread_t *threads;
+	wp_deque_t *queues;
+
+	pthread_mutex_t lock;	// Protects sleeping/waking only
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	int sleepers;
+	int stop;
+
+	long queued;		// Tasks sitting in a deque (atomic)
+	long pending;		// Tasks queued or running (atomic)
+};
+
+typedef struct {
+	WorkPool *pool;
+	int index;
+} wp_start_t;
+
+static __thread WorkPool *wp_pool = NULL;
+static __thread int wp_self = -1;
+
+static void deque_init(wp_deque_t *dq) {
+	pthread_mutex_init(&dq->lock, NULL);
+	dq->buf = NULL;
+	dq->cap = dq->head = dq->count = 0;
+}
+
+static void deque_free(wp_deque_t *dq) {
+	pthread_mutex_destroy(&dq->lock);
+	free(dq->buf);
+}
+
+static void deque_push(wp_deque_t *dq, wp_task_t task) {
+	pthread_mutex_lock(&dq->lock);
+	if (dq->count == dq->cap) {
+		size_t ncap = dq->cap ? dq->cap * 2 : 64;
+		wp_task_t *nbuf = malloc(ncap * sizeof(*nbuf));
+		if (!nbuf) {
+			fprintf(stderr, "%s: Failed to allocate task queue\n", getProgramName());
+			exit(EXIT_FAILURE);
+		}
+		// Unwrap the ring while growing
+		for (size_t i = 0; i < dq->count; i++) {
+			nbuf[i] = dq->buf[(dq->head + i) % dq->cap];
+		}
+		free(dq->buf);
+		dq->buf = nbuf;
+		dq->cap = ncap;
+		dq->head = 0;
+	}
+	dq->buf[(dq->head + dq->count) % dq->cap] = task;
+	dq->count++;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+// Owner side: newest task first
+static int deque_pop_tail(wp_deque_t *dq, wp_task_t *task) {
+	int ok = 0;
+	pthread_mutex_lock(&dq->lock);
+	if (dq->count > 0) {
+		dq->count--;
+		*task = dq->buf[(dq->head + dq->count) % dq->cap];
+		ok = 1;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ok;
+}
+
+// Thief side: oldest task first
+static int deque_pop_head(wp_deque_t *dq, wp_task_t *task) {
+	int ok = 0;
+	pthread_mutex_lock(&dq->lock);
+	if (dq->count > 0) {
+		*task = dq->buf[dq->head];
+		dq->head = (dq->head + 1) % dq->cap;
+		dq->count--;
+		ok = 1;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ok;
+}
+
+// Find something to run: own deque, shared queue, then steal
+static int take_task(WorkPool *pool, int self, wp_task_t *task) {
+	int shared = pool->nqueues - 1;
+	int found = 0;
+
+	if (self >= 0 && deque_pop_tail(&pool->queues[self], task)) {
+		found = 1;
+	} else if (deque_pop_head(&pool->queues[shared], task)) {
+		found = 1;
+	} else {
+		int start = self >= 0 ? self + 1 : 0;
+		for (int i = 0; i < shared && !found; i++) {
+			int victim = (start + i) % shared;
+			if (victim != self && deque_pop_head(&pool->queues[victim], task)) {
+				found = 1;
+			}
+		}
+	}
+
+	if (found) {
+		__atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+	}
+	return found;
+}
+
+static void run_task(WorkPool *pool, wp_task_t *task) {
+	task->fn(task->arg);
+	if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_broadcast(&pool->done_cv);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+static void *worker_main(void *p) {
+	wp_start_t *start = p;
+	WorkPool *pool = start->pool;
+	wp_task_t task;
+
+	wp_pool = pool;
+	wp_self = start->index;
+	free(start);
+
+	for (;;) {
+		if (take_task(pool, wp_self, &task)) {
+			run_task(pool, &task);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 && !pool->stop) {
+			pool->sleepers++;
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+			pool->sleepers--;
+		}
+		if (pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+int workPoolThreads(int requested) {
+	if (requested > 0) {
+		return requested;
+	}
+
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+		return CPU_COUNT(&set);
+	}
+
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+WorkPool *workPoolCreate(int nthreads) {
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+
+	WorkPool *pool = calloc(1, sizeof(*pool));
+	if (!pool) {
+		return NULL;
+	}
+
+	pool->nqueues = nthreads + 1;
+	pool->queues = calloc(pool->nqueues, sizeof(*pool->queues));
+	pool->threads = calloc(nthreads, sizeof(*pool->threads));
+	if (!pool->queues || !pool->threads) {
+		free(pool->queues);
+		free(pool->threads);
+		free(pool);
+		return NULL;
+	}
+
+	for (int i = 0; i < pool->nqueues; i++) {
+		deque_init(&pool->queues[i]);
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cv, NULL);
+	pthread_cond_init(&pool->done_cv, NULL);
+
+	// If some threads cannot be started, workPoolWait() still drains the queues
+	for (int i = 0; i < nthreads; i++) {
+		wp_start_t *start = malloc(sizeof(*start));
+		if (!start) {
+			break;
+		}
+		start->pool = pool;
+		start->index = i;
+		if (pthread_create(&pool->threads[pool->nthreads], NULL, worker_main, start) != 0) {
+			LOG("pthread_create failed after %d threads\n", pool->nthreads);
+			free(start);
+			break;
+		}
+		pool->nthreads++;
+	}
+
+	return pool;
+}
+
+int workPoolSize(const WorkPool *pool) {
+	return pool ? pool->nthreads : 0;
+}
+
+void workPoolSubmit(WorkPool *pool, workFunc fn, void *arg) {
+	wp_task_t task = { fn, arg };
+	int idx = (wp_pool == pool && wp_self >= 0) ? wp_self : pool->nqueues - 1;
+
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+	__atomic_add_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+	deque_push(&pool->queues[idx], task);
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->sleepers > 0) {
+		pthread_cond_signal(&pool->work_cv);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void workPoolWait(WorkPool *pool) {
+	wp_task_t task;
+	int self = (wp_pool == pool) ? wp_self : -1;
+
+	for (;;) {
+		if (take_task(pool, self, &task)) {
+			run_task(pool, &task);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		if (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		// Somebody is still running, wake up when they finish or queue more
+		if (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0) {
+			pthread_cond_wait(&pool->done_cv, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+void workPoolDestroy(WorkPool *pool) {
+	if (!pool) {
+		return;
+	}
+
+	workPoolWait(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	for (int i = 0; i < pool->nqueues; i++) {
+		deque_free(&pool->queues[i]);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work_cv);
+	pthread_cond_destroy(&pool->done_cv);
+	free(pool->threads);
+	free(pool->queues);
+	free(pool);
+}
+
+int workPoolSelf(void) {
+	return wp_self;
+}
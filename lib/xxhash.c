@@ -0,0 +1,542 @@
+/*
+ * xxhash.c - XXH3 64-bit and 128-bit hashes
+ *
+ * Follows the xxHash 0.8 specification with the default secret and seed 0,
+ * the values are the ones printed by upstream xxhsum -H3 / -H2.
+ *
+ * Inputs up to 240 bytes take the short paths. Longer inputs are cut into
+ * 64-byte stripes which are folded into eight 64-bit accumulators, the hot
+ * loop. It is written once with GCC vector types and compiled for SSE2 (2
+ * lanes), AVX2 (4) and AVX-512F (8) on x86, NEON (2) on AArch64, picked at
+ * runtime from the CPU features.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "xxhash.h"
+#include "debug.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+#endif
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define PRIME_MX1 0x165667919E3779F9ULL
+#define PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH_STRIPE_LEN		64
+#define XXH_SECRET_CONSUME_RATE	8
+#define XXH_STRIPES_PER_BLOCK	((XXH3_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME_RATE)
+#define XXH_BLOCK_LEN		(XXH_STRIPE_LEN * XXH_STRIPES_PER_BLOCK)
+#define XXH_SECRET_LIMIT	(XXH3_SECRET_SIZE - XXH_STRIPE_LEN)
+#define XXH_SECRET_MERGEACCS	11
+#define XXH_SECRET_LASTACC	7
+#define XXH_MIDSIZE_MAX		240
+#define XXH_MIDSIZE_START	3
+#define XXH_MIDSIZE_LAST	17
+#define XXH_SECRET_SIZE_MIN	136
+
+static const uint8_t xxh3_secret[XXH3_SECRET_SIZE] __attribute__((aligned(64))) = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static const uint64_t xxh3_init_acc[XXH3_ACC_NB] = {
+	PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+	PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1
+};
+
+// Fold nstripes 64-byte stripes into acc, stripe n is keyed with secret + 8n
+typedef void (*xxh_accumulate_fn)(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t nstripes);
+
+static xxh_accumulate_fn xxh_accumulate;
+static pthread_once_t xxh_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline XXH128_hash_t mult64to128(uint64_t a, uint64_t b) {
+	unsigned __int128 p = (unsigned __int128)a * b;
+	XXH128_hash_t r = { (uint64_t)p, (uint64_t)(p >> 64) };
+	return r;
+}
+
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+	XXH128_hash_t p = mult64to128(a, b);
+	return p.low64 ^ p.high64;
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h) {
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+static inline uint64_t xxh3_avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= PRIME_MX1;
+	h ^= h >> 32;
+	return h;
+}
+
+static inline uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+	h ^= rotl64(h, 49) ^ rotl64(h, 24);
+	h *= PRIME_MX2;
+	h ^= (h >> 35) + len;
+	h *= PRIME_MX2;
+	h ^= h >> 28;
+	return h;
+}
+
+static inline uint64_t mix16b(const uint8_t *in, const uint8_t *secret, uint64_t seed) {
+	return mul128_fold64(read64(in) ^ (read64(secret) + seed), read64(in + 8) ^ (read64(secret + 8) - seed));
+}
+
+static inline XXH128_hash_t mix32b(XXH128_hash_t acc, const uint8_t *in1, const uint8_t *in2,
+		const uint8_t *secret, uint64_t seed) {
+	acc.low64 += mix16b(in1, secret, seed);
+	acc.low64 ^= read64(in2) + read64(in2 + 8);
+	acc.high64 += mix16b(in2, secret + 16, seed);
+	acc.high64 ^= read64(in1) + read64(in1 + 8);
+	return acc;
+}
+
+/* Portable stripe kernel */
+static void xxh_accumulate_scalar(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t nstripes) {
+	for (size_t n = 0; n < nstripes; n++) {
+		const uint8_t *in = input + n * XXH_STRIPE_LEN;
+		const uint8_t *key = secret + n * XXH_SECRET_CONSUME_RATE;
+
+		for (int i = 0; i < XXH3_ACC_NB; i++) {
+			uint64_t data = read64(in + 8 * i);
+			uint64_t dk = data ^ read64(key + 8 * i);
+			acc[i ^ 1] += data;
+			acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32);
+		}
+	}
+}
+
+/*
+ * Vector stripe kernel: the 8 accumulators are 8 / lanes vectors of 64-bit
+ * lanes, the data is added to the neighbouring lane (swap) and the 32x32
+ * product of its halves to its own lane. GCC widens a plain vector multiply
+ * to a full 64x64 one, mul32(a, b) multiplies the low halves only.
+ */
+#define XXH_ACCUMULATE(name, vec, lanes, swap, mul32) \
+static void name(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t nstripes) { \
+	vec a[XXH3_ACC_NB / (lanes)]; \
+	\
+	memcpy(a, acc, sizeof(a)); \
+	for (size_t n = 0; n < nstripes; n++) { \
+		const uint8_t *in = input + n * XXH_STRIPE_LEN; \
+		const uint8_t *key = secret + n * XXH_SECRET_CONSUME_RATE; \
+		\
+		for (int i = 0; i < XXH3_ACC_NB / (lanes); i++) { \
+			vec data, k; \
+			memcpy(&data, in + i * 8 * (lanes), sizeof(data)); \
+			memcpy(&k, key + i * 8 * (lanes), sizeof(k)); \
+			vec dk = data ^ k; \
+			a[i] += __builtin_shuffle(data, swap) + mul32(dk, dk >> 32); \
+		} \
+	} \
+	memcpy(acc, a, sizeof(a)); \
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+typedef uint64_t xxh_vec2 __attribute__((vector_size(16)));
+
+# if defined(__x86_64__) || defined(__i386__)
+typedef uint64_t xxh_vec4 __attribute__((vector_size(32)));
+typedef uint64_t xxh_vec8 __attribute__((vector_size(64)));
+
+#define XXH_MUL32_SSE2(a, b)	((xxh_vec2)_mm_mul_epu32((__m128i)(a), (__m128i)(b)))
+#define XXH_MUL32_AVX2(a, b)	((xxh_vec4)_mm256_mul_epu32((__m256i)(a), (__m256i)(b)))
+#define XXH_MUL32_AVX512(a, b)	((xxh_vec8)_mm512_mul_epu32((__m512i)(a), (__m512i)(b)))
+
+__attribute__((target("sse2")))
+XXH_ACCUMULATE(xxh_accumulate_sse2, xxh_vec2, 2, ((xxh_vec2){ 1, 0 }), XXH_MUL32_SSE2)
+
+__attribute__((target("avx2")))
+XXH_ACCUMULATE(xxh_accumulate_avx2, xxh_vec4, 4, ((xxh_vec4){ 1, 0, 3, 2 }), XXH_MUL32_AVX2)
+
+__attribute__((target("avx512f")))
+XXH_ACCUMULATE(xxh_accumulate_avx512, xxh_vec8, 8, ((xxh_vec8){ 1, 0, 3, 2, 5, 4, 7, 6 }), XXH_MUL32_AVX512)
+# elif defined(__aarch64__)
+static inline xxh_vec2 xxh_mul32_neon(xxh_vec2 a, xxh_vec2 b) {
+	return (xxh_vec2)vmull_u32(vmovn_u64((uint64x2_t)a), vmovn_u64((uint64x2_t)b));
+}
+
+XXH_ACCUMULATE(xxh_accumulate_neon, xxh_vec2, 2, ((xxh_vec2){ 1, 0 }), xxh_mul32_neon)
+# endif
+#endif
+
+static void xxh_init(void) {
+	xxh_accumulate = xxh_accumulate_scalar;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx512f")) {
+		xxh_accumulate = xxh_accumulate_avx512;
+	} else if (__builtin_cpu_supports("avx2")) {
+		xxh_accumulate = xxh_accumulate_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		xxh_accumulate = xxh_accumulate_sse2;
+	}
+# elif defined(__aarch64__)
+	xxh_accumulate = xxh_accumulate_neon;
+# endif
+#endif
+	LOG("xxh3 kernel: %s\n", xxh_accumulate == xxh_accumulate_scalar ? "scalar" : "vector");
+}
+
+// Once per block, keeps the accumulators well mixed
+static void xxh_scramble(uint64_t *acc, const uint8_t *secret) {
+	for (int i = 0; i < XXH3_ACC_NB; i++) {
+		uint64_t a = acc[i];
+		a ^= a >> 47;
+		a ^= read64(secret + 8 * i);
+		a *= PRIME32_1;
+		acc[i] = a;
+	}
+}
+
+static uint64_t xxh_merge_accs(const uint64_t *acc, const uint8_t *secret, uint64_t start) {
+	uint64_t result = start;
+
+	for (int i = 0; i < 4; i++) {
+		result += mul128_fold64(acc[2 * i] ^ read64(secret + 16 * i), acc[2 * i + 1] ^ read64(secret + 16 * i + 8));
+	}
+	return xxh3_avalanche(result);
+}
+
+// Accumulators of a long input (> 240 bytes)
+static void xxh_hash_long(uint64_t *acc, const uint8_t *input, size_t len) {
+	size_t nblocks = (len - 1) / XXH_BLOCK_LEN;
+
+	memcpy(acc, xxh3_init_acc, sizeof(xxh3_init_acc));
+	for (size_t n = 0; n < nblocks; n++) {
+		xxh_accumulate(acc, input + n * XXH_BLOCK_LEN, xxh3_secret, XXH_STRIPES_PER_BLOCK);
+		xxh_scramble(acc, xxh3_secret + XXH_SECRET_LIMIT);
+	}
+
+	// Last partial block, then the last stripe (which may overlap it)
+	size_t nstripes = ((len - 1) - XXH_BLOCK_LEN * nblocks) / XXH_STRIPE_LEN;
+	xxh_accumulate(acc, input + nblocks * XXH_BLOCK_LEN, xxh3_secret, nstripes);
+	xxh_accumulate(acc, input + len - XXH_STRIPE_LEN, xxh3_secret + XXH_SECRET_LIMIT - XXH_SECRET_LASTACC, 1);
+}
+
+static uint64_t xxh3_64_short(const uint8_t *in, size_t len) {
+	const uint8_t *s = xxh3_secret;
+
+	if (len == 0) {
+		return xxh64_avalanche(read64(s + 56) ^ read64(s + 64));
+	}
+	if (len <= 3) {
+		uint32_t combined = ((uint32_t)in[0] << 16) | ((uint32_t)in[len >> 1] << 24)
+			| (uint32_t)in[len - 1] | ((uint32_t)len << 8);
+		uint64_t bitflip = read32(s) ^ read32(s + 4);
+		return xxh64_avalanche((uint64_t)combined ^ bitflip);
+	}
+	if (len <= 8) {
+		uint64_t bitflip = read64(s + 8) ^ read64(s + 16);
+		uint64_t input64 = read32(in + len - 4) + ((uint64_t)read32(in) << 32);
+		return xxh3_rrmxmx(input64 ^ bitflip, len);
+	}
+	if (len <= 16) {
+		uint64_t lo = read64(in) ^ (read64(s + 24) ^ read64(s + 32));
+		uint64_t hi = read64(in + len - 8) ^ (read64(s + 40) ^ read64(s + 48));
+		uint64_t acc = len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi);
+		return xxh3_avalanche(acc);
+	}
+	if (len <= 128) {
+		uint64_t acc = len * PRIME64_1;
+		if (len > 32) {
+			if (len > 64) {
+				if (len > 96) {
+					acc += mix16b(in + 48, s + 96, 0);
+					acc += mix16b(in + len - 64, s + 112, 0);
+				}
+				acc += mix16b(in + 32, s + 64, 0);
+				acc += mix16b(in + len - 48, s + 80, 0);
+			}
+			acc += mix16b(in + 16, s + 32, 0);
+			acc += mix16b(in + len - 32, s + 48, 0);
+		}
+		acc += mix16b(in, s, 0);
+		acc += mix16b(in + len - 16, s + 16, 0);
+		return xxh3_avalanche(acc);
+	}
+
+	// 129..240 bytes
+	uint64_t acc = len * PRIME64_1;
+	size_t rounds = len / 16;
+	for (size_t i = 0; i < 8; i++) {
+		acc += mix16b(in + 16 * i, s + 16 * i, 0);
+	}
+	acc = xxh3_avalanche(acc);
+	for (size_t i = 8; i < rounds; i++) {
+		acc += mix16b(in + 16 * i, s + 16 * (i - 8) + XXH_MIDSIZE_START, 0);
+	}
+	acc += mix16b(in + len - 16, s + XXH_SECRET_SIZE_MIN - XXH_MIDSIZE_LAST, 0);
+	return xxh3_avalanche(acc);
+}
+
+static XXH128_hash_t xxh3_128_short(const uint8_t *in, size_t len) {
+	const uint8_t *s = xxh3_secret;
+	XXH128_hash_t h;
+
+	if (len == 0) {
+		h.low64 = xxh64_avalanche(read64(s + 64) ^ read64(s + 72));
+		h.high64 = xxh64_avalanche(read64(s + 80) ^ read64(s + 88));
+		return h;
+	}
+	if (len <= 3) {
+		uint32_t combinedl = ((uint32_t)in[0] << 16) | ((uint32_t)in[len >> 1] << 24)
+			| (uint32_t)in[len - 1] | ((uint32_t)len << 8);
+		uint32_t swapped = __builtin_bswap32(combinedl);
+		uint32_t combinedh = (swapped << 13) | (swapped >> 19);
+		uint64_t bitflipl = read32(s) ^ read32(s + 4);
+		uint64_t bitfliph = read32(s + 8) ^ read32(s + 12);
+		h.low64 = xxh64_avalanche((uint64_t)combinedl ^ bitflipl);
+		h.high64 = xxh64_avalanche((uint64_t)combinedh ^ bitfliph);
+		return h;
+	}
+	if (len <= 8) {
+		uint64_t input64 = read32(in) + ((uint64_t)read32(in + len - 4) << 32);
+		uint64_t bitflip = read64(s + 16) ^ read64(s + 24);
+		XXH128_hash_t m = mult64to128(input64 ^ bitflip, PRIME64_1 + (len << 2));
+		m.high64 += m.low64 << 1;
+		m.low64 ^= m.high64 >> 3;
+		m.low64 ^= m.low64 >> 35;
+		m.low64 *= PRIME_MX2;
+		m.low64 ^= m.low64 >> 28;
+		m.high64 = xxh3_avalanche(m.high64);
+		return m;
+	}
+	if (len <= 16) {
+		uint64_t bitflipl = read64(s + 32) ^ read64(s + 40);
+		uint64_t bitfliph = read64(s + 48) ^ read64(s + 56);
+		uint64_t lo = read64(in);
+		uint64_t hi = read64(in + len - 8);
+		XXH128_hash_t m = mult64to128(lo ^ hi ^ bitflipl, PRIME64_1);
+		m.low64 += (uint64_t)(len - 1) << 54;
+		hi ^= bitfliph;
+		m.high64 += hi + (uint64_t)(uint32_t)hi * (PRIME32_2 - 1);
+		m.low64 ^= __builtin_bswap64(m.high64);
+		h = mult64to128(m.low64, PRIME64_2);
+		h.high64 += m.high64 * PRIME64_2;
+		h.low64 = xxh3_avalanche(h.low64);
+		h.high64 = xxh3_avalanche(h.high64);
+		return h;
+	}
+
+	XXH128_hash_t acc = { len * PRIME64_1, 0 };
+	if (len <= 128) {
+		if (len > 32) {
+			if (len > 64) {
+				if (len > 96) {
+					acc = mix32b(acc, in + 48, in + len - 64, s + 96, 0);
+				}
+				acc = mix32b(acc, in + 32, in + len - 48, s + 64, 0);
+			}
+			acc = mix32b(acc, in + 16, in + len - 32, s + 32, 0);
+		}
+		acc = mix32b(acc, in, in + len - 16, s, 0);
+	} else {
+		// 129..240 bytes
+		size_t rounds = len / 32;
+		for (size_t i = 0; i < 4; i++) {
+			acc = mix32b(acc, in + 32 * i, in + 32 * i + 16, s + 32 * i, 0);
+		}
+		acc.low64 = xxh3_avalanche(acc.low64);
+		acc.high64 = xxh3_avalanche(acc.high64);
+		for (size_t i = 4; i < rounds; i++) {
+			acc = mix32b(acc, in + 32 * i, in + 32 * i + 16, s + XXH_MIDSIZE_START + 32 * (i - 4), 0);
+		}
+		acc = mix32b(acc, in + len - 16, in + len - 32, s + XXH_SECRET_SIZE_MIN - XXH_MIDSIZE_LAST - 16, 0);
+	}
+
+	h.low64 = acc.low64 + acc.high64;
+	h.high64 = acc.low64 * PRIME64_1 + acc.high64 * PRIME64_4 + len * PRIME64_2;
+	h.low64 = xxh3_avalanche(h.low64);
+	h.high64 = 0 - xxh3_avalanche(h.high64);
+	return h;
+}
+
+static uint64_t xxh3_64_long_digest(const uint64_t *acc, uint64_t len) {
+	return xxh_merge_accs(acc, xxh3_secret + XXH_SECRET_MERGEACCS, len * PRIME64_1);
+}
+
+static XXH128_hash_t xxh3_128_long_digest(const uint64_t *acc, uint64_t len) {
+	XXH128_hash_t h;
+	h.low64 = xxh_merge_accs(acc, xxh3_secret + XXH_SECRET_MERGEACCS, len * PRIME64_1);
+	h.high64 = xxh_merge_accs(acc, xxh3_secret + XXH3_SECRET_SIZE - XXH_STRIPE_LEN - XXH_SECRET_MERGEACCS,
+			~(len * PRIME64_2));
+	return h;
+}
+
+uint64_t XXH3_64bits(const void *input, size_t len) {
+	uint64_t acc[XXH3_ACC_NB] __attribute__((aligned(64)));
+
+	if (len <= XXH_MIDSIZE_MAX) {
+		return xxh3_64_short(input, len);
+	}
+	pthread_once(&xxh_once, xxh_init);
+	xxh_hash_long(acc, input, len);
+	return xxh3_64_long_digest(acc, len);
+}
+
+XXH128_hash_t XXH3_128bits(const void *input, size_t len) {
+	uint64_t acc[XXH3_ACC_NB] __attribute__((aligned(64)));
+
+	if (len <= XXH_MIDSIZE_MAX) {
+		return xxh3_128_short(input, len);
+	}
+	pthread_once(&xxh_once, xxh_init);
+	xxh_hash_long(acc, input, len);
+	return xxh3_128_long_digest(acc, len);
+}
+
+void XXH3_reset(XXH3_state_t *state) {
+	pthread_once(&xxh_once, xxh_init);
+	memcpy(state->acc, xxh3_init_acc, sizeof(xxh3_init_acc));
+	state->buffered = 0;
+	state->stripes_so_far = 0;
+	state->total_len = 0;
+}
+
+// Accumulate stripes that continue the current block, scramble at each block end
+static void xxh_consume_stripes(uint64_t *acc, size_t *so_far, const uint8_t *input, size_t nstripes) {
+	while (nstripes > 0) {
+		size_t to_end = XXH_STRIPES_PER_BLOCK - *so_far;
+		size_t n = nstripes < to_end ? nstripes : to_end;
+
+		xxh_accumulate(acc, input, xxh3_secret + *so_far * XXH_SECRET_CONSUME_RATE, n);
+		*so_far += n;
+		input += n * XXH_STRIPE_LEN;
+		nstripes -= n;
+		if (*so_far == XXH_STRIPES_PER_BLOCK) {
+			xxh_scramble(acc, xxh3_secret + XXH_SECRET_LIMIT);
+			*so_far = 0;
+		}
+	}
+}
+
+void XXH3_update(XXH3_state_t *state, const void *input, size_t len) {
+	const uint8_t *in = input;
+
+	state->total_len += len;
+
+	// Everything fits, nothing is consumed until we know more input follows
+	if (state->buffered + len <= XXH3_BUFFER_SIZE) {
+		memcpy(state->buffer + state->buffered, in, len);
+		state->buffered += len;
+		return;
+	}
+
+	if (state->buffered) {
+		size_t fill = XXH3_BUFFER_SIZE - state->buffered;
+		memcpy(state->buffer + state->buffered, in, fill);
+		in += fill;
+		len -= fill;
+		xxh_consume_stripes(state->acc, &state->stripes_so_far, state->buffer, XXH3_BUFFER_SIZE / XXH_STRIPE_LEN);
+		state->buffered = 0;
+	}
+
+	// Whole stripes straight from the input, keep 1..64 bytes back
+	if (len > XXH3_BUFFER_SIZE) {
+		size_t nstripes = (len - 1) / XXH_STRIPE_LEN;
+		xxh_consume_stripes(state->acc, &state->stripes_so_far, in, nstripes);
+		in += nstripes * XXH_STRIPE_LEN;
+		len -= nstripes * XXH_STRIPE_LEN;
+
+		// The last stripe of the digest may reach back into these bytes
+		memcpy(state->buffer + XXH3_BUFFER_SIZE - XXH_STRIPE_LEN, in - XXH_STRIPE_LEN, XXH_STRIPE_LEN);
+	}
+
+	memcpy(state->buffer, in, len);
+	state->buffered = len;
+}
+
+// Finish the accumulators of a long stream on a copy, the state stays usable
+static void xxh_digest_long(const XXH3_state_t *state, uint64_t *acc) {
+	uint8_t last[XXH_STRIPE_LEN];
+	const uint8_t *last_stripe;
+
+	memcpy(acc, state->acc, sizeof(state->acc));
+	if (state->buffered >= XXH_STRIPE_LEN) {
+		size_t nstripes = (state->buffered - 1) / XXH_STRIPE_LEN;
+		size_t so_far = state->stripes_so_far;
+		xxh_consume_stripes(acc, &so_far, state->buffer, nstripes);
+		last_stripe = state->buffer + state->buffered - XXH_STRIPE_LEN;
+	} else {
+		size_t catchup = XXH_STRIPE_LEN - state->buffered;
+		memcpy(last, state->buffer + XXH3_BUFFER_SIZE - catchup, catchup);
+		memcpy(last + catchup, state->buffer, state->buffered);
+		last_stripe = last;
+	}
+	xxh_accumulate(acc, last_stripe, xxh3_secret + XXH_SECRET_LIMIT - XXH_SECRET_LASTACC, 1);
+}
+
+uint64_t XXH3_64bits_digest(const XXH3_state_t *state) {
+	uint64_t acc[XXH3_ACC_NB] __attribute__((aligned(64)));
+
+	if (state->total_len <= XXH_MIDSIZE_MAX) {
+		return xxh3_64_short(state->buffer, state->total_len);
+	}
+	xxh_digest_long(state, acc);
+	return xxh3_64_long_digest(acc, state->total_len);
+}
+
+XXH128_hash_t XXH3_128bits_digest(const XXH3_state_t *state) {
+	uint64_t acc[XXH3_ACC_NB] __attribute__((aligned(64)));
+
+	if (state->total_len <= XXH_MIDSIZE_MAX) {
+		return xxh3_128_short(state->buffer, state->total_len);
+	}
+	xxh_digest_long(state, acc);
+	return xxh3_128_long_digest(acc, state->total_len);
+}
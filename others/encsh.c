@@ -19,6 +19,7 @@
 
 #include "module.h"
 #include "config.h"
+#include "hexKernel.h"
 
 // Convert hex character to 4-bit value (0-15), 0xff for invalid
 static unsigned char hex_to_byte(char c) {
@@ -33,11 +34,7 @@ static char *bin2hex(const unsigned char *bin, size_t len) {
 	if (!bin || len == 0) return NULL;
 	char *hex = (char*)malloc(len * 2 + 1);
 	if (!hex) return NULL;
-	const char *hex_chars = "0123456789abcdef";
-	for (size_t i = 0; i < len; i++) {
-		hex[2*i] = hex_chars[(bin[i] >> 4) & 0x0f];
-		hex[2*i + 1] = hex_chars[bin[i] & 0x0f];
-	}
+	hexEncode(bin, len, hex, 0);
 	hex[len * 2] = '\0';
 	return hex;
 }
@@ -0,0 +1,466 @@
+/**
+ *	b3sum.c - Print or check BLAKE3 checksums
+ *
+ *		2026/10/18
+ *
+ *	Copyright (C) 2025-2026 ASO-Studio
+ *	Based on MIT protocol open source
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "module.h"
+#include "config.h"
+#include "checksum.h"
+#include "blake3.h"
+#include "workPool.h"
+
+/**
+ * @def B3_PAR_MIN
+ * @brief Regular files at least this large are hashed by the thread pool
+ */
+#define B3_PAR_MIN (64 << 20)
+
+/**
+ * @def B3_SUBTREE
+ * @brief Bytes per pool task, a power of two number of chunks so every task
+ * is a complete subtree of the BLAKE3 tree
+ */
+#define B3_SUBTREE (4 << 20)
+
+/**
+ * @struct b3_task_t
+ * @brief One subtree of a large file, hashed on a pool thread
+ */
+typedef struct {
+	int fd;				// File being hashed
+	off_t offset;			// Start of the subtree, multiple of B3_SUBTREE
+	uint8_t cv[BLAKE3_OUT_LEN];	// Chaining value of the subtree
+	int err;			// errno of a failed read
+} b3_task_t;
+
+// Command-line option flags
+static int flag_binary = 0;	// Binary mode (-b/--binary)
+static int flag_check = 0;	// Check mode (-c/--check)
+static int flag_tag = 0;	// BSD-style output (--tag)
+static int flag_text = 1;	// Text mode (-t/--text, default)
+static int flag_zero = 0;	// NUL-terminated lines (-z/--zero)
+static int flag_ignore_missing = 0;	// Ignore missing files (--ignore-missing)
+static int flag_quiet = 0;	// Quiet mode (--quiet)
+static int flag_status = 0;	// No output, status code only (--status)
+static int flag_strict = 0;	// Strict mode for bad lines (--strict)
+static int flag_warn = 0;	// Warn about bad lines (-w/--warn)
+static int flag_help = 0;	// Show help (--help)
+static int flag_threads = 0;	// Hashing threads (-j/--threads), 0 means all CPUs
+
+// Shared by every large file, created on the first one
+static WorkPool *b3_pool = NULL;
+
+/**
+ * @brief Hash update callback for sumReadFile()
+ * @param ctx Pointer to blake3_hasher
+ * @param data Next block of the file
+ * @param len Length of the block in bytes
+ */
+static void b3_feed(void *ctx, const unsigned char *data, size_t len) {
+	blake3_hasher_update(ctx, data, len);
+}
+
+/**
+ * @brief Compute the BLAKE3 hash of a file on the calling thread
+ * Used by check mode, whose verifier threads already spread files over the CPUs.
+ * @param filename Path to the file (use "-" for standard input)
+ * @param digest Output buffer for the 32-byte digest
+ * @param binary_mode Ignored, both modes read the same bytes
+ * @return 0 on success, -1 if file cannot be opened, -2 if read error occurs
+ */
+static int file_b3(const char *filename, uint8_t digest[BLAKE3_OUT_LEN], int binary_mode) {
+	(void)binary_mode;
+
+	blake3_hasher hasher;
+	blake3_hasher_init(&hasher);
+
+	int ret = sumReadFile(filename ? filename : "-", b3_feed, &hasher);
+	if (ret != 0) {
+		return ret;
+	}
+
+	blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+	return 0;
+}
+
+/**
+ * @brief Pool task: read one subtree and compute its chaining value
+ * @param arg Pointer to b3_task_t
+ */
+static void b3_subtree_task(void *arg) {
+	b3_task_t *task = arg;
+	uint8_t *buf = malloc(B3_SUBTREE);
+	size_t done = 0;
+
+	if (!buf) {
+		task->err = ENOMEM;
+		return;
+	}
+
+	while (done < B3_SUBTREE) {
+		ssize_t n = pread(task->fd, buf + done, B3_SUBTREE - done, task->offset + done);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			task->err = errno;
+			break;
+		}
+		if (n == 0) {
+			task->err = EIO;	// Truncated while we were reading
+			break;
+		}
+		done += n;
+	}
+
+	if (!task->err && blake3_subtree_cv(buf, B3_SUBTREE, task->offset / BLAKE3_CHUNK_LEN, task->cv) != 0) {
+		task->err = ENOMEM;
+	}
+	free(buf);
+}
+
+/**
+ * @brief Hash the leading whole subtrees of a large file on the pool
+ * The tasks run in parallel, their chaining values are added to the hasher
+ * in file order. At least one byte is left for the hasher, which has to see
+ * the last chunk itself.
+ * @param fd Open regular file
+ * @param size Size of the file
+ * @param threads Pool size
+ * @param hasher Fresh hasher, advanced past the hashed subtrees
+ * @return Bytes hashed (0 if the pool cannot be used), -2 on read error
+ */
+static off_t b3_hash_subtrees(int fd, off_t size, int threads, blake3_hasher *hasher) {
+	size_t ntasks = (size - 1) / B3_SUBTREE;
+
+	b3_task_t *tasks = calloc(ntasks, sizeof(*tasks));
+	if (!tasks) {
+		return 0;
+	}
+	if (!b3_pool && !(b3_pool = workPoolCreate(threads))) {
+		free(tasks);
+		return 0;
+	}
+
+	for (size_t i = 0; i < ntasks; i++) {
+		tasks[i].fd = fd;
+		tasks[i].offset = (off_t)i * B3_SUBTREE;
+		workPoolSubmit(b3_pool, b3_subtree_task, &tasks[i]);
+	}
+	workPoolWait(b3_pool);
+
+	off_t ret = (off_t)ntasks * B3_SUBTREE;
+	for (size_t i = 0; i < ntasks; i++) {
+		if (tasks[i].err) {
+			errno = tasks[i].err;
+			ret = -2;
+			break;
+		}
+		blake3_hasher_add_subtree(hasher, tasks[i].cv, B3_SUBTREE / BLAKE3_CHUNK_LEN);
+	}
+	free(tasks);
+	return ret;
+}
+
+/**
+ * @brief Compute the BLAKE3 hash of a file, large files on all threads
+ * @param filename Path to the file (use "-" for standard input)
+ * @param digest Output buffer for the 32-byte digest
+ * @return 0 on success, -1 if file cannot be opened, -2 if read error occurs
+ */
+static int file_b3_parallel(const char *filename, uint8_t digest[BLAKE3_OUT_LEN]) {
+	int fd = STDIN_FILENO;
+	int ret = 0;
+	struct stat st;
+
+	if (strcmp(filename, "-") != 0) {
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			return -1;
+		}
+	}
+
+	blake3_hasher hasher;
+	blake3_hasher_init(&hasher);
+
+	// Whole subtrees in parallel, then the tail through the read-ahead reader
+	int threads = workPoolThreads(flag_threads);
+	if (threads > 1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= B3_PAR_MIN) {
+		off_t done = b3_hash_subtrees(fd, st.st_size, threads, &hasher);
+		if (done < 0) {
+			ret = -2;
+		} else if (done > 0 && lseek(fd, done, SEEK_SET) < 0) {
+			ret = -2;
+		}
+	}
+	if (ret == 0) {
+		ret = sumReadFd(fd, b3_feed, &hasher);
+	}
+
+	if (fd != STDIN_FILENO) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+	}
+	if (ret != 0) {
+		return ret;
+	}
+
+	blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+	return 0;
+}
+
+/**
+ * @brief Convert a BLAKE3 digest to a hexadecimal string
+ * @param digest 32-byte digest
+ * @param str Output buffer (must be at least 65 bytes to hold null terminator)
+ */
+static void digest2str(const uint8_t digest[BLAKE3_OUT_LEN], char *str) {
+	static const char hex_chars[] = "0123456789abcdef";
+	for (int i = 0; i < BLAKE3_OUT_LEN; i++) {
+		str[2*i] = hex_chars[(digest[i] >> 4) & 0x0F];
+		str[2*i + 1] = hex_chars[digest[i] & 0x0F];
+	}
+	str[2 * BLAKE3_OUT_LEN] = '\0';
+}
+
+/**
+ * @brief Print help message
+ */
+static void print_help() {
+	SHOW_VERSION(stdout);
+	printf("Usage: b3sum [OPTION]... [FILE]...\n");
+	printf("Print or check BLAKE3 (256-bit) checksums.\n\n");
+	printf("With no FILE, or when FILE is -, read standard input.\n\n");
+	printf("  -b, --binary          read in binary mode\n");
+	printf("  -c, --check           read checksums from the FILEs and check them\n");
+	printf("      --tag             create a BSD-style checksum\n");
+	printf("  -t, --text            read in text mode (default)\n");
+	printf("  -j, --threads=N       hash large files with N threads (default: all CPUs)\n");
+	printf("  -z, --zero            end each output line with NUL, not newline,\n");
+	printf("                          and disable file name escaping\n\n");
+	printf("The following five options are useful only when verifying checksums:\n");
+	printf("      --ignore-missing  don't fail or report status for missing files\n");
+	printf("      --quiet           don't print OK for each successfully verified file\n");
+	printf("      --status          don't output anything, status code shows success\n");
+	printf("      --strict          exit non-zero for improperly formatted checksum lines\n");
+	printf("  -w, --warn            warn about improperly formatted checksum lines\n\n");
+	printf("      --help            display this help and exit\n");
+}
+
+/**
+ * @brief Parse command-line arguments
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @return 0 on success, -1 on error (invalid options or conflicts)
+ */
+static int parse_args(int argc, char *argv[]) {
+	static const struct option long_options[] = {
+		{"binary",		no_argument, NULL, 'b'},
+		{"check",		no_argument, NULL, 'c'},
+		{"tag",			no_argument, NULL, 0},
+		{"text",		no_argument, NULL, 't'},
+		{"threads",		required_argument, NULL, 'j'},
+		{"zero",		no_argument, NULL, 'z'},
+		{"ignore-missing", no_argument, NULL, 0},
+		{"quiet",		no_argument, NULL, 0},
+		{"status",		no_argument, NULL, 0},
+		{"strict",		no_argument, NULL, 0},
+		{"warn",		no_argument, NULL, 'w'},
+		{"help",		no_argument, NULL, 0},
+		{NULL, 0, NULL, 0}
+	};
+
+	int opt;
+	int option_index = 0;
+
+	while ((opt = getopt_long(argc, argv, "bctj:zw", long_options, &option_index)) != -1) {
+		switch (opt) {
+			case 'b':
+				flag_binary = 1;
+				flag_text = 0;
+				break;
+			case 'c':
+				flag_check = 1;
+				break;
+			case 't':
+				flag_text = 1;
+				flag_binary = 0;
+				break;
+			case 'j':
+				flag_threads = atoi(optarg);
+				if (flag_threads < 1) {
+					fprintf(stderr, "b3sum: invalid thread count: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'z':
+				flag_zero = 1;
+				break;
+			case 'w':
+				flag_warn = 1;
+				break;
+			case 0:
+				if (strcmp(long_options[option_index].name, "tag") == 0) {
+					flag_tag = 1;
+				} else if (strcmp(long_options[option_index].name, "ignore-missing") == 0) {
+					flag_ignore_missing = 1;
+				} else if (strcmp(long_options[option_index].name, "quiet") == 0) {
+					flag_quiet = 1;
+				} else if (strcmp(long_options[option_index].name, "status") == 0) {
+					flag_status = 1;
+					flag_quiet = 1;  // --status implies --quiet
+				} else if (strcmp(long_options[option_index].name, "strict") == 0) {
+					flag_strict = 1;
+				} else if (strcmp(long_options[option_index].name, "help") == 0) {
+					flag_help = 1;
+				}
+				break;
+			case '?':
+				return -1;
+			default:
+				abort();
+		}
+	}
+
+	if (flag_binary && flag_text) {
+		fprintf(stderr, "b3sum: cannot specify both --binary and --text\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Run in check mode (verify checksums)
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors or checksum mismatches)
+ */
+static int check_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	SumCheckOpts opts = {
+		.prog = "b3sum",
+		.tag = "BLAKE3",
+		.digest_len = BLAKE3_OUT_LEN,
+		.sum = file_b3,
+		.threads = flag_threads,
+		.binary = flag_binary,
+		.ignore_missing = flag_ignore_missing,
+		.quiet = flag_quiet,
+		.status = flag_status,
+		.strict = flag_strict,
+		.warn = flag_warn,
+	};
+
+	if (optind >= argc) {
+		static char stdin_flag[] = "-";
+		argv[argc++] = stdin_flag;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		SumCheckResult res;
+		if (sumCheckFile(&opts, argv[i], &res) != 0) {
+			exit_status = 1;
+		}
+		sumCheckReport(&opts, &res);
+	}
+
+	return exit_status;
+}
+
+/**
+ * @brief Run in compute mode (generate checksums)
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors)
+ */
+static int compute_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	int use_stdin = (optind >= argc);
+
+	for (int i = optind; i < argc; i++) {
+		uint8_t digest[BLAKE3_OUT_LEN];
+		char digest_str[65];
+
+		if (file_b3_parallel(argv[i], digest) != 0) {
+			fprintf(stderr, "b3sum: %s: %s\n", argv[i], strerror(errno));
+			exit_status = 1;
+			continue;
+		}
+
+		digest2str(digest, digest_str);
+
+		if (flag_tag) {
+			printf("BLAKE3 (%s) = %s", argv[i], digest_str);
+		} else {
+			printf("%s %c%s", digest_str, flag_binary ? '*' : ' ', argv[i]);
+		}
+
+		putchar(flag_zero ? '\0' : '\n');
+	}
+
+	if (use_stdin) {
+		uint8_t digest[BLAKE3_OUT_LEN];
+		char digest_str[65];
+
+		if (file_b3_parallel("-", digest) != 0) {
+			fprintf(stderr, "b3sum: standard input: %s\n", strerror(errno));
+			return 1;
+		}
+
+		digest2str(digest, digest_str);
+
+		if (flag_tag) {
+			printf("BLAKE3 (stdin) = %s", digest_str);
+		} else {
+			printf("%s %c-", digest_str, flag_binary ? '*' : ' ');
+		}
+
+		putchar(flag_zero ? '\0' : '\n');
+	}
+
+	return exit_status;
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status
+ */
+M_ENTRY(b3sum) {
+	int ret;
+
+	if (parse_args(argc, argv) != 0) {
+		return 1;
+	}
+
+	if (flag_help) {
+		print_help();
+		return 0;
+	}
+
+	if (flag_check) {
+		ret = check_mode(argc, argv);
+	} else {
+		ret = compute_mode(argc, argv);
+	}
+
+	workPoolDestroy(b3_pool);
+	b3_pool = NULL;
+	return ret;
+}
+REGISTER_MODULE(b3sum);
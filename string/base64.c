@@ -12,37 +12,58 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
-#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "module.h"
+#include "base64.h"
+#include "lib.h"
+#include "workPool.h"
 
 #define DEFAULT_WRAP 76  // Default line wrap length for encoding
 
-// Base64 alphabet as defined in RFC 4648
-static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-// Decode lookup table: maps ASCII characters to their 6-bit values
-// -1 indicates an invalid base64 character
-static const int decode_table[256] = {
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
-	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
-	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
-	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
-	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+// Input block sizes, the encoder's is a multiple of 3 so only the last block is padded
+#define ENCODE_CHUNK (3 * 256 * 1024)
+#define DECODE_CHUNK (1024 * 1024)
+
+#define PAR_MIN		(16 << 20)	// Regular files this large are split across threads
+#define PAR_CHUNK	(3 << 20)	// Input bytes per task, a multiple of 3
+
+static int thread_count = 0;
+
+// Task states of the parallel mode
+enum {
+	CHUNK_PENDING = 0,
+	CHUNK_DONE,
+	CHUNK_FAILED,
 };
 
+// One slice of a mapped input, converted by a pool thread into its own buffer
+typedef struct {
+	const unsigned char *in;
+	size_t len;
+	size_t column;		// Encoding: output column the slice starts at
+	int last;		// Decoding: the final slice checks for an incomplete group
+	char *tmp;		// Encoding: unwrapped text
+	unsigned char *out;
+	size_t out_len;
+	size_t bad;		// Decoding: offset of an invalid character in the slice
+	int state;		// CHUNK_*, protected by the context lock
+	struct par_ctx *ctx;
+} par_chunk_t;
+
+typedef struct par_ctx {
+	int decode;
+	int wrap;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+} par_ctx_t;
+
 /**
  * Print help information to stdout
  */
@@ -56,138 +77,421 @@ static void print_help() {
 	printf("  -i, --ignore-garbage  when decoding, ignore non-alphabet characters\n");
 	printf("  -w, --wrap=COLS       wrap encoded lines after COLS character (default %d).\n", DEFAULT_WRAP);
 	printf("                        Use 0 to disable line wrapping\n");
+	printf("  -j, --threads=N       split large files across N threads (default: all CPUs)\n");
+}
+
+/**
+ * Read until len bytes or end of file
+ *
+ * @return bytes read, -1 on error
+ */
+static ssize_t read_full(int fd, void *buf, size_t len) {
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t n = read(fd, (char *)buf + done, len - done);
+		if (n == 0) {
+			break;
+		}
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		done += n;
+	}
+	return done;
+}
+
+/**
+ * Write all of buf
+ *
+ * @return 0 on success, -1 on error
+ */
+static int write_full(int fd, const void *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * Copy encoded text into lines of wrap characters
+ *
+ * @param column Characters already on the current line, updated
+ * @return bytes written to out
+ */
+static size_t wrap_lines(const char *enc, size_t len, char *out, int wrap, size_t *column) {
+	char *o = out;
+
+	for (size_t i = 0; i < len;) {
+		size_t take = wrap - *column;
+		if (take > len - i) {
+			take = len - i;
+		}
+		memcpy(o, enc + i, take);
+		o += take;
+		i += take;
+		*column += take;
+		if (*column == (size_t)wrap) {
+			*o++ = '\n';
+			*column = 0;
+		}
+	}
+	return o - out;
 }
 
 /**
  * Encode binary data to Base64 format
  * 
- * @param input  File pointer to read binary data from
- * @param output File pointer to write encoded data to
+ * @param in     File descriptor to read binary data from
+ * @param out    File descriptor to write encoded data to
  * @param wrap   Number of characters per line (0 to disable wrapping)
  * @return 0 on success, -1 on error (I/O error)
  */
-static int base64_encode(FILE *input, FILE *output, int wrap) {
-	unsigned char buffer[3];  // Read 3 bytes at a time (3*8=24 bits = 4*6 bits)
-	ssize_t bytes_read;
-	int chars_written = 0;	// Track total encoded characters for line wrapping
-	
-	while ((bytes_read = fread(buffer, 1, 3, input)) > 0) {
-		unsigned char encoded[4];  // 3 bytes encode to 4 Base64 characters
-		
-		// Encode 3-byte chunks into 4 6-bit values (per RFC 4648)
-		encoded[0] = (buffer[0] & 0xFC) >> 2;  // First 6 bits of byte 0
-		encoded[1] = ((buffer[0] & 0x03) << 4) | ((bytes_read > 1 ? buffer[1] : 0) >> 4);
-		encoded[2] = (bytes_read > 1) ? 
-					 ((buffer[1] & 0x0F) << 2) | ((bytes_read > 2 ? buffer[2] : 0) >> 6) : 64;
-		encoded[3] = (bytes_read > 2) ? (buffer[2] & 0x3F) : 64;
-		
-		// Write encoded characters to output
-		for (int i = 0; i < 4; i++) {
-			if (encoded[i] == 64) {  // Padding character
-				fputc('=', output);
-			} else {
-				fputc(base64_alphabet[encoded[i]], output);
-			}
-			
-			chars_written++;
-			
-			// Add newline if line wrapping is enabled and limit is reached
-			if (wrap > 0 && chars_written % wrap == 0) {
-				fputc('\n', output);
+static int base64_encode(int in, int out, int wrap) {
+	size_t enc_len = BASE64_ENCODED_LEN(ENCODE_CHUNK);
+	unsigned char *buf = xmalloc(ENCODE_CHUNK);
+	char *enc = xmalloc(enc_len);
+	char *lines = wrap > 0 ? xmalloc(enc_len + enc_len / wrap + 1) : NULL;
+	size_t column = 0;	// Characters on the current output line
+	int ret = 0;
+	ssize_t n;
+
+	while ((n = read_full(in, buf, ENCODE_CHUNK)) > 0) {
+		size_t len = base64Encode(buf, n, enc);
+
+		if (wrap == 0) {
+			if (write_full(out, enc, len) != 0) {
+				ret = -1;
+				break;
 			}
+			continue;
+		}
+
+		// Break the block into lines, the last one may continue in the next block
+		len = wrap_lines(enc, len, lines, wrap, &column);
+		if (write_full(out, lines, len) != 0) {
+			ret = -1;
+			break;
 		}
 	}
-	
+	if (n < 0) {
+		ret = -1;
+	}
+
 	// Add final newline if wrapping is enabled and last line isn't complete
-	if (wrap > 0 && chars_written > 0 && chars_written % wrap != 0) {
-		fputc('\n', output);
+	if (ret == 0 && column > 0 && write_full(out, "\n", 1) != 0) {
+		ret = -1;
 	}
-	
-	// Check for I/O errors
-	return ferror(input) || ferror(output) ? -1 : 0;
+
+	if (ret != 0) {
+		perror("base64");
+	}
+	xfree(buf);
+	xfree(enc);
+	xfree(lines);
+	return ret;
 }
 
 /**
  * Decode Base64 data to binary format
  * 
- * @param input		 File pointer to read encoded data from
- * @param output		File pointer to write binary data to
+ * @param in             File descriptor to read encoded data from
+ * @param out            File descriptor to write binary data to
  * @param ignore_garbage If 1, skip non-base64 characters; if 0, error on them
  * @return 0 on success, -1 on error (invalid input or I/O error)
  */
-static int base64_decode(FILE *input, FILE *output, int ignore_garbage) {
-	unsigned char buffer[4];  // Read 4 Base64 characters at a time
-	int count = 0;			// Number of characters in current buffer
-	int c;					// Current character being read
-	
-	while ((c = fgetc(input)) != EOF) {
-		// Skip whitespace and line breaks
-		if (isspace(c)) {
-			continue;
+static int base64_decode(int in, int out, int ignore_garbage) {
+	char *buf = xmalloc(DECODE_CHUNK);
+	unsigned char *dec = xmalloc(BASE64_DECODED_MAX(DECODE_CHUNK));
+	Base64Decoder state;
+	int ret = 0;
+	ssize_t n;
+
+	base64DecodeInit(&state, ignore_garbage);
+	while ((n = read_full(in, buf, DECODE_CHUNK)) > 0) {
+		Base64Decoder start = state;
+		size_t bad;
+		ssize_t len = base64DecodeBlock(&state, buf, n, dec, &bad);
+
+		if (len < 0) {
+			// Output what precedes the invalid character first
+			len = base64DecodeBlock(&start, buf, bad, dec, &bad);
+			write_full(out, dec, len);
+			fprintf(stderr, "Invalid base64 character: 0x%02x\n", (unsigned char)buf[bad]);
+			ret = -1;
+			goto out;
 		}
-		
-		// Skip non-alphabet characters if ignore_garbage is enabled
-		if (ignore_garbage && decode_table[c] == -1 && c != '=') {
-			continue;
+		if (write_full(out, dec, len) != 0) {
+			break;
 		}
-		
-		// Reject invalid characters if not ignoring garbage
-		if (decode_table[c] == -1 && c != '=') {
-			if (!ignore_garbage) {
-				fprintf(stderr, "Invalid base64 character: 0x%02x\n", c);
-				return -1;
-			}
-			continue;
+	}
+	if (n != 0) {
+		perror("base64");
+		ret = -1;
+		goto out;
+	}
+
+	// Error on incomplete chunks unless ignoring garbage
+	if (base64DecodeFinish(&state) != 0) {
+		fprintf(stderr, "Invalid base64 input length (not a multiple of 4)\n");
+		ret = -1;
+	}
+
+out:
+	xfree(buf);
+	xfree(dec);
+	return ret;
+}
+
+/**
+ * Convert one slice on a pool thread
+ */
+static void par_task(void *arg) {
+	par_chunk_t *c = arg;
+	par_ctx_t *ctx = c->ctx;
+	int state = CHUNK_DONE;
+
+	if (!ctx->decode) {
+		size_t len = base64Encode(c->in, c->len, ctx->wrap > 0 ? c->tmp : (char *)c->out);
+		if (ctx->wrap > 0) {
+			size_t column = c->column;
+			len = wrap_lines(c->tmp, len, (char *)c->out, ctx->wrap, &column);
 		}
-		
-		// Add valid character to buffer
-		buffer[count++] = (unsigned char)c;
-		
-		// Decode when buffer is full (4 characters)
-		if (count == 4) {
-			unsigned char decoded[3];  // 4 base64 chars decode to 3 bytes
-			int padding = 0;
-			
-			// Count padding characters (trailing '=')
-			for (int i = 3; i >= 0; i--) {
-				if (buffer[i] == '=') {
-					padding++;
-				} else {
-					break;
-				}
+		c->out_len = len;
+	} else {
+		Base64Decoder dec;
+		base64DecodeInit(&dec, 0);
+		ssize_t len = base64DecodeBlock(&dec, (const char *)c->in, c->len, c->out, &c->bad);
+		if (len < 0) {
+			// Keep what precedes the invalid character
+			size_t bad;
+			base64DecodeInit(&dec, 0);
+			c->out_len = base64DecodeBlock(&dec, (const char *)c->in, c->bad, c->out, &bad);
+			state = CHUNK_FAILED;
+		} else {
+			c->out_len = len;
+			// Inner slices end on group boundaries, only the final one can be short
+			if (c->last && base64DecodeFinish(&dec) != 0) {
+				c->bad = c->len;
+				state = CHUNK_FAILED;
 			}
-			
-			// Calculate output bytes based on padding
-			unsigned long output_bytes = 3 - padding;
+		}
+	}
 
-			// Decode 4 base64 characters into 3 bytes
-			decoded[0] = (decode_table[buffer[0]] << 2) | (decode_table[buffer[1]] >> 4);
+	pthread_mutex_lock(&ctx->lock);
+	c->state = state;
+	pthread_cond_broadcast(&ctx->ready);
+	pthread_mutex_unlock(&ctx->lock);
+}
 
-			if (output_bytes > 1) {
-				decoded[1] = ((decode_table[buffer[1]] & 0x0F) << 4) | (decode_table[buffer[2]] >> 2);
-			}
+typedef struct {
+	size_t text;		// Offset of the range
+	size_t count;		// Characters in it that are not whitespace
+} scan_range_t;
 
-			if (output_bytes > 2) {
-				decoded[2] = ((decode_table[buffer[2]] & 0x03) << 6) | decode_table[buffer[3]];
+static const char *scan_data;
+
+static void scan_task(void *arg) {
+	scan_range_t *r = arg;
+	size_t len = r[1].text - r[0].text;
+
+	r->count = base64TextLen(scan_data + r->text, len);
+}
+
+/**
+ * Cut encoded text into slices that start on 4-character group boundaries
+ *
+ * Whitespace does not count towards a group, so every range is scanned in
+ * parallel first; the running totals tell how far past each rough cut the
+ * next group starts.
+ *
+ * @return number of slices, bounds[0..n] are their offsets
+ */
+static size_t split_text(WorkPool *pool, const char *text, size_t size, size_t **bounds) {
+	size_t n = (size + PAR_CHUNK - 1) / PAR_CHUNK;
+	scan_range_t *r = xmalloc((n + 1) * sizeof(*r));
+
+	scan_data = text;
+	for (size_t i = 0; i <= n; i++) {
+		r[i].text = i < n ? i * PAR_CHUNK : size;
+	}
+	for (size_t i = 0; i < n; i++) {
+		workPoolSubmit(pool, scan_task, &r[i]);
+	}
+	workPoolWait(pool);
+
+	size_t *b = xmalloc((n + 1) * sizeof(*b));
+	size_t slices = 0, total = 0;
+	b[0] = 0;
+	for (size_t i = 1; i < n; i++) {
+		total += r[i - 1].count;
+
+		// Move the cut forward until a whole number of groups lies before it
+		size_t pos = r[i].text, count = total;
+		while (pos < size && count % 4 != 0) {
+			unsigned char ch = text[pos++];
+			count += !(ch == ' ' || (ch >= '\t' && ch <= '\r'));
+		}
+		if (pos > b[slices] && pos < size) {
+			b[++slices] = pos;
+		}
+	}
+	b[++slices] = size;
+	xfree(r);
+	*bounds = b;
+	return slices;
+}
+
+/**
+ * Encode or decode a mapped file on the pool, writing the slices in order
+ *
+ * A window of slots bounds the memory: slice i + window is queued once
+ * slice i has been written.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int base64_parallel(const unsigned char *data, size_t size, int out, int threads,
+		int decode, int wrap) {
+	WorkPool *pool = workPoolCreate(threads);
+	if (pool == NULL) {
+		return 1;
+	}
+
+	size_t *bounds = NULL, nchunks;
+	if (decode) {
+		nchunks = split_text(pool, (const char *)data, size, &bounds);
+	} else {
+		nchunks = (size + PAR_CHUNK - 1) / PAR_CHUNK;
+		bounds = xmalloc((nchunks + 1) * sizeof(*bounds));
+		for (size_t i = 0; i <= nchunks; i++) {
+			bounds[i] = i < nchunks ? i * PAR_CHUNK : size;
+		}
+	}
+
+	size_t max_len = 0;
+	for (size_t i = 0; i < nchunks; i++) {
+		if (bounds[i + 1] - bounds[i] > max_len) {
+			max_len = bounds[i + 1] - bounds[i];
+		}
+	}
+
+	par_ctx_t ctx = { .decode = decode, .wrap = wrap };
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.ready, NULL);
+
+	size_t window = (size_t)threads * 2;
+	if (window > nchunks) {
+		window = nchunks;
+	}
+	size_t enc_len = BASE64_ENCODED_LEN(max_len);
+	par_chunk_t *slots = xcalloc(window, sizeof(*slots));
+	for (size_t i = 0; i < window; i++) {
+		slots[i].ctx = &ctx;
+		if (decode) {
+			slots[i].out = xmalloc(BASE64_DECODED_MAX(max_len));
+		} else {
+			slots[i].tmp = wrap > 0 ? xmalloc(enc_len) : NULL;
+			slots[i].out = xmalloc(enc_len + (wrap > 0 ? enc_len / wrap + 1 : 0));
+		}
+	}
+
+	int ret = 0;
+	for (size_t i = 0; i < nchunks + window && ret == 0; i++) {
+		// Write slice i - window, then reuse its slot for slice i
+		if (i >= window) {
+			size_t k = i - window;
+			par_chunk_t *c = &slots[k % window];
+
+			pthread_mutex_lock(&ctx.lock);
+			while (c->state == CHUNK_PENDING) {
+				pthread_cond_wait(&ctx.ready, &ctx.lock);
 			}
+			pthread_mutex_unlock(&ctx.lock);
 
-			// Write decoded bytes to output
-			if (fwrite(decoded, 1, output_bytes, output) != output_bytes) {
-				return -1;
+			if (c->state == CHUNK_FAILED) {
+				write_full(out, c->out, c->out_len);
+				if (c->bad < c->len) {
+					fprintf(stderr, "Invalid base64 character: 0x%02x\n", c->in[c->bad]);
+				} else {
+					fprintf(stderr, "Invalid base64 input length (not a multiple of 4)\n");
+				}
+				ret = -1;
+				break;
+			}
+			if (write_full(out, c->out, c->out_len) != 0) {
+				perror("base64");
+				ret = -1;
+				break;
 			}
-			
-			count = 0;  // Reset buffer for next chunk
+		}
+
+		if (i < nchunks) {
+			par_chunk_t *c = &slots[i % window];
+			c->in = data + bounds[i];
+			c->len = bounds[i + 1] - bounds[i];
+			c->column = wrap > 0 ? BASE64_ENCODED_LEN(bounds[i]) % wrap : 0;
+			c->last = i == nchunks - 1;
+			c->state = CHUNK_PENDING;
+			workPoolSubmit(pool, par_task, c);
 		}
 	}
-	
-	// Error on incomplete chunks unless ignoring garbage
-	if (count > 0 && !ignore_garbage) {
-		fprintf(stderr, "Invalid base64 input length (not a multiple of 4)\n");
-		return -1;
+
+	// Let the queued slices finish before their buffers go away
+	workPoolWait(pool);
+	workPoolDestroy(pool);
+
+	if (ret == 0 && !decode && wrap > 0 && BASE64_ENCODED_LEN(size) % wrap != 0
+			&& write_full(out, "\n", 1) != 0) {
+		perror("base64");
+		ret = -1;
 	}
-	
-	// Check for I/O errors
-	return ferror(input) || ferror(output) ? -1 : 0;
+
+	for (size_t i = 0; i < window; i++) {
+		xfree(slots[i].tmp);
+		xfree(slots[i].out);
+	}
+	xfree(slots);
+	xfree(bounds);
+	pthread_mutex_destroy(&ctx.lock);
+	pthread_cond_destroy(&ctx.ready);
+	return ret;
+}
+
+/**
+ * Split a large regular file across the pool
+ *
+ * @return 0 or -1 as the converters, 1 when the input does not qualify
+ */
+static int base64_try_parallel(int in, int out, int decode, int wrap, int ignore_garbage) {
+	struct stat st;
+	int threads = workPoolThreads(thread_count);
+
+	// --ignore-garbage would need a full scan to find the group boundaries
+	if (threads < 2 || (decode && ignore_garbage) || fstat(in, &st) != 0
+			|| !S_ISREG(st.st_mode) || st.st_size < PAR_MIN) {
+		return 1;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+	if (data == MAP_FAILED) {
+		return 1;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	int ret = base64_parallel(data, st.st_size, out, threads, decode, wrap);
+	munmap(data, st.st_size);
+	return ret;
 }
 
 /**
@@ -204,6 +508,7 @@ M_ENTRY(base64) {
 		{"decode", no_argument, 0, 'd'},
 		{"ignore-garbage", no_argument, 0, 'i'},
 		{"wrap", required_argument, 0, 'w'},
+		{"threads", required_argument, 0, 'j'},
 		{"help", no_argument, 0, 'h'},
 		{0, 0, 0, 0}
 	};
@@ -211,7 +516,7 @@ M_ENTRY(base64) {
 	// Parse command-line options
 	int opt;
 	int option_index = 0;
-	while ((opt = getopt_long(argc, argv, "diw:h", long_options, &option_index)) != -1) {
+	while ((opt = getopt_long(argc, argv, "diw:j:h", long_options, &option_index)) != -1) {
 		switch (opt) {
 			case 'd':
 				decode = 1;
@@ -226,6 +531,13 @@ M_ENTRY(base64) {
 					return 1;
 				}
 				break;
+			case 'j':
+				thread_count = atoi(optarg);
+				if (thread_count < 1) {
+					fprintf(stderr, "Invalid thread count: %s\n", optarg);
+					return 1;
+				}
+				break;
 			case 'h':
 				print_help();
 				return 0;
@@ -249,26 +561,28 @@ M_ENTRY(base64) {
 	}
 	
 	// Open input file (or use stdin)
-	FILE *input = stdin;
+	int input = STDIN_FILENO;
 	if (input_filename != NULL && strcmp(input_filename, "-") != 0) {
-		input = fopen(input_filename, "rb");
-		if (input == NULL) {
+		input = open(input_filename, O_RDONLY);
+		if (input < 0) {
 			perror("Failed to open input file");
 			return 1;
 		}
 	}
 	
-	// Execute encode or decode
-	int result;
-	if (decode) {
-		result = base64_decode(input, stdout, ignore_garbage);
-	} else {
-		result = base64_encode(input, stdout, wrap);
+	// Execute encode or decode, large files on all threads
+	int result = base64_try_parallel(input, STDOUT_FILENO, decode, wrap, ignore_garbage);
+	if (result > 0) {
+		if (decode) {
+			result = base64_decode(input, STDOUT_FILENO, ignore_garbage);
+		} else {
+			result = base64_encode(input, STDOUT_FILENO, wrap);
+		}
 	}
 	
 	// Cleanup
-	if (input != stdin) {
-		fclose(input);
+	if (input != STDIN_FILENO) {
+		close(input);
 	}
 	
 	return result;
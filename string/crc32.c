@@ -1,5 +1,5 @@
 /**
- *	crc32.c - Print CRC32 checksums
+ *	crc32.c - Print CRC32 (and CRC32C) checksums
  *
  * 	Created by RoofAlan
  *		2025/8/15
@@ -14,13 +14,20 @@
 #include <string.h>
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "module.h"
 #include "lib.h"
+#include "checksum.h"
+#include "crc.h"
+#include "workPool.h"
 
-// CRC32 polynomial (IEEE 802.3)
-#define CRC32_POLY 0xEDB88320
+#define CRC_PAR_MIN	(64 << 20)	// Regular files this large are split across threads
+#define CRC_RANGE_MIN	(16 << 20)	// Smallest range given to one task
+#define CRC_READ_BUF	(1 << 20)	// Read size of a range task
 
 // Global options
 static int check_mode = 0;
@@ -31,94 +38,194 @@ static int warn_mode = 0;
 static int binary_mode = 0;
 static int text_mode = 0;
 
-// CRC32 lookup table
-static uint32_t crc32_table[256];
+// Polynomial in use, switched by --castagnoli or the crc32c name
+typedef struct {
+	const char *name;	// Program name in messages
+	const char *tag;	// BSD-style tag
+	uint32_t (*update)(uint32_t crc, const void *data, size_t length);
+	uint32_t (*combine)(uint32_t crc1, uint32_t crc2, uint64_t len2);
+} crc_algo_t;
 
-// Initialize CRC32 lookup table
-static void init_crc32_table() {
-	for (uint32_t i = 0; i < 256; i++) {
-		uint32_t c = i;
-		for (int j = 0; j < 8; j++) {
-			c = (c & 1) ? (c >> 1) ^ CRC32_POLY : (c >> 1);
+static const crc_algo_t crc_ieee = { "crc32", "CRC32", crc32_update, crc32_combine };
+static const crc_algo_t crc_castagnoli = { "crc32c", "CRC32C", crc32c_update, crc32c_combine };
+static const crc_algo_t *crc_algo = &crc_ieee;
+static int thread_count = 0;
+
+// Shared by every file, created on the first large one
+static WorkPool *crc_pool = NULL;
+
+// One independently computed part of a file
+typedef struct {
+	int fd;
+	off_t offset;
+	off_t length;		// Bytes actually read when done
+	uint32_t crc;
+	int err;		// errno of a failed read
+} crc_range_t;
+
+// Hash update callback for sumReadFd()
+static void crc32_feed(void *ctx, const unsigned char *data, size_t len) {
+	*(uint32_t *)ctx = crc_algo->update(*(uint32_t *)ctx, data, len);
+}
+
+static void crc32_range_task(void *arg) {
+	crc_range_t *r = arg;
+	unsigned char *buf = malloc(CRC_READ_BUF);
+	off_t done = 0;
+	uint32_t crc = 0;
+
+	if (!buf) {
+		r->err = ENOMEM;
+		return;
+	}
+	while (done < r->length) {
+		size_t want = r->length - done < CRC_READ_BUF ? (size_t)(r->length - done) : CRC_READ_BUF;
+		ssize_t n = pread(r->fd, buf, want, r->offset + done);
+		if (n == 0) {
+			break;	// Truncated under us, hash what is there
+		}
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			r->err = errno;
+			break;
 		}
-		crc32_table[i] = c;
+		crc = crc_algo->update(crc, buf, n);
+		done += n;
 	}
+	free(buf);
+	r->length = done;
+	r->crc = crc;
 }
 
-// Calculate CRC32 for data buffer (unused)
-fused static uint32_t calculate_crc32(const void *data, size_t length) {
-	const uint8_t *bytes = (const uint8_t *)data;
-	uint32_t crc = 0xFFFFFFFF;
-	
-	for (size_t i = 0; i < length; i++) {
-		crc = crc32_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+// Split a large file into ranges, one task each, then merge with the combine function
+static int calculate_crc32_parallel(int fd, off_t size, int threads, uint32_t *result) {
+	int nranges = threads * 4;
+	if (size / nranges < CRC_RANGE_MIN) {
+		nranges = size / CRC_RANGE_MIN;
 	}
-	
-	return ~crc;
+
+	crc_range_t *ranges = calloc(nranges, sizeof(*ranges));
+	if (!ranges) {
+		return 1;
+	}
+	if (!crc_pool && !(crc_pool = workPoolCreate(threads))) {
+		free(ranges);
+		return 1;
+	}
+
+	// Ranges start on 64 KiB boundaries to keep the reads page aligned
+	off_t step = (size / nranges) & ~(off_t)0xFFFF;
+	for (int i = 0; i < nranges; i++) {
+		ranges[i].fd = fd;
+		ranges[i].offset = step * i;
+		ranges[i].length = i == nranges - 1 ? size - step * i : step;
+		workPoolSubmit(crc_pool, crc32_range_task, &ranges[i]);
+	}
+	workPoolWait(crc_pool);
+
+	uint32_t crc = 0;
+	int ret = 0;
+	for (int i = 0; i < nranges; i++) {
+		if (ranges[i].err) {
+			errno = ranges[i].err;
+			ret = -2;
+			break;
+		}
+		crc = crc_algo->combine(crc, ranges[i].crc, ranges[i].length);
+	}
+	free(ranges);
+
+	if (ret == 0) {
+		*result = crc;
+	}
+	return ret;
 }
 
-// Calculate CRC32 for a file
-static int calculate_file_crc32(const char *filename, uint32_t *result) {
-	FILE *file;
-	uint32_t crc = 0xFFFFFFFF;
-	uint8_t buffer[4096];
-	size_t bytes_read;
+/*
+ * Calculate CRC32 (or CRC32C) for a file, return: 0->success, -1->open failed, -2->read failed
+ * parallel: may split the file across the pool, only from the main thread
+ */
+static int calculate_file_crc32(const char *filename, uint32_t *result, int parallel) {
+	uint32_t crc = 0;
+	int fd = STDIN_FILENO;
+	int ret;
 	
-	if (strcmp(filename, "-") == 0) {
-		file = stdin;
-	} else {
-		file = fopen(filename, binary_mode ? "rb" : "r");
-		if (!file) {
-			if (!quiet_mode) {
-				fprintf(stderr, "crc32: %s: %s\n", filename, strerror(errno));
-			}
+	if (strcmp(filename, "-") != 0) {
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
 			return -1;
 		}
 	}
 	
-	while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-		for (size_t i = 0; i < bytes_read; i++) {
-			crc = crc32_table[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
-		}
+	// Large regular files are hashed range by range on all threads
+	struct stat st;
+	int threads = parallel ? workPoolThreads(thread_count) : 1;
+	if (threads > 1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= CRC_PAR_MIN) {
+		ret = calculate_crc32_parallel(fd, st.st_size, threads, &crc);
+	} else {
+		ret = 1;
 	}
 	
-	if (ferror(file)) {
-		if (!quiet_mode) {
-			fprintf(stderr, "crc32: %s: %s\n", 
-					strcmp(filename, "-") == 0 ? "stdin" : filename, 
-					strerror(errno));
-		}
-		if (file != stdin) fclose(file);
-		return -1;
+	// Otherwise a helper thread reads ahead while we compute
+	if (ret > 0) {
+		ret = sumReadFd(fd, crc32_feed, &crc);
 	}
 	
-	if (file != stdin) fclose(file);
+	if (fd != STDIN_FILENO) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+	}
+	if (ret != 0) {
+		return ret;
+	}
 	
-	*result = ~crc;
+	*result = crc;
 	return 0;
 }
 
+/*
+ * Digest callback for check mode, the CRC is stored big-endian like it is printed.
+ * Runs on the verifier threads, which already spread the files over the CPUs.
+ */
+static int crc32_sum_file(const char *filename, unsigned char *digest, int binary) {
+	(void)binary;
+	uint32_t crc;
+	
+	int ret = calculate_file_crc32(filename, &crc, 0);
+	if (ret == 0) {
+		digest[0] = (unsigned char)(crc >> 24);
+		digest[1] = (unsigned char)(crc >> 16);
+		digest[2] = (unsigned char)(crc >> 8);
+		digest[3] = (unsigned char)crc;
+	}
+	return ret;
+}
+
 // Print help information
 static void print_help() {
 	SHOW_VERSION(stderr);
-	fprintf(stderr, "Usage: crc32 [OPTION] [FILE]...\n\n"
-		"Print CRC32 checksums for files.\n\n"
+	fprintf(stderr, "Usage: %s [OPTION] [FILE]...\n\n"
+		"Print %s checksums for files.\n\n"
 		"Suppot options:\n"
 		"  -b, --binary      read files in binary mode (default)\n"
-		"  -c, --check       read CRC32 sums from files and check them\n"
+		"  -c, --check       read %s sums from files and check them\n"
+		"  -C, --castagnoli  use the CRC32C (Castagnoli) polynomial\n"
 		"  -t, --text        read files in text mode\n"
+		"  -j, --threads=N   hash large files with N threads (default: all CPUs)\n"
 		"  -q, --quiet	    suppress all normal output\n"
 		"  -s, --status      don't output anything, status code shows success\n"
 		"      --strict      exit non-zero for improperly formatted checksum lines\n"
 		"  -w, --warn        warn about improperly formatted checksum lines\n\n"
-		"With no FILE, or when FILE is -, read standard input.\n");
+		"With no FILE, or when FILE is -, read standard input.\n",
+		crc_algo->name, crc_algo->tag, crc_algo->tag);
 }
 
 // Process a single file in normal mode
 static void process_file(const char *filename) {
 	uint32_t crc;
 	
-	if (calculate_file_crc32(filename, &crc) == 0) {
+	if (calculate_file_crc32(filename, &crc, 1) == 0) {
 		if (status_mode) return;
 		if (quiet_mode) return;
 		
@@ -127,127 +234,68 @@ static void process_file(const char *filename) {
 		} else {
 			printf("%08x  %s\n", crc, filename);
 		}
+	} else if (!quiet_mode) {
+		fprintf(stderr, "%s: %s: %s\n", crc_algo->name,
+				strcmp(filename, "-") == 0 ? "stdin" : filename,
+				strerror(errno));
 	}
 }
 
 // Process a file in check mode
 static int check_file(const char *filename) {
-	FILE *file;
-	char line[256];
-	int line_number = 0;
-	int format_errors = 0;
-	int mismatches = 0;
-	int total = 0;
-
-	if (strcmp(filename, "-") == 0) {
-		file = stdin;
-	} else {
-		file = fopen(filename, "r");
-		if (!file) {
-			if (!quiet_mode) {
-				fprintf(stderr, "crc32: %s: %s\n", filename, strerror(errno));
-			}
-			return -1;
-		}
-	}
-	
-	while (fgets(line, sizeof(line), file)) {
-		line_number++;
-		total++;
-		
-		// Parse line: <checksum> [space] [space] <filename>
-		uint32_t expected_crc;
-		char file_path[256];
-		int parsed = 0;
-		
-		if (sscanf(line, "%08x  %255[^\n]", &expected_crc, file_path) == 2) {
-			parsed = 1;
-		} else if (sscanf(line, "%08x %255[^\n]", &expected_crc, file_path) == 2) {
-			parsed = 1;
-		} else if (sscanf(line, "%08x\t%255[^\n]", &expected_crc, file_path) == 2) {
-			parsed = 1;
-		}
-		
-		if (!parsed) {
-			format_errors++;
-			if (warn_mode && !quiet_mode) {
-				fprintf(stderr, "crc32: %s: %d: improperly formatted CRC32 line\n", 
-						filename, line_number);
-			}
-			continue;
-		}
-		
-		// Calculate actual CRC
-		uint32_t actual_crc;
-		if (calculate_file_crc32(file_path, &actual_crc) != 0) {
-			mismatches++;
-			if (!status_mode && !quiet_mode) {
-				printf("%s: FAILED open or read\n", file_path);
-			}
-			continue;
-		}
-		
-		// Compare results
-		if (actual_crc == expected_crc) {
-			if (!status_mode && !quiet_mode) {
-				printf("%s: OK\n", file_path);
-			}
-		} else {
-			mismatches++;
-			if (!status_mode && !quiet_mode) {
-				printf("%s: FAILED\n", file_path);
-			}
-		}
-	}
+	SumCheckOpts opts = {
+		.prog = crc_algo->name,
+		.tag = crc_algo->tag,
+		.digest_len = 4,
+		.sum = crc32_sum_file,
+		.quiet = quiet_mode,
+		.status = status_mode,
+		.strict = strict_mode,
+		.warn = warn_mode && !quiet_mode,
+	};
+	SumCheckResult res;
 	
-	if (ferror(file)) {
-		if (!quiet_mode) {
-			fprintf(stderr, "crc32: %s: %s\n", 
-					strcmp(filename, "-") == 0 ? "stdin" : filename, 
-					strerror(errno));
-		}
-		if (file != stdin) fclose(file);
+	int ret = sumCheckFile(&opts, filename, &res);
+	if (ret < 0) {
 		return -1;
 	}
 	
-	if (file != stdin) fclose(file);
-	
 	// Print summary if requested
-	if (!status_mode && !quiet_mode && total > 0) {
+	int failed = res.mismatched + res.unreadable;
+	if (!status_mode && !quiet_mode && res.lines > 0 && !res.stopped) {
 		printf("\n");
-		if (mismatches > 0 || format_errors > 0) {
+		if (failed > 0 || res.malformed > 0) {
 			printf("%s: FAILED\n", filename);
-			printf("%d of %d computed checksums did NOT match", mismatches, total);
-			if (format_errors > 0) {
-				printf(", %d lines improperly formatted", format_errors);
+			printf("%d of %d computed checksums did NOT match", failed, res.lines);
+			if (res.malformed > 0) {
+				printf(", %d lines improperly formatted", res.malformed);
 			}
 			printf("\n");
 		} else {
 			printf("%s: OK\n", filename);
-			printf("All %d computed checksums matched\n", total);
+			printf("All %d computed checksums matched\n", res.lines);
 		}
 	}
 	
 	// Return status
-	if (strict_mode && format_errors > 0) {
+	if (strict_mode && res.malformed > 0) {
 		return 1;
 	}
-	return mismatches > 0 ? 1 : 0;
+	return failed > 0 || res.stopped ? 1 : 0;
 }
 
 M_ENTRY(crc32) {
-	// Initialize CRC table
-	init_crc32_table();
-	
 	// Parse command-line options
 	static struct option long_options[] = {
 		{"binary",  no_argument, 0, 'b'},
 		{"check",   no_argument, 0, 'c'},
+		{"castagnoli", no_argument, 0, 'C'},
 		{"text",	no_argument, 0, 't'},
 		{"quiet",   no_argument, 0, 'q'},
 		{"status",  no_argument, 0, 's'},
 		{"strict",  no_argument, 0, 0},
 		{"warn",	no_argument, 0, 'w'},
+		{"threads", required_argument, 0, 'j'},
 		{"help",	no_argument, 0, 'h'},
 		{0, 0, 0, 0}
 	};
@@ -255,7 +303,7 @@ M_ENTRY(crc32) {
 	int option_index = 0;
 	int c;
 	
-	while ((c = getopt_long(argc, argv, "bctqswhv", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(argc, argv, "bcCtqswj:hv", long_options, &option_index)) != -1) {
 		switch (c) {
 			case 'b':
 				binary_mode = 1;
@@ -264,6 +312,9 @@ M_ENTRY(crc32) {
 			case 'c':
 				check_mode = 1;
 				break;
+			case 'C':
+				crc_algo = &crc_castagnoli;
+				break;
 			case 't':
 				text_mode = 1;
 				binary_mode = 0;
@@ -278,6 +329,13 @@ M_ENTRY(crc32) {
 			case 'w':
 				warn_mode = 1;
 				break;
+			case 'j':
+				thread_count = atoi(optarg);
+				if (thread_count < 1) {
+					fprintf(stderr, "%s: invalid thread count: %s\n", crc_algo->name, optarg);
+					return 2;
+				}
+				break;
 			case 'h':
 				print_help();
 				return 0;
@@ -318,7 +376,16 @@ M_ENTRY(crc32) {
 		}
 	}
 	
+	workPoolDestroy(crc_pool);
+	crc_pool = NULL;
 	return exit_status;
 }
 
+// Same as 'crc32 --castagnoli'
+M_ENTRY(crc32c) {
+	crc_algo = &crc_castagnoli;
+	return crc32_main(argc, argv);
+}
+
 REGISTER_MODULE(crc32);
+REGISTER_MODULE(crc32c);
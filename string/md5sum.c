@@ -18,9 +18,13 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <stdbool.h>
-#include <ctype.h>
 #include "module.h"
 #include "config.h"
+#include "checksum.h"
+
+/* Digest cache (--cache), NULL when not used */
+static SumCache *md5_cache = NULL;
+
 /* MD5 context structure */
 typedef struct {
 	unsigned int state[4];		/* state (ABCD) */
@@ -233,39 +237,24 @@ static void MD5_Transform(unsigned int state[4], const unsigned char block[64])
 	state[3] += d;
 }
 
-/* Compute MD5 hash of a file */
-static int compute_file_md5(const char *filename, unsigned char digest[16], bool binary_mode) {
+/* Hash update callback for sumReadFile() */
+static void md5_feed(void *ctx, const unsigned char *data, size_t len) {
+	MD5_Update(ctx, data, (unsigned int)len);
+}
+
+/* Compute MD5 hash of a file, return: 0->success, -1->open failed, -2->read failed */
+static int compute_file_md5(const char *filename, unsigned char digest[16], int binary_mode) {
 	(void)binary_mode;
 	MD5_CTX ctx;
-	unsigned char buffer[4096];
-	ssize_t bytes_read;
-	int fd;
-
-	if (strcmp(filename, "-") == 0) {
-		fd = STDIN_FILENO;
-	} else {
-		fd = open(filename, O_RDONLY);
-		if (fd == -1) {
-			fprintf(stderr, "md5sum: %s: %s\n", filename, strerror(errno));
-			return -1;
-		}
-	}
 
 	MD5_Init(&ctx);
 
-	while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
-		/* On non-GNU systems, text mode would convert line endings here */
-		MD5_Update(&ctx, buffer, (unsigned int)bytes_read);
+	/* Large files are read ahead by a helper thread while we hash */
+	int ret = sumReadFile(filename, md5_feed, &ctx);
+	if (ret != 0) {
+		return ret;
 	}
 
-	if (bytes_read == -1) {
-		fprintf(stderr, "md5sum: %s: %s\n", filename, strerror(errno));
-		if (fd != STDIN_FILENO) close(fd);
-		return -1;
-	}
-
-	if (fd != STDIN_FILENO) close(fd);
-
 	MD5_Final(digest, &ctx);
 	return 0;
 }
@@ -279,158 +268,53 @@ static void md5_digest_to_string(const unsigned char digest[16], char *str) {
 	str[32] = '\0';
 }
 
-/* Check if a line is a valid checksum line */
-static bool is_valid_checksum_line(const char *line, char *digest_str, char *filename, char *mode) {
-	if (strlen(line) < 34) return false;  /* Minimum length: 32 hex + 1 space + 1 char + 0 */
-	
-	/* Extract digest */
-	strncpy(digest_str, line, 32);
-	digest_str[32] = '\0';
-	
-	/* Check digest is valid hex */
-	for (int i = 0; i < 32; i++) {
-		if (!isxdigit((unsigned char)digest_str[i])) {
-			return false;
-		}
-	}
-	
-	/* Extract mode */
-	*mode = line[32];
-	if (*mode != ' ' && *mode != '*') {
-		return false;
-	}
-	
-	/* Extract filename */
-	if (line[33] != ' ') {
-		return false;
-	}
-	strcpy(filename, &line[34]);
-	
-	return true;
-}
-
-/* Convert string to MD5 digest */
-static bool md5_string_to_digest(const char *str, unsigned char digest[16]) {
-	if (strlen(str) != 32) return false;
-	
-	for (int i = 0; i < 16; i++) {
-		char hex[3] = {str[2*i], str[2*i+1], '\0'};
-		unsigned int val;
-		if (sscanf(hex, "%x", &val) != 1) {
-			return false;
-		}
-		digest[i] = (unsigned char)val;
-	}
-	return true;
-}
-
-/* Compare two MD5 digests */
-static bool md5_digests_equal(const unsigned char a[16], const unsigned char b[16]) {
-	for (int i = 0; i < 16; i++) {
-		if (a[i] != b[i]) return false;
-	}
-	return true;
-}
-
-/* Check checksums from a file */
+/* Check checksums from a file, entries are verified in parallel */
 static int check_checksums(const char *filename, bool ignore_missing, bool quiet, bool status, bool strict, bool warn) {
-	FILE *file;
-	char line[1024];
-	int line_num = 0;
-	int errors = 0;
-	bool has_errors = false;
-
-	if (strcmp(filename, "-") == 0) {
-		file = stdin;
-	} else {
-		file = fopen(filename, "r");
-		if (!file) {
-			fprintf(stderr, "md5sum: %s: %s\n", filename, strerror(errno));
-			return 1;
-		}
-	}
-
-	while (fgets(line, sizeof(line), file)) {
-		line_num++;
-		size_t len = strlen(line);
-		if (len > 0 && line[len-1] == '\n') {
-			line[len-1] = '\0';  /* Remove newline */
-		}
+	SumCheckOpts opts = {
+		.prog = "md5sum",
+		.tag = "MD5",
+		.digest_len = 16,
+		.sum = compute_file_md5,
+		.cache = md5_cache,
+		.ignore_missing = ignore_missing,
+		.quiet = quiet,
+		.status = status,
+		.strict = strict,
+		.warn = warn,
+	};
+	SumCheckResult res;
 
-		char expected_digest_str[33];
-		char file_to_check[1024];
-		char mode;
+	int ret = sumCheckFile(&opts, filename, &res);
+	sumCheckReport(&opts, &res);
 
-		if (!is_valid_checksum_line(line, expected_digest_str, file_to_check, &mode)) {
-			if (strict) {
-				has_errors = true;
-				errors++;
-			}
-			if (warn || strict) {
-				fprintf(stderr, "md5sum: %s: %d: improperly formatted checksum line\n", filename, line_num);
-			}
-			if (status) continue;
-			continue;
-		}
-
-		/* Check if file exists */
-		struct stat st;
-		if (stat(file_to_check, &st) != 0) {
-			if (!ignore_missing) {
-				has_errors = true;
-				errors++;
-				if (!status) {
-					fprintf(stderr, "md5sum: %s: No such file or directory\n", file_to_check);
-				}
-			}
-			continue;
-		}
+	return ret != 0 ? 1 : 0;
+}
 
-		/* Compute actual digest */
-		unsigned char actual_digest[16];
-		unsigned char expected_digest[16];
-		
-		if (compute_file_md5(file_to_check, actual_digest, mode == '*') != 0) {
-			has_errors = true;
-			errors++;
-			continue;
-		}
-		
-		if (!md5_string_to_digest(expected_digest_str, expected_digest)) {
-			if (strict) {
-				has_errors = true;
-				errors++;
-			}
-			if (warn || strict) {
-				fprintf(stderr, "md5sum: %s: %d: invalid hex in checksum\n", filename, line_num);
-			}
-			continue;
-		}
+/* Print a sorted manifest of the regular files under each DIR, hashed in parallel */
+static int hash_trees(char **dirs, int ndirs, bool binary_mode, bool tag_mode, bool zero_terminated,
+		bool follow, bool one_fs) {
+	SumTreeOpts opts = {
+		.prog = "md5sum",
+		.tag = "MD5",
+		.digest_len = 16,
+		.sum = compute_file_md5,
+		.cache = md5_cache,
+		.binary = binary_mode,
+		.bsd_tag = tag_mode,
+		.zero = zero_terminated,
+		.follow = follow,
+		.one_fs = one_fs,
+	};
+	int result = 0;
 
-		/* Compare digests */
-		if (md5_digests_equal(actual_digest, expected_digest)) {
-			if (!quiet && !status) {
-				printf("%s: OK\n", file_to_check);
-			}
-		} else {
-			has_errors = true;
-			errors++;
-			if (!status) {
-				printf("%s: FAILED\n", file_to_check);
-			}
+	for (int i = 0; i < ndirs; i++) {
+		if (sumTreeFile(&opts, dirs[i]) != 0) {
+			result = 1;
 		}
 	}
-
-	if (file != stdin) fclose(file);
-
-	if (has_errors && !status) {
-		printf("md5sum: WARNING: %d computed checksum did NOT match\n", errors);
-	}
-
-	return has_errors ? 1 : 0;
+	return result;
 }
 
-
 /* Print help information */
 static void print_help() {
 	SHOW_VERSION(stdout);
@@ -442,13 +326,20 @@ static void print_help() {
 	printf("    --tag          create a BSD-style checksum\n");
 	printf("  -t, --text       read in text mode (default)\n");
 	printf("  -z, --zero       end each output line with NUL, not newline,\n");
-	printf("                   and disable file name escaping\n\n");
+	printf("                   and disable file name escaping\n");
+	printf("  -r, --recursive  hash every regular file under the DIRs, sorted by path\n");
+	printf("  -L, --dereference  follow symbolic links with -r\n");
+	printf("  -x, --one-file-system  with -r, skip directories on other file systems\n\n");
 	printf("The following five options are useful only when verifying checksums:\n");
 	printf("    --ignore-missing  don't fail or report status for missing files\n");
 	printf("    --quiet        don't print OK for each successfully verified file\n");
 	printf("    --status       don't output anything, status code shows success\n");
 	printf("    --strict       exit non-zero for improperly formatted checksum lines\n");
 	printf("  -w, --warn       warn about improperly formatted checksum lines\n\n");
+	printf("    --cache[=FILE] reuse digests of files whose size, mtime and ctime are\n");
+	printf("                   unchanged (default FILE: ~/.cache/toolen/md5.idx)\n");
+	printf("    --cache-revalidate  hash every file again and refresh the cache\n");
+	printf("    --cache-stats  print cache hits and misses on stderr\n\n");
 	printf("    --help         display this help and exit\n");
 }
 
@@ -463,6 +354,14 @@ M_ENTRY(md5sum) {
 	bool strict = false;
 	bool warn = false;
 	bool help = false;
+	bool recursive = false;
+	bool follow = false;
+	bool one_fs = false;
+	bool use_cache = false;
+	bool cache_revalidate = false;
+	bool cache_stats = false;
+	const char *cache_path = NULL;
+	int result = 0;
 
 	/* Command line options */
 	static struct option long_options[] = {
@@ -476,14 +375,20 @@ M_ENTRY(md5sum) {
 		{"status", no_argument, 0, 0},
 		{"strict", no_argument, 0, 0},
 		{"warn", no_argument, 0, 'w'},
+		{"recursive", no_argument, 0, 'r'},
+		{"dereference", no_argument, 0, 'L'},
+		{"one-file-system", no_argument, 0, 'x'},
 		{"help", no_argument, 0, 0},
+		{"cache", optional_argument, 0, 0},
+		{"cache-revalidate", no_argument, 0, 0},
+		{"cache-stats", no_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
 
 	int opt;
 	int option_index = 0;
 
-	while ((opt = getopt_long(argc, argv, "bctzw", long_options, &option_index)) != -1) {
+	while ((opt = getopt_long(argc, argv, "bctzwrLx", long_options, &option_index)) != -1) {
 		switch (opt) {
 			case 'b':
 				binary_mode = true;
@@ -500,6 +405,15 @@ M_ENTRY(md5sum) {
 			case 'w':
 				warn = true;
 				break;
+			case 'r':
+				recursive = true;
+				break;
+			case 'L':
+				follow = true;
+				break;
+			case 'x':
+				one_fs = true;
+				break;
 			case 0:
 				if (strcmp(long_options[option_index].name, "tag") == 0) {
 					tag_mode = true;
@@ -513,6 +427,14 @@ M_ENTRY(md5sum) {
 					strict = true;
 				} else if (strcmp(long_options[option_index].name, "help") == 0) {
 					help = true;
+				} else if (strcmp(long_options[option_index].name, "cache") == 0) {
+					use_cache = true;
+					cache_path = optarg;
+				} else if (strcmp(long_options[option_index].name, "cache-revalidate") == 0) {
+					use_cache = true;
+					cache_revalidate = true;
+				} else if (strcmp(long_options[option_index].name, "cache-stats") == 0) {
+					cache_stats = true;
 				}
 				break;
 			default:
@@ -527,31 +449,43 @@ M_ENTRY(md5sum) {
 		return 0;
 	}
 
+	if (check_mode && recursive) {
+		fprintf(stderr, "md5sum: the --recursive option is meaningless when verifying checksums\n");
+		return 1;
+	}
+
 	/* Determine files to process */
 	int num_files = argc - optind;
 	char **files = argv + optind;
 
-	/* If no files specified, read from stdin */
+	/* If no files specified, read from stdin (-r: walk the current directory) */
 	if (num_files == 0) {
 		num_files = 1;
 		static char *stdin_file[] = {"-"};
-		files = stdin_file;
+		static char *cwd[] = {"."};
+		files = recursive ? cwd : stdin_file;
+	}
+
+	if (use_cache) {
+		md5_cache = sumCacheOpen("md5sum", "md5", 16, cache_path, cache_revalidate);
 	}
 
 	if (check_mode) {
 		/* Check mode: verify checksums */
-		int result = 0;
 		for (int i = 0; i < num_files; i++) {
 			int res = check_checksums(files[i], ignore_missing, quiet, status, strict, warn);
 			if (res != 0) result = res;
 		}
-		return result;
+	} else if (recursive) {
+		result = hash_trees(files, num_files, binary_mode, tag_mode, zero_terminated, follow, one_fs);
 	} else {
 		/* Generate mode: compute and print checksums */
 		for (int i = 0; i < num_files; i++) {
 			unsigned char digest[16];
-			if (compute_file_md5(files[i], digest, binary_mode) != 0) {
-				return 1;
+			if (sumCacheFile(md5_cache, files[i], compute_file_md5, digest, binary_mode) != 0) {
+				fprintf(stderr, "md5sum: %s: %s\n", files[i], strerror(errno));
+				result = 1;
+				break;
 			}
 
 			char digest_str[33];
@@ -571,7 +505,15 @@ M_ENTRY(md5sum) {
 				putchar('\n');
 			}
 		}
-		return 0;
 	}
+
+	if (md5_cache) {
+		if (cache_stats) {
+			sumCacheReport(md5_cache);
+		}
+		sumCacheClose(md5_cache);
+		md5_cache = NULL;
+	}
+	return result;
 }
 REGISTER_MODULE(md5sum);
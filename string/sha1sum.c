@@ -19,6 +19,7 @@
 
 #include "module.h"
 #include "config.h"
+#include "checksum.h"
 /**
  * @def SHA1_DIGEST_SIZE
  * @brief Size of the SHA1 digest in bytes (160 bits = 20 bytes)
@@ -59,6 +60,16 @@ static int flag_status = 0;	// No output, status code only (--status)
 static int flag_strict = 0;	// Strict mode for bad lines (--strict)
 static int flag_warn = 0;	// Warn about bad lines (-w/--warn)
 static int flag_help = 0;	// Show help (--help)
+static int flag_recursive = 0;	// Manifest of directory trees (-r/--recursive)
+static int flag_follow = 0;	// Follow symlinks in the trees (-L/--dereference)
+static int flag_one_fs = 0;	// Stay on one file system (-x/--one-file-system)
+static int flag_cache = 0;	// Digest cache (--cache[=FILE])
+static int flag_cache_revalidate = 0;	// Re-hash and refresh the cache (--cache-revalidate)
+static int flag_cache_stats = 0;	// Print cache counters (--cache-stats)
+static const char *cache_path = NULL;	// Index file of --cache=FILE
+
+// Digest cache, open while the command runs with --cache
+static SumCache *sum_cache = NULL;
 
 /**
  * @brief Initial SHA1 state values (defined by FIPS 180-1)
@@ -264,6 +275,16 @@ static void sha1_final(uint8_t digest[SHA1_DIGEST_SIZE], SHA1_CTX *ctx) {
 	memset(ctx, 0, sizeof(SHA1_CTX));
 }
 
+/**
+ * @brief Hash update callback for sumReadFile()
+ * @param ctx Pointer to SHA1_CTX
+ * @param data Next block of the file
+ * @param len Length of the block in bytes
+ */
+static void sha1_feed(void *ctx, const unsigned char *data, size_t len) {
+	sha1_update(ctx, data, len);
+}
+
 /**
  * @brief Compute SHA1 hash of a file
  * Opens the file (or reads from stdin), processes all data, and returns the digest
@@ -273,57 +294,24 @@ static void sha1_final(uint8_t digest[SHA1_DIGEST_SIZE], SHA1_CTX *ctx) {
  * @return 0 on success, -1 if file cannot be opened, -2 if read error occurs
  */
 static int file_sha1(const char *filename, uint8_t digest[SHA1_DIGEST_SIZE], int binary_mode) {
-	FILE *file = stdin;  // Default to stdin
-
-	// Open file if not using stdin
-	if (filename && strcmp(filename, "-") != 0) {
-		// Open in binary or text mode based on flag
-		file = fopen(filename, binary_mode ? "rb" : "r");
-		if (!file) {
-			return -1;  // Failed to open file
-		}
-	}
+	// Text and binary mode read the same bytes on GNU/Linux
+	(void)binary_mode;
 
-	// Initialize hash context
+	// Initialize SHA1 context
 	SHA1_CTX ctx;
 	sha1_init(&ctx);
 
-	// Read file in chunks and update hash
-	uint8_t buffer[8192];  // 8KB buffer for efficient reading
-	size_t bytes_read;
-	while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-		sha1_update(&ctx, buffer, bytes_read);
-	}
-
-	// Check for read errors
-	int read_error = ferror(file);
-
-	// Close file (don't close stdin)
-	if (file != stdin) {
-		fclose(file);
-	}
-
-	// Handle read errors
-	if (read_error) {
-		errno = read_error;  // Preserve error code
-		return -2;  // Indicate read error
+	// Feed the file (or standard input) to the hash, large files are read ahead
+	int ret = sumReadFile(filename ? filename : "-", sha1_feed, &ctx);
+	if (ret != 0) {
+		return ret;  // -1: cannot open, -2: read error (errno is set)
 	}
 
-	// Finalize hash and get digest
+	// Finalize the hash and get the digest
 	sha1_final(digest, &ctx);
 	return 0;  // Success
 }
 
-/**
- * @brief Compare two SHA1 digests
- * @param a First digest to compare
- * @param b Second digest to compare
- * @return 1 if digests are equal, 0 otherwise
- */
-static int digest_cmp(const uint8_t a[SHA1_DIGEST_SIZE], const uint8_t b[SHA1_DIGEST_SIZE]) {
-	return memcmp(a, b, SHA1_DIGEST_SIZE) == 0;
-}
-
 /**
  * @brief Convert SHA1 digest to hexadecimal string
  * Produces a lowercase 40-character string (each byte → 2 hex chars)
@@ -339,31 +327,6 @@ static void digest2str(const uint8_t digest[SHA1_DIGEST_SIZE], char *str) {
 	str[2 * SHA1_DIGEST_SIZE] = '\0';  // Null-terminate
 }
 
-/**
- * @brief Convert hexadecimal string to SHA1 digest
- * @param str 40-character hex string
- * @param digest Output buffer for 20-byte digest
- * @return 0 on success, -1 if string is invalid
- */
-static int str2digest(const char *str, uint8_t digest[SHA1_DIGEST_SIZE]) {
-	// Check string length is correct
-	if (strlen(str) != 2 * SHA1_DIGEST_SIZE) {
-		return -1;
-	}
-
-	// Parse each pair of hex characters
-	for (int i = 0; i < SHA1_DIGEST_SIZE; i++) {
-		unsigned int value;
-		// Parse 2-character hex value
-		if (sscanf(&str[2*i], "%2x", &value) != 1) {
-			return -1;  // Invalid hex character
-		}
-		digest[i] = (uint8_t)value;
-	}
-
-	return 0;  // Success
-}
-
 /**
  * @brief Print help message
  * Displays usage information and option descriptions
@@ -378,13 +341,20 @@ static void print_help() {
 	printf("      --tag       create a BSD-style checksum\n");
 	printf("  -t, --text      read in text mode (default)\n");
 	printf("  -z, --zero      end each output line with NUL, not newline,\n");
-	printf("                  and disable file name escaping\n\n");
+	printf("                  and disable file name escaping\n");
+	printf("  -r, --recursive  hash every regular file under the DIRs, sorted by path\n");
+	printf("  -L, --dereference  follow symbolic links with -r\n");
+	printf("  -x, --one-file-system  with -r, skip directories on other file systems\n\n");
 	printf("The following five options are useful only when verifying checksums:\n");
 	printf("      --ignore-missing  don't fail or report status for missing files\n");
 	printf("      --quiet     don't print OK for each successfully verified file\n");
 	printf("      --status    don't output anything, status code shows success\n");
 	printf("      --strict    exit non-zero for improperly formatted checksum lines\n");
 	printf("  -w, --warn      warn about improperly formatted checksum lines\n\n");
+	printf("      --cache[=FILE]  reuse digests of files whose size, mtime and ctime\n");
+	printf("                  are unchanged (default FILE: ~/.cache/toolen/sha1.idx)\n");
+	printf("      --cache-revalidate  hash every file again and refresh the cache\n");
+	printf("      --cache-stats  print cache hits and misses on stderr\n\n");
 	printf("      --help      display this help and exit\n");
 }
 
@@ -408,7 +378,13 @@ static int parse_args(int argc, char *argv[]) {
 		{"status",		no_argument, NULL, 0},
 		{"strict",		no_argument, NULL, 0},
 		{"warn",		no_argument, NULL, 'w'},
+		{"recursive",	no_argument, NULL, 'r'},
+		{"dereference",	no_argument, NULL, 'L'},
+		{"one-file-system", no_argument, NULL, 'x'},
 		{"help",		no_argument, NULL, 0},
+		{"cache",		optional_argument, NULL, 0},
+		{"cache-revalidate", no_argument, NULL, 0},
+		{"cache-stats",	no_argument, NULL, 0},
 		{NULL, 0, NULL, 0}  // Terminator
 	};
 
@@ -416,7 +392,7 @@ static int parse_args(int argc, char *argv[]) {
 	int option_index = 0;
 
 	// Process options
-	while ((opt = getopt_long(argc, argv, "bctzw", long_options, &option_index)) != -1) {
+	while ((opt = getopt_long(argc, argv, "bctzwrLx", long_options, &option_index)) != -1) {
 		switch (opt) {
 			case 'b':
 				flag_binary = 1;
@@ -435,6 +411,15 @@ static int parse_args(int argc, char *argv[]) {
 			case 'w':
 				flag_warn = 1;
 				break;
+			case 'r':
+				flag_recursive = 1;
+				break;
+			case 'L':
+				flag_follow = 1;
+				break;
+			case 'x':
+				flag_one_fs = 1;
+				break;
 			case 0:
 				// Handle long options with no short equivalent
 				if (strcmp(long_options[option_index].name, "tag") == 0) {
@@ -450,6 +435,14 @@ static int parse_args(int argc, char *argv[]) {
 					flag_strict = 1;
 				} else if (strcmp(long_options[option_index].name, "help") == 0) {
 					flag_help = 1;
+				} else if (strcmp(long_options[option_index].name, "cache") == 0) {
+					flag_cache = 1;
+					cache_path = optarg;
+				} else if (strcmp(long_options[option_index].name, "cache-revalidate") == 0) {
+					flag_cache = 1;
+					flag_cache_revalidate = 1;
+				} else if (strcmp(long_options[option_index].name, "cache-stats") == 0) {
+					flag_cache_stats = 1;
 				} 
 				break;
 			case '?':
@@ -467,6 +460,12 @@ static int parse_args(int argc, char *argv[]) {
 		return -1;
 	}
 
+
+	if (flag_check && flag_recursive) {
+		fprintf(stderr, "sha1sum: the --recursive option is meaningless when verifying checksums\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -480,135 +479,33 @@ static int parse_args(int argc, char *argv[]) {
  */
 static int check_mode(int argc, char *argv[]) {
 	int exit_status = 0;  // 0 = success, 1 = failure
+	SumCheckOpts opts = {
+		.prog = "sha1sum",
+		.tag = "SHA1",
+		.digest_len = SHA1_DIGEST_SIZE,
+		.sum = file_sha1,
+		.cache = sum_cache,
+		.binary = flag_binary,
+		.ignore_missing = flag_ignore_missing,
+		.quiet = flag_quiet,
+		.status = flag_status,
+		.strict = flag_strict,
+		.warn = flag_warn,
+	};
 
-	// If no files provided, read from stdin
+	// If no files are provided, read checksums from standard input
 	if (optind >= argc) {
-		static char stdin_flag[] = "-";  // Avoid string literal to char* warning
+		static char stdin_flag[] = "-";  // Avoids string literal to char* warning
 		argv[argc++] = stdin_flag;
 	}
 
-	// Process each checksum file
+	// Verify each checksum file, entries are hashed in parallel
 	for (int i = optind; i < argc; i++) {
-		FILE *checkfile = stdin;
-
-		// Open the checksum file (or use stdin)
-		if (strcmp(argv[i], "-") != 0) {
-			checkfile = fopen(argv[i], "r");
-			if (!checkfile) {
-				fprintf(stderr, "sha1sum: %s: %s\n", argv[i], strerror(errno));
-				exit_status = 1;
-				continue;
-			}
-		}
-
-		char line[1024];  // Buffer to hold lines from checksum file
-		int line_num = 0;  // Track line numbers for error messages
-
-		// Read each line from the checksum file
-		while (fgets(line, sizeof(line), checkfile)) {
-			line_num++;
-			char expected_str[41];  // Expected checksum string (40 chars + null)
-			char filename[1024];	// Filename from checksum line
-			uint8_t expected_digest[SHA1_DIGEST_SIZE];  // Parsed expected digest
-			uint8_t computed_digest[SHA1_DIGEST_SIZE];  // Computed digest
-			int ret;				// Return value from file_sha1
-			int binary_mode = 0;	// Whether file was stored in binary mode
-			char mode_char;		 // Mode character (' ' for text, '*' for binary)
-
-			// Process line terminators
-			size_t line_len = strlen(line);
-			if (line_len > 0 && line[line_len - 1] == '\n') {
-				line[line_len - 1] = '\0';  // Remove newline
-			} else if (!feof(checkfile) && (flag_warn || flag_strict)) {
-				// Line is too long (didn't fit in buffer)
-				fprintf(stderr, "sha1sum: %s:%d: improperly formatted checksum line (too long)\n",
-						(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-				if (flag_strict) {
-					exit_status = 1;
-				}
-				continue;
-			}
-
-			// Parse line based on format (BSD-style or standard)
-			if (flag_tag) {
-				// BSD-style format: "SHA1 (filename) = checksum"
-				if (sscanf(line, "SHA1 (%s) = %40s", filename, expected_str) != 2) {
-					if (flag_warn || flag_strict) {
-						fprintf(stderr, "sha1sum: %s:%d: improperly formatted BSD-style checksum line\n",
-								(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-						if (flag_strict) {
-							exit_status = 1;
-						}
-					}
-					continue;
-				}
-			} else {
-				// Standard format: "checksum mode filename" (mode is ' ' or '*')
-				if (sscanf(line, "%40s %c%s", expected_str, &mode_char, filename) != 3) {
-					if (flag_warn || flag_strict) {
-						fprintf(stderr, "sha1sum: %s:%d: improperly formatted checksum line\n",
-								(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-						if (flag_strict) {
-							exit_status = 1;
-						}
-					}
-					continue;
-				}
-				// Determine if file was stored in binary mode
-				binary_mode = (mode_char == '*');
-			}
-
-			// Convert expected checksum string to digest
-			if (str2digest(expected_str, expected_digest) != 0) {
-				if (flag_warn || flag_strict) {
-					fprintf(stderr, "sha1sum: %s:%d: invalid checksum value\n",
-							(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-					if (flag_strict) {
-						exit_status = 1;
-					}
-				}
-				continue;
-			}
-
-			// Compute digest for the file (honor binary mode flag)
-			ret = file_sha1(filename, computed_digest, binary_mode || flag_binary);
-			if (ret == -1) {
-				// File not found
-				if (!flag_ignore_missing) {
-					if (!flag_status) {
-						fprintf(stderr, "sha1sum: %s: %s\n", filename, strerror(errno));
-					}
-					exit_status = 1;
-				}
-			} else if (ret == -2) {
-				// Error reading file
-				if (!flag_status) {
-					fprintf(stderr, "sha1sum: %s: %s\n", filename, strerror(errno));
-				}
-				exit_status = 1;
-			} else if (!digest_cmp(expected_digest, computed_digest)) {
-				// Checksum mismatch
-				if (!flag_status) {
-					fprintf(stderr, "%s: FAILED\n", filename);
-				}
-				exit_status = 1;
-			} else if (!flag_quiet && !flag_status) {
-				// Checksum match
-				printf("%s: OK\n", filename);
-			}
-		}
-
-		// Check for errors reading the checksum file
-		if (ferror(checkfile)) {
-			fprintf(stderr, "sha1sum: %s: %s\n",
-					(checkfile == stdin) ? "(stdin)" : argv[i], strerror(errno));
+		SumCheckResult res;
+		if (sumCheckFile(&opts, argv[i], &res) != 0) {
 			exit_status = 1;
 		}
-
-		// Close the checksum file (don't close stdin)
-		if (checkfile != stdin) {
-			fclose(checkfile);
-		}
+		sumCheckReport(&opts, &res);
 	}
 
 	return exit_status;
@@ -632,7 +529,7 @@ static int compute_mode(int argc, char *argv[]) {
 		int ret;
 
 		// Compute hash for the file
-		ret = file_sha1(argv[i], digest, flag_binary);
+		ret = sumCacheFile(sum_cache, argv[i], file_sha1, digest, flag_binary);
 		if (ret != 0) {
 			fprintf(stderr, "sha1sum: %s: %s\n", argv[i], strerror(errno));
 			exit_status = 1;
@@ -682,6 +579,40 @@ static int compute_mode(int argc, char *argv[]) {
 	return exit_status;
 }
 
+/**
+ * @brief Run in recursive mode (-r)
+ * Prints a manifest of every regular file under each DIR (default: the
+ * current directory), sorted by path, that -c accepts.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors)
+ */
+static int tree_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	SumTreeOpts opts = {
+		.prog = "sha1sum",
+		.tag = "SHA1",
+		.digest_len = SHA1_DIGEST_SIZE,
+		.sum = file_sha1,
+		.cache = sum_cache,
+		.binary = flag_binary,
+		.bsd_tag = flag_tag,
+		.zero = flag_zero,
+		.follow = flag_follow,
+		.one_fs = flag_one_fs,
+	};
+
+	if (optind >= argc) {
+		return sumTreeFile(&opts, ".");
+	}
+	for (int i = optind; i < argc; i++) {
+		if (sumTreeFile(&opts, argv[i]) != 0) {
+			exit_status = 1;
+		}
+	}
+	return exit_status;
+}
+
 /**
  * @brief Main function
  * Parses arguments, handles help/version requests, and dispatches to compute/check mode
@@ -701,11 +632,28 @@ M_ENTRY(sha1sum) {
 		return 0;
 	}
 
+	// Reuse the digests of unchanged files
+	if (flag_cache) {
+		sum_cache = sumCacheOpen("sha1sum", "sha1", SHA1_DIGEST_SIZE, cache_path, flag_cache_revalidate);
+	}
+
 	// Run in check mode or compute mode
+	int ret;
 	if (flag_check) {
-		return check_mode(argc, argv);
+		ret = check_mode(argc, argv);
+	} else if (flag_recursive) {
+		ret = tree_mode(argc, argv);
 	} else {
-		return compute_mode(argc, argv);
+		ret = compute_mode(argc, argv);
+	}
+
+	if (sum_cache) {
+		if (flag_cache_stats) {
+			sumCacheReport(sum_cache);
+		}
+		sumCacheClose(sum_cache);
+		sum_cache = NULL;
 	}
+	return ret;
 }
 REGISTER_MODULE(sha1sum);
@@ -19,6 +19,7 @@
 
 #include "module.h"
 #include "config.h"
+#include "checksum.h"
 /**
  * @def SHA256_DIGEST_SIZE
  * @brief Size of SHA-256 digest in bytes (256 bits = 32 bytes)
@@ -65,6 +66,16 @@ static int flag_status = 0;	// No output, status code only (--status)
 static int flag_strict = 0;	// Strict mode for bad lines (--strict)
 static int flag_warn = 0;	// Warn about bad lines (-w/--warn)
 static int flag_help = 0;	// Show help (--help)
+static int flag_recursive = 0;	// Manifest of directory trees (-r/--recursive)
+static int flag_follow = 0;	// Follow symlinks in the trees (-L/--dereference)
+static int flag_one_fs = 0;	// Stay on one file system (-x/--one-file-system)
+static int flag_cache = 0;	// Digest cache (--cache[=FILE])
+static int flag_cache_revalidate = 0;	// Re-hash and refresh the cache (--cache-revalidate)
+static int flag_cache_stats = 0;	// Print cache counters (--cache-stats)
+static const char *cache_path = NULL;	// Index file of --cache=FILE
+
+// Digest cache, open while the command runs with --cache
+static SumCache *sum_cache = NULL;
 
 /**
  * @brief SHA-256 initial hash values (FIPS 180-4 specification)
@@ -300,6 +311,16 @@ static void sha256_final(uint8_t digest[SHA256_DIGEST_SIZE], SHA256_CTX *ctx) {
 	memset(ctx, 0, sizeof(SHA256_CTX));
 }
 
+/**
+ * @brief Hash update callback for sumReadFile()
+ * @param ctx Pointer to SHA256_CTX
+ * @param data Next block of the file
+ * @param len Length of the block in bytes
+ */
+static void sha256_feed(void *ctx, const unsigned char *data, size_t len) {
+	sha256_update(ctx, data, len);
+}
+
 /**
  * @brief Compute SHA-256 hash of a file
  * Opens a file (or reads from standard input), processes all data,
@@ -310,40 +331,17 @@ static void sha256_final(uint8_t digest[SHA256_DIGEST_SIZE], SHA256_CTX *ctx) {
  * @return 0 on success, -1 if file cannot be opened, -2 if read error occurs
  */
 static int file_sha256(const char *filename, uint8_t digest[SHA256_DIGEST_SIZE], int binary_mode) {
-	FILE *file = stdin;  // Default to standard input
-
-	// Open the file if not using standard input
-	if (filename && strcmp(filename, "-") != 0) {
-		// Open in binary or text mode based on the flag
-		file = fopen(filename, binary_mode ? "rb" : "r");
-		if (!file) {
-			return -1;  // Failed to open file
-		}
-	}
+	// Text and binary mode read the same bytes on GNU/Linux
+	(void)binary_mode;
 
-	// Initialize SHA-256 context
+	// Initialize SHA256 context
 	SHA256_CTX ctx;
 	sha256_init(&ctx);
 
-	// Read file in chunks and update hash (8KB buffer for efficiency)
-	uint8_t buffer[8192];
-	size_t bytes_read;
-	while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-		sha256_update(&ctx, buffer, bytes_read);
-	}
-
-	// Check for errors during reading
-	int read_error = ferror(file);
-
-	// Close the file (do not close standard input)
-	if (file != stdin) {
-		fclose(file);
-	}
-
-	// Handle read errors
-	if (read_error) {
-		errno = read_error;  // Preserve the error code
-		return -2;  // Indicate read error
+	// Feed the file (or standard input) to the hash, large files are read ahead
+	int ret = sumReadFile(filename ? filename : "-", sha256_feed, &ctx);
+	if (ret != 0) {
+		return ret;  // -1: cannot open, -2: read error (errno is set)
 	}
 
 	// Finalize the hash and get the digest
@@ -351,16 +349,6 @@ static int file_sha256(const char *filename, uint8_t digest[SHA256_DIGEST_SIZE],
 	return 0;  // Success
 }
 
-/**
- * @brief Compare two SHA-256 digests
- * @param a First digest to compare
- * @param b Second digest to compare
- * @return 1 if digests are equal, 0 otherwise
- */
-static int digest_cmp(const uint8_t a[SHA256_DIGEST_SIZE], const uint8_t b[SHA256_DIGEST_SIZE]) {
-	return memcmp(a, b, SHA256_DIGEST_SIZE) == 0;
-}
-
 /**
  * @brief Convert SHA-256 digest to hexadecimal string
  * Converts the 32-byte digest to a 64-character lowercase hex string.
@@ -376,32 +364,6 @@ static void digest2str(const uint8_t digest[SHA256_DIGEST_SIZE], char *str) {
 	str[2 * SHA256_DIGEST_SIZE] = '\0';  // Null-terminate the string
 }
 
-/**
- * @brief Convert hexadecimal string to SHA-256 digest
- * Parses a 64-character hex string into a 32-byte digest.
- * @param str 64-character hexadecimal string
- * @param digest Output buffer for the 32-byte digest
- * @return 0 on success, -1 if string is invalid (wrong length or bad characters)
- */
-static int str2digest(const char *str, uint8_t digest[SHA256_DIGEST_SIZE]) {
-	// Check if the string length is correct (64 characters for 32 bytes)
-	if (strlen(str) != 2 * SHA256_DIGEST_SIZE) {
-		return -1;
-	}
-
-	// Parse each pair of hex characters into a byte
-	for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
-		unsigned int val;
-		// Read 2-character hex value
-		if (sscanf(&str[2*i], "%2x", &val) != 1) {
-			return -1;  // Invalid hex character
-		}
-		digest[i] = (uint8_t)val;
-	}
-
-	return 0;  // Success
-}
-
 /**
  * @brief Print help message
  * Displays usage information and describes all supported options.
@@ -416,13 +378,20 @@ static void print_help() {
 	printf("      --tag             create a BSD-style checksum\n");
 	printf("  -t, --text            read in text mode (default)\n");
 	printf("  -z, --zero            end each output line with NUL, not newline,\n");
-	printf("                          and disable file name escaping\n\n");
+	printf("                          and disable file name escaping\n");
+	printf("  -r, --recursive       hash every regular file under the DIRs, sorted by path\n");
+	printf("  -L, --dereference     follow symbolic links with -r\n");
+	printf("  -x, --one-file-system  with -r, skip directories on other file systems\n\n");
 	printf("The following five options are useful only when verifying checksums:\n");
 	printf("      --ignore-missing  don't fail or report status for missing files\n");
 	printf("      --quiet           don't print OK for each successfully verified file\n");
 	printf("      --status          don't output anything, status code shows success\n");
 	printf("      --strict          exit non-zero for improperly formatted checksum lines\n");
 	printf("  -w, --warn            warn about improperly formatted checksum lines\n\n");
+	printf("      --cache[=FILE]    reuse digests of files whose size, mtime and ctime\n");
+	printf("                        are unchanged (default FILE: ~/.cache/toolen/sha256.idx)\n");
+	printf("      --cache-revalidate  hash every file again and refresh the cache\n");
+	printf("      --cache-stats     print cache hits and misses on stderr\n\n");
 	printf("      --help            display this help and exit\n");
 }
 
@@ -447,7 +416,13 @@ static int parse_args(int argc, char *argv[]) {
 		{"status",		no_argument, NULL, 0},
 		{"strict",		no_argument, NULL, 0},
 		{"warn",		no_argument, NULL, 'w'},
+		{"recursive",	no_argument, NULL, 'r'},
+		{"dereference",	no_argument, NULL, 'L'},
+		{"one-file-system", no_argument, NULL, 'x'},
 		{"help",		no_argument, NULL, 0},
+		{"cache",		optional_argument, NULL, 0},
+		{"cache-revalidate", no_argument, NULL, 0},
+		{"cache-stats",	no_argument, NULL, 0},
 		{NULL, 0, NULL, 0}  // Terminator
 	};
 
@@ -455,7 +430,7 @@ static int parse_args(int argc, char *argv[]) {
 	int option_index = 0;   // Index for long options
 
 	// Process all options
-	while ((opt = getopt_long(argc, argv, "bctzw", long_options, &option_index)) != -1) {
+	while ((opt = getopt_long(argc, argv, "bctzwrLx", long_options, &option_index)) != -1) {
 		switch (opt) {
 			case 'b':
 				flag_binary = 1;
@@ -474,6 +449,15 @@ static int parse_args(int argc, char *argv[]) {
 			case 'w':
 				flag_warn = 1;
 				break;
+			case 'r':
+				flag_recursive = 1;
+				break;
+			case 'L':
+				flag_follow = 1;
+				break;
+			case 'x':
+				flag_one_fs = 1;
+				break;
 			case 0:
 				// Handle long options with no short equivalent
 				if (strcmp(long_options[option_index].name, "tag") == 0) {
@@ -489,6 +473,14 @@ static int parse_args(int argc, char *argv[]) {
 					flag_strict = 1;
 				} else if (strcmp(long_options[option_index].name, "help") == 0) {
 					flag_help = 1;
+				} else if (strcmp(long_options[option_index].name, "cache") == 0) {
+					flag_cache = 1;
+					cache_path = optarg;
+				} else if (strcmp(long_options[option_index].name, "cache-revalidate") == 0) {
+					flag_cache = 1;
+					flag_cache_revalidate = 1;
+				} else if (strcmp(long_options[option_index].name, "cache-stats") == 0) {
+					flag_cache_stats = 1;
 				}
 				break;
 			case '?':
@@ -506,6 +498,12 @@ static int parse_args(int argc, char *argv[]) {
 		return -1;
 	}
 
+
+	if (flag_check && flag_recursive) {
+		fprintf(stderr, "sha256sum: the --recursive option is meaningless when verifying checksums\n");
+		return -1;
+	}
+
 	return 0;  // Success
 }
 
@@ -519,6 +517,19 @@ static int parse_args(int argc, char *argv[]) {
  */
 static int check_mode(int argc, char *argv[]) {
 	int exit_status = 0;  // 0 = success, 1 = failure
+	SumCheckOpts opts = {
+		.prog = "sha256sum",
+		.tag = "SHA256",
+		.digest_len = SHA256_DIGEST_SIZE,
+		.sum = file_sha256,
+		.cache = sum_cache,
+		.binary = flag_binary,
+		.ignore_missing = flag_ignore_missing,
+		.quiet = flag_quiet,
+		.status = flag_status,
+		.strict = flag_strict,
+		.warn = flag_warn,
+	};
 
 	// If no files are provided, read checksums from standard input
 	if (optind >= argc) {
@@ -526,128 +537,13 @@ static int check_mode(int argc, char *argv[]) {
 		argv[argc++] = stdin_flag;
 	}
 
-	// Process each checksum file
+	// Verify each checksum file, entries are hashed in parallel
 	for (int i = optind; i < argc; i++) {
-		FILE *checkfile = stdin;  // Default to standard input
-
-		// Open the checksum file if it's not standard input
-		if (strcmp(argv[i], "-") != 0) {
-			checkfile = fopen(argv[i], "r");
-			if (!checkfile) {
-				fprintf(stderr, "sha256sum: %s: %s\n", argv[i], strerror(errno));
-				exit_status = 1;
-				continue;
-			}
-		}
-
-		char line[1024];  // Buffer to hold lines from the checksum file
-		int line_num = 0;  // Track line numbers for error messages
-
-		// Read each line from the checksum file
-		while (fgets(line, sizeof(line), checkfile)) {
-			line_num++;
-			char expected_str[65];  // Expected checksum string (64 chars + null)
-			char filename[1024];	// Filename from the checksum line
-			uint8_t expected_digest[SHA256_DIGEST_SIZE];  // Parsed expected digest
-			uint8_t computed_digest[SHA256_DIGEST_SIZE];  // Computed digest
-			int ret;				// Return value from file_sha256
-			int binary_mode = 0;	// Whether the file was stored in binary mode
-			char mode_char;		 // Mode character (' ' for text, '*' for binary)
-
-			// Process line terminators
-			size_t line_len = strlen(line);
-			if (line_len > 0 && line[line_len - 1] == '\n') {
-				line[line_len - 1] = '\0';  // Remove newline character
-			} else if (!feof(checkfile) && (flag_warn || flag_strict)) {
-				// Line is too long (didn't fit in the buffer)
-				fprintf(stderr, "sha256sum: %s:%d: improperly formatted checksum line (too long)\n",
-						(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-				if (flag_strict) {
-					exit_status = 1;
-				}
-				continue;
-			}
-
-			// Parse the line based on the selected format (BSD-style or standard)
-			if (flag_tag) {
-				// BSD-style format: "SHA256 (filename) = checksum"
-				if (sscanf(line, "SHA256 (%s) = %64s", filename, expected_str) != 2) {
-					if (flag_warn || flag_strict) {
-						fprintf(stderr, "sha256sum: %s:%d: improperly formatted BSD-style checksum line\n",
-								(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-						if (flag_strict) {
-							exit_status = 1;
-						}
-					}
-					continue;
-				}
-			} else {
-				// Standard format: "checksum mode filename" (mode is ' ' or '*')
-				if (sscanf(line, "%64s %c%s", expected_str, &mode_char, filename) != 3) {
-					if (flag_warn || flag_strict) {
-						fprintf(stderr, "sha256sum: %s:%d: improperly formatted checksum line\n",
-								(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-						if (flag_strict) {
-							exit_status = 1;
-						}
-					}
-					continue;
-				}
-				// Determine if the file was stored in binary mode
-				binary_mode = (mode_char == '*');
-			}
-
-			// Convert the expected checksum string to a digest
-			if (str2digest(expected_str, expected_digest) != 0) {
-				if (flag_warn || flag_strict) {
-					fprintf(stderr, "sha256sum: %s:%d: invalid checksum value\n",
-							(checkfile == stdin) ? "(stdin)" : argv[i], line_num);
-					if (flag_strict) {
-						exit_status = 1;
-					}
-				}
-				continue;
-			}
-
-			// Compute the digest for the file (honor binary mode)
-			ret = file_sha256(filename, computed_digest, binary_mode || flag_binary);
-			if (ret == -1) {
-				// File not found
-				if (!flag_ignore_missing) {
-					if (!flag_status) {
-						fprintf(stderr, "sha256sum: %s: %s\n", filename, strerror(errno));
-					}
-					exit_status = 1;
-				}
-			} else if (ret == -2) {
-				// Error reading the file
-				if (!flag_status) {
-					fprintf(stderr, "sha256sum: %s: %s\n", filename, strerror(errno));
-				}
-				exit_status = 1;
-			} else if (!digest_cmp(expected_digest, computed_digest)) {
-				// Checksum mismatch
-				if (!flag_status) {
-					fprintf(stderr, "%s: FAILED\n", filename);
-				}
-				exit_status = 1;
-			} else if (!flag_quiet && !flag_status) {
-				// Checksum match
-				printf("%s: OK\n", filename);
-			}
-		}
-
-		// Check for errors reading the checksum file
-		if (ferror(checkfile)) {
-			fprintf(stderr, "sha256sum: %s: %s\n",
-					(checkfile == stdin) ? "(stdin)" : argv[i], strerror(errno));
+		SumCheckResult res;
+		if (sumCheckFile(&opts, argv[i], &res) != 0) {
 			exit_status = 1;
 		}
-
-		// Close the checksum file (do not close standard input)
-		if (checkfile != stdin) {
-			fclose(checkfile);
-		}
+		sumCheckReport(&opts, &res);
 	}
 
 	return exit_status;
@@ -672,7 +568,7 @@ static int compute_mode(int argc, char *argv[]) {
 		int ret;
 
 		// Compute the SHA-256 hash for the file
-		ret = file_sha256(argv[i], digest, flag_binary);
+		ret = sumCacheFile(sum_cache, argv[i], file_sha256, digest, flag_binary);
 		if (ret != 0) {
 			fprintf(stderr, "sha256sum: %s: %s\n", argv[i], strerror(errno));
 			exit_status = 1;
@@ -722,6 +618,40 @@ static int compute_mode(int argc, char *argv[]) {
 	return exit_status;
 }
 
+/**
+ * @brief Run in recursive mode (-r)
+ * Prints a manifest of every regular file under each DIR (default: the
+ * current directory), sorted by path, that -c accepts.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors)
+ */
+static int tree_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	SumTreeOpts opts = {
+		.prog = "sha256sum",
+		.tag = "SHA256",
+		.digest_len = SHA256_DIGEST_SIZE,
+		.sum = file_sha256,
+		.cache = sum_cache,
+		.binary = flag_binary,
+		.bsd_tag = flag_tag,
+		.zero = flag_zero,
+		.follow = flag_follow,
+		.one_fs = flag_one_fs,
+	};
+
+	if (optind >= argc) {
+		return sumTreeFile(&opts, ".");
+	}
+	for (int i = optind; i < argc; i++) {
+		if (sumTreeFile(&opts, argv[i]) != 0) {
+			exit_status = 1;
+		}
+	}
+	return exit_status;
+}
+
 /**
  * @brief Main function
  * Parses command-line arguments, handles help requests, and dispatches
@@ -742,11 +672,28 @@ M_ENTRY(sha256sum) {
 		return 0;
 	}
 
+	// Reuse the digests of unchanged files
+	if (flag_cache) {
+		sum_cache = sumCacheOpen("sha256sum", "sha256", SHA256_DIGEST_SIZE, cache_path, flag_cache_revalidate);
+	}
+
 	// Run in check mode or compute mode
+	int ret;
 	if (flag_check) {
-		return check_mode(argc, argv);
+		ret = check_mode(argc, argv);
+	} else if (flag_recursive) {
+		ret = tree_mode(argc, argv);
 	} else {
-		return compute_mode(argc, argv);
+		ret = compute_mode(argc, argv);
+	}
+
+	if (sum_cache) {
+		if (flag_cache_stats) {
+			sumCacheReport(sum_cache);
+		}
+		sumCacheClose(sum_cache);
+		sum_cache = NULL;
 	}
+	return ret;
 }
 REGISTER_MODULE(sha256sum);
@@ -0,0 +1,728 @@
+/**
+ *	sha512sum.c - Print or check SHA512 and SHA384 checksums
+ *
+ *		2026/10/18
+ *
+ *	Copyright (C) 2025-2026 ASO-Studio
+ *	Based on MIT protocol open source
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "module.h"
+#include "config.h"
+#include "checksum.h"
+#include "debug.h"
+
+/**
+ * @def SHA512_DIGEST_SIZE
+ * @brief Size of SHA-512 digest in bytes (512 bits = 64 bytes)
+ */
+#define SHA512_DIGEST_SIZE 64
+
+/**
+ * @def SHA384_DIGEST_SIZE
+ * @brief Size of SHA-384 digest in bytes, the truncated SHA-512 state
+ */
+#define SHA384_DIGEST_SIZE 48
+
+/**
+ * @def SHA512_BLOCK_SIZE
+ * @brief Size of SHA-512 processing block in bytes (1024 bits = 128 bytes)
+ */
+#define SHA512_BLOCK_SIZE 128
+
+/**
+ * @def SHA512_ROUNDS
+ * @brief Number of transformation rounds in SHA-512
+ */
+#define SHA512_ROUNDS 80
+
+/**
+ * @def SHA512_LANES
+ * @brief Blocks whose message schedules the vector kernel expands at once
+ */
+#define SHA512_LANES 4
+
+/**
+ * @struct SHA512_CTX
+ * @brief Context structure for SHA-512 / SHA-384 hashing operations
+ * @var SHA512_CTX::state
+ * Current hash state (8 x 64-bit registers: a-h)
+ * @var SHA512_CTX::byte_len
+ * Total length of input data in bytes (the 128-bit bit length of the
+ * padding is derived from it)
+ * @var SHA512_CTX::buffer
+ * Buffer to accumulate input data until a full 1024-bit block is formed
+ */
+typedef struct {
+	uint64_t state[8];		// Hash state registers
+	uint64_t byte_len;		// Total input length in bytes
+	uint8_t buffer[SHA512_BLOCK_SIZE];	// Input data buffer
+} SHA512_CTX;
+
+/**
+ * @struct sha512_variant_t
+ * @brief SHA-512 or SHA-384: same compression, different IV and digest size
+ */
+typedef struct {
+	const char *prog;		// Applet name used in messages
+	const char *tag;		// BSD-style tag
+	int bits;			// Digest size in bits (help text)
+	size_t digest_len;		// Digest size in bytes
+	const uint64_t *init_state;	// Initial hash values
+} sha512_variant_t;
+
+// Command-line option flags
+static int flag_binary = 0;	// Binary mode (-b/--binary)
+static int flag_check = 0;	// Check mode (-c/--check)
+static int flag_tag = 0;	// BSD-style output (--tag)
+static int flag_text = 1;	// Text mode (-t/--text, default)
+static int flag_zero = 0;	// NUL-terminated lines (-z/--zero)
+static int flag_ignore_missing = 0;	// Ignore missing files (--ignore-missing)
+static int flag_quiet = 0;	// Quiet mode (--quiet)
+static int flag_status = 0;	// No output, status code only (--status)
+static int flag_strict = 0;	// Strict mode for bad lines (--strict)
+static int flag_warn = 0;	// Warn about bad lines (-w/--warn)
+static int flag_help = 0;	// Show help (--help)
+
+/**
+ * @brief SHA-512 initial hash values (FIPS 180-4 specification)
+ * First 64 bits of the fractional parts of the square roots of the first
+ * 8 prime numbers.
+ */
+static const uint64_t SHA512_INIT_STATE[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+/**
+ * @brief SHA-384 initial hash values (FIPS 180-4 specification)
+ * First 64 bits of the fractional parts of the square roots of the 9th
+ * through 16th prime numbers.
+ */
+static const uint64_t SHA384_INIT_STATE[8] = {
+	0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+	0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+static const sha512_variant_t sha512_variant = {
+	"sha512sum", "SHA512", 512, SHA512_DIGEST_SIZE, SHA512_INIT_STATE
+};
+
+static const sha512_variant_t sha384_variant = {
+	"sha384sum", "SHA384", 384, SHA384_DIGEST_SIZE, SHA384_INIT_STATE
+};
+
+// Variant of the running applet, SHA-512 unless started as sha384sum
+static const sha512_variant_t *sha_variant = &sha512_variant;
+
+/**
+ * @brief SHA-512 round constants (K[0..79])
+ * First 64 bits of the fractional parts of the cube roots of the first
+ * 80 prime numbers.
+ */
+static const uint64_t SHA512_K[SHA512_ROUNDS] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+/**
+ * @brief Right rotation macro
+ * @param x 64-bit value to rotate
+ * @param n Number of bits to rotate (0 < n < 64)
+ * @return Rotated value
+ */
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+/**
+ * @brief SHA-512 Sigma0 function (for state)
+ */
+#define SIGMA0(x) (ROTR(x, 28) ^ ROTR(x, 34) ^ ROTR(x, 39))
+
+/**
+ * @brief SHA-512 Sigma1 function (for state)
+ */
+#define SIGMA1(x) (ROTR(x, 14) ^ ROTR(x, 18) ^ ROTR(x, 41))
+
+/**
+ * @brief SHA-512 Gamma0 function (for message schedule)
+ */
+#define GAMMA0(x) (ROTR(x, 1) ^ ROTR(x, 8) ^ ((x) >> 7))
+
+/**
+ * @brief SHA-512 Gamma1 function (for message schedule)
+ */
+#define GAMMA1(x) (ROTR(x, 19) ^ ROTR(x, 61) ^ ((x) >> 6))
+
+/**
+ * @brief Choice function, one operation shorter than (x & y) ^ (~x & z)
+ */
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+
+/**
+ * @brief Majority function, one operation shorter than the textbook form
+ */
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+/**
+ * @brief One round with the working variables passed by name
+ * Instead of shifting a..h every round, the callers rotate the argument
+ * list, so each round only writes d and h.
+ * @param wk W[i] + K[i] of this round
+ */
+#define ROUND(a, b, c, d, e, f, g, h, wk) do { \
+	uint64_t t1 = h + SIGMA1(e) + CH(e, f, g) + (wk); \
+	d += t1; \
+	h = t1 + SIGMA0(a) + MAJ(a, b, c); \
+} while (0)
+
+/**
+ * @brief Read a 64-bit big-endian word
+ * @param p Pointer to 8 bytes
+ * @return Host-order value
+ */
+static inline uint64_t load_be64(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+/**
+ * @brief Message schedule kernel
+ * Expands nblocks (1 or SHA512_LANES) consecutive blocks into
+ * wk[round * SHA512_LANES + block] = W[round] + K[round].
+ */
+typedef void (*sha512_schedule_fn)(const uint8_t *blocks, uint64_t *wk);
+
+static sha512_schedule_fn sha512_schedule_x4 = NULL;	// NULL: no vector kernel on this CPU
+static pthread_once_t sha512_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Scalar message schedule of one block
+ * @param block 128-byte input block
+ * @param wk Output, W[i] + K[i] at wk[i * SHA512_LANES]
+ */
+static void sha512_schedule(const uint8_t *block, uint64_t *wk) {
+	uint64_t w[SHA512_ROUNDS];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = load_be64(block + 8 * i);
+	}
+	for (i = 16; i < SHA512_ROUNDS; i++) {
+		w[i] = GAMMA1(w[i-2]) + w[i-7] + GAMMA0(w[i-15]) + w[i-16];
+	}
+	for (i = 0; i < SHA512_ROUNDS; i++) {
+		wk[i * SHA512_LANES] = w[i] + SHA512_K[i];
+	}
+}
+
+#if defined(__x86_64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+typedef uint64_t sha_v4 __attribute__((vector_size(32)));
+typedef uint8_t sha_v32 __attribute__((vector_size(32)));
+
+#define VROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+/**
+ * @brief AVX2 message schedule of 4 consecutive blocks, one block per lane
+ * Within one block each word depends on the one two rounds back, so the
+ * lanes run across blocks instead: the 4x4 transposed loads put word i of
+ * every block in one vector and the recurrence needs no shuffles at all.
+ * @param blocks 4 * 128 input bytes
+ * @param wk Output, W[i] + K[i] of block b at wk[i * 4 + b]
+ */
+__attribute__((target("avx2")))
+static void sha512_schedule_avx2(const uint8_t *blocks, uint64_t *wk) {
+	static const sha_v32 bswap = {
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		23, 22, 21, 20, 19, 18, 17, 16, 31, 30, 29, 28, 27, 26, 25, 24
+	};
+	sha_v4 w[16];
+	int i;
+
+	// Word i of block b lands in lane b of w[i]
+	for (i = 0; i < 16; i += 4) {
+		sha_v4 r[4];
+		for (int b = 0; b < 4; b++) {
+			sha_v32 bytes;
+			memcpy(&bytes, blocks + b * SHA512_BLOCK_SIZE + 8 * i, sizeof(bytes));
+			r[b] = (sha_v4)__builtin_shuffle(bytes, bswap);
+		}
+		sha_v4 t0 = __builtin_shuffle(r[0], r[1], (sha_v4){ 0, 4, 2, 6 });
+		sha_v4 t1 = __builtin_shuffle(r[0], r[1], (sha_v4){ 1, 5, 3, 7 });
+		sha_v4 t2 = __builtin_shuffle(r[2], r[3], (sha_v4){ 0, 4, 2, 6 });
+		sha_v4 t3 = __builtin_shuffle(r[2], r[3], (sha_v4){ 1, 5, 3, 7 });
+		w[i] = __builtin_shuffle(t0, t2, (sha_v4){ 0, 1, 4, 5 });
+		w[i + 1] = __builtin_shuffle(t1, t3, (sha_v4){ 0, 1, 4, 5 });
+		w[i + 2] = __builtin_shuffle(t0, t2, (sha_v4){ 2, 3, 6, 7 });
+		w[i + 3] = __builtin_shuffle(t1, t3, (sha_v4){ 2, 3, 6, 7 });
+	}
+
+	// 16-word ring, every word is stored with its constant as it is made
+	for (i = 0; i < SHA512_ROUNDS; i++) {
+		sha_v4 x;
+		if (i < 16) {
+			x = w[i];
+		} else {
+			sha_v4 w2 = w[(i - 2) & 15], w15 = w[(i - 15) & 15];
+			x = (VROTR(w2, 19) ^ VROTR(w2, 61) ^ (w2 >> 6)) + w[(i - 7) & 15]
+				+ (VROTR(w15, 1) ^ VROTR(w15, 8) ^ (w15 >> 7)) + w[i & 15];
+			w[i & 15] = x;
+		}
+		x += SHA512_K[i];
+		memcpy(wk + i * SHA512_LANES, &x, sizeof(x));
+	}
+}
+#endif
+
+/**
+ * @brief Pick the message schedule kernel for this CPU
+ */
+static void sha512_init_kernel(void) {
+#if defined(__x86_64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (__builtin_cpu_supports("avx2")) {
+		sha512_schedule_x4 = sha512_schedule_avx2;
+	}
+#endif
+	LOG("sha512 schedule: %s\n", sha512_schedule_x4 ? "avx2 x4" : "scalar");
+}
+
+/**
+ * @brief SHA-512 compression function (core transformation)
+ * Runs the 80 rounds over one expanded message schedule, unrolled by 8 so
+ * the working variables never move between registers.
+ * @param state Hash state to update
+ * @param wk W[i] + K[i] at wk[i * SHA512_LANES]
+ */
+static void sha512_rounds(uint64_t state[8], const uint64_t *wk) {
+	uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int i = 0; i < SHA512_ROUNDS; i += 8) {
+		const uint64_t *p = wk + i * SHA512_LANES;
+		ROUND(a, b, c, d, e, f, g, h, p[0 * SHA512_LANES]);
+		ROUND(h, a, b, c, d, e, f, g, p[1 * SHA512_LANES]);
+		ROUND(g, h, a, b, c, d, e, f, p[2 * SHA512_LANES]);
+		ROUND(f, g, h, a, b, c, d, e, p[3 * SHA512_LANES]);
+		ROUND(e, f, g, h, a, b, c, d, p[4 * SHA512_LANES]);
+		ROUND(d, e, f, g, h, a, b, c, p[5 * SHA512_LANES]);
+		ROUND(c, d, e, f, g, h, a, b, p[6 * SHA512_LANES]);
+		ROUND(b, c, d, e, f, g, h, a, p[7 * SHA512_LANES]);
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+/**
+ * @brief Compress whole blocks into the state
+ * Runs of 4 blocks get their schedules from the vector kernel when the CPU
+ * has one, the rest are expanded one at a time.
+ * @param state Hash state to update
+ * @param data Input blocks
+ * @param nblocks Number of 128-byte blocks
+ */
+static void sha512_blocks(uint64_t state[8], const uint8_t *data, size_t nblocks) {
+	uint64_t wk[SHA512_ROUNDS * SHA512_LANES] __attribute__((aligned(32)));
+
+	if (sha512_schedule_x4) {
+		for (; nblocks >= SHA512_LANES; nblocks -= SHA512_LANES) {
+			sha512_schedule_x4(data, wk);
+			for (int b = 0; b < SHA512_LANES; b++) {
+				sha512_rounds(state, wk + b);
+			}
+			data += SHA512_LANES * SHA512_BLOCK_SIZE;
+		}
+	}
+
+	for (; nblocks > 0; nblocks--) {
+		sha512_schedule(data, wk);
+		sha512_rounds(state, wk);
+		data += SHA512_BLOCK_SIZE;
+	}
+}
+
+/**
+ * @brief Initialize SHA-512 / SHA-384 context
+ * @param ctx Pointer to SHA512_CTX structure to initialize
+ * @param init_state Initial hash values of the variant
+ */
+static void sha512_init(SHA512_CTX *ctx, const uint64_t init_state[8]) {
+	pthread_once(&sha512_once, sha512_init_kernel);
+	memcpy(ctx->state, init_state, sizeof(ctx->state));
+	ctx->byte_len = 0;
+	memset(ctx->buffer, 0, SHA512_BLOCK_SIZE);
+}
+
+/**
+ * @brief Update SHA-512 context with input data
+ * Completes a partially filled buffer first, then compresses whole blocks
+ * straight from the input and keeps the remainder.
+ * @param ctx Pointer to SHA512_CTX structure
+ * @param data Pointer to input data to hash
+ * @param len Length of input data in bytes
+ */
+static void sha512_update(SHA512_CTX *ctx, const uint8_t *data, size_t len) {
+	size_t pos = ctx->byte_len % SHA512_BLOCK_SIZE;
+	ctx->byte_len += len;
+
+	if (pos) {
+		size_t fill = SHA512_BLOCK_SIZE - pos;
+		if (len < fill) {
+			memcpy(ctx->buffer + pos, data, len);
+			return;
+		}
+		memcpy(ctx->buffer + pos, data, fill);
+		sha512_blocks(ctx->state, ctx->buffer, 1);
+		data += fill;
+		len -= fill;
+	}
+
+	size_t nblocks = len / SHA512_BLOCK_SIZE;
+	sha512_blocks(ctx->state, data, nblocks);
+	data += nblocks * SHA512_BLOCK_SIZE;
+	len -= nblocks * SHA512_BLOCK_SIZE;
+
+	memcpy(ctx->buffer, data, len);
+}
+
+/**
+ * @brief Finalize SHA-512 / SHA-384 hash computation
+ * Pads with 0x80, zeros and the 128-bit big-endian bit length, then writes
+ * the first digest_len bytes of the state.
+ * @param digest Output buffer for digest_len bytes
+ * @param digest_len 64 for SHA-512, 48 for SHA-384
+ * @param ctx Pointer to SHA512_CTX structure
+ */
+static void sha512_final(uint8_t *digest, size_t digest_len, SHA512_CTX *ctx) {
+	size_t pos = ctx->byte_len % SHA512_BLOCK_SIZE;
+
+	ctx->buffer[pos++] = 0x80;
+
+	// Not enough room for the 16-byte length: pad out this block
+	if (pos > SHA512_BLOCK_SIZE - 16) {
+		memset(ctx->buffer + pos, 0, SHA512_BLOCK_SIZE - pos);
+		sha512_blocks(ctx->state, ctx->buffer, 1);
+		pos = 0;
+	}
+
+	memset(ctx->buffer + pos, 0, SHA512_BLOCK_SIZE - 16 - pos);
+
+	// Bit length, the upper 64 bits only hold what overflows the byte count
+	uint64_t bits_hi = ctx->byte_len >> 61;
+	uint64_t bits_lo = ctx->byte_len << 3;
+	for (int i = 0; i < 8; i++) {
+		ctx->buffer[SHA512_BLOCK_SIZE - 16 + i] = (uint8_t)(bits_hi >> (56 - 8 * i));
+		ctx->buffer[SHA512_BLOCK_SIZE - 8 + i] = (uint8_t)(bits_lo >> (56 - 8 * i));
+	}
+
+	sha512_blocks(ctx->state, ctx->buffer, 1);
+
+	for (size_t i = 0; i < digest_len; i++) {
+		digest[i] = (uint8_t)(ctx->state[i / 8] >> (56 - 8 * (i % 8)));
+	}
+
+	// Clear context for security (prevent sensitive data leakage)
+	memset(ctx, 0, sizeof(SHA512_CTX));
+}
+
+/**
+ * @brief Hash update callback for sumReadFile()
+ * @param ctx Pointer to SHA512_CTX
+ * @param data Next block of the file
+ * @param len Length of the block in bytes
+ */
+static void sha512_feed(void *ctx, const unsigned char *data, size_t len) {
+	sha512_update(ctx, data, len);
+}
+
+/**
+ * @brief Compute the SHA-512 or SHA-384 hash of a file
+ * @param filename Path to the file (use "-" for standard input)
+ * @param digest Output buffer for the digest of the running variant
+ * @param binary_mode If non-zero, open file in binary mode
+ * @return 0 on success, -1 if file cannot be opened, -2 if read error occurs
+ */
+static int file_sha512(const char *filename, uint8_t *digest, int binary_mode) {
+	// Text and binary mode read the same bytes on GNU/Linux
+	(void)binary_mode;
+
+	SHA512_CTX ctx;
+	sha512_init(&ctx, sha_variant->init_state);
+
+	int ret = sumReadFile(filename ? filename : "-", sha512_feed, &ctx);
+	if (ret != 0) {
+		return ret;  // -1: cannot open, -2: read error (errno is set)
+	}
+
+	sha512_final(digest, sha_variant->digest_len, &ctx);
+	return 0;
+}
+
+/**
+ * @brief Convert a digest to a lowercase hexadecimal string
+ * @param digest Digest bytes
+ * @param len Digest size in bytes
+ * @param str Output buffer (at least 2 * len + 1 bytes)
+ */
+static void digest2str(const uint8_t *digest, size_t len, char *str) {
+	static const char hex_chars[] = "0123456789abcdef";
+	for (size_t i = 0; i < len; i++) {
+		str[2*i] = hex_chars[(digest[i] >> 4) & 0x0F];
+		str[2*i + 1] = hex_chars[digest[i] & 0x0F];
+	}
+	str[2 * len] = '\0';
+}
+
+/**
+ * @brief Print help message
+ * Displays usage information and describes all supported options.
+ */
+static void print_help() {
+	SHOW_VERSION(stdout);
+	printf("Usage: %s [OPTION]... [FILE]...\n", sha_variant->prog);
+	printf("Print or check %s (%d-bit) checksums.\n\n", sha_variant->tag, sha_variant->bits);
+	printf("With no FILE, or when FILE is -, read standard input.\n\n");
+	printf("  -b, --binary          read in binary mode\n");
+	printf("  -c, --check           read checksums from the FILEs and check them\n");
+	printf("      --tag             create a BSD-style checksum\n");
+	printf("  -t, --text            read in text mode (default)\n");
+	printf("  -z, --zero            end each output line with NUL, not newline,\n");
+	printf("                          and disable file name escaping\n\n");
+	printf("The following five options are useful only when verifying checksums:\n");
+	printf("      --ignore-missing  don't fail or report status for missing files\n");
+	printf("      --quiet           don't print OK for each successfully verified file\n");
+	printf("      --status          don't output anything, status code shows success\n");
+	printf("      --strict          exit non-zero for improperly formatted checksum lines\n");
+	printf("  -w, --warn            warn about improperly formatted checksum lines\n\n");
+	printf("      --help            display this help and exit\n");
+}
+
+/**
+ * @brief Parse command-line arguments
+ * Uses getopt_long to process options and set corresponding flags.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @return 0 on success, -1 on error (invalid options or conflicts)
+ */
+static int parse_args(int argc, char *argv[]) {
+	static const struct option long_options[] = {
+		{"binary",		no_argument, NULL, 'b'},
+		{"check",		no_argument, NULL, 'c'},
+		{"tag",			no_argument, NULL, 0},
+		{"text",		no_argument, NULL, 't'},
+		{"zero",		no_argument, NULL, 'z'},
+		{"ignore-missing", no_argument, NULL, 0},
+		{"quiet",		no_argument, NULL, 0},
+		{"status",		no_argument, NULL, 0},
+		{"strict",		no_argument, NULL, 0},
+		{"warn",		no_argument, NULL, 'w'},
+		{"help",		no_argument, NULL, 0},
+		{NULL, 0, NULL, 0}  // Terminator
+	};
+
+	int opt;				// Current option
+	int option_index = 0;   // Index for long options
+
+	while ((opt = getopt_long(argc, argv, "bctzw", long_options, &option_index)) != -1) {
+		switch (opt) {
+			case 'b':
+				flag_binary = 1;
+				flag_text = 0;
+				break;
+			case 'c':
+				flag_check = 1;
+				break;
+			case 't':
+				flag_text = 1;
+				flag_binary = 0;
+				break;
+			case 'z':
+				flag_zero = 1;
+				break;
+			case 'w':
+				flag_warn = 1;
+				break;
+			case 0:
+				// Handle long options with no short equivalent
+				if (strcmp(long_options[option_index].name, "tag") == 0) {
+					flag_tag = 1;
+				} else if (strcmp(long_options[option_index].name, "ignore-missing") == 0) {
+					flag_ignore_missing = 1;
+				} else if (strcmp(long_options[option_index].name, "quiet") == 0) {
+					flag_quiet = 1;
+				} else if (strcmp(long_options[option_index].name, "status") == 0) {
+					flag_status = 1;
+					flag_quiet = 1;  // --status implies --quiet
+				} else if (strcmp(long_options[option_index].name, "strict") == 0) {
+					flag_strict = 1;
+				} else if (strcmp(long_options[option_index].name, "help") == 0) {
+					flag_help = 1;
+				}
+				break;
+			case '?':
+				return -1;
+			default:
+				abort();
+		}
+	}
+
+	if (flag_binary && flag_text) {
+		fprintf(stderr, "%s: cannot specify both --binary and --text\n", sha_variant->prog);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Run in check mode (verify checksums)
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors or checksum mismatches)
+ */
+static int check_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	SumCheckOpts opts = {
+		.prog = sha_variant->prog,
+		.tag = sha_variant->tag,
+		.digest_len = sha_variant->digest_len,
+		.sum = file_sha512,
+		.binary = flag_binary,
+		.ignore_missing = flag_ignore_missing,
+		.quiet = flag_quiet,
+		.status = flag_status,
+		.strict = flag_strict,
+		.warn = flag_warn,
+	};
+
+	if (optind >= argc) {
+		static char stdin_flag[] = "-";  // Avoids string literal to char* warning
+		argv[argc++] = stdin_flag;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		SumCheckResult res;
+		if (sumCheckFile(&opts, argv[i], &res) != 0) {
+			exit_status = 1;
+		}
+		sumCheckReport(&opts, &res);
+	}
+
+	return exit_status;
+}
+
+/**
+ * @brief Run in compute mode (generate checksums)
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors)
+ */
+static int compute_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	int use_stdin = (optind >= argc);  // No files specified: read from stdin
+	uint8_t digest[SHA512_DIGEST_SIZE];
+	char digest_str[2 * SHA512_DIGEST_SIZE + 1];
+
+	for (int i = optind; i < argc; i++) {
+		if (file_sha512(argv[i], digest, flag_binary) != 0) {
+			fprintf(stderr, "%s: %s: %s\n", sha_variant->prog, argv[i], strerror(errno));
+			exit_status = 1;
+			continue;
+		}
+
+		digest2str(digest, sha_variant->digest_len, digest_str);
+		if (flag_tag) {
+			printf("%s (%s) = %s", sha_variant->tag, argv[i], digest_str);
+		} else {
+			printf("%s %c%s", digest_str, flag_binary ? '*' : ' ', argv[i]);
+		}
+		putchar(flag_zero ? '\0' : '\n');
+	}
+
+	if (use_stdin) {
+		if (file_sha512("-", digest, flag_binary) != 0) {
+			fprintf(stderr, "%s: standard input: %s\n", sha_variant->prog, strerror(errno));
+			return 1;
+		}
+
+		digest2str(digest, sha_variant->digest_len, digest_str);
+		if (flag_tag) {
+			printf("%s (stdin) = %s", sha_variant->tag, digest_str);
+		} else {
+			printf("%s %c-", digest_str, flag_binary ? '*' : ' ');
+		}
+		putchar(flag_zero ? '\0' : '\n');
+	}
+
+	return exit_status;
+}
+
+/**
+ * @brief Main function
+ * Parses command-line arguments, handles help requests, and dispatches
+ * to either check mode or compute mode.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status
+ */
+M_ENTRY(sha512sum) {
+	if (parse_args(argc, argv) != 0) {
+		return 1;
+	}
+
+	if (flag_help) {
+		print_help();
+		return 0;
+	}
+
+	if (flag_check) {
+		return check_mode(argc, argv);
+	} else {
+		return compute_mode(argc, argv);
+	}
+}
+
+// SHA-384 is SHA-512 with another IV, truncated to 48 bytes
+M_ENTRY(sha384sum) {
+	sha_variant = &sha384_variant;
+	return sha512sum_main(argc, argv);
+}
+
+REGISTER_MODULE(sha512sum);
+REGISTER_MODULE(sha384sum);
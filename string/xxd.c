@@ -0,0 +1,656 @@
+/**
+ *	xxd.c - Make a hexdump or do the reverse
+ *
+ *		2026/10/18
+ *
+ *	Copyright (C) 2025-2026 ASO-Studio
+ *	Based on MIT protocol open source
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "module.h"
+#include "lib.h"
+#include "hexKernel.h"
+
+#define XXD_IOBUF	(1 << 20)	// Input block, rounded down to whole lines
+#define XXD_OUTBUF	(1 << 16)	// Output is flushed in blocks of about this size
+#define XXD_MAX_COLS	256		// Octets per line in the normal dump
+
+// Exit codes of the original xxd
+#define XXD_ERR_USAGE	1
+#define XXD_ERR_INPUT	2
+#define XXD_ERR_OUTPUT	3
+#define XXD_ERR_SEEK	4
+#define XXD_ERR_BACKWARDS	5
+
+// Command-line options
+static int flag_autoskip = 0;	// -a: '*' for runs of all-zero lines
+static int flag_decimal = 0;	// -d: decimal offsets
+static int flag_plain = 0;	// -p: plain hex, no offsets or text column
+static int flag_reverse = 0;	// -r: hexdump to binary
+static int flag_upper = 0;	// -u: upper case hex digits
+static long cols = -1;		// -c: octets per line (-1: default)
+static long group = -1;		// -g: octets per group (-1: default)
+static long long length = -1;	// -l: stop after this many octets (-1: all)
+static long long seek_off = 0;	// -s: start offset (reverse: added to positions, subtracted for -s -N)
+static int seek_mode = 0;	// -s given: 0 none, 1 absolute, 2 relative (+), 3 from the end (-)
+static long long disp_off = 0;	// -o: added to the displayed offsets
+
+// Buffered output, a position is only tracked for -r
+static int out_fd = STDOUT_FILENO;
+static char *out_buf;
+static size_t out_len;
+static size_t out_cap;
+static unsigned long long out_pos;	// Output file position of out_buf + out_len
+static int out_error = 0;		// errno of a failed write
+
+// Text column: printable ASCII as it is, everything else as '.'
+static char text_map[256];
+
+static void print_help() {
+	SHOW_VERSION(stdout);
+	printf("Usage: xxd [OPTION]... [INFILE [OUTFILE]]\n"
+		"   or: xxd -r [-s [-]OFFSET] [-c COLS] [-p] [INFILE [OUTFILE]]\n"
+		"Make a hexdump of INFILE or standard input, or turn one back into binary.\n\n"
+		"  -a          toggle autoskip: a single '*' replaces runs of nul-lines\n"
+		"  -c COLS     format COLS octets per line (default 16, -p: 30, max 256)\n"
+		"  -d          show offsets in decimal instead of hex\n"
+		"  -g BYTES    number of octets per group in normal output (default 2)\n"
+		"  -h          print this summary\n"
+		"  -l LEN      stop after LEN octets\n"
+		"  -o OFF      add OFF to the displayed file position\n"
+		"  -p, -ps     output in plain hexdump style\n"
+		"  -r          reverse operation: convert (or patch) a hexdump into binary\n"
+		"  -r -s [-]OFF  revert with OFF added to (-: subtracted from) the file positions\n"
+		"  -s [+][-]SEEK  start at SEEK bytes absolute (or +: relative) infile offset\n"
+		"  -u          use upper case hex letters\n");
+}
+
+/**
+ * Read until len bytes or end of file
+ *
+ * @return bytes read, -1 on error
+ */
+static ssize_t read_full(int fd, void *buf, size_t len) {
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t n = read(fd, (char *)buf + done, len - done);
+		if (n == 0) {
+			break;
+		}
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		done += n;
+	}
+	return done;
+}
+
+static void out_flush(void) {
+	const char *p = out_buf;
+
+	while (out_len > 0 && !out_error) {
+		ssize_t n = write(out_fd, p, out_len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			out_error = errno;
+			break;
+		}
+		p += n;
+		out_len -= n;
+	}
+	out_len = 0;
+}
+
+/* Make room for n more bytes, return: where they go */
+static char *out_room(size_t n) {
+	if (out_len + n > out_cap) {
+		out_flush();
+		if (n > out_cap) {
+			out_cap = n;
+			out_buf = xrealloc(out_buf, out_cap);
+		}
+	}
+	return out_buf + out_len;
+}
+
+/**
+ * Move the output to file position pos (reverse mode)
+ *
+ * Seekable outputs are patched in place, others can only be moved forward
+ * by writing zeros.
+ *
+ * @return 0 on success, -1 if the output cannot seek back
+ */
+static int out_moveto(unsigned long long pos) {
+	if (pos == out_pos) {
+		return 0;
+	}
+	out_flush();
+	if (lseek(out_fd, pos, SEEK_SET) >= 0) {
+		out_pos = pos;
+		return 0;
+	}
+	if (pos < out_pos) {
+		return -1;
+	}
+	while (out_pos < pos) {
+		size_t n = pos - out_pos < XXD_OUTBUF ? pos - out_pos : XXD_OUTBUF;
+		memset(out_room(n), 0, n);
+		out_len += n;
+		out_pos += n;
+	}
+	return 0;
+}
+
+/**
+ * Reverse: move to pos of the dump shifted by -s, which is negative for -s -N
+ *
+ * @return 0 on success, XXD_ERR_* (message printed) on error
+ */
+static int out_moveto_shifted(unsigned long long pos) {
+	long long shift = seek_mode == 3 ? -seek_off : seek_off;
+
+	if (shift < 0 && pos < (unsigned long long)-shift) {
+		fprintf(stderr, "xxd: Sorry, cannot seek backwards.\n");
+		return XXD_ERR_BACKWARDS;
+	}
+	if (out_moveto(pos + shift) != 0) {
+		fprintf(stderr, "xxd: Sorry, cannot seek.\n");
+		return XXD_ERR_SEEK;
+	}
+	return 0;
+}
+
+/* Offset column, at least 8 digits, always lower case */
+static size_t put_offset(char *o, unsigned long long addr) {
+	if (flag_decimal) {
+		return sprintf(o, "%08llu", addr);
+	}
+
+	int digits = 8;
+	while (digits < 16 && (addr >> (4 * digits)) != 0) {
+		digits++;
+	}
+	for (int i = digits - 1; i >= 0; i--) {
+		o[i] = "0123456789abcdef"[addr & 0x0f];
+		addr >>= 4;
+	}
+	return digits;
+}
+
+/* One line of the normal dump: offset, grouped hex (already encoded), text */
+static void put_line(const unsigned char *p, const char *hex, size_t n, unsigned long long addr) {
+	size_t width = cols * 2 + (cols + group - 1) / group + 1;	// Hex column and separator
+	char *o = out_room(24 + width + cols + 1);
+
+	o += put_offset(o, addr);
+	*o++ = ':';
+	*o++ = ' ';
+
+	char *h = o;
+	for (size_t i = 0; i < n; i += group) {
+		size_t k = n - i < (size_t)group ? n - i : (size_t)group;
+		memcpy(o, hex + 2 * i, 2 * k);
+		o += 2 * k;
+		*o++ = ' ';
+	}
+	memset(o, ' ', width - (o - h));
+	o = h + width;
+
+	for (size_t i = 0; i < n; i++) {
+		*o++ = text_map[p[i]];
+	}
+	*o++ = '\n';
+	out_len = o - out_buf;
+}
+
+/**
+ * Skip to the -s position
+ *
+ * @return input position reached, -1 on error
+ */
+static long long seek_input(int in) {
+	off_t pos;
+
+	switch (seek_mode) {
+	case 0:
+		return 0;
+	case 3:
+		pos = lseek(in, -seek_off, SEEK_END);
+		break;
+	case 2:
+		pos = lseek(in, seek_off, SEEK_CUR);
+		break;
+	default:
+		pos = lseek(in, seek_off, SEEK_SET);
+		break;
+	}
+	if (pos >= 0) {
+		return pos;
+	}
+	if (errno != ESPIPE || seek_mode == 3) {
+		return -1;
+	}
+
+	// A pipe: read and drop
+	char buf[4096];
+	long long left = seek_off;
+	while (left > 0) {
+		ssize_t n = read(in, buf, left < (long long)sizeof(buf) ? (size_t)left : sizeof(buf));
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		left -= n;
+	}
+	return seek_off - left;
+}
+
+/**
+ * Dump the input
+ *
+ * @return 0 on success, XXD_ERR_* on error
+ */
+static int dump(int in) {
+	long long start = seek_input(in);
+	if (start < 0) {
+		fprintf(stderr, "xxd: Sorry, cannot seek.\n");
+		return XXD_ERR_SEEK;
+	}
+
+	// Whole lines per block, so lines never straddle reads
+	size_t line = cols > 0 ? (size_t)cols : 1;
+	size_t chunk = XXD_IOBUF / line * line;
+	if (chunk == 0) {
+		chunk = line;
+	}
+	unsigned char *buf = xmalloc(chunk);
+	char *hex = xmalloc(2 * chunk);
+	static const unsigned char zeros[XXD_MAX_COLS];
+	unsigned long long addr = start;
+	long long left = length;
+	int prev_zero = 0;		// -a: the line before was all zero
+	int starred = 0;		// -a: '*' printed for the current run
+	int skipped = 0;		// -a: the last line was dropped
+	int ret = 0;
+
+	for (;;) {
+		size_t want = chunk;
+		if (left >= 0 && (unsigned long long)left < want) {
+			want = left;
+		}
+		if (want == 0) {
+			break;
+		}
+		ssize_t n = read_full(in, buf, want);
+		if (n < 0) {
+			perror("xxd");
+			ret = XXD_ERR_INPUT;
+			break;
+		}
+		if (n == 0) {
+			break;
+		}
+
+		// Hex digits of the whole block at once, the lines copy from them
+		hexEncode(buf, n, hex, flag_upper);
+
+		if (flag_plain && cols == 0) {
+			// -c 0 puts everything on one line
+			memcpy(out_room(2 * n), hex, 2 * n);
+			out_len += 2 * n;
+		} else if (flag_plain) {
+			for (size_t i = 0; i < (size_t)n; i += line) {
+				size_t k = (size_t)n - i < line ? (size_t)n - i : line;
+				char *o = out_room(2 * k + 1);
+				memcpy(o, hex + 2 * i, 2 * k);
+				o[2 * k] = '\n';
+				out_len += 2 * k + 1;
+			}
+		} else {
+			for (size_t i = 0; i < (size_t)n; i += line) {
+				size_t k = (size_t)n - i < line ? (size_t)n - i : line;
+				unsigned long long at = addr + i;
+
+				if (flag_autoskip && k == line && memcmp(buf + i, zeros, k) == 0) {
+					if (prev_zero) {
+						if (!starred) {
+							memcpy(out_room(2), "*\n", 2);
+							out_len += 2;
+							starred = 1;
+						}
+						skipped = 1;
+						continue;
+					}
+					prev_zero = 1;
+				} else {
+					prev_zero = 0;
+					starred = 0;
+				}
+				skipped = 0;
+				put_line(buf + i, hex + 2 * i, k, at + disp_off);
+			}
+		}
+
+		addr += n;
+		if (left >= 0) {
+			left -= n;
+		}
+		if ((size_t)n < want) {
+			break;
+		}
+	}
+
+	// The last line is always shown, even inside a run of zeros
+	if (skipped) {
+		char zero_hex[2 * XXD_MAX_COLS];
+		memset(zero_hex, '0', sizeof(zero_hex));
+		put_line(zeros, zero_hex, line, addr - line + disp_off);
+	}
+	if (flag_plain && cols == 0) {
+		*out_room(1) = '\n';
+		out_len++;
+	}
+	xfree(buf);
+	xfree(hex);
+	return ret;
+}
+
+/* Append one decoded byte at the current output position */
+static inline void put_byte(unsigned char c) {
+	*out_room(1) = c;
+	out_len++;
+	out_pos++;
+}
+
+/**
+ * Plain hex to binary, anything that is not a hex digit is skipped
+ *
+ * @return 0 on success, XXD_ERR_* on error
+ */
+static int revert_plain(int in) {
+	char *buf = xmalloc(XXD_IOBUF);
+	int nibble = -1;	// High half of a byte split by a gap
+	ssize_t n;
+
+	int err = out_moveto_shifted(0);
+	if (err != 0) {
+		xfree(buf);
+		return err;
+	}
+	while ((n = read_full(in, buf, XXD_IOBUF)) > 0) {
+		size_t i = 0;
+		while (i < (size_t)n) {
+			// Runs of digit pairs go through the vector decoder
+			if (nibble < 0) {
+				size_t used;
+				char *o = out_room(((size_t)n - i) / 2);
+				size_t k = hexDecode(buf + i, n - i, (unsigned char *)o, &used);
+				out_len += k;
+				out_pos += k;
+				i += used;
+				if (i == (size_t)n) {
+					break;
+				}
+			}
+
+			int v = hexValue(buf[i++]);
+			if (v < 0) {
+				continue;
+			}
+			if (nibble < 0) {
+				nibble = v;
+			} else {
+				put_byte(nibble << 4 | v);
+				nibble = -1;
+			}
+		}
+	}
+	xfree(buf);
+	if (n < 0) {
+		perror("xxd");
+		return XXD_ERR_INPUT;
+	}
+	return 0;
+}
+
+/**
+ * Normal hexdump to binary: each line is "offset: hex  text"
+ *
+ * The hex column ends at two blanks in a row or anything that is not a
+ * hex digit or blank, so the text column is never read.
+ *
+ * @return 0 on success, XXD_ERR_* on error
+ */
+static int revert_dump(int in) {
+	FILE *fp = fdopen(dup(in), "r");
+	char *line = NULL;
+	size_t cap = 0;
+	int ret = 0;
+
+	if (fp == NULL) {
+		perror("xxd");
+		return XXD_ERR_INPUT;
+	}
+	while (getline(&line, &cap, fp) > 0) {
+		char *p = line;
+		unsigned long long off = 0;
+		int v;
+
+		while ((v = hexValue(*p)) >= 0) {
+			off = off << 4 | v;
+			p++;
+		}
+		if (*p != ':') {
+			continue;
+		}
+		p++;
+
+		if ((ret = out_moveto_shifted(off)) != 0) {
+			break;
+		}
+
+		int nibble = -1, blanks = 0;
+		for (; *p; p++) {
+			v = hexValue(*p);
+			if (v >= 0) {
+				blanks = 0;
+				if (nibble < 0) {
+					nibble = v;
+				} else {
+					put_byte(nibble << 4 | v);
+					nibble = -1;
+				}
+			} else if ((*p == ' ' || *p == '\t') && ++blanks < 2) {
+				continue;
+			} else {
+				break;
+			}
+		}
+	}
+	if (ferror(fp)) {
+		perror("xxd");
+		ret = XXD_ERR_INPUT;
+	}
+	free(line);
+	fclose(fp);
+	return ret;
+}
+
+/* Parse a number with an optional 0x prefix, return: -1 if malformed */
+static int parse_number(const char *s, long long *value) {
+	char *end;
+
+	errno = 0;
+	*value = strtoll(s, &end, 0);
+	return errno || end == s || *end ? -1 : 0;
+}
+
+M_ENTRY(xxd) {
+	static struct option long_options[] = {
+		{"autoskip",	no_argument,		NULL, 'a'},
+		{"cols",	required_argument,	NULL, 'c'},
+		{"groupsize",	required_argument,	NULL, 'g'},
+		{"len",		required_argument,	NULL, 'l'},
+		{"offset",	required_argument,	NULL, 'o'},
+		{"ps",		no_argument,		NULL, 'p'},
+		{"postscript",	no_argument,		NULL, 'p'},
+		{"plain",	no_argument,		NULL, 'p'},
+		{"revert",	no_argument,		NULL, 'r'},
+		{"seek",	required_argument,	NULL, 's'},
+		{"help",	no_argument,		NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	long long num;
+	int opt;
+
+	// Single-dash long options (-ps, -cols) like the original
+	while ((opt = getopt_long_only(argc, argv, "ac:dg:hl:o:prs:u", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			flag_autoskip = !flag_autoskip;
+			break;
+		case 'c':
+			if (parse_number(optarg, &num) != 0 || num < 0) {
+				fprintf(stderr, "xxd: invalid number of columns: %s\n", optarg);
+				return XXD_ERR_USAGE;
+			}
+			cols = num;
+			break;
+		case 'd':
+			flag_decimal = 1;
+			break;
+		case 'g':
+			if (parse_number(optarg, &num) != 0 || num < 0) {
+				fprintf(stderr, "xxd: invalid group size: %s\n", optarg);
+				return XXD_ERR_USAGE;
+			}
+			group = num;
+			break;
+		case 'l':
+			if (parse_number(optarg, &num) != 0 || num < 0) {
+				fprintf(stderr, "xxd: invalid length: %s\n", optarg);
+				return XXD_ERR_USAGE;
+			}
+			length = num;
+			break;
+		case 'o':
+			if (parse_number(optarg, &num) != 0) {
+				fprintf(stderr, "xxd: invalid offset: %s\n", optarg);
+				return XXD_ERR_USAGE;
+			}
+			disp_off = num;
+			break;
+		case 'p':
+			flag_plain = 1;
+			break;
+		case 'r':
+			flag_reverse = 1;
+			break;
+		case 's':
+			seek_mode = optarg[0] == '+' ? 2 : optarg[0] == '-' ? 3 : 1;
+			if (parse_number(optarg + (seek_mode != 1), &num) != 0 || num < 0) {
+				fprintf(stderr, "xxd: invalid seek offset: %s\n", optarg);
+				return XXD_ERR_USAGE;
+			}
+			seek_off = num;
+			break;
+		case 'u':
+			flag_upper = 1;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			return XXD_ERR_USAGE;
+		}
+	}
+
+	if (cols < 0) {
+		cols = flag_plain ? 30 : 16;
+	}
+	if (!flag_plain && cols == 0) {
+		cols = 16;
+	}
+	if (!flag_plain && cols > XXD_MAX_COLS) {
+		fprintf(stderr, "xxd: invalid number of columns (max. %d).\n", XXD_MAX_COLS);
+		return XXD_ERR_USAGE;
+	}
+	if (group < 0) {
+		group = 2;
+	}
+	if (group == 0 || group > cols) {
+		group = cols;
+	}
+	if (argc - optind > 2) {
+		fprintf(stderr, "xxd: too many arguments\n");
+		return XXD_ERR_USAGE;
+	}
+
+	int in = STDIN_FILENO;
+	if (optind < argc && strcmp(argv[optind], "-") != 0) {
+		in = open(argv[optind], O_RDONLY);
+		if (in < 0) {
+			fprintf(stderr, "xxd: %s: %s\n", argv[optind], strerror(errno));
+			return XXD_ERR_INPUT;
+		}
+	}
+	if (optind + 1 < argc && strcmp(argv[optind + 1], "-") != 0) {
+		// -r patches an existing file instead of replacing it
+		out_fd = open(argv[optind + 1], O_WRONLY | O_CREAT | (flag_reverse ? 0 : O_TRUNC), 0666);
+		if (out_fd < 0) {
+			fprintf(stderr, "xxd: %s: %s\n", argv[optind + 1], strerror(errno));
+			if (in != STDIN_FILENO) {
+				close(in);
+			}
+			return XXD_ERR_OUTPUT;
+		}
+	}
+
+	for (int c = 0; c < 256; c++) {
+		text_map[c] = c >= 0x20 && c < 0x7f ? c : '.';
+	}
+	out_cap = XXD_OUTBUF;
+	out_buf = xmalloc(out_cap);
+
+	int ret;
+	if (flag_reverse) {
+		ret = flag_plain ? revert_plain(in) : revert_dump(in);
+	} else {
+		ret = dump(in);
+	}
+	out_flush();
+	if (out_error) {
+		fprintf(stderr, "xxd: %s\n", strerror(out_error));
+		ret = XXD_ERR_OUTPUT;
+	}
+
+	xfree(out_buf);
+	if (in != STDIN_FILENO) {
+		close(in);
+	}
+	if (out_fd != STDOUT_FILENO) {
+		close(out_fd);
+	}
+	return ret;
+}
+
+REGISTER_MODULE(xxd);
@@ -0,0 +1,356 @@
+/**
+ *	xxhsum.c - Print or check XXH3 / XXH128 checksums
+ *
+ *		2026/10/18
+ *
+ *	Copyright (C) 2025-2026 ASO-Studio
+ *	Based on MIT protocol open source
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include "module.h"
+#include "config.h"
+#include "checksum.h"
+#include "xxhash.h"
+
+/**
+ * @struct xxh_algo_t
+ * @brief One of the hashes selected by -H
+ */
+typedef struct {
+	const char *tag;	// BSD-style tag, as printed by upstream xxhsum
+	size_t digest_len;	// Digest size in bytes
+} xxh_algo_t;
+
+static const xxh_algo_t xxh_xxh3 = { "XXH3", 8 };
+static const xxh_algo_t xxh_xxh128 = { "XXH128", 16 };
+
+// Command-line option flags
+static int flag_binary = 0;	// Binary mode (-b/--binary)
+static int flag_check = 0;	// Check mode (-c/--check)
+static int flag_tag = 0;	// BSD-style output (--tag)
+static int flag_text = 1;	// Text mode (-t/--text, default)
+static int flag_zero = 0;	// NUL-terminated lines (-z/--zero)
+static int flag_ignore_missing = 0;	// Ignore missing files (--ignore-missing)
+static int flag_quiet = 0;	// Quiet mode (--quiet)
+static int flag_status = 0;	// No output, status code only (--status)
+static int flag_strict = 0;	// Strict mode for bad lines (--strict)
+static int flag_warn = 0;	// Warn about bad lines (-w/--warn)
+static int flag_help = 0;	// Show help (--help)
+
+// Selected hash (-H), XXH3 64-bit unless started as xxh128sum
+static const xxh_algo_t *xxh_algo = &xxh_xxh3;
+
+/**
+ * @brief Hash update callback for sumReadFile()
+ * @param ctx Pointer to XXH3_state_t
+ * @param data Next block of the file
+ * @param len Length of the block in bytes
+ */
+static void xxh_feed(void *ctx, const unsigned char *data, size_t len) {
+	XXH3_update(ctx, data, len);
+}
+
+/**
+ * @brief Store a 64-bit value big-endian, the canonical xxHash byte order
+ * @param v Value to store
+ * @param out 8-byte output buffer
+ */
+static void put_be64(uint64_t v, uint8_t *out) {
+	for (int i = 7; i >= 0; i--) {
+		out[i] = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
+/**
+ * @brief Compute the selected XXH3 hash of a file
+ * The state is streamed, so pipes and standard input work like regular files.
+ * @param filename Path to the file (use "-" for standard input)
+ * @param digest Output buffer, 8 bytes (XXH3) or 16 bytes (XXH128)
+ * @param binary_mode If non-zero, open file in binary mode
+ * @return 0 on success, -1 if file cannot be opened, -2 if read error occurs
+ */
+static int file_xxh(const char *filename, uint8_t *digest, int binary_mode) {
+	// Text and binary mode read the same bytes on GNU/Linux
+	(void)binary_mode;
+
+	XXH3_state_t *state = malloc(sizeof(*state));
+	if (state == NULL) {
+		return -2;
+	}
+	XXH3_reset(state);
+
+	int ret = sumReadFile(filename ? filename : "-", xxh_feed, state);
+	if (ret != 0) {
+		free(state);
+		return ret;  // -1: cannot open, -2: read error (errno is set)
+	}
+
+	if (xxh_algo == &xxh_xxh128) {
+		XXH128_hash_t h = XXH3_128bits_digest(state);
+		put_be64(h.high64, digest);
+		put_be64(h.low64, digest + 8);
+	} else {
+		put_be64(XXH3_64bits_digest(state), digest);
+	}
+	free(state);
+	return 0;
+}
+
+/**
+ * @brief Convert a digest to a lowercase hexadecimal string
+ * @param digest Digest bytes
+ * @param len Digest size in bytes
+ * @param str Output buffer (at least 2 * len + 1 bytes)
+ */
+static void digest2str(const uint8_t *digest, size_t len, char *str) {
+	static const char hex_chars[] = "0123456789abcdef";
+	for (size_t i = 0; i < len; i++) {
+		str[2*i] = hex_chars[(digest[i] >> 4) & 0x0F];
+		str[2*i + 1] = hex_chars[digest[i] & 0x0F];
+	}
+	str[2 * len] = '\0';
+}
+
+/**
+ * @brief Print help message
+ * Displays usage information and describes all supported options.
+ */
+static void print_help() {
+	SHOW_VERSION(stdout);
+	printf("Usage: xxhsum [OPTION]... [FILE]...\n");
+	printf("Print or check XXH3 (64-bit) or XXH128 checksums.\n\n");
+	printf("With no FILE, or when FILE is -, read standard input.\n\n");
+	printf("  -H ALGO               hash to use: 3 = XXH3 (default), 2 = XXH128\n");
+	printf("  -b, --binary          read in binary mode\n");
+	printf("  -c, --check           read checksums from the FILEs and check them\n");
+	printf("      --tag             create a BSD-style checksum\n");
+	printf("  -t, --text            read in text mode (default)\n");
+	printf("  -z, --zero            end each output line with NUL, not newline,\n");
+	printf("                          and disable file name escaping\n\n");
+	printf("The following five options are useful only when verifying checksums:\n");
+	printf("      --ignore-missing  don't fail or report status for missing files\n");
+	printf("      --quiet           don't print OK for each successfully verified file\n");
+	printf("      --status          don't output anything, status code shows success\n");
+	printf("      --strict          exit non-zero for improperly formatted checksum lines\n");
+	printf("  -w, --warn            warn about improperly formatted checksum lines\n\n");
+	printf("      --help            display this help and exit\n");
+}
+
+/**
+ * @brief Parse command-line arguments
+ * Uses getopt_long to process options and set corresponding flags.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @return 0 on success, -1 on error (invalid options or conflicts)
+ */
+static int parse_args(int argc, char *argv[]) {
+	static const struct option long_options[] = {
+		{"binary",		no_argument, NULL, 'b'},
+		{"check",		no_argument, NULL, 'c'},
+		{"tag",			no_argument, NULL, 0},
+		{"text",		no_argument, NULL, 't'},
+		{"zero",		no_argument, NULL, 'z'},
+		{"ignore-missing", no_argument, NULL, 0},
+		{"quiet",		no_argument, NULL, 0},
+		{"status",		no_argument, NULL, 0},
+		{"strict",		no_argument, NULL, 0},
+		{"warn",		no_argument, NULL, 'w'},
+		{"help",		no_argument, NULL, 0},
+		{NULL, 0, NULL, 0}  // Terminator
+	};
+
+	int opt;				// Current option
+	int option_index = 0;   // Index for long options
+
+	while ((opt = getopt_long(argc, argv, "H:bctzw", long_options, &option_index)) != -1) {
+		switch (opt) {
+			case 'H':
+				// Same numbering as upstream xxhsum, XXH32 and XXH64 are not provided
+				if (strcmp(optarg, "3") == 0) {
+					xxh_algo = &xxh_xxh3;
+				} else if (strcmp(optarg, "2") == 0 || strcmp(optarg, "128") == 0) {
+					xxh_algo = &xxh_xxh128;
+				} else {
+					fprintf(stderr, "xxhsum: unsupported hash algorithm: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'b':
+				flag_binary = 1;
+				flag_text = 0;
+				break;
+			case 'c':
+				flag_check = 1;
+				break;
+			case 't':
+				flag_text = 1;
+				flag_binary = 0;
+				break;
+			case 'z':
+				flag_zero = 1;
+				break;
+			case 'w':
+				flag_warn = 1;
+				break;
+			case 0:
+				// Handle long options with no short equivalent
+				if (strcmp(long_options[option_index].name, "tag") == 0) {
+					flag_tag = 1;
+				} else if (strcmp(long_options[option_index].name, "ignore-missing") == 0) {
+					flag_ignore_missing = 1;
+				} else if (strcmp(long_options[option_index].name, "quiet") == 0) {
+					flag_quiet = 1;
+				} else if (strcmp(long_options[option_index].name, "status") == 0) {
+					flag_status = 1;
+					flag_quiet = 1;  // --status implies --quiet
+				} else if (strcmp(long_options[option_index].name, "strict") == 0) {
+					flag_strict = 1;
+				} else if (strcmp(long_options[option_index].name, "help") == 0) {
+					flag_help = 1;
+				}
+				break;
+			case '?':
+				return -1;
+			default:
+				abort();
+		}
+	}
+
+	if (flag_binary && flag_text) {
+		fprintf(stderr, "xxhsum: cannot specify both --binary and --text\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Run in check mode (verify checksums)
+ * The hash is the one selected by -H, manifest lines are checked in parallel.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors or checksum mismatches)
+ */
+static int check_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	SumCheckOpts opts = {
+		.prog = "xxhsum",
+		.tag = xxh_algo->tag,
+		.digest_len = xxh_algo->digest_len,
+		.sum = file_xxh,
+		.binary = flag_binary,
+		.ignore_missing = flag_ignore_missing,
+		.quiet = flag_quiet,
+		.status = flag_status,
+		.strict = flag_strict,
+		.warn = flag_warn,
+	};
+
+	if (optind >= argc) {
+		static char stdin_flag[] = "-";  // Avoids string literal to char* warning
+		argv[argc++] = stdin_flag;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		SumCheckResult res;
+		if (sumCheckFile(&opts, argv[i], &res) != 0) {
+			exit_status = 1;
+		}
+		sumCheckReport(&opts, &res);
+	}
+
+	return exit_status;
+}
+
+/**
+ * @brief Print the checksum line of one file
+ * @param digest_str Hex digest
+ * @param name File name as given, "-" for standard input
+ */
+static void print_sum(const char *digest_str, const char *name) {
+	if (flag_tag) {
+		// BSD-style format: "XXH3 (filename) = checksum"
+		printf("%s (%s) = %s", xxh_algo->tag, strcmp(name, "-") == 0 ? "stdin" : name, digest_str);
+	} else {
+		printf("%s %c%s", digest_str, flag_binary ? '*' : ' ', name);
+	}
+	putchar(flag_zero ? '\0' : '\n');
+}
+
+/**
+ * @brief Run in compute mode (generate checksums)
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status (0 for success, non-zero for errors)
+ */
+static int compute_mode(int argc, char *argv[]) {
+	int exit_status = 0;
+	uint8_t digest[16];
+	char digest_str[33];
+
+	// No files specified: read from stdin
+	if (optind >= argc) {
+		if (file_xxh("-", digest, flag_binary) != 0) {
+			fprintf(stderr, "xxhsum: standard input: %s\n", strerror(errno));
+			return 1;
+		}
+		digest2str(digest, xxh_algo->digest_len, digest_str);
+		print_sum(digest_str, "-");
+		return 0;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (file_xxh(argv[i], digest, flag_binary) != 0) {
+			fprintf(stderr, "xxhsum: %s: %s\n", argv[i], strerror(errno));
+			exit_status = 1;
+			continue;
+		}
+		digest2str(digest, xxh_algo->digest_len, digest_str);
+		print_sum(digest_str, argv[i]);
+	}
+
+	return exit_status;
+}
+
+/**
+ * @brief Main function
+ * Parses command-line arguments, handles help requests, and dispatches
+ * to either check mode or compute mode.
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line arguments
+ * @return Exit status
+ */
+M_ENTRY(xxhsum) {
+	if (parse_args(argc, argv) != 0) {
+		return 1;
+	}
+
+	if (flag_help) {
+		print_help();
+		return 0;
+	}
+
+	if (flag_check) {
+		return check_mode(argc, argv);
+	} else {
+		return compute_mode(argc, argv);
+	}
+}
+
+// Same as 'xxhsum -H2'
+M_ENTRY(xxh128sum) {
+	xxh_algo = &xxh_xxh128;
+	return xxhsum_main(argc, argv);
+}
+
+REGISTER_MODULE(xxhsum);
+REGISTER_MODULE(xxh128sum);
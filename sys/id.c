@@ -82,16 +82,6 @@ void print_supplementary_groups(int use_name) {
 	xfree(groups);
 }
 
-// Function to get group IDs for a specific user
-gid_t* get_user_groups(const char *username, int *count) {
-	// This is a simplified implementation
-	// In a real implementation, you would parse /etc/group or use other methods
-	*count = 1;
-	gid_t *groups = xmalloc(sizeof(gid_t));
-	groups[0] = getgid_name(username);
-	return groups;
-}
-
 int id_main(int argc, char *argv[]) {
 	int opt;
 	int show_user = 0;